@@ -0,0 +1,404 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "a2dp.h"
+
+#include <cstring>
+#include <cwchar>
+#include <stdio.h>
+
+const WCHAR *AvdtpActivityToString(AvdtpActivity activity) {
+    switch (activity) {
+    case Abort_Cfm:
+        return L"Abort_Cfm";
+    case Abort_Ind:
+        return L"Abort_Ind";
+    case Close_Cfm:
+        return L"Close_Cfm";
+    case Close_Ind:
+        return L"Close_Ind";
+    case Connect_Cfm:
+        return L"Connect_Cfm";
+    case Connect_Ind:
+        return L"Connect_Ind";
+    case Disconnect_Cfm:
+        return L"Disconnect_Cfm";
+    case Disconnect_Ind:
+        return L"Disconnect_Ind";
+    case Discover_Cfm:
+        return L"Discover_Cfm";
+    case Discover_Ind:
+        return L"Discover_Ind";
+    case GetCapabilities_Cfm:
+        return L"GetCapabilities_Cfm";
+    case GetCapabilities_ind:
+        return L"GetCapabilities_ind";
+    case GetConfiguration_Cfm:
+        return L"GetConfiguration_Cfm";
+    case GetConfiguration_Ind:
+        return L"GetConfiguration_Ind";
+    case SetConfiguration_Cfm:
+        return L"SetConfiguration_Cfm";
+    case SetConfiguration_Ind_1:
+        return L"SetConfiguration_Ind_1";
+    case SetConfiguration_Ind_2:
+        return L"SetConfiguration_Ind_2";
+    case Reconfigure_Ind_1:
+        return L"Reconfigure_Ind_1";
+    case Reconfigure_Ind_2:
+        return L"Reconfigure_Ind_2";
+    case Open_Cfm:
+        return L"Open_Cfm";
+    case Open_Ind:
+        return L"Open_Ind";
+    case Reconfigure_Cfm:
+        return L"Reconfigure_Cfm";
+    case Start_Cfm:
+        return L"Start_Cfm";
+    case Start_Ind:
+        return L"Start_Ind";
+    case Suspend_Cfm:
+        return L"Suspend_Cfm";
+    case Suspend_Ind:
+        return L"Suspend_Ind";
+    case AbortStream:
+        return L"AbortStream";
+    case EnterNewStreamingState:
+        return L"EnterNewStreamingState";
+    case FindNextSepAndGepCaps:
+        return L"FindNextSepAndGepCaps";
+    case RequestOpenMediaChannel:
+        return L"RequestOpenMediaChannel";
+    case RequestStreamClose:
+        return L"RequestStreamClose";
+    case RequestStreamOpen:
+        return L"RequestStreamOpen";
+    case SendReconfigurationRequest:
+        return L"SendReconfigurationRequest";
+    default:
+        return L"Unknown";
+    }
+}
+
+namespace {
+
+// Reads the first element of a property as a little endian value of type
+// T. Bytes that the property does not have are left zero, and bytes that do
+// not fit into T are ignored.
+template <typename T>
+T ReadValue(const BYTE *data, ULONG size, ULONG elementSize) {
+    ULONG length = elementSize != 0 && elementSize < size ? elementSize : size;
+    T value{};
+    if (length >= sizeof(T)) {
+        // The usual case, a copy of a constant size is a single load
+        memcpy(&value, data, sizeof(T));
+    } else {
+        memcpy(&value, data, length);
+    }
+    return value;
+}
+
+// The formatters below run for every property of every traced event, they
+// are written out by hand as swprintf was most of the trace time. They
+// return the number of characters written, or 0 if the buffer is too small.
+
+template <typename Char>
+int WriteDecimal(ULONGLONG value, Char *buffer, size_t count) {
+    Char digits[20];
+    int length = 0;
+    do {
+        digits[length++] = (Char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    if ((size_t)length >= count) {
+        return 0;
+    }
+    for (int i = 0; i < length; i++) {
+        buffer[i] = digits[length - 1 - i];
+    }
+    buffer[length] = 0;
+    return length;
+}
+
+// Upper case hex with at least minDigits digits, after prefix
+template <typename Char>
+int WriteHex(ULONGLONG value, int minDigits, const char *prefix, Char *buffer,
+             size_t count) {
+    int digits = 1;
+    while (digits < 16 && value >> (digits * 4) != 0) {
+        digits++;
+    }
+    if (digits < minDigits) {
+        digits = minDigits;
+    }
+    const size_t prefixLength = strlen(prefix);
+    const size_t length = prefixLength + digits;
+    if (length >= count) {
+        return 0;
+    }
+    for (size_t i = 0; i < prefixLength; i++) {
+        buffer[i] = (Char)prefix[i];
+    }
+    for (int i = digits - 1; i >= 0; i--) {
+        buffer[prefixLength + i] = (Char)"0123456789ABCDEF"[value & 0xF];
+        value >>= 4;
+    }
+    buffer[length] = 0;
+    return (int)length;
+}
+
+// Activity names are ASCII, so narrowing them is a plain copy
+template <typename Char>
+int WriteText(const WCHAR *text, Char *buffer, size_t count) {
+    size_t length = wcslen(text);
+    if (length >= count) {
+        return 0;
+    }
+    for (size_t i = 0; i <= length; i++) {
+        buffer[i] = (Char)text[i];
+    }
+    return (int)length;
+}
+
+// Formats an integer value of a field
+template <typename T, typename Char>
+int FormatValue(T value, FieldFormat format, Char *buffer, size_t count) {
+    switch (format) {
+    case FieldFormat::Number:
+        return WriteDecimal((ULONGLONG)value, buffer, count);
+    case FieldFormat::Hex:
+        return WriteHex((ULONGLONG)value, 1, "0x", buffer, count);
+    case FieldFormat::Activity:
+        return WriteText(AvdtpActivityToString((AvdtpActivity)value), buffer,
+                         count);
+    case FieldFormat::Address:
+        // Only the lower 48 bits are the address
+        return WriteHex((ULONGLONG)value & 0xFFFFFFFFFFFFULL, 12, "", buffer,
+                        count);
+    default:
+        return 0;
+    }
+}
+
+// GUIDs are shown as raw bytes only
+template <typename Char>
+int FormatValue(const GUID &, FieldFormat, Char *, size_t) {
+    return 0;
+}
+
+// Widens an integer value of a field for filters
+template <typename T>
+bool IntegerValue(T value, FieldFormat format, ULONGLONG &out) {
+    out = (ULONGLONG)value;
+    if (format == FieldFormat::Address) {
+        out &= 0xFFFFFFFFFFFFULL;
+    }
+    return true;
+}
+
+// GUIDs have no integer value
+bool IntegerValue(const GUID &, FieldFormat, ULONGLONG &) {
+    return false;
+}
+
+template <typename Char>
+int FormatField(const A2dpEventData &eventData, A2dpField field, Char *buffer,
+                size_t count) {
+    switch (field) {
+#define X(member, name, type, format)                                          \
+    case A2dpField::member:                                                    \
+        if (!eventData.member) {                                               \
+            return 0;                                                          \
+        }                                                                      \
+        return FormatValue(*eventData.member, FieldFormat::format, buffer,     \
+                           count);
+        A2DP_EVENT_FIELDS(X)
+#undef X
+    default:
+        return 0;
+    }
+}
+
+} // namespace
+
+A2dpField FindEventField(const WCHAR *name) {
+    ULONG slot =
+        FieldNameHash(name, FIELD_HASH.Seed) & (FIELD_HASH_SLOTS - 1);
+    int index = FIELD_HASH.Slots[slot];
+    if (index < 0 || wcscmp(A2DP_FIELDS[index].Name, name) != 0) {
+        return A2dpField::Count;
+    }
+    return (A2dpField)index;
+}
+
+A2dpField FindEventField(const char *name, size_t length) {
+    ULONG slot = NarrowFieldNameHash(name, length, NARROW_FIELD_HASH.Seed) &
+                 (FIELD_HASH_SLOTS - 1);
+    int index = NARROW_FIELD_HASH.Slots[slot];
+    if (index < 0 || NARROW_FIELD_NAMES[index].Length != length) {
+        return A2dpField::Count;
+    }
+    // A word at a time like the hash, the last word overlaps the one
+    // before it. The call to memcmp cost more than the comparison.
+    const char *known = NARROW_FIELD_NAMES[index].Text;
+    if (length < 8) {
+        return memcmp(known, name, length) == 0 ? (A2dpField)index
+                                                : A2dpField::Count;
+    }
+    for (size_t i = 0; i + 8 < length; i += 8) {
+        if (NameWord(known + i) != NameWord(name + i)) {
+            return A2dpField::Count;
+        }
+    }
+    if (NameWord(known + length - 8) != NameWord(name + length - 8)) {
+        return A2dpField::Count;
+    }
+    return (A2dpField)index;
+}
+
+void SetEventField(A2dpEventData &eventData, A2dpField field,
+                   const BYTE *data, ULONG size, ULONG elementSize) {
+    switch (field) {
+#define X(member, name, type, format)                                          \
+    case A2dpField::member:                                                    \
+        eventData.member = ReadValue<type>(data, size, elementSize);           \
+        break;
+        A2DP_EVENT_FIELDS(X)
+#undef X
+    default:
+        break;
+    }
+}
+
+void SetEventField(A2dpEventData &eventData, const WCHAR *name,
+                   const BYTE *data, ULONG size, ULONG elementSize) {
+    SetEventField(eventData, FindEventField(name), data, size, elementSize);
+}
+
+bool ReadFieldValue(A2dpField field, const BYTE *data, ULONG size,
+                    ULONG elementSize, ULONGLONG &value) {
+    switch (field) {
+#define X(member, name, type, format)                                          \
+    case A2dpField::member:                                                    \
+        return IntegerValue(ReadValue<type>(data, size, elementSize),          \
+                            FieldFormat::format, value);
+        A2DP_EVENT_FIELDS(X)
+#undef X
+    default:
+        return false;
+    }
+}
+
+bool GetEventField(const A2dpEventData &eventData, A2dpField field,
+                   ULONGLONG &value) {
+    switch (field) {
+#define X(member, name, type, format)                                          \
+    case A2dpField::member:                                                    \
+        return eventData.member &&                                             \
+               IntegerValue(*eventData.member, FieldFormat::format, value);
+        A2DP_EVENT_FIELDS(X)
+#undef X
+    default:
+        return false;
+    }
+}
+
+int FormatEventField(const A2dpEventData &eventData, A2dpField field,
+                     WCHAR *buffer, size_t count) {
+    return FormatField(eventData, field, buffer, count);
+}
+
+int FormatEventField(const A2dpEventData &eventData, A2dpField field,
+                     char *buffer, size_t count) {
+    return FormatField(eventData, field, buffer, count);
+}
+
+const CodecData *FindCodec(const A2dpEventData &eventData) {
+    // Find codec if codec data was specified
+    if (!eventData.a2dpStandardCodecId) {
+        return nullptr;
+    }
+    // Vendor specific codecs can not be told apart without the vendor ids
+    if (*eventData.a2dpStandardCodecId == A2DP_VENDOR_CODEC_ID &&
+        (!eventData.a2dpVendorId || !eventData.a2dpVendorCodecId)) {
+        return nullptr;
+    }
+    return codecRegistry.Find(*eventData.a2dpStandardCodecId,
+                              eventData.a2dpVendorId.value_or(0),
+                              eventData.a2dpVendorCodecId.value_or(0));
+}
+
+// Returns pointer to codec name or nullptr if codec was not found
+const WCHAR *GetCodecName(const A2dpEventData &eventData) {
+    const CodecData *codec = FindCodec(eventData);
+    return codec != nullptr ? codec->Name : nullptr;
+}
+
+A2dpFinding AnalyzeEventData(const A2dpEventData &eventData) {
+    A2dpFinding finding;
+
+    // Here is absolute guess based on the events I saw
+    // 1. If AcceptorStreamEndPointID is defined but
+    // InitiatorStreamEndPointID and codec data is defined, seems like that
+    // is receiver transmits its list of supported codecs
+    if (eventData.AcceptorStreamEndPointID &&
+        !eventData.InitiatorStreamEndPointID && eventData.a2dpStandardCodecId) {
+        finding.Kind = A2dpFindingKind::SupportedCodec;
+    }
+
+    // 2. If AcceptorStreamEndPointID and InitiatorStreamEndPointID are
+    // defined and if AvdtpActivity is defined and equal to 0x12, seems like
+    // that means that codec was selected
+    if (eventData.AcceptorStreamEndPointID &&
+        eventData.InitiatorStreamEndPointID && eventData.AvdtpActivity &&
+        (eventData.AvdtpActivity == AvdtpActivity::SetConfiguration_Cfm ||
+         eventData.AvdtpActivity == AvdtpActivity::SetConfiguration_Ind_2)) {
+        finding.Kind = A2dpFindingKind::SelectedCodec;
+        finding.Selected = true;
+    }
+
+    if (finding.Kind != A2dpFindingKind::None) {
+        finding.Codec = FindCodec(eventData);
+        finding.CodecName = finding.Codec ? finding.Codec->Name : nullptr;
+        if (finding.CodecName == nullptr) {
+            finding.Kind = A2dpFindingKind::UnknownCodec;
+        }
+    }
+    return finding;
+}
+
+bool ProcessEventData(const A2dpEventData &eventData) {
+    const A2dpFinding finding = AnalyzeEventData(eventData);
+    switch (finding.Kind) {
+    case A2dpFindingKind::SupportedCodec:
+        wprintf(L"> Received supported codec: %ls\n", finding.CodecName);
+        return true;
+    case A2dpFindingKind::SelectedCodec:
+        wprintf(L"# Selected codec: %ls\n", finding.CodecName);
+        return true;
+    case A2dpFindingKind::UnknownCodec:
+        wprintf(L"ERROR: Unknown codec\n");
+        return false;
+    default:
+        return true;
+    }
+}
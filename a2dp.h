@@ -0,0 +1,155 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "a2dp_fields.h"
+#include "codec_registry.h"
+#include "platform.h"
+
+#include <optional>
+
+// Data model of the BthA2dp events and the analysis of it. Nothing here
+// depends on ETW, so it is shared by every way of feeding events in.
+
+// Values of the known properties of an event, one member per line of
+// A2DP_EVENT_FIELDS. Properties the event did not have stay empty.
+struct A2dpEventData {
+#define X(member, name, type, format) std::optional<type> member;
+    A2DP_EVENT_FIELDS(X)
+#undef X
+};
+
+// These vaklues were reversed from btha2dp.sys on Windows 11 build 26100
+// and I am not sure if this going to stay the same in new builds.
+// I explained the process in the events.md file
+enum AvdtpActivity {
+    Abort_Cfm = 0x2e,
+    Abort_Ind = 0x2f,
+    Close_Cfm = 0x26,
+    Close_Ind = 0x27,
+    Connect_Cfm = 0x2,
+    Connect_Ind = 0x3,
+    Disconnect_Cfm = 0x6,
+    Disconnect_Ind = 0x7,
+    Discover_Cfm = 10,
+    Discover_Ind = 0xb,
+    GetCapabilities_Cfm = 0xe,
+    GetCapabilities_ind = 0xf,
+    GetConfiguration_Cfm = 0x16,
+    GetConfiguration_Ind = 0x17,
+    SetConfiguration_Cfm = 0x12,
+    SetConfiguration_Ind_1 = 0x13, // in the same func it goes 0x13 and then
+                                   // 0x14
+    SetConfiguration_Ind_2 = 0x14,
+
+    Open_Cfm = 0x1e,
+    Open_Ind = 0x1f,
+    Reconfigure_Cfm = 0x1a,
+    Reconfigure_Ind_1 = 0x1c, // Same as above, it goes 0x1c and then 0x1b
+    Reconfigure_Ind_2 = 0x1b,
+    Start_Cfm = 0x22,
+    Start_Ind = 0x24,
+    Suspend_Cfm = 0x2a,
+    Suspend_Ind = 0x2c,
+
+    AbortStream = 0x2d,
+    EnterNewStreamingState = 0x29,
+    FindNextSepAndGepCaps = 0xd,
+    RequestOpenMediaChannel = 0x1d,
+    RequestStreamClose = 0x25,
+    RequestStreamOpen = 9,
+
+    SendReconfigurationRequest = 0x19,
+};
+
+// Returns the name of the activity or "Unknown"
+const WCHAR *AvdtpActivityToString(AvdtpActivity activity);
+
+// Stores the value of the property to the given field of eventData.
+// elementSize is the size of one element if the property is an array.
+void SetEventField(A2dpEventData &eventData, A2dpField field,
+                   const BYTE *data, ULONG size, ULONG elementSize);
+
+// Same as above, with the field found by property name. Properties that are
+// not of interest are ignored.
+void SetEventField(A2dpEventData &eventData, const WCHAR *name,
+                   const BYTE *data, ULONG size, ULONG elementSize);
+
+// Reads the property the way SetEventField stores it, as an integer for
+// filters. Address fields keep only their 48 address bits. Returns false for
+// fields that are not integers (GUIDs).
+bool ReadFieldValue(A2dpField field, const BYTE *data, ULONG size,
+                    ULONG elementSize, ULONGLONG &value);
+
+// Same as above, from a decoded event. Returns false if the field is not set
+// or is not an integer.
+bool GetEventField(const A2dpEventData &eventData, A2dpField field,
+                   ULONGLONG &value);
+
+// Writes the value of the field, formatted as its FieldFormat says, to
+// buffer. Returns the number of characters written, 0 if the field is not
+// set or has nothing to show.
+int FormatEventField(const A2dpEventData &eventData, A2dpField field,
+                     WCHAR *buffer, size_t count);
+int FormatEventField(const A2dpEventData &eventData, A2dpField field,
+                     char *buffer, size_t count);
+
+// Returns the codec the event talks about or nullptr if the event has no
+// codec data or the codec is not known
+const CodecData *FindCodec(const A2dpEventData &eventData);
+
+// Returns pointer to codec name or nullptr if codec was not found
+const WCHAR *GetCodecName(const A2dpEventData &eventData);
+
+// What the analysis makes of one event
+enum class A2dpFindingKind {
+    None,
+    SupportedCodec, // the headset lists a codec it supports
+    SelectedCodec,  // a codec was selected for the stream
+    UnknownCodec,   // one of the above, with a codec nobody knows
+};
+
+struct A2dpFinding {
+    A2dpFindingKind Kind = A2dpFindingKind::None;
+    const WCHAR *CodecName = nullptr; // set for the known codecs
+    const CodecData *Codec = nullptr; // the same codec
+    // SelectedCodec, or an UnknownCodec that was selected and not announced
+    bool Selected = false;
+};
+
+// Looks for codec announcements and selections in the event
+A2dpFinding AnalyzeEventData(const A2dpEventData &eventData);
+
+// The fields AnalyzeEventData looks at. Events only decoded for the analysis
+// can skip the others.
+const A2dpFieldMask A2DP_ANALYSIS_FIELDS =
+    FieldBit(A2dpField::AcceptorStreamEndPointID) |
+    FieldBit(A2dpField::InitiatorStreamEndPointID) |
+    FieldBit(A2dpField::a2dpStandardCodecId) |
+    FieldBit(A2dpField::a2dpVendorId) |
+    FieldBit(A2dpField::a2dpVendorCodecId) |
+    FieldBit(A2dpField::AvdtpActivity);
+
+// Prints what AnalyzeEventData found. Returns true if all OK or false if
+// error happened during processing.
+bool ProcessEventData(const A2dpEventData &eventData);
@@ -0,0 +1,233 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "platform.h"
+
+#include <cstddef>
+
+// Every BthA2dp event property the tool knows about (see events.txt). The
+// members of A2dpEventData, their decoders, the trace printers and the
+// lookup by property name are all generated from this list, so adding a
+// property is a matter of adding a line here.
+//
+// X(member of A2dpEventData, property name, type, how to show it)
+//
+// For array properties (like SampleRate [12]) the first element is kept.
+#define A2DP_EVENT_FIELDS(X)                                                   \
+    X(PartA_PrivTags, L"PartA_PrivTags", ULONGLONG, Hex)                       \
+    X(a2dpStandardCodecId, L"A2dpStandardCodecId", BYTE, Hex)                  \
+    X(a2dpVendorId, L"A2dpVendorId", DWORD, Hex)                               \
+    X(a2dpVendorCodecId, L"A2dpVendorCodecId", WORD, Hex)                      \
+    X(AvdtpActivity, L"AvdtpActivity", DWORD, Activity)                        \
+    X(ResultCode, L"ResultCode", WORD, Number)                                 \
+    X(SampleRate, L"Sample Rate", DWORD, Number)                               \
+    X(ChannelCount, L"ChannelCount", DWORD, Number)                            \
+    X(AcceptorStreamEndPointID, L"AcceptorStreamEndPointID", BYTE, Number)     \
+    X(InitiatorStreamEndPointID, L"InitiatorStreamEndPointID", BYTE, Number)   \
+    X(BTDeviceAddress, L"BTDeviceAddress", ULONGLONG, Address)                 \
+    X(BTDeviceAddressRemote, L"BTDeviceAddressRemote", ULONGLONG, Address)     \
+    X(L2capChannelHandleSessionId, L"L2capChannelHandleSessionId", ULONGLONG,  \
+      Hex)                                                                     \
+    X(AudioSessionId, L"AudioSessionId", GUID, Bytes)                          \
+    X(TransitionFromState, L"TransitionFromState", BYTE, Number)               \
+    X(TransitionToState, L"TransitionToState", BYTE, Number)                   \
+    X(TransitionDurationMs, L"TransitionDurationMs", ULONGLONG, Number)        \
+    X(DurationInMilliseconds, L"DurationInMilliseconds", ULONGLONG, Number)    \
+    X(StatusErrorCode, L"StatusErrorCode", DWORD, Hex)                         \
+    X(A2dpRemoteDelayReportDurationInMs, L"A2dpRemoteDelayReportDurationInMs", \
+      WORD, Number)                                                            \
+    X(A2dpIsConnected, L"A2dpIsConnected", DWORD, Number)                      \
+    X(A2dpIsSepOpen, L"A2dpIsSepOpen", DWORD, Number)                          \
+    X(A2dpIsAvrcpRegistered, L"A2dpIsAvrcpRegistered", DWORD, Number)          \
+    X(A2dpIsSink, L"A2dpIsSink", DWORD, Number)                                \
+    X(A2dpIsStreaming, L"A2dpIsStreaming", DWORD, Number)                      \
+    X(A2dpSupportsAbsoluteVolume, L"A2dpSupportsAbsoluteVolume", DWORD,        \
+      Number)                                                                  \
+    X(IsKsPinCreated, L"IsKsPinCreated", DWORD, Number)                        \
+    X(FormatTag, L"FormatTag", WORD, Hex)                                      \
+    X(PinSampleRate, L"SampleRate", DWORD, Number)                             \
+    X(BitDepth, L"BitDepth", WORD, Number)                                     \
+    X(ChannelMask, L"ChannelMask", DWORD, Hex)
+
+// How a field is shown next to its raw bytes in traces
+enum class FieldFormat {
+    Number,   // decimal
+    Hex,      // 0x prefixed hex
+    Activity, // name of the AvdtpActivity
+    Address,  // Bluetooth address, the way Windows shows it: 7C96D2F479F4
+    Bytes,    // nothing, the raw bytes say it all
+};
+
+// Index of every known field
+enum class A2dpField : int {
+#define X(member, name, type, format) member,
+    A2DP_EVENT_FIELDS(X)
+#undef X
+    Count // also returned for properties that are not known
+};
+
+const int A2DP_FIELD_COUNT = (int)A2dpField::Count;
+
+// A set of fields, bit n for field n
+typedef ULONGLONG A2dpFieldMask;
+
+static_assert(A2DP_FIELD_COUNT <= 64, "A2dpFieldMask is 64 bits");
+
+constexpr A2dpFieldMask FieldBit(A2dpField field) {
+    return 1ULL << (int)field;
+}
+
+const A2dpFieldMask A2DP_ALL_FIELDS =
+    A2DP_FIELD_COUNT == 64 ? ~0ULL : (1ULL << A2DP_FIELD_COUNT) - 1;
+
+struct A2dpFieldInfo {
+    const WCHAR *Name;
+    FieldFormat Format;
+    ULONG Size; // of the value A2dpEventData keeps
+};
+
+inline constexpr A2dpFieldInfo A2DP_FIELDS[] = {
+#define X(member, name, type, format)                                          \
+    {name, FieldFormat::format, (ULONG)sizeof(type)},
+    A2DP_EVENT_FIELDS(X)
+#undef X
+};
+
+// Perfect hash of the property names, found at compile time. FNV-1a with a
+// seed is tried with increasing seeds until every name lands in its own
+// slot, so a lookup is one hash and one string compare.
+
+constexpr ULONG FieldNameHash(const WCHAR *name, ULONG seed) {
+    ULONG hash = 2166136261u ^ seed;
+    for (; *name != 0; name++) {
+        hash ^= (ULONG)*name;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Power of two. With about four slots per field a working seed is found
+// after a few dozen tries, a denser table makes the search explode.
+const ULONG FIELD_HASH_SLOTS = 128;
+static_assert(FIELD_HASH_SLOTS >= 4 * A2DP_FIELD_COUNT,
+              "grow FIELD_HASH_SLOTS, the table is too dense");
+
+struct FieldHashTable {
+    ULONG Seed = 0;
+    signed char Slots[FIELD_HASH_SLOTS] = {}; // field index or -1
+};
+
+// Tries seeds until slotOf(field index, seed) puts every field in its own
+// slot
+template <typename SlotFn>
+constexpr FieldHashTable BuildFieldHashTable(SlotFn slotOf) {
+    for (ULONG seed = 0; seed < 100000; seed++) {
+        FieldHashTable table;
+        table.Seed = seed;
+        for (auto &slot : table.Slots) {
+            slot = -1;
+        }
+        bool collision = false;
+        for (int i = 0; i < A2DP_FIELD_COUNT && !collision; i++) {
+            ULONG slot = slotOf(i, seed) & (FIELD_HASH_SLOTS - 1);
+            if (table.Slots[slot] != -1) {
+                collision = true;
+            } else {
+                table.Slots[slot] = (signed char)i;
+            }
+        }
+        if (!collision) {
+            return table;
+        }
+    }
+    // Not reachable with a sane number of fields. Failing here makes the
+    // compiler reject the tables below.
+    throw "no perfect hash seed found";
+}
+
+inline constexpr FieldHashTable FIELD_HASH =
+    BuildFieldHashTable([](int field, ULONG seed) {
+        return FieldNameHash(A2DP_FIELDS[field].Name, seed);
+    });
+
+// Names read from text logs are narrow and not null terminated. Importing
+// logs at GB/s leaves no time to hash them a character at a time, so they
+// have their own perfect hash over the first and the last eight characters
+// read as two words.
+
+struct NarrowFieldName {
+    char Text[64];
+    size_t Length;
+};
+
+constexpr NarrowFieldName NarrowName(const WCHAR *name) {
+    NarrowFieldName narrow = {};
+    for (; name[narrow.Length] != 0; narrow.Length++) {
+        narrow.Text[narrow.Length] = (char)name[narrow.Length];
+    }
+    return narrow;
+}
+
+inline constexpr NarrowFieldName NARROW_FIELD_NAMES[] = {
+#define X(member, name, type, format) NarrowName(name),
+    A2DP_EVENT_FIELDS(X)
+#undef X
+};
+
+// Eight characters as a little endian word. Compilers turn this into a
+// single load.
+constexpr ULONGLONG NameWord(const char *text) {
+    return (ULONGLONG)(unsigned char)text[0] |
+           (ULONGLONG)(unsigned char)text[1] << 8 |
+           (ULONGLONG)(unsigned char)text[2] << 16 |
+           (ULONGLONG)(unsigned char)text[3] << 24 |
+           (ULONGLONG)(unsigned char)text[4] << 32 |
+           (ULONGLONG)(unsigned char)text[5] << 40 |
+           (ULONGLONG)(unsigned char)text[6] << 48 |
+           (ULONGLONG)(unsigned char)text[7] << 56;
+}
+
+// Only the length tells apart names shorter than eight characters, none
+// of the known ones is, so they do not need a better hash
+constexpr ULONG NarrowFieldNameHash(const char *name, size_t length,
+                                    ULONG seed) {
+    if (length < 8) {
+        return (ULONG)length;
+    }
+    ULONGLONG hash = (NameWord(name) ^ seed) * 0x9E3779B97F4A7C15ull;
+    hash ^= (NameWord(name + length - 8) + length) * 0xC2B2AE3D27D4EB4Full;
+    return (ULONG)(hash >> 40);
+}
+
+inline constexpr FieldHashTable NARROW_FIELD_HASH =
+    BuildFieldHashTable([](int field, ULONG seed) {
+        return NarrowFieldNameHash(NARROW_FIELD_NAMES[field].Text,
+                                   NARROW_FIELD_NAMES[field].Length, seed);
+    });
+
+// Returns the field with the given property name or A2dpField::Count
+A2dpField FindEventField(const WCHAR *name);
+
+// Same as above, for a name of length narrow characters
+A2dpField FindEventField(const char *name, size_t length);
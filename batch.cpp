@@ -0,0 +1,265 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "batch.h"
+
+#include "a2dp.h"
+#include "capture_file.h"
+#include "event_decoder.h"
+#include "providers.h"
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <memory>
+#include <thread>
+
+namespace {
+
+// A file being analyzed. The first task of a file opens it and queues its
+// other blocks, the last block done closes it.
+struct BatchFile {
+    std::string Path;
+    std::unique_ptr<CaptureReader> Reader;
+    std::atomic<size_t> BlocksLeft{0};
+};
+
+struct BatchTask {
+    size_t File = 0;
+    size_t Block = 0;
+    bool Open = false; // open the file, then analyze its first block
+};
+
+void AnalyzeBlock(const CaptureReader &reader, size_t block,
+                  const EventFilter &filter, BatchStats &stats) {
+    CaptureBlockReader records = reader.Block(block);
+    EVENT_RECORD event;
+    const EventSchema *schema = nullptr;
+    const A2dpFieldMask fields = A2DP_ANALYSIS_FIELDS | filter.Fields();
+    while (records.Next(event, schema)) {
+        stats.Events++;
+        const Provider *provider =
+            providers.Find(event.EventHeader.ProviderId);
+        if (provider == nullptr || provider->Kind != ProviderKind::A2dp) {
+            continue;
+        }
+        stats.A2dpEvents++;
+        if (!filter.Empty() &&
+            !filter.Matches(event, *schema, MeasureStringProperty)) {
+            stats.FilteredOut++;
+            continue;
+        }
+
+        A2dpEventData eventData;
+        if (!DecodeEventData(event, *schema, MeasureStringProperty, eventData,
+                             fields)) {
+            stats.UndecodedEvents++;
+            continue;
+        }
+        const A2dpFinding finding = AnalyzeEventData(eventData);
+        if (finding.Kind == A2dpFindingKind::None) {
+            continue;
+        }
+        const ULONGLONG key =
+            PackCodecKey(eventData.a2dpStandardCodecId.value_or(0),
+                         eventData.a2dpVendorId.value_or(0),
+                         eventData.a2dpVendorCodecId.value_or(0));
+        switch (finding.Kind) {
+        case A2dpFindingKind::SupportedCodec:
+            stats.Codecs[key].Announced++;
+            break;
+        case A2dpFindingKind::SelectedCodec:
+            stats.Codecs[key].Selected++;
+            break;
+        default:
+            stats.UnknownCodecs[key]++;
+            break;
+        }
+    }
+    stats.Blocks++;
+    if (records.Corrupt()) {
+        stats.CorruptBlocks++;
+    }
+}
+
+// Sorted keys of a map, for output that does not depend on hashing
+template <typename Map> std::vector<ULONGLONG> SortedKeys(const Map &map) {
+    std::vector<ULONGLONG> keys;
+    keys.reserve(map.size());
+    for (const auto &entry : map) {
+        keys.push_back(entry.first);
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+} // namespace
+
+void BatchStats::Merge(const BatchStats &other) {
+    Files += other.Files;
+    UnreadableFiles += other.UnreadableFiles;
+    TruncatedFiles += other.TruncatedFiles;
+    Blocks += other.Blocks;
+    CorruptBlocks += other.CorruptBlocks;
+    Events += other.Events;
+    A2dpEvents += other.A2dpEvents;
+    UndecodedEvents += other.UndecodedEvents;
+    FilteredOut += other.FilteredOut;
+    for (const auto &entry : other.Codecs) {
+        BatchCodecCounts &counts = Codecs[entry.first];
+        counts.Announced += entry.second.Announced;
+        counts.Selected += entry.second.Selected;
+    }
+    for (const auto &entry : other.UnknownCodecs) {
+        UnknownCodecs[entry.first] += entry.second;
+    }
+}
+
+BatchStats RunBatch(const std::vector<std::string> &paths, size_t workers,
+                    const EventFilter &filter) {
+    if (workers == 0) {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::vector<BatchFile> files(paths.size());
+    WorkStealingPool<BatchTask> pool(workers);
+    // Consecutive files go to the same worker, its neighbours steal them
+    // from the other end once they are done with theirs
+    for (size_t i = 0; i < files.size(); i++) {
+        files[i].Path = paths[i];
+        BatchTask task;
+        task.File = i;
+        task.Open = true;
+        pool.Push(i * pool.Workers() / files.size(), task);
+    }
+
+    std::vector<BatchStats> stats(pool.Workers());
+    pool.Run([&](size_t worker, const BatchTask &task) {
+        BatchFile &file = files[task.File];
+        BatchStats &counts = stats[worker];
+        if (task.Open) {
+            counts.Files++;
+            auto reader = std::make_unique<CaptureReader>();
+            if (!reader->Open(file.Path.c_str())) {
+                counts.UnreadableFiles++;
+                return;
+            }
+            if (reader->Truncated()) {
+                counts.TruncatedFiles++;
+            }
+            const size_t blocks = reader->BlockCount();
+            if (blocks == 0) {
+                return;
+            }
+            file.Reader = std::move(reader);
+            file.BlocksLeft.store(blocks, std::memory_order_relaxed);
+            // The other blocks are left for thieves, the first one is
+            // analyzed right away
+            for (size_t block = blocks - 1; block > 0; block--) {
+                BatchTask blockTask;
+                blockTask.File = task.File;
+                blockTask.Block = block;
+                pool.Push(worker, blockTask);
+            }
+        }
+        AnalyzeBlock(*file.Reader, task.Block, filter, counts);
+        if (file.BlocksLeft.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            file.Reader.reset(); // unmaps the file
+        }
+    });
+
+    BatchStats total;
+    for (const BatchStats &counts : stats) {
+        total.Merge(counts);
+    }
+    return total;
+}
+
+bool ReadBatchList(const char *path, std::vector<std::string> &paths) {
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        size_t length = strlen(line);
+        while (length > 0 && (line[length - 1] == '\n' ||
+                              line[length - 1] == '\r' ||
+                              line[length - 1] == ' ')) {
+            length--;
+        }
+        if (length == 0 || line[0] == '#') {
+            continue;
+        }
+        paths.emplace_back(line, length);
+    }
+    const bool ok = !ferror(file);
+    if (file != stdin) {
+        fclose(file);
+    }
+    return ok;
+}
+
+void PrintBatchStats(const BatchStats &stats) {
+    wprintf(L"Files: %llu, %llu unreadable, %llu truncated\n",
+            (unsigned long long)stats.Files,
+            (unsigned long long)stats.UnreadableFiles,
+            (unsigned long long)stats.TruncatedFiles);
+    wprintf(L"Blocks: %llu, %llu corrupt\n", (unsigned long long)stats.Blocks,
+            (unsigned long long)stats.CorruptBlocks);
+    wprintf(L"Events: %llu, %llu BthA2dp, %llu not matching their schema\n",
+            (unsigned long long)stats.Events,
+            (unsigned long long)stats.A2dpEvents,
+            (unsigned long long)stats.UndecodedEvents);
+    if (stats.FilteredOut > 0) {
+        wprintf(L"Filtered out: %llu events\n",
+                (unsigned long long)stats.FilteredOut);
+    }
+
+    if (!stats.Codecs.empty()) {
+        wprintf(L"\n  codec                                   announced   "
+                L"selected\n");
+        for (ULONGLONG key : SortedKeys(stats.Codecs)) {
+            const BatchCodecCounts &counts = stats.Codecs.at(key);
+            const CodecData *codec = codecRegistry.Find(key);
+            wprintf(L"  %-38ls %10llu %10llu\n",
+                    codec != nullptr ? codec->Name : L"?",
+                    (unsigned long long)counts.Announced,
+                    (unsigned long long)counts.Selected);
+        }
+    }
+    if (!stats.UnknownCodecs.empty()) {
+        wprintf(L"\nUnknown codecs:\n");
+        for (ULONGLONG key : SortedKeys(stats.UnknownCodecs)) {
+            wprintf(L"  standard 0x%02X, vendor 0x%08lX, vendor codec "
+                    L"0x%04X: %llu events\n",
+                    (unsigned)(key >> 48),
+                    (unsigned long)((key >> 16) & 0xFFFFFFFF),
+                    (unsigned)(key & 0xFFFF),
+                    (unsigned long long)stats.UnknownCodecs.at(key));
+        }
+    }
+}
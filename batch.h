@@ -0,0 +1,77 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "filter.h"
+#include "platform.h"
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Offline analysis of many capture files at once, for example the captures
+// of a whole fleet. Files, and the blocks of large files, are spread over
+// the cores with a WorkStealingPool. Every event goes through the same
+// decoding and AnalyzeEventData as a replay, but instead of printing the
+// findings each worker counts them, and the counts of all workers are
+// added up at the end. Sums do not depend on which worker saw what, so
+// the result is the same whatever the number of workers.
+
+struct BatchCodecCounts {
+    ULONGLONG Announced = 0; // SupportedCodec findings
+    ULONGLONG Selected = 0;  // SelectedCodec findings
+};
+
+struct BatchStats {
+    ULONGLONG Files = 0;
+    ULONGLONG UnreadableFiles = 0; // missing or not capture files
+    ULONGLONG TruncatedFiles = 0;
+    ULONGLONG Blocks = 0;
+    ULONGLONG CorruptBlocks = 0;
+    ULONGLONG Events = 0;
+    ULONGLONG A2dpEvents = 0;
+    ULONGLONG UndecodedEvents = 0; // data did not match the schema
+    ULONGLONG FilteredOut = 0;
+    // Known codecs and the id tuples of unknown ones (the "ERROR: Unknown
+    // codec" of a replay), both by PackCodecKey
+    std::unordered_map<ULONGLONG, BatchCodecCounts> Codecs;
+    std::unordered_map<ULONGLONG, ULONGLONG> UnknownCodecs;
+
+    void Merge(const BatchStats &other);
+};
+
+// Analyzes the capture files on that many threads (0 for one per core). Only
+// the events that match filter are counted, an empty filter lets all of
+// them through. Returns the merged counts.
+BatchStats RunBatch(const std::vector<std::string> &paths, size_t workers,
+                    const EventFilter &filter);
+
+// Reads the paths listed in a file, one per line ("-" reads standard
+// input). Empty lines and # comments are skipped. Returns false if the
+// file can not be read.
+bool ReadBatchList(const char *path, std::vector<std::string> &paths);
+
+// Prints the counts, codecs in key order so runs can be compared with diff
+void PrintBatchStats(const BatchStats &stats);
@@ -0,0 +1,695 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Microbenchmarks of the decoding and analysis code. Builds on any platform.
+// The tests of the same code are in tests.cpp.
+//
+// Results are printed to stderr, and with --json FILE also written as JSON
+// so runs can be compared by scripts. The analysis code prints what it
+// finds to stdout, which goes to the null device while benchmarking.
+
+#include "a2dp.h"
+#include "batch.h"
+#include "capture_file.h"
+#include "coalescer.h"
+#include "device_tracker.h"
+#include "event_decoder.h"
+#include "event_schema.h"
+#include "filter.h"
+#include "flight_recorder.h"
+#include "latency_histogram.h"
+#include "load_generator.h"
+#include "metrics.h"
+#include "negotiation.h"
+#include "output_sink.h"
+#include "output_writer.h"
+#include "pnp_codecs.h"
+#include "reorder_merger.h"
+#include "spsc_ring.h"
+#include "status_snapshot.h"
+#include "test_support.h"
+#include "trace_import.h"
+#include "trace_source.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+#ifdef _WIN32
+const char NULL_DEVICE[] = "NUL";
+#else
+const char NULL_DEVICE[] = "/dev/null";
+#endif
+
+// Keeps the compiler from optimizing the measured work away
+volatile ULONGLONG sink = 0;
+
+struct BenchmarkResult {
+    std::string Name;
+    ULONGLONG Items;
+    double NsPerItem;
+    double AllocationsPerItem;
+    double BytesPerSecond; // 0 if the benchmark does not measure bytes
+};
+
+std::vector<BenchmarkResult> results;
+
+// Runs fn iterations times and reports the time and allocations per call,
+// or per item if every call handles itemsPerCall items. With bytesPerCall
+// the throughput is reported instead of the time.
+template <typename Fn>
+void Measure(const char *name, ULONGLONG iterations, ULONGLONG itemsPerCall,
+             size_t bytesPerCall, Fn &&fn) {
+    const ULONGLONG allocationsBefore = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (ULONGLONG i = 0; i < iterations; i++) {
+        fn(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    const ULONGLONG allocated = allocations.load() - allocationsBefore;
+
+    BenchmarkResult result;
+    result.Name = name;
+    result.Items = iterations * itemsPerCall;
+    const double ns =
+        std::chrono::duration<double, std::nano>(end - start).count();
+    result.NsPerItem = ns / result.Items;
+    result.AllocationsPerItem = (double)allocated / result.Items;
+    result.BytesPerSecond =
+        bytesPerCall != 0 ? (double)bytesPerCall * iterations / ns * 1e9 : 0;
+    results.push_back(result);
+
+    if (result.BytesPerSecond != 0) {
+        fprintf(stderr, "%-40s %8.2f GB/s    %8.2f allocs/op\n", name,
+                result.BytesPerSecond / 1e9, result.AllocationsPerItem);
+    } else {
+        fprintf(stderr, "%-40s %8.2f ns/op   %8.2f allocs/op\n", name,
+                result.NsPerItem, result.AllocationsPerItem);
+    }
+}
+
+template <typename Fn>
+void RunBenchmark(const char *name, ULONGLONG iterations, Fn &&fn,
+                  ULONGLONG itemsPerCall = 1) {
+    Measure(name, iterations, itemsPerCall, 0, fn);
+}
+
+// Runs fn iterations times over bytes of input and reports the throughput
+template <typename Fn>
+void RunThroughputBenchmark(const char *name, ULONGLONG iterations,
+                            size_t bytes, Fn &&fn) {
+    Measure(name, iterations, 1, bytes, fn);
+}
+
+void WriteJsonString(FILE *file, const std::string &text) {
+    fputc('"', file);
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', file);
+        }
+        fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+// Writes the results as {"benchmarks": [{...}, ...]}. Returns false if the
+// file can not be written.
+bool WriteJsonResults(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == nullptr) {
+        return false;
+    }
+    fprintf(file, "{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult &result = results[i];
+        fprintf(file, "    {\"name\": ");
+        WriteJsonString(file, result.Name);
+        fprintf(file,
+                ", \"items\": %llu, \"ns_per_item\": %.3f, "
+                "\"allocs_per_item\": %.3f",
+                (unsigned long long)result.Items, result.NsPerItem,
+                result.AllocationsPerItem);
+        if (result.BytesPerSecond != 0) {
+            fprintf(file, ", \"bytes_per_second\": %.0f",
+                    result.BytesPerSecond);
+        }
+        fprintf(file, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+// GetCodecName as it was before the codec registry, kept to compare with
+const WCHAR *LegacyGetCodecName(const A2dpEventData &eventData) {
+    if (eventData.a2dpStandardCodecId) {
+        for (const auto &codec : CODECS) {
+            if (eventData.a2dpStandardCodecId == 0x00 ||
+                eventData.a2dpStandardCodecId == 0x01 ||
+                eventData.a2dpStandardCodecId == 0x02 ||
+                eventData.a2dpStandardCodecId == 0x04) {
+                if (codec.A2dpStandardCodecId ==
+                    eventData.a2dpStandardCodecId) {
+                    return codec.Name;
+                }
+            } else if (codec.A2dpStandardCodecId ==
+                           eventData.a2dpStandardCodecId &&
+                       codec.A2dpVendorId == eventData.a2dpVendorId &&
+                       codec.A2dpVendorCodecId == eventData.a2dpVendorCodecId) {
+                return codec.Name;
+            }
+        }
+    }
+    return nullptr;
+}
+
+// Codec announcements as they come from a headset (see events.txt), plus
+// one codec nobody knows
+std::vector<A2dpEventData> CodecCorpus() {
+    const struct {
+        BYTE StandardCodecId;
+        DWORD VendorId;
+        WORD VendorCodecId;
+    } codecs[] = {{0xFF, 0xD7, 0x24},  {0xFF, 0x4F, 0x01},
+                  {0x02, 0x00, 0x00},  {0xFF, 0x0A, 0x0106},
+                  {0xFF, 0x0A, 0x0104}, {0xFF, 0x0A, 0x0103},
+                  {0x00, 0x00, 0x00},  {0xFF, 0x1234, 0x5678}};
+
+    std::vector<A2dpEventData> corpus;
+    for (const auto &codec : codecs) {
+        A2dpEventData eventData;
+        eventData.a2dpStandardCodecId = codec.StandardCodecId;
+        eventData.a2dpVendorId = codec.VendorId;
+        eventData.a2dpVendorCodecId = codec.VendorCodecId;
+        corpus.push_back(eventData);
+    }
+    return corpus;
+}
+
+// About 64 MB of --trace output, events as in events.txt
+std::string TraceLogCorpus() {
+    const char *event = "--------------------------------------\n"
+                        "Event ID: 0\n"
+                        "  PartA_PrivTags [8]: 0008000300000000\n"
+                        "  AvdtpActivity [4]: 12000000     "
+                        "[SetConfiguration_Cfm]\n"
+                        "  AcceptorStreamEndPointID [1]: 03     [3]\n"
+                        "  InitiatorStreamEndPointID [1]: 37     [55]\n"
+                        "  ResultCode [1]: 00     [0]\n"
+                        "  A2dpStandardCodecId [1]: 02     [0x2]\n"
+                        "  A2dpVendorId [4]: 00000000     [0x0]\n"
+                        "  A2dpVendorCodecId [2]: 0000     [0x0]\n"
+                        "  BTDeviceAddress [8]: f479f4d2967c0000\n"
+                        "  AudioSessionId [16]: "
+                        "a16c3dc9202a04008b29d5c9202adc01\n"
+                        "  SampleRate [12]: 80bb000080bb000080bb0000\n";
+    std::string log;
+    while (log.size() < (64 << 20)) {
+        log += event;
+    }
+    return log;
+}
+
+// Events of many devices, each announcing a codec and then streaming
+std::vector<A2dpEventData> DeviceCorpus(int devices) {
+    std::vector<A2dpEventData> corpus;
+    for (int i = 0; i < devices; i++) {
+        A2dpEventData announce;
+        announce.BTDeviceAddress = 0x7C96D2000000ULL + i * 0x10001ULL;
+        announce.AcceptorStreamEndPointID = 3;
+        announce.a2dpStandardCodecId = 0x02;
+        corpus.push_back(announce);
+
+        A2dpEventData start;
+        start.BTDeviceAddress = announce.BTDeviceAddress;
+        start.AvdtpActivity = AvdtpActivity::Start_Cfm;
+        corpus.push_back(start);
+    }
+    return corpus;
+}
+
+// Every device goes through a whole stream setup and tears it down again
+struct NegotiationEvent {
+    LONGLONG Timestamp;
+    A2dpEventData Data;
+    A2dpFinding Finding;
+};
+
+std::vector<NegotiationEvent> NegotiationCorpus(int devices) {
+    const AvdtpActivity setup[] = {
+        AvdtpActivity::Discover_Cfm,         AvdtpActivity::GetCapabilities_Cfm,
+        AvdtpActivity::SetConfiguration_Cfm, AvdtpActivity::Open_Cfm,
+        AvdtpActivity::Start_Cfm,            AvdtpActivity::Close_Cfm};
+    std::vector<NegotiationEvent> corpus;
+    LONGLONG timestamp = 0;
+    for (const AvdtpActivity activity : setup) {
+        for (int i = 0; i < devices; i++) {
+            NegotiationEvent event;
+            event.Timestamp = timestamp += 1000 + i;
+            event.Data.BTDeviceAddress = 0x7C96D2000000ULL + i * 0x10001ULL;
+            event.Data.AvdtpActivity = activity;
+            event.Data.AcceptorStreamEndPointID = 3;
+            event.Data.InitiatorStreamEndPointID = 0x37;
+            event.Data.a2dpStandardCodecId = (BYTE)(i % 2 ? 0x02 : 0x00);
+            event.Finding = AnalyzeEventData(event.Data);
+            corpus.push_back(event);
+        }
+    }
+    return corpus;
+}
+
+void CountBatch(const TraceEvent *events, size_t count) {
+    sink = sink + count;
+    (void)events;
+}
+
+void CountImportedEvent(ULONG eventId, const A2dpEventData &eventData) {
+    sink = sink + eventId + (eventData.AvdtpActivity ? 1 : 0);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    const char *jsonPath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: win_bt_codec_bench [--json FILE]\n");
+            return 1;
+        }
+    }
+    freopen(NULL_DEVICE, "w", stdout);
+
+    const ULONGLONG iterations = 10000000;
+    const std::vector<A2dpEventData> corpus = CodecCorpus();
+
+    RunBenchmark("GetCodecName (linear scan)", iterations, [&](ULONGLONG i) {
+        sink = sink + (ULONGLONG)(uintptr_t)LegacyGetCodecName(
+                          corpus[i % corpus.size()]);
+    });
+    RunBenchmark("GetCodecName (registry)", iterations, [&](ULONGLONG i) {
+        sink = sink +
+               (ULONGLONG)(uintptr_t)GetCodecName(corpus[i % corpus.size()]);
+    });
+
+    const AvdtpActivity activities[] = {
+        AvdtpActivity::Connect_Cfm, AvdtpActivity::SetConfiguration_Cfm,
+        AvdtpActivity::Start_Cfm,   AvdtpActivity::Close_Ind,
+        AvdtpActivity::Abort_Cfm,   (AvdtpActivity)0x7F};
+    RunBenchmark("AvdtpActivityToString", iterations, [&](ULONGLONG i) {
+        sink = sink + (ULONGLONG)(uintptr_t)AvdtpActivityToString(
+                          activities[i % 6]);
+    });
+
+    EventCorpus events;
+    BuildEventCorpus(events);
+    const size_t shapes = events.Events.size();
+
+    {
+        static TraceLoggingCorpus traceLogging;
+        BuildTraceLoggingCorpus(events, traceLogging);
+        static SchemaCache cache(traceLogging.Backend);
+        RunBenchmark("SchemaCache::Lookup (same event)", iterations,
+                     [&](ULONGLONG) {
+                         sink = sink + (ULONGLONG)(uintptr_t)cache.Lookup(
+                                           traceLogging.Events[0]);
+                     });
+        RunBenchmark("SchemaCache::Lookup (round robin)", iterations,
+                     [&](ULONGLONG i) {
+                         sink = sink + (ULONGLONG)(uintptr_t)cache.Lookup(
+                                           traceLogging.Events[i % shapes]);
+                     });
+    }
+    std::vector<A2dpEventData> decoded(shapes);
+    RunBenchmark("DecodeEventData", iterations, [&](ULONGLONG i) {
+        const size_t k = i % shapes;
+        A2dpEventData eventData;
+        DecodeEventData(events.Events[k], events.Schemas[k],
+                        MeasureStringProperty, eventData);
+        decoded[k] = eventData;
+    });
+    static EventMessage message;
+    RunBenchmark("FillEventMessage", iterations, [&](ULONGLONG i) {
+        const size_t k = i % shapes;
+        FillEventMessage(message, events.Events[k], events.Schemas[k],
+                         MeasureStringProperty);
+        sink = sink + message.DataLength;
+    });
+    RunBenchmark("FillEventMessage (analysis fields)", iterations,
+                 [&](ULONGLONG i) {
+                     const size_t k = i % shapes;
+                     FillEventMessage(message, events.Events[k],
+                                      events.Schemas[k], MeasureStringProperty,
+                                      DEVICE_TRACKER_FIELDS);
+                     sink = sink + message.DataLength;
+                 });
+
+    EventFilter filter;
+    std::wstring filterError;
+    filter.Compile(
+        "AvdtpActivity in (0x12, 0x14) && BTDeviceAddress == 7C96D2F479F4",
+        filterError);
+    RunBenchmark("EventFilter::Matches", iterations, [&](ULONGLONG i) {
+        const size_t k = i % shapes;
+        sink = sink + filter.Matches(events.Events[k], events.Schemas[k],
+                                     MeasureStringProperty);
+    });
+
+    // Files of several blocks each, so the pool splits them too
+    const size_t batchFiles = 8;
+    const size_t batchEvents = 100000;
+    std::vector<std::string> batchPaths;
+    for (size_t i = 0; i < batchFiles; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "win_bt_codec_bench_%zu.cap", i);
+        if (!WriteCorpusCapture(path, events, batchEvents)) {
+            fprintf(stderr, "Unable to write %s\n", path);
+            return 1;
+        }
+        batchPaths.push_back(path);
+    }
+    const EventFilter noFilter;
+    RunBenchmark(
+        "RunBatch (per event)", 5,
+        [&](ULONGLONG) {
+            sink = sink + RunBatch(batchPaths, 0, noFilter).Events;
+        },
+        batchFiles * batchEvents);
+    for (const std::string &path : batchPaths) {
+        remove(path.c_str());
+    }
+
+    RunBenchmark("ProcessEventData", iterations / 10, [&](ULONGLONG i) {
+        sink = sink + ProcessEventData(decoded[i % shapes]);
+    });
+    std::wstring line;
+    RunBenchmark("Trace formatting (per event)", iterations / 10,
+                 [&](ULONGLONG i) {
+                     const size_t k = i % shapes;
+                     const EventSchema &schema = events.Schemas[k];
+                     const BYTE *data = events.Data[k].data();
+                     line.clear();
+                     for (const PropertyLayout &property : schema.Properties) {
+                         AppendPropertyLine(line, property,
+                                            data + property.Offset,
+                                            property.Size, decoded[k]);
+                     }
+                     sink = sink + line.size();
+                 });
+
+    const size_t pnpDevices = 512;
+    std::vector<PnpDeviceCodecs> devices(pnpDevices);
+    for (size_t i = 0; i < pnpDevices; i++) {
+        devices[i].Address = 0x7C96D2000000ULL + i;
+        // Every device a little different, so lists have different lengths
+        devices[i].Remote.assign(PNP_REMOTE_CODECS,
+                                 PNP_REMOTE_CODECS + sizeof(PNP_REMOTE_CODECS) -
+                                     (i % 3) * 7 - 1);
+        devices[i].Configured.assign(1, i % 2 ? 0x02 : 0x00);
+    }
+    RunBenchmark(
+        "PnpCodecList (per device)", 20000,
+        [&](ULONGLONG) {
+            for (const PnpDeviceCodecs &device : devices) {
+                const PnpCodecList remote = device.RemoteCodecs();
+                int selected =
+                    SelectedCodecIndex(remote, device.ConfiguredCodecs());
+                for (const PnpCodecRecord &record : remote) {
+                    sink = sink + (ULONGLONG)(uintptr_t)record.Find();
+                }
+                sink = sink + selected;
+            }
+        },
+        pnpDevices);
+
+    // Every sink writes to the null device, traced, as with --trace
+    std::vector<EventMessage> messages(shapes);
+    std::vector<A2dpFinding> findings(shapes);
+    for (size_t k = 0; k < shapes; k++) {
+        FillEventMessage(messages[k], events.Events[k], events.Schemas[k],
+                         MeasureStringProperty);
+        findings[k] = AnalyzeEventData(messages[k].Data);
+    }
+    const struct {
+        const char *Name;
+        OutputFormat Format;
+    } formats[] = {{"OutputSink text", OutputFormat::Text},
+                   {"OutputSink jsonl", OutputFormat::JsonLines},
+                   {"OutputSink binary", OutputFormat::Binary}};
+    for (const auto &format : formats) {
+        std::unique_ptr<OutputSink> sink =
+            CreateOutputSink(format.Format, NULL_DEVICE);
+        if (sink == nullptr) {
+            fprintf(stderr, "Unable to open %s\n", NULL_DEVICE);
+            return 1;
+        }
+        RunBenchmark(format.Name, iterations / 10, [&](ULONGLONG i) {
+            const size_t k = i % shapes;
+            sink->WriteEvent(messages[k], findings[k], true);
+        });
+    }
+
+    const std::string hex = "a16c3dc9202a04008b29d5c9202adc01"
+                            "80bb000080bb000080bb0000f479f4d2";
+    BYTE bytes[32];
+    RunThroughputBenchmark("DecodeHex (64 digits)", iterations, hex.size(),
+                           [&](ULONGLONG) {
+                               DecodeHex(hex.data(), hex.size(), bytes);
+                               sink = sink + bytes[31];
+                           });
+
+    {
+        LoadOptions options;
+        options.Events = ~0ULL;
+        static LoadGenerator generator(options);
+        RunBenchmark("LoadGenerator::Next", iterations, [&](ULONGLONG) {
+            EVENT_RECORD event;
+            const EventSchema *schema = nullptr;
+            generator.Next(event, schema);
+            sink = sink + event.UserDataLength;
+        });
+    }
+
+    {
+        LoadOptions options;
+        options.Events = iterations;
+        RunBenchmark(
+            "GeneratorTraceSource::Run", 1,
+            [&](ULONGLONG) {
+                GeneratorTraceSource source(options);
+                source.Run(CountBatch);
+            },
+            iterations);
+    }
+
+    const std::string log = TraceLogCorpus();
+    RunThroughputBenchmark("TraceImporter", 5, log.size(), [&](ULONGLONG) {
+        TraceImporter importer(CountImportedEvent);
+        const size_t chunk = 1 << 20;
+        for (size_t offset = 0; offset < log.size(); offset += chunk) {
+            size_t size = log.size() - offset < chunk ? log.size() - offset
+                                                      : chunk;
+            importer.Feed(log.data() + offset, size);
+        }
+        importer.Finish();
+    });
+
+    for (int devices : {16, 4096}) {
+        const std::vector<A2dpEventData> events = DeviceCorpus(devices);
+        std::vector<A2dpFinding> findings;
+        for (const A2dpEventData &data : events) {
+            findings.push_back(AnalyzeEventData(data));
+        }
+        DeviceTracker tracker;
+        char name[64];
+        snprintf(name, sizeof(name), "DeviceTracker::Update (%d devices)",
+                 devices);
+        RunBenchmark(name, iterations, [&](ULONGLONG i) {
+            const size_t k = i % events.size();
+            sink = sink + tracker.Update(events[k], findings[k])->Events;
+        });
+    }
+
+    const size_t merged = 1000000;
+    for (size_t streams : {4, 64}) {
+        const size_t batch = 16;
+        const std::vector<StreamEvent> events =
+            InterleavedStreams(streams, batch, merged);
+        char name[64];
+        snprintf(name, sizeof(name), "ReorderMerger (%zu streams)", streams);
+        RunBenchmark(
+            name, 1,
+            [&](ULONGLONG) {
+                sink = sink + MergeStreams(events, (LONGLONG)(streams * batch));
+            },
+            merged);
+    }
+
+    {
+        // Events of four processors through the queue, the merger and the
+        // text sink. Once warmed up, nothing should be allocated per event.
+        OutputWriter writer;
+        writer.SetSink(CreateOutputSink(OutputFormat::Text, NULL_DEVICE));
+        writer.Start(false, 1000000, std::chrono::milliseconds(10));
+        LONGLONG timestamp = 0;
+        auto feed = [&](ULONGLONG i) {
+            const size_t k = i % shapes;
+            EVENT_RECORD event = events.Events[k];
+            event.EventHeader.TimeStamp.QuadPart = ++timestamp;
+            event.BufferContext.ProcessorNumber = (UCHAR)(i % 4);
+            EventMessage *message = writer.Claim(OverflowPolicy::Wait);
+            FillEventMessage(*message, event, events.Schemas[k],
+                             MeasureStringProperty);
+            writer.Publish(*message);
+        };
+        for (ULONGLONG i = 0; i < 100000; i++) {
+            feed(i);
+        }
+        writer.Flush();
+        RunBenchmark("OutputWriter (per event)", iterations / 10, feed);
+        writer.Stop();
+    }
+
+    static LatencyHistogram histogram;
+    RunBenchmark("LatencyHistogram::Record", iterations,
+                 [&](ULONGLONG i) { histogram.Record(i + 1); });
+
+    static QuantileSketch sketch;
+    RunBenchmark("QuantileSketch::Record", iterations,
+                 [&](ULONGLONG i) { sketch.Record(i + 1); });
+
+    const std::vector<NegotiationEvent> negotiations = NegotiationCorpus(16);
+    NegotiationTracker negotiationTracker;
+    negotiationTracker.SetFrequency(1000000);
+    RunBenchmark("NegotiationTracker::Update", iterations, [&](ULONGLONG i) {
+        const NegotiationEvent &event = negotiations[i % negotiations.size()];
+        // Every round of the corpus is later than the one before
+        const LONGLONG round = (LONGLONG)(i / negotiations.size());
+        negotiationTracker.Update(event.Timestamp + round * 1000000000LL,
+                                  event.Data, event.Finding);
+    });
+    sink = sink + negotiationTracker.All().Connections;
+
+    RunBenchmark("ShardedCounter::Add", iterations,
+                 [&](ULONGLONG) { metrics.Events.Add(); });
+    RunBenchmark("MetricsTable::Add", iterations, [&](ULONGLONG i) {
+        metrics.EventsByActivity.Add(activities[i % 6]);
+    });
+    std::string openMetrics;
+    RunBenchmark("WriteOpenMetrics", 1000, [&](ULONGLONG) {
+        WriteOpenMetrics(openMetrics);
+        sink = sink + openMetrics.size();
+    });
+
+    {
+        static FlightRecorder recorder;
+        recorder.SetCapacity(FLIGHT_RECORDER_DEFAULT_EVENTS);
+        static EventMessage recorded[8];
+        for (size_t k = 0; k < 8; k++) {
+            FillEventMessage(recorded[k], events.Events[k % shapes],
+                             events.Schemas[k % shapes],
+                             MeasureStringProperty, DEVICE_TRACKER_FIELDS);
+            recorded[k].Data.BTDeviceAddress = 0x7C96D2F47900ULL + k % 3;
+        }
+        RunBenchmark("FlightRecorder::Record", iterations, [&](ULONGLONG i) {
+            recorder.Record(recorded[i % 8]);
+        });
+    }
+
+    {
+        // Devices reconnecting with the same codecs, everything is a repeat
+        static Coalescer coalescer;
+        std::vector<A2dpEventData> announcements;
+        for (ULONGLONG device = 0; device < 16; device++) {
+            for (int codec = 0; codec < 5; codec++) {
+                announcements.push_back(
+                    CodecEvent(0x7C96D2F47900ULL + device, CODECS[codec],
+                               codec == 4));
+            }
+        }
+        RunBenchmark("Coalescer::Update", iterations, [&](ULONGLONG i) {
+            const A2dpEventData &data =
+                announcements[i % announcements.size()];
+            A2dpFinding finding = AnalyzeEventData(data);
+            sink = sink + coalescer.Update(data, finding);
+        });
+    }
+
+    {
+        StatusPublisher publisher;
+        const std::string name = StatusRegionName();
+        if (publisher.Open(name.c_str())) {
+            DeviceState device;
+            device.Address = 0x0123456789ABULL;
+            device.SelectedCodec = codecRegistry.Find(0x02, 0, 0);
+            RunBenchmark("StatusPublisher::Publish", iterations,
+                         [&](ULONGLONG i) {
+                             device.Events = i;
+                             publisher.Publish(&device);
+                         });
+
+            SharedMemoryRegion region;
+            static StatusSnapshot snapshot;
+            if (region.Open(name.c_str(), STATUS_REGION_SIZE)) {
+                RunBenchmark("ReadStatusSnapshot", iterations / 10,
+                             [&](ULONGLONG) {
+                                 sink = sink + ReadStatusSnapshot(
+                                                   region.Data(), region.Size(),
+                                                   snapshot);
+                             });
+            }
+        }
+    }
+
+    const ULONGLONG transfers = 10000000;
+    RunBenchmark(
+        "SpscRing transfer", 1,
+        [&](ULONGLONG) { sink = sink + TransferThroughRing<64>(transfers, 1); },
+        transfers);
+    RunBenchmark(
+        "SpscRing transfer (1024 slots)", 1,
+        [&](ULONGLONG) {
+            sink = sink +
+                   TransferThroughRing<OUTPUT_QUEUE_CAPACITY>(transfers, 1);
+        },
+        transfers);
+    RunBenchmark(
+        "SpscRing transfer (1024 slots, batched)", 1,
+        [&](ULONGLONG) {
+            sink = sink + TransferThroughRing<OUTPUT_QUEUE_CAPACITY>(
+                              transfers, TRACE_BATCH_EVENTS);
+        },
+        transfers);
+
+    if (jsonPath != nullptr && !WriteJsonResults(jsonPath)) {
+        fprintf(stderr, "Unable to write %s\n", jsonPath);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,445 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "capture_file.h"
+
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+// Records are padded to this
+const uint32_t RECORD_ALIGNMENT = 8;
+
+uint32_t PadRecord(size_t size) {
+    return (uint32_t)((size + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1));
+}
+
+// UserDataLength is 16 bits, no event carries more data than this
+const uint64_t MAX_EVENT_DATA = 0xFFFF;
+
+// Checks a fixed property size read from a file. It has to fit in an event
+// and, for plain values, hold a whole number of them (arrays hold several).
+bool ValidPropertySize(USHORT inType, uint32_t size) {
+    if (size == VARIABLE_LAYOUT) {
+        return true;
+    }
+    const ULONG elementSize = InTypeSize(inType);
+    return size <= MAX_EVENT_DATA &&
+           (elementSize == 0 || (size != 0 && size % elementSize == 0));
+}
+
+// Appends size bytes to the buffer
+void Append(std::vector<BYTE> &buffer, const void *data, size_t size) {
+    const BYTE *bytes = (const BYTE *)data;
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+} // namespace
+
+bool CaptureWriter::Open(const char *path, LONGLONG timestampFrequency) {
+    Close();
+    m_file = fopen(path, "wb");
+    if (m_file == nullptr) {
+        return false;
+    }
+
+    CaptureFileHeader header = {};
+    memcpy(header.Magic, CAPTURE_MAGIC, sizeof(header.Magic));
+    header.Version = CAPTURE_VERSION;
+    header.HeaderSize = sizeof(header);
+    header.TimestampFrequency = timestampFrequency;
+
+    m_failed = fwrite(&header, sizeof(header), 1, m_file) != 1;
+    m_offset = sizeof(header);
+    m_block.clear();
+    m_block.reserve(CAPTURE_BLOCK_SIZE + 4096);
+    m_blockHeader = {};
+    m_blockOffsets.clear();
+    m_schemaIds.clear();
+    m_schemaInBlock.clear();
+    m_eventCount = 0;
+    return !m_failed;
+}
+
+void CaptureWriter::AppendSchema(uint32_t schemaId,
+                                 const EventSchema &schema) {
+    const size_t start = m_block.size();
+
+    CaptureSchemaRecord record = {};
+    record.Header.Type = CAPTURE_RECORD_SCHEMA;
+    record.SchemaId = schemaId;
+    record.PropertyCount = (uint32_t)schema.Properties.size();
+    Append(m_block, &record, sizeof(record));
+
+    for (const auto &property : schema.Properties) {
+        CaptureSchemaProperty entry = {};
+        entry.InType = property.InType;
+        entry.NameLength = (uint16_t)property.Name.size();
+        entry.Flags = property.Flags;
+        entry.Size = property.Size;
+        Append(m_block, &entry, sizeof(entry));
+        // Names are stored as UTF-16 whatever the size of wchar_t is. They
+        // are ASCII in practice, so characters outside of the BMP are not
+        // worth the trouble.
+        for (WCHAR c : property.Name) {
+            uint16_t unit = (uint16_t)c;
+            Append(m_block, &unit, sizeof(unit));
+        }
+    }
+
+    const uint32_t size = PadRecord(m_block.size() - start);
+    m_block.resize(start + size, 0);
+    memcpy(&m_block[start + offsetof(CaptureRecordHeader, Size)], &size,
+           sizeof(size));
+}
+
+bool CaptureWriter::Write(const EVENT_RECORD &event,
+                          const EventSchema &schema) {
+    if (m_file == nullptr) {
+        return false;
+    }
+
+    // Give the schema an id the first time it is seen, and put it into the
+    // block before the first event that uses it
+    auto it = m_schemaIds.find(&schema);
+    if (it == m_schemaIds.end()) {
+        it = m_schemaIds.emplace(&schema, (uint32_t)m_schemaIds.size()).first;
+        m_schemaInBlock.push_back(false);
+    }
+    const uint32_t schemaId = it->second;
+    if (!m_schemaInBlock[schemaId]) {
+        AppendSchema(schemaId, schema);
+        m_schemaInBlock[schemaId] = true;
+    }
+
+    const EVENT_HEADER &header = event.EventHeader;
+    CaptureEventRecord record = {};
+    record.Header.Type = CAPTURE_RECORD_EVENT;
+    record.Header.Size = PadRecord(sizeof(record) + event.UserDataLength);
+    record.ProviderId = header.ProviderId;
+    record.Id = header.EventDescriptor.Id;
+    record.Version = header.EventDescriptor.Version;
+    record.Channel = header.EventDescriptor.Channel;
+    record.Level = header.EventDescriptor.Level;
+    record.Opcode = header.EventDescriptor.Opcode;
+    record.Task = header.EventDescriptor.Task;
+    record.Keyword = header.EventDescriptor.Keyword;
+    record.TimeStamp = header.TimeStamp.QuadPart;
+    record.ProcessId = header.ProcessId;
+    record.ThreadId = header.ThreadId;
+    record.Flags = header.Flags;
+    record.EventProperty = header.EventProperty;
+    record.ProcessorNumber = event.BufferContext.ProcessorNumber;
+    record.SchemaId = schemaId;
+    record.UserDataLength = event.UserDataLength;
+
+    const size_t start = m_block.size();
+    Append(m_block, &record, sizeof(record));
+    Append(m_block, event.UserData, event.UserDataLength);
+    m_block.resize(start + record.Header.Size, 0);
+
+    if (m_blockHeader.EventCount == 0) {
+        m_blockHeader.FirstTimestamp = record.TimeStamp;
+    }
+    m_blockHeader.LastTimestamp = record.TimeStamp;
+    m_blockHeader.EventCount++;
+    m_eventCount++;
+
+    if (m_block.size() >= CAPTURE_BLOCK_SIZE) {
+        return FlushBlock();
+    }
+    return !m_failed;
+}
+
+bool CaptureWriter::FlushBlock() {
+    if (m_block.empty()) {
+        return !m_failed;
+    }
+
+    m_blockHeader.Magic = CAPTURE_BLOCK_MAGIC;
+    m_blockHeader.Size = (uint32_t)m_block.size();
+    if (fwrite(&m_blockHeader, sizeof(m_blockHeader), 1, m_file) != 1 ||
+        fwrite(m_block.data(), m_block.size(), 1, m_file) != 1) {
+        m_failed = true;
+    }
+    m_blockOffsets.push_back(m_offset);
+    m_offset += sizeof(m_blockHeader) + m_block.size();
+
+    // The next block starts from scratch and repeats the schemas it uses
+    m_block.clear();
+    m_blockHeader = {};
+    m_schemaInBlock.assign(m_schemaInBlock.size(), false);
+    return !m_failed;
+}
+
+bool CaptureWriter::Close() {
+    if (m_file == nullptr) {
+        return true;
+    }
+    FlushBlock();
+
+    CaptureIndexHeader index = {};
+    index.Magic = CAPTURE_INDEX_MAGIC;
+    index.BlockCount = (uint32_t)m_blockOffsets.size();
+    CaptureFileFooter footer = {};
+    footer.IndexOffset = m_offset;
+    memcpy(footer.Magic, CAPTURE_FOOTER_MAGIC, sizeof(footer.Magic));
+
+    if (fwrite(&index, sizeof(index), 1, m_file) != 1 ||
+        (!m_blockOffsets.empty() &&
+         fwrite(m_blockOffsets.data(), sizeof(uint64_t), m_blockOffsets.size(),
+                m_file) != m_blockOffsets.size()) ||
+        fwrite(&footer, sizeof(footer), 1, m_file) != 1) {
+        m_failed = true;
+    }
+    if (fclose(m_file) != 0) {
+        m_failed = true;
+    }
+    m_file = nullptr;
+    return !m_failed;
+}
+
+const EventSchema &CaptureSchemaStore::Add(std::string record,
+                                           EventSchema &&schema) {
+    return m_schemas.emplace(std::move(record), std::move(schema))
+        .first->second;
+}
+
+bool CaptureBlockReader::ReadSchema(const BYTE *record, uint32_t size) {
+    CaptureSchemaRecord header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, record, sizeof(header));
+
+    EventSchema schema;
+    size_t offset = sizeof(header);
+    // Sizes come from the file, a damaged or crafted one must not get a
+    // layout past the end of the event data
+    uint64_t fixedSize = 0;
+    for (uint32_t i = 0; i < header.PropertyCount; i++) {
+        CaptureSchemaProperty entry;
+        if (size - offset < sizeof(entry)) {
+            return false;
+        }
+        memcpy(&entry, record + offset, sizeof(entry));
+        offset += sizeof(entry);
+        if (size - offset < entry.NameLength * sizeof(uint16_t)) {
+            return false;
+        }
+        if (!ValidPropertySize(entry.InType, entry.Size)) {
+            return false;
+        }
+        if (entry.Size != VARIABLE_LAYOUT) {
+            fixedSize += entry.Size;
+            if (fixedSize > MAX_EVENT_DATA) {
+                return false;
+            }
+        }
+
+        PropertyLayout property;
+        property.InType = entry.InType;
+        property.Flags = entry.Flags;
+        property.Size = entry.Size;
+        property.Name.resize(entry.NameLength);
+        for (uint16_t k = 0; k < entry.NameLength; k++) {
+            uint16_t unit;
+            memcpy(&unit, record + offset, sizeof(unit));
+            property.Name[k] = (WCHAR)unit;
+            offset += sizeof(unit);
+        }
+        schema.Properties.push_back(std::move(property));
+    }
+    ComputeLayout(schema);
+    // The same properties give the same schema, whatever its id in the block
+    std::string properties((const char *)&header.PropertyCount,
+                           sizeof(header.PropertyCount));
+    properties.append((const char *)record + sizeof(header),
+                      offset - sizeof(header));
+    CaptureSchemaStore &store =
+        m_sharedSchemas != nullptr ? *m_sharedSchemas : m_ownSchemas;
+    m_schemas[header.SchemaId] =
+        &store.Add(std::move(properties), std::move(schema));
+    return true;
+}
+
+bool CaptureBlockReader::Next(EVENT_RECORD &event,
+                              const EventSchema *&schema) {
+    while (!m_corrupt && m_size - m_offset >= sizeof(CaptureRecordHeader)) {
+        const BYTE *record = m_data + m_offset;
+        CaptureRecordHeader header;
+        memcpy(&header, record, sizeof(header));
+        if (header.Size < sizeof(header) || header.Size > m_size - m_offset) {
+            m_corrupt = true;
+            break;
+        }
+        m_offset += header.Size;
+
+        if (header.Type == CAPTURE_RECORD_SCHEMA) {
+            if (!ReadSchema(record, header.Size)) {
+                m_corrupt = true;
+            }
+            continue;
+        }
+        if (header.Type != CAPTURE_RECORD_EVENT) {
+            // Written by a newer version, skip it
+            continue;
+        }
+
+        CaptureEventRecord data;
+        if (header.Size < sizeof(data)) {
+            m_corrupt = true;
+            break;
+        }
+        memcpy(&data, record, sizeof(data));
+        auto it = m_schemas.find(data.SchemaId);
+        if (it == m_schemas.end() ||
+            data.UserDataLength > header.Size - sizeof(data)) {
+            m_corrupt = true;
+            break;
+        }
+
+        event = {};
+        EVENT_HEADER &eventHeader = event.EventHeader;
+        eventHeader.Size = sizeof(EVENT_HEADER);
+        eventHeader.ProviderId = data.ProviderId;
+        eventHeader.EventDescriptor.Id = data.Id;
+        eventHeader.EventDescriptor.Version = data.Version;
+        eventHeader.EventDescriptor.Channel = data.Channel;
+        eventHeader.EventDescriptor.Level = data.Level;
+        eventHeader.EventDescriptor.Opcode = data.Opcode;
+        eventHeader.EventDescriptor.Task = data.Task;
+        eventHeader.EventDescriptor.Keyword = data.Keyword;
+        eventHeader.TimeStamp.QuadPart = data.TimeStamp;
+        eventHeader.ProcessId = data.ProcessId;
+        eventHeader.ThreadId = data.ThreadId;
+        eventHeader.Flags = data.Flags;
+        eventHeader.EventProperty = data.EventProperty;
+        event.BufferContext.ProcessorNumber = data.ProcessorNumber;
+        event.UserDataLength = data.UserDataLength;
+        event.UserData = (PVOID)(record + sizeof(data));
+        schema = it->second;
+        return true;
+    }
+    return false;
+}
+
+bool CaptureReader::Open(const char *path) {
+    m_blocks.clear();
+    m_truncated = false;
+    if (!m_file.Open(path)) {
+        return false;
+    }
+
+    CaptureFileHeader header;
+    if (m_file.Size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, m_file.Data(), sizeof(header));
+    if (memcmp(header.Magic, CAPTURE_MAGIC, sizeof(header.Magic)) != 0 ||
+        header.Version != CAPTURE_VERSION ||
+        header.HeaderSize < sizeof(header) ||
+        header.HeaderSize > m_file.Size()) {
+        return false;
+    }
+    m_timestampFrequency = header.TimestampFrequency;
+
+    if (!ReadIndex()) {
+        ScanBlocks();
+    }
+    return true;
+}
+
+bool CaptureReader::ReadIndex() {
+    const BYTE *data = m_file.Data();
+    const size_t size = m_file.Size();
+
+    CaptureFileFooter footer;
+    if (size < sizeof(CaptureFileHeader) + sizeof(footer)) {
+        return false;
+    }
+    memcpy(&footer, data + size - sizeof(footer), sizeof(footer));
+    if (memcmp(footer.Magic, CAPTURE_FOOTER_MAGIC, sizeof(footer.Magic)) !=
+            0 ||
+        footer.IndexOffset < sizeof(CaptureFileHeader) ||
+        footer.IndexOffset > size - sizeof(footer) - sizeof(CaptureIndexHeader)) {
+        return false;
+    }
+
+    CaptureIndexHeader index;
+    memcpy(&index, data + footer.IndexOffset, sizeof(index));
+    const uint64_t indexEnd = footer.IndexOffset + sizeof(index) +
+                              (uint64_t)index.BlockCount * sizeof(uint64_t);
+    if (index.Magic != CAPTURE_INDEX_MAGIC ||
+        indexEnd > size - sizeof(footer)) {
+        return false;
+    }
+
+    std::vector<const CaptureBlockHeader *> blocks;
+    for (uint32_t i = 0; i < index.BlockCount; i++) {
+        uint64_t offset;
+        memcpy(&offset,
+               data + footer.IndexOffset + sizeof(index) + i * sizeof(offset),
+               sizeof(offset));
+        if (offset > footer.IndexOffset - sizeof(CaptureBlockHeader)) {
+            return false;
+        }
+        const CaptureBlockHeader *block =
+            (const CaptureBlockHeader *)(data + offset);
+        if (block->Magic != CAPTURE_BLOCK_MAGIC ||
+            block->Size > footer.IndexOffset - offset - sizeof(*block)) {
+            return false;
+        }
+        blocks.push_back(block);
+    }
+    m_blocks = std::move(blocks);
+    return true;
+}
+
+void CaptureReader::ScanBlocks() {
+    const BYTE *data = m_file.Data();
+    const size_t size = m_file.Size();
+
+    size_t offset = ((const CaptureFileHeader *)data)->HeaderSize;
+    while (size - offset >= sizeof(CaptureBlockHeader)) {
+        const CaptureBlockHeader *block =
+            (const CaptureBlockHeader *)(data + offset);
+        if (block->Magic != CAPTURE_BLOCK_MAGIC) {
+            // The index, or garbage of an interrupted write
+            break;
+        }
+        if (block->Size > size - offset - sizeof(*block)) {
+            m_truncated = true;
+            break;
+        }
+        m_blocks.push_back(block);
+        offset += sizeof(*block) + block->Size;
+    }
+}
+
+CaptureBlockReader CaptureReader::Block(size_t block,
+                                        CaptureSchemaStore *schemas) const {
+    const CaptureBlockHeader *header = m_blocks[block];
+    return CaptureBlockReader((const BYTE *)(header + 1), header->Size,
+                              schemas);
+}
@@ -0,0 +1,253 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "event_schema.h"
+#include "mapped_file.h"
+#include "platform.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Capture files keep raw events so a session can be replayed through the
+// decoder later, on any platform. All values are little endian.
+//
+//   file header
+//   block*        header, then schema and event records
+//   index         offsets of the blocks
+//   footer        offset of the index
+//
+// Every block carries the schemas its events use, so any block can be
+// decoded on its own. The index is written when the file is closed; if it
+// is missing (the recorder did not exit cleanly) the blocks are found by
+// walking them from the start.
+
+#pragma pack(push, 1)
+
+struct CaptureFileHeader {
+    char Magic[8];        // CAPTURE_MAGIC
+    uint32_t Version;     // CAPTURE_VERSION
+    uint32_t HeaderSize;  // sizeof(CaptureFileHeader)
+    int64_t TimestampFrequency; // ticks per second of the timestamps, 0
+                                // if not known
+    uint64_t Reserved;
+};
+
+struct CaptureBlockHeader {
+    uint32_t Magic;       // CAPTURE_BLOCK_MAGIC
+    uint32_t Size;        // bytes of records after this header
+    uint32_t EventCount;
+    uint32_t Reserved;
+    int64_t FirstTimestamp;
+    int64_t LastTimestamp;
+};
+
+// Starts every record in a block. Records are padded to 8 bytes and Size
+// includes the padding.
+struct CaptureRecordHeader {
+    uint16_t Type; // CAPTURE_RECORD_*
+    uint16_t Reserved;
+    uint32_t Size;
+};
+
+// Followed by UserDataLength bytes of the event data
+struct CaptureEventRecord {
+    CaptureRecordHeader Header;
+    GUID ProviderId;
+    uint16_t Id;
+    uint8_t Version;
+    uint8_t Channel;
+    uint8_t Level;
+    uint8_t Opcode;
+    uint16_t Task;
+    uint64_t Keyword;
+    int64_t TimeStamp;
+    uint32_t ProcessId;
+    uint32_t ThreadId;
+    uint16_t Flags;
+    uint16_t EventProperty;
+    uint8_t ProcessorNumber;
+    uint8_t Reserved[3];
+    uint32_t SchemaId;
+    uint16_t UserDataLength;
+    uint16_t Reserved2;
+};
+
+// Followed by PropertyCount CaptureSchemaProperty
+struct CaptureSchemaRecord {
+    CaptureRecordHeader Header;
+    uint32_t SchemaId;
+    uint32_t PropertyCount;
+};
+
+// Followed by NameLength UTF-16 code units of the name, no terminator
+struct CaptureSchemaProperty {
+    uint16_t InType;
+    uint16_t NameLength;
+    uint32_t Flags;
+    uint32_t Size; // VARIABLE_LAYOUT if not fixed
+};
+
+// Followed by BlockCount uint64_t file offsets of the blocks
+struct CaptureIndexHeader {
+    uint32_t Magic; // CAPTURE_INDEX_MAGIC
+    uint32_t BlockCount;
+};
+
+struct CaptureFileFooter {
+    uint64_t IndexOffset;
+    char Magic[8]; // CAPTURE_FOOTER_MAGIC
+};
+
+#pragma pack(pop)
+
+const char CAPTURE_MAGIC[8] = {'W', 'B', 'T', 'C', 'A', 'P', 'T', 0};
+const char CAPTURE_FOOTER_MAGIC[8] = {'W', 'B', 'T', 'C', 'I', 'D', 'X', 0};
+const uint32_t CAPTURE_VERSION = 1;
+const uint32_t CAPTURE_BLOCK_MAGIC = 0x4B4C4253; // "SBLK"
+const uint32_t CAPTURE_INDEX_MAGIC = 0x58444E49; // "INDX"
+const uint16_t CAPTURE_RECORD_EVENT = 1;
+const uint16_t CAPTURE_RECORD_SCHEMA = 2;
+
+// Blocks are written once they grow past this size
+const size_t CAPTURE_BLOCK_SIZE = 64 * 1024;
+
+// Writes a capture file. Not thread safe.
+class CaptureWriter {
+  public:
+    CaptureWriter() = default;
+    ~CaptureWriter() { Close(); }
+    CaptureWriter(const CaptureWriter &) = delete;
+    CaptureWriter &operator=(const CaptureWriter &) = delete;
+
+    // Creates the file, replacing an existing one. timestampFrequency is
+    // the number of timestamp ticks per second, 0 if not known.
+    bool Open(const char *path, LONGLONG timestampFrequency);
+
+    // Appends the event. The schema is identified by its address, so it has
+    // to stay alive while the file is written (SchemaCache guarantees it).
+    // Returns false if writing failed.
+    bool Write(const EVENT_RECORD &event, const EventSchema &schema);
+
+    // Writes the last block and the index and closes the file. Returns
+    // false if writing failed.
+    bool Close();
+
+    bool IsOpen() const { return m_file != nullptr; }
+    ULONGLONG EventCount() const { return m_eventCount; }
+
+  private:
+    bool FlushBlock();
+    void AppendSchema(uint32_t schemaId, const EventSchema &schema);
+
+    FILE *m_file = nullptr;
+    bool m_failed = false;
+    uint64_t m_offset = 0; // of the end of the file
+    std::vector<BYTE> m_block;
+    CaptureBlockHeader m_blockHeader = {};
+    std::vector<uint64_t> m_blockOffsets;
+    std::unordered_map<const EventSchema *, uint32_t> m_schemaIds;
+    // Schemas already written to the current block, by id
+    std::vector<bool> m_schemaInBlock;
+    ULONGLONG m_eventCount = 0;
+};
+
+// Schemas read from the blocks of a capture file. Every block writes its
+// schemas again, the store keeps one copy of each so that readers sharing it
+// can go away while events still point at their schemas.
+class CaptureSchemaStore {
+  public:
+    // Returns the stored schema read from the record, adding it if new
+    const EventSchema &Add(std::string record, EventSchema &&schema);
+
+    size_t Size() const { return m_schemas.size(); }
+
+  private:
+    // By the properties as written to the file
+    std::unordered_map<std::string, EventSchema> m_schemas;
+};
+
+// Walks the records of one block. The schemas go into the given store, or
+// into one of the reader's own when there is none.
+class CaptureBlockReader {
+  public:
+    CaptureBlockReader(const BYTE *data, size_t size,
+                       CaptureSchemaStore *schemas = nullptr) :
+        m_data(data), m_size(size), m_sharedSchemas(schemas) {}
+    // The schema pointers refer to m_ownSchemas, which a copy would not
+    CaptureBlockReader(const CaptureBlockReader &) = delete;
+    CaptureBlockReader(CaptureBlockReader &&) = default;
+
+    // Moves to the next event of the block, filling event and schema.
+    // event.UserData points into the block. Returns false at the end of
+    // the block or if the block is corrupt, see Corrupt().
+    bool Next(EVENT_RECORD &event, const EventSchema *&schema);
+
+    bool Corrupt() const { return m_corrupt; }
+
+  private:
+    bool ReadSchema(const BYTE *record, uint32_t size);
+
+    const BYTE *m_data;
+    size_t m_size;
+    size_t m_offset = 0;
+    bool m_corrupt = false;
+    CaptureSchemaStore m_ownSchemas;
+    CaptureSchemaStore *m_sharedSchemas;
+    std::unordered_map<uint32_t, const EventSchema *> m_schemas;
+};
+
+// Reads a capture file through a memory mapping
+class CaptureReader {
+  public:
+    // Maps the file and finds its blocks. Returns false if the file can not
+    // be read or is not a capture file.
+    bool Open(const char *path);
+
+    size_t BlockCount() const { return m_blocks.size(); }
+    LONGLONG TimestampFrequency() const { return m_timestampFrequency; }
+    const CaptureBlockHeader &BlockHeader(size_t block) const {
+        return *m_blocks[block];
+    }
+
+    // Returns a reader of the records of the block. Blocks are independent,
+    // so different blocks can be read from different threads, as long as
+    // they do not share a schema store.
+    CaptureBlockReader Block(size_t block,
+                             CaptureSchemaStore *schemas = nullptr) const;
+
+    // True if the file ends in a partially written block
+    bool Truncated() const { return m_truncated; }
+
+  private:
+    bool ReadIndex();
+    void ScanBlocks();
+
+    MappedFile m_file;
+    LONGLONG m_timestampFrequency = 0;
+    std::vector<const CaptureBlockHeader *> m_blocks;
+    bool m_truncated = false;
+};
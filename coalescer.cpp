@@ -0,0 +1,159 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "coalescer.h"
+
+#include "device_tracker.h"
+
+namespace {
+
+const int CODEC_SET_BITS = 64;
+static_assert(CODECS_COUNT < CODEC_SET_BITS,
+              "the codec sets have no room for the loaded codecs");
+
+int CountCodecs(uint64_t set) {
+    int count = 0;
+    for (; set != 0; set &= set - 1) {
+        count++;
+    }
+    return count;
+}
+
+} // namespace
+
+const WCHAR *DeviceChangeKindToString(DeviceChangeKind kind) {
+    switch (kind) {
+    case DeviceChangeKind::CodecSetUnchanged:
+        return L"codec_set_unchanged";
+    case DeviceChangeKind::CodecWithdrawn:
+        return L"codec_withdrawn";
+    case DeviceChangeKind::SelectedCodecChanged:
+        return L"selected_codec_changed";
+    default:
+        return L"unknown";
+    }
+}
+
+int Coalescer::CodecBit(const CodecData *codec) {
+    // The built in codecs are in one array, their index is their bit
+    if (codec >= CODECS && codec < CODECS + CODECS_COUNT) {
+        return (int)(codec - CODECS);
+    }
+    for (size_t i = 0; i < m_loadedCodecs.size(); i++) {
+        if (m_loadedCodecs[i] == codec) {
+            return CODECS_COUNT + (int)i;
+        }
+    }
+    if (CODECS_COUNT + m_loadedCodecs.size() == CODEC_SET_BITS) {
+        return -1;
+    }
+    m_loadedCodecs.push_back(codec);
+    return CODECS_COUNT + (int)m_loadedCodecs.size() - 1;
+}
+
+void Coalescer::CloseRound(ULONGLONG address, Device &device) {
+    // The first set was written codec by codec, later ones are compared
+    // with the one before
+    if (device.Announced != 0) {
+        if (device.Round != device.Announced) {
+            device.Unchanged = false;
+        } else if (!device.Unchanged) {
+            // Said once, a flapping device repeats it on every connection
+            device.Unchanged = true;
+            DeviceChange change;
+            change.Kind = DeviceChangeKind::CodecSetUnchanged;
+            change.Address = address;
+            change.Codecs = CountCodecs(device.Round);
+            m_changes.push_back(change);
+        }
+        // The codecs added were written when they came
+        for (CodecSet gone = device.Announced & ~device.Round; gone != 0;
+             gone &= gone - 1) {
+            int bit = 0;
+            while ((gone >> bit & 1) == 0) {
+                bit++;
+            }
+            DeviceChange change;
+            change.Kind = DeviceChangeKind::CodecWithdrawn;
+            change.Address = address;
+            change.CodecName = bit < CODECS_COUNT
+                                   ? CODECS[bit].Name
+                                   : m_loadedCodecs[bit - CODECS_COUNT]->Name;
+            m_changes.push_back(change);
+        }
+    }
+    device.Announced = device.Round;
+    device.Round = 0;
+}
+
+bool Coalescer::Update(const A2dpEventData &eventData,
+                       A2dpFinding &finding) {
+    m_changes.clear();
+    if (finding.Kind != A2dpFindingKind::SupportedCodec &&
+        finding.Kind != A2dpFindingKind::SelectedCodec) {
+        return true;
+    }
+    const std::optional<ULONGLONG> address = EventDeviceAddress(eventData);
+    const CodecData *codec = FindCodec(eventData);
+    if (!address || codec == nullptr) {
+        return true;
+    }
+    Device &device = m_devices[*address];
+
+    if (finding.Kind == A2dpFindingKind::SupportedCodec) {
+        const int bit = CodecBit(codec);
+        if (bit < 0) {
+            return true; // no bit left, written every time
+        }
+        const CodecSet mask = (CodecSet)1 << bit;
+        const bool known = ((device.Announced | device.Round) & mask) != 0;
+        device.Round |= mask;
+        if (known) {
+            m_coalesced++;
+            return false;
+        }
+        return true;
+    }
+
+    // A selection ends the announcements of the connection. If it was
+    // reported in two events the second one finds no set to close.
+    if (device.Round != 0) {
+        CloseRound(*address, device);
+    }
+    const CodecData *previous = device.Selected;
+    device.Selected = codec;
+    if (previous == nullptr) {
+        return true;
+    }
+    if (previous != codec) {
+        DeviceChange change;
+        change.Kind = DeviceChangeKind::SelectedCodecChanged;
+        change.Address = *address;
+        change.CodecName = codec->Name;
+        change.PreviousCodecName = previous->Name;
+        m_changes.push_back(change);
+        finding = A2dpFinding();
+        return true;
+    }
+    m_coalesced++;
+    return false;
+}
@@ -0,0 +1,103 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "a2dp.h"
+#include "codec_registry.h"
+#include "platform.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// A headset sends its whole list of supported codecs on every connection,
+// and the selection often comes in two events (SetConfiguration_Cfm and
+// _Ind_2). A device that keeps reconnecting fills the output with the same
+// lines over and over. The coalescer remembers per device the codecs it
+// announced and the one selected, lets through only what is news and
+// reduces the rest to a summary line:
+//
+//   > Received supported codec: LDAC      a codec not announced before
+//   = Codec set unchanged: 7 codecs       the same list as last time, said
+//                                         once until the list changes
+//   - Codec no longer supported: aptX     announced last time, not now
+//   # Selected codec changed: AAC -> SBC  another codec was selected
+//
+// The codecs a device announces between two selections are one set. Sets
+// are compared as bitsets, a bit per codec, so comparing them and checking
+// whether a codec was announced before are single instructions. Unknown
+// codecs are errors and always let through, as are events without an
+// address.
+
+enum class DeviceChangeKind {
+    CodecSetUnchanged,    // the device announced the same codecs again
+    CodecWithdrawn,       // a codec of the last set was not announced
+    SelectedCodecChanged, // the selection moved to another codec
+};
+
+const WCHAR *DeviceChangeKindToString(DeviceChangeKind kind);
+
+struct DeviceChange {
+    DeviceChangeKind Kind = DeviceChangeKind::CodecSetUnchanged;
+    ULONGLONG Address = 0;
+    const WCHAR *CodecName = nullptr;         // Withdrawn, SelectedChanged
+    const WCHAR *PreviousCodecName = nullptr; // SelectedCodecChanged
+    int Codecs = 0;                           // CodecSetUnchanged
+};
+
+// Used by the writer thread only
+class Coalescer {
+  public:
+    // Looks at what the analysis found in the event. Returns false if the
+    // event only repeats what was already written and can be left out.
+    // Either way Changes() then holds what the event shows that its own
+    // finding does not, to be written before it; a selection of another
+    // codec is such a change and the finding is cleared so it is not
+    // written twice.
+    bool Update(const A2dpEventData &eventData, A2dpFinding &finding);
+
+    const std::vector<DeviceChange> &Changes() const { return m_changes; }
+
+    // Events left out
+    ULONGLONG Coalesced() const { return m_coalesced; }
+
+  private:
+    typedef uint64_t CodecSet;
+
+    struct Device {
+        CodecSet Announced = 0; // the last complete set
+        CodecSet Round = 0;     // announced since the last selection
+        const CodecData *Selected = nullptr;
+        bool Unchanged = false; // CodecSetUnchanged written for Announced
+    };
+
+    // Returns the bit of the codec, -1 once all of them are taken
+    int CodecBit(const CodecData *codec);
+    void CloseRound(ULONGLONG address, Device &device);
+
+    std::unordered_map<ULONGLONG, Device> m_devices;
+    // Codecs loaded from codec files, their bits follow those of CODECS
+    std::vector<const CodecData *> m_loadedCodecs;
+    std::vector<DeviceChange> m_changes;
+    ULONGLONG m_coalesced = 0;
+};
@@ -0,0 +1,169 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "codec_registry.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+CodecRegistry codecRegistry;
+
+namespace {
+
+// Removes spaces and tabs from both ends
+std::string Trim(const std::string &text) {
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return std::string();
+    }
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+// Parses a hex number that must fit into max
+bool ParseHex(const std::string &text, ULONGLONG max, ULONGLONG &value) {
+    if (text.empty()) {
+        return false;
+    }
+    char *end = nullptr;
+    value = strtoull(text.c_str(), &end, 16);
+    return *end == 0 && value <= max;
+}
+
+// Parses "-" or flag names joined with "+"
+bool ParseFlags(const std::string &text, ULONG &flags) {
+    flags = CODEC_FLAG_RUNTIME;
+    if (text == "-") {
+        return true;
+    }
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = text.find('+', begin);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string name = text.substr(begin, end - begin);
+        if (name == "standard") {
+            flags |= CODEC_FLAG_STANDARD;
+        } else if (name == "vendor") {
+            flags |= CODEC_FLAG_VENDOR;
+        } else if (name == "hires") {
+            flags |= CODEC_FLAG_HIGH_RES;
+        } else if (name == "lowlatency") {
+            flags |= CODEC_FLAG_LOW_LATENCY;
+        } else {
+            return false;
+        }
+        begin = end + 1;
+    }
+    return true;
+}
+
+} // namespace
+
+const CodecData *CodecRegistry::Find(ULONGLONG key) const {
+    if (!m_runtime.empty()) {
+        auto it = m_runtime.find(key);
+        if (it != m_runtime.end()) {
+            return it->second;
+        }
+    }
+
+    for (ULONG slot = CodecKeySlot(key);; slot = (slot + 1) &
+                                              (CODEC_TABLE_SLOTS - 1)) {
+        int index = CODEC_TABLE.Index[slot];
+        if (index < 0) {
+            return nullptr;
+        }
+        if (CODEC_TABLE.Keys[slot] == key) {
+            return &CODECS[index];
+        }
+    }
+}
+
+void CodecRegistry::Add(BYTE standardCodecId, DWORD vendorId,
+                        WORD vendorCodecId, const std::wstring &name,
+                        const std::wstring &vendor, ULONG flags) {
+    m_strings.push_back(name);
+    const WCHAR *namePtr = m_strings.back().c_str();
+    m_strings.push_back(vendor);
+    const WCHAR *vendorPtr = m_strings.back().c_str();
+
+    m_codecs.push_back(CodecData{standardCodecId, vendorId, vendorCodecId,
+                                 namePtr, vendorPtr, flags});
+    m_runtime[PackCodecKey(m_codecs.back())] = &m_codecs.back();
+}
+
+int CodecRegistry::LoadFile(const char *path, int &badLine) {
+    badLine = 0;
+    std::ifstream file(path);
+    if (!file) {
+        return -1;
+    }
+
+    int loaded = 0;
+    int lineNumber = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = Trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        // Split to 6 fields, the name is the rest of the line and may
+        // have commas of its own
+        std::vector<std::string> fields;
+        size_t begin = 0;
+        while (fields.size() < 5) {
+            size_t comma = line.find(',', begin);
+            if (comma == std::string::npos) {
+                break;
+            }
+            fields.push_back(Trim(line.substr(begin, comma - begin)));
+            begin = comma + 1;
+        }
+        fields.push_back(Trim(line.substr(begin)));
+
+        ULONGLONG standardCodecId = 0;
+        ULONGLONG vendorId = 0;
+        ULONGLONG vendorCodecId = 0;
+        ULONG flags = 0;
+        if (fields.size() != 6 || fields[5].empty() ||
+            !ParseHex(fields[0], 0xFF, standardCodecId) ||
+            !ParseHex(fields[1], 0xFFFFFFFF, vendorId) ||
+            !ParseHex(fields[2], 0xFFFF, vendorCodecId) ||
+            !ParseFlags(fields[3], flags)) {
+            badLine = lineNumber;
+            return -1;
+        }
+
+        // Names are ASCII, so widening byte by byte is enough
+        std::wstring vendor(fields[4].begin(), fields[4].end());
+        std::wstring name(fields[5].begin(), fields[5].end());
+        Add((BYTE)standardCodecId, (DWORD)vendorId, (WORD)vendorCodecId, name,
+            vendor, flags);
+        loaded++;
+    }
+    return loaded;
+}
@@ -0,0 +1,187 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "platform.h"
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+// Codec flags
+const ULONG CODEC_FLAG_STANDARD = 0x1;  // defined by the Bluetooth SIG
+const ULONG CODEC_FLAG_VENDOR = 0x2;    // vendor specific (id 0xFF)
+const ULONG CODEC_FLAG_HIGH_RES = 0x4;  // high resolution audio
+const ULONG CODEC_FLAG_LOW_LATENCY = 0x8;
+const ULONG CODEC_FLAG_RUNTIME = 0x10;  // loaded from a codec file
+
+// A2dpStandardCodecId of vendor specific codecs. Only for them the vendor
+// id and the vendor codec id mean something.
+const BYTE A2DP_VENDOR_CODEC_ID = 0xFF;
+
+struct CodecData {
+    const BYTE A2dpStandardCodecId;
+    const DWORD A2dpVendorId;
+    const WORD A2dpVendorCodecId;
+    const WCHAR *Name;
+    const WCHAR *Vendor;
+    const ULONG Flags;
+};
+
+inline constexpr CodecData CODECS[] = {
+    {0x0, 0x0, 0x0, L"SBC", L"Bluetooth SIG", CODEC_FLAG_STANDARD},
+    {0x01, 0x0, 0x0, L"MPEG-1,2 (aka MP3)", L"Bluetooth SIG",
+     CODEC_FLAG_STANDARD},
+    {0x02, 0x0, 0x0, L"MPEG-2,4 (aka AAC)", L"Bluetooth SIG",
+     CODEC_FLAG_STANDARD},
+    {0x03, 0x0, 0x0, L"ATRAC", L"Bluetooth SIG", CODEC_FLAG_STANDARD},
+    {0xFF, 0x004F, 0x01, L"aptX", L"APT", CODEC_FLAG_VENDOR},
+    {0xFF, 0x00D7, 0x24, L"aptX HD", L"Qualcomm",
+     CODEC_FLAG_VENDOR | CODEC_FLAG_HIGH_RES},
+    {0xFF, 0x000A, 0x02, L"aptX Low Latency", L"CSR",
+     CODEC_FLAG_VENDOR | CODEC_FLAG_LOW_LATENCY},
+    {0xFF, 0x00D7, 0x02, L"aptX Low Latency", L"Qualcomm",
+     CODEC_FLAG_VENDOR | CODEC_FLAG_LOW_LATENCY},
+    {0xFF, 0x000A, 0x01, L"FastStream", L"CSR",
+     CODEC_FLAG_VENDOR | CODEC_FLAG_LOW_LATENCY},
+    {0xFF, 0x012D, 0xAA, L"LDAC", L"Sony",
+     CODEC_FLAG_VENDOR | CODEC_FLAG_HIGH_RES},
+    {0xFF, 0x0075, 0x0102, L"Samsung HD", L"Samsung", CODEC_FLAG_VENDOR},
+    {0xFF, 0x0075, 0x0103, L"Samsung Scalable Codec", L"Samsung",
+     CODEC_FLAG_VENDOR},
+    {0xFF, 0x053A, 0x484C, L"Savitech LHDC", L"Savitech",
+     CODEC_FLAG_VENDOR | CODEC_FLAG_HIGH_RES},
+    {0xFF, 0x000A, 0x0103, L"Qualcomm specific aptX version", L"CSR",
+     CODEC_FLAG_VENDOR},
+    {0xFF, 0x000A, 0x0104, L"The CSR True Wireless Stereo v3 Codec ID for AAC",
+     L"CSR", CODEC_FLAG_VENDOR},
+    {0xFF, 0x000A, 0x0105, L"The CSR True Wireless Stereo v3 Codec ID for MP3",
+     L"CSR", CODEC_FLAG_VENDOR},
+    {0xFF, 0x000A, 0x0106,
+     L"The CSR True Wireless Stereo v3 Codec ID for aptX", L"CSR",
+     CODEC_FLAG_VENDOR}};
+
+const int CODECS_COUNT = sizeof(CODECS) / sizeof(CODECS[0]);
+
+// Packs the three codec ids into one key. For codecs that are not vendor
+// specific the vendor fields are ignored, whatever they hold.
+constexpr ULONGLONG PackCodecKey(BYTE standardCodecId, DWORD vendorId,
+                                 WORD vendorCodecId) {
+    if (standardCodecId != A2DP_VENDOR_CODEC_ID) {
+        return (ULONGLONG)standardCodecId << 48;
+    }
+    return (ULONGLONG)standardCodecId << 48 | (ULONGLONG)vendorId << 16 |
+           vendorCodecId;
+}
+
+constexpr ULONGLONG PackCodecKey(const CodecData &codec) {
+    return PackCodecKey(codec.A2dpStandardCodecId, codec.A2dpVendorId,
+                        codec.A2dpVendorCodecId);
+}
+
+// Hash table of CODECS built at compile time. Open addressing with linear
+// probing, a lookup usually touches a single slot.
+
+const ULONG CODEC_TABLE_SLOTS = 64; // power of two, well above CODECS_COUNT
+static_assert(CODEC_TABLE_SLOTS >= 2 * CODECS_COUNT,
+              "grow CODEC_TABLE_SLOTS, the table is too dense");
+
+// Mixes the bits of the key (the finalizer of MurmurHash3)
+constexpr ULONG CodecKeySlot(ULONGLONG key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (ULONG)key & (CODEC_TABLE_SLOTS - 1);
+}
+
+struct CodecTable {
+    ULONGLONG Keys[CODEC_TABLE_SLOTS] = {};
+    signed char Index[CODEC_TABLE_SLOTS] = {}; // index in CODECS or -1
+};
+
+constexpr CodecTable BuildCodecTable() {
+    CodecTable table;
+    for (auto &index : table.Index) {
+        index = -1;
+    }
+    for (int i = 0; i < CODECS_COUNT; i++) {
+        const ULONGLONG key = PackCodecKey(CODECS[i]);
+        ULONG slot = CodecKeySlot(key);
+        while (table.Index[slot] != -1) {
+            if (table.Keys[slot] == key) {
+                // Two CODECS entries with the same ids, fails the build
+                throw "duplicate codec in CODECS";
+            }
+            slot = (slot + 1) & (CODEC_TABLE_SLOTS - 1);
+        }
+        table.Keys[slot] = key;
+        table.Index[slot] = (signed char)i;
+    }
+    return table;
+}
+
+inline constexpr CodecTable CODEC_TABLE = BuildCodecTable();
+
+// The built in codecs plus the ones loaded from codec files at run time.
+// Loading is not thread safe, do it before events start to flow.
+class CodecRegistry {
+  public:
+    // Returns the codec or nullptr if it is not known. Codecs loaded at run
+    // time take precedence, so a codec file can also rename a built in one.
+    const CodecData *Find(ULONGLONG key) const;
+
+    const CodecData *Find(BYTE standardCodecId, DWORD vendorId,
+                          WORD vendorCodecId) const {
+        return Find(PackCodecKey(standardCodecId, vendorId, vendorCodecId));
+    }
+
+    // Adds or replaces a codec
+    void Add(BYTE standardCodecId, DWORD vendorId, WORD vendorCodecId,
+             const std::wstring &name, const std::wstring &vendor,
+             ULONG flags);
+
+    // Loads codec definitions from a text file. Each line, besides empty
+    // ones and # comments, describes one codec:
+    //
+    //   <standard id>, <vendor id>, <vendor codec id>, <flags>, <vendor>, <name>
+    //
+    // Ids are hex. Flags are "-" or names joined with "+" (standard, vendor,
+    // hires, lowlatency). Names are ASCII. For example:
+    //
+    //   FF, 053A, 4C35, vendor+hires, Savitech, LHDC V5
+    //
+    // Returns the number of codecs loaded, or -1 if the file can not be
+    // read or a line is malformed; badLine is then set to the line number
+    // (0 when the file can not be opened).
+    int LoadFile(const char *path, int &badLine);
+
+  private:
+    // deques, as adding to them does not move what is already there, so
+    // the codecs can point to the strings and the map to the codecs
+    std::deque<std::wstring> m_strings;
+    std::deque<CodecData> m_codecs;
+    std::unordered_map<ULONGLONG, const CodecData *> m_runtime;
+};
+
+// Registry used by the analysis
+extern CodecRegistry codecRegistry;
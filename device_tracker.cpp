@@ -0,0 +1,275 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "device_tracker.h"
+
+#include <cwchar>
+#include <stdio.h>
+
+namespace {
+
+// Marks used slots, so address 0 is a valid key
+const ULONGLONG KEY_USED = 1ULL << 63;
+
+// Mixes the bits of the key (the finalizer of MurmurHash3)
+inline ULONGLONG MixKey(ULONGLONG key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+void AddCodec(DeviceState &device, const CodecData *codec) {
+    for (int i = 0; i < device.CodecCount; i++) {
+        if (device.Codecs[i] == codec) {
+            return; // advertised again, on every reconnect
+        }
+    }
+    if (device.CodecCount == DEVICE_MAX_CODECS) {
+        device.OtherCodecs++;
+        return;
+    }
+    device.Codecs[device.CodecCount++] = codec;
+}
+
+void AddUnknownCodec(DeviceState &device, const A2dpEventData &eventData) {
+    const ULONGLONG key = PackCodecKey(
+        eventData.a2dpStandardCodecId.value_or(0),
+        eventData.a2dpVendorId.value_or(0),
+        eventData.a2dpVendorCodecId.value_or(0));
+    for (int i = 0; i < device.UnknownCodecCount; i++) {
+        if (device.UnknownCodecs[i] == key) {
+            return;
+        }
+    }
+    if (device.UnknownCodecCount == DEVICE_MAX_CODECS) {
+        device.OtherCodecs++;
+        return;
+    }
+    device.UnknownCodecs[device.UnknownCodecCount++] = key;
+}
+
+// Moves the stream along the AVDTP state machine
+void ApplyActivity(DeviceState &device, DWORD activity) {
+    switch (activity) {
+    case AvdtpActivity::Connect_Cfm:
+    case AvdtpActivity::Connect_Ind:
+        device.Connected = true;
+        break;
+    case AvdtpActivity::Disconnect_Cfm:
+    case AvdtpActivity::Disconnect_Ind:
+        device.Connected = false;
+        device.State = StreamState::Idle;
+        break;
+    case AvdtpActivity::SetConfiguration_Cfm:
+    case AvdtpActivity::SetConfiguration_Ind_1:
+    case AvdtpActivity::SetConfiguration_Ind_2:
+        device.State = StreamState::Configured;
+        break;
+    case AvdtpActivity::Open_Cfm:
+    case AvdtpActivity::Open_Ind:
+    case AvdtpActivity::Suspend_Cfm:
+    case AvdtpActivity::Suspend_Ind:
+        device.State = StreamState::Open;
+        break;
+    case AvdtpActivity::Start_Cfm:
+    case AvdtpActivity::Start_Ind:
+        device.State = StreamState::Streaming;
+        break;
+    case AvdtpActivity::Close_Cfm:
+    case AvdtpActivity::Close_Ind:
+    case AvdtpActivity::Abort_Cfm:
+    case AvdtpActivity::Abort_Ind:
+        device.State = StreamState::Idle;
+        break;
+    default:
+        break;
+    }
+}
+
+} // namespace
+
+const WCHAR *StreamStateToString(StreamState state) {
+    switch (state) {
+    case StreamState::Idle:
+        return L"idle";
+    case StreamState::Configured:
+        return L"configured";
+    case StreamState::Open:
+        return L"open";
+    case StreamState::Streaming:
+        return L"streaming";
+    default:
+        return L"unknown";
+    }
+}
+
+std::optional<ULONGLONG> EventDeviceAddress(const A2dpEventData &eventData) {
+    // The codec selection names the device in BTDeviceAddressRemote
+    if (eventData.BTDeviceAddress) {
+        return *eventData.BTDeviceAddress & BT_ADDRESS_MASK;
+    }
+    if (eventData.BTDeviceAddressRemote) {
+        return *eventData.BTDeviceAddressRemote & BT_ADDRESS_MASK;
+    }
+    return std::nullopt;
+}
+
+DeviceTracker::DeviceTracker(size_t expectedDevices) {
+    // At most half full, so probes stay short
+    size_t capacity = 16;
+    while (capacity < expectedDevices * 2) {
+        capacity *= 2;
+    }
+    m_keys.resize(capacity);
+    m_devices.resize(capacity);
+}
+
+size_t DeviceTracker::Slot(ULONGLONG key) const {
+    return (size_t)MixKey(key) & (m_keys.size() - 1);
+}
+
+const DeviceState *DeviceTracker::Find(ULONGLONG address) const {
+    const ULONGLONG key = (address & BT_ADDRESS_MASK) | KEY_USED;
+    for (size_t slot = Slot(key); m_keys[slot] != 0;
+         slot = (slot + 1) & (m_keys.size() - 1)) {
+        if (m_keys[slot] == key) {
+            return &m_devices[slot];
+        }
+    }
+    return nullptr;
+}
+
+DeviceState &DeviceTracker::FindOrAdd(ULONGLONG address) {
+    const ULONGLONG key = address | KEY_USED;
+    size_t slot = Slot(key);
+    for (; m_keys[slot] != 0; slot = (slot + 1) & (m_keys.size() - 1)) {
+        if (m_keys[slot] == key) {
+            return m_devices[slot];
+        }
+    }
+
+    if ((m_size + 1) * 2 > m_keys.size()) {
+        Grow();
+        return FindOrAdd(address);
+    }
+    m_keys[slot] = key;
+    m_devices[slot] = DeviceState();
+    m_devices[slot].Address = address;
+    m_size++;
+    return m_devices[slot];
+}
+
+void DeviceTracker::Grow() {
+    std::vector<ULONGLONG> keys(m_keys.size() * 2);
+    std::vector<DeviceState> devices(keys.size());
+    keys.swap(m_keys);
+    devices.swap(m_devices);
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (keys[i] == 0) {
+            continue;
+        }
+        size_t slot = Slot(keys[i]);
+        while (m_keys[slot] != 0) {
+            slot = (slot + 1) & (m_keys.size() - 1);
+        }
+        m_keys[slot] = keys[i];
+        m_devices[slot] = devices[i];
+    }
+}
+
+const DeviceState *DeviceTracker::Update(const A2dpEventData &eventData,
+                                         const A2dpFinding &finding) {
+    std::optional<ULONGLONG> address = EventDeviceAddress(eventData);
+    if (!address) {
+        return nullptr;
+    }
+    DeviceState &device = FindOrAdd(*address);
+    device.Events++;
+
+    if (finding.Selected) {
+        device.SelectedCodec = finding.Codec;
+        device.AcceptorSepId = eventData.AcceptorStreamEndPointID;
+        device.InitiatorSepId = eventData.InitiatorStreamEndPointID;
+    } else if (finding.Codec != nullptr) {
+        AddCodec(device, finding.Codec);
+    } else if (finding.Kind == A2dpFindingKind::UnknownCodec) {
+        AddUnknownCodec(device, eventData);
+    }
+
+    if (eventData.AvdtpActivity) {
+        device.LastActivity = eventData.AvdtpActivity;
+        ApplyActivity(device, *eventData.AvdtpActivity);
+    }
+    if (eventData.A2dpIsConnected) {
+        device.Connected = *eventData.A2dpIsConnected != 0;
+    }
+    if (eventData.A2dpIsStreaming) {
+        device.Streaming = *eventData.A2dpIsStreaming != 0;
+    }
+    if (eventData.TransitionToState) {
+        device.DriverState = eventData.TransitionToState;
+    }
+    if (eventData.L2capChannelHandleSessionId) {
+        device.L2capSessionId = eventData.L2capChannelHandleSessionId;
+    }
+    // Pin events name it SampleRate, which is PinSampleRate here, others
+    // "Sample Rate"
+    if (eventData.PinSampleRate) {
+        device.SampleRate = eventData.PinSampleRate;
+    } else if (eventData.SampleRate) {
+        device.SampleRate = eventData.SampleRate;
+    }
+    if (eventData.ChannelCount) {
+        device.ChannelCount = eventData.ChannelCount;
+    }
+    return &device;
+}
+
+void PrintDeviceState(const DeviceState &device) {
+    wprintf(L"Device %012llX: %ls", (unsigned long long)device.Address,
+            StreamStateToString(device.State));
+    if (device.Connected && !*device.Connected) {
+        wprintf(L", disconnected");
+    }
+    if (device.SelectedCodec != nullptr) {
+        wprintf(L", codec %ls", device.SelectedCodec->Name);
+    }
+    if (device.AcceptorSepId && device.InitiatorSepId) {
+        wprintf(L", SEP %u/%u", (unsigned)*device.AcceptorSepId,
+                (unsigned)*device.InitiatorSepId);
+    }
+    if (device.SampleRate) {
+        wprintf(L", %lu Hz", (unsigned long)*device.SampleRate);
+    }
+    if (device.ChannelCount) {
+        wprintf(L", %lu channels", (unsigned long)*device.ChannelCount);
+    }
+    wprintf(L", %d codecs advertised", device.AdvertisedCodecs());
+    if (device.LastActivity) {
+        wprintf(L", last activity %ls",
+                AvdtpActivityToString((AvdtpActivity)*device.LastActivity));
+    }
+    wprintf(L", %llu events\n", (unsigned long long)device.Events);
+}
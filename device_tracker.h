@@ -0,0 +1,142 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "a2dp.h"
+#include "codec_registry.h"
+#include "platform.h"
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+// Follows every device through its events. ProcessEventData looks at one
+// event at a time, the tracker remembers per device what it advertised,
+// what was selected and where its stream is.
+
+// Only the lower 48 bits of BTDeviceAddress are the address
+const ULONGLONG BT_ADDRESS_MASK = 0xFFFFFFFFFFFFULL;
+
+// AVDTP stream states, moved along by the AvdtpActivity of the events
+enum class StreamState : BYTE {
+    Idle,
+    Configured,
+    Open,
+    Streaming,
+};
+
+const WCHAR *StreamStateToString(StreamState state);
+
+// Advertised codecs kept per device, a headset advertises a handful
+const int DEVICE_MAX_CODECS = 16;
+
+struct DeviceState {
+    ULONGLONG Address = 0;
+    ULONGLONG Events = 0;
+
+    // Advertised codecs, each once. Codecs the registry does not know are
+    // kept by their ids (PackCodecKey), as they are announced again on
+    // every reconnect too. The ones beyond DEVICE_MAX_CODECS are only
+    // counted.
+    const CodecData *Codecs[DEVICE_MAX_CODECS] = {};
+    int CodecCount = 0;
+    ULONGLONG UnknownCodecs[DEVICE_MAX_CODECS] = {};
+    int UnknownCodecCount = 0;
+    int OtherCodecs = 0;
+
+    const CodecData *SelectedCodec = nullptr;
+    std::optional<BYTE> AcceptorSepId;
+    std::optional<BYTE> InitiatorSepId;
+
+    StreamState State = StreamState::Idle;
+    std::optional<bool> Connected;
+    std::optional<bool> Streaming; // as A2dpIsStreaming says
+    std::optional<DWORD> LastActivity;
+    std::optional<BYTE> DriverState; // TransitionToState, meaning unknown
+    std::optional<ULONGLONG> L2capSessionId;
+    // Of the audio pin, as the driver last reported it
+    std::optional<DWORD> SampleRate;
+    std::optional<DWORD> ChannelCount;
+
+    int AdvertisedCodecs() const {
+        return CodecCount + UnknownCodecCount + OtherCodecs;
+    }
+};
+
+// Returns the address the event is about, from BTDeviceAddress or
+// BTDeviceAddressRemote
+std::optional<ULONGLONG> EventDeviceAddress(const A2dpEventData &eventData);
+
+// The fields DeviceTracker::Update looks at
+const A2dpFieldMask DEVICE_TRACKER_FIELDS =
+    A2DP_ANALYSIS_FIELDS | FieldBit(A2dpField::BTDeviceAddress) |
+    FieldBit(A2dpField::BTDeviceAddressRemote) |
+    FieldBit(A2dpField::A2dpIsConnected) |
+    FieldBit(A2dpField::A2dpIsStreaming) |
+    FieldBit(A2dpField::TransitionToState) |
+    FieldBit(A2dpField::L2capChannelHandleSessionId) |
+    FieldBit(A2dpField::SampleRate) | FieldBit(A2dpField::PinSampleRate) |
+    FieldBit(A2dpField::ChannelCount);
+
+// The devices, in a flat open addressing hash table keyed by address. An
+// update is one probe into an array of keys, which stays fast with
+// thousands of devices.
+class DeviceTracker {
+  public:
+    explicit DeviceTracker(size_t expectedDevices = 64);
+
+    // Moves the state of the device the event is about. finding is what
+    // AnalyzeEventData found in the event. Returns the device, or nullptr
+    // if the event has no address.
+    const DeviceState *Update(const A2dpEventData &eventData,
+                              const A2dpFinding &finding);
+
+    // Returns the device or nullptr if it was never seen
+    const DeviceState *Find(ULONGLONG address) const;
+
+    size_t Size() const { return m_size; }
+
+    // Calls fn(const DeviceState &) for every device, in no particular order
+    template <typename Fn> void ForEach(Fn &&fn) const {
+        for (size_t i = 0; i < m_keys.size(); i++) {
+            if (m_keys[i] != 0) {
+                fn(m_devices[i]);
+            }
+        }
+    }
+
+  private:
+    size_t Slot(ULONGLONG key) const;
+    DeviceState &FindOrAdd(ULONGLONG address);
+    void Grow();
+
+    // Keys are kept apart from the devices so probing touches only them.
+    // A key is the address with KEY_USED set, 0 is an empty slot.
+    std::vector<ULONGLONG> m_keys;
+    std::vector<DeviceState> m_devices;
+    size_t m_size = 0;
+};
+
+// Prints one line about the device
+void PrintDeviceState(const DeviceState &device);
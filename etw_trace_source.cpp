@@ -0,0 +1,256 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "etw_trace_source.h"
+
+#ifdef _WIN32
+#include "latency_histogram.h"
+#include "providers.h"
+
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <cwchar>
+#include <stdio.h>
+
+namespace {
+
+// Measures a variable sized property with TDH. Only used for properties
+// whose size can not be known from the schema.
+ULONG TdhMeasureProperty(const EVENT_RECORD &event,
+                         const PropertyLayout &property, ULONG offset,
+                         ULONG &size) {
+    PROPERTY_DATA_DESCRIPTOR descriptor;
+    descriptor.PropertyName = (ULONGLONG)property.Name.c_str();
+    descriptor.ArrayIndex = ULONG_MAX; // the whole property, not an element
+    descriptor.Reserved = 0;
+    return TdhGetPropertySize((PEVENT_RECORD)&event, 0, NULL, 1, &descriptor,
+                              &size);
+}
+
+// Without PROCESS_TRACE_MODE_RAW_TIMESTAMP, ETW converts the timestamps of
+// a file to system time, in 100 ns units
+const LONGLONG FILETIME_FREQUENCY = 10000000;
+
+} // namespace
+
+MeasurePropertyFn EtwTraceSource::Measure() const {
+    return TdhMeasureProperty;
+}
+
+bool EtwTraceSource::OpenSession(const WCHAR *sessionName,
+                                 const std::vector<USHORT> &eventIds) {
+    m_live = true;
+    m_sessionName = sessionName;
+
+    // The session uses QPC timestamps, see ClientContext below
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    m_frequency = frequency.QuadPart;
+
+    // The properties and the name after them, 8 byte aligned
+    const size_t bufferSize = sizeof(EVENT_TRACE_PROPERTIES) +
+                              (m_sessionName.size() + 1) * sizeof(WCHAR);
+    m_properties.assign((bufferSize + 7) / 8, 0);
+    EVENT_TRACE_PROPERTIES *properties =
+        (EVENT_TRACE_PROPERTIES *)m_properties.data();
+    properties->Wnode.BufferSize = (ULONG)bufferSize;
+    properties->Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+    properties->Wnode.ClientContext = 1; // Use QPC for timestamp
+    properties->Wnode.Guid = BTHA2DP_PROVIDER;
+    properties->LogFileMode = EVENT_TRACE_REAL_TIME_MODE;
+    properties->FlushTimer = 1; // seconds
+    properties->LoggerNameOffset = sizeof(EVENT_TRACE_PROPERTIES);
+
+    // Start the trace session
+    TRACEHANDLE session = 0;
+    ULONG status = StartTraceW(&session, sessionName, properties);
+    // If the session already exists, attach to it
+    if (status == ERROR_ALREADY_EXISTS) {
+        wprintf(L"Attaching to existing session...\n");
+        // Query the existing session to get its handle
+        status = ControlTraceW(0, sessionName, properties,
+                               EVENT_TRACE_CONTROL_QUERY);
+        if (status != ERROR_SUCCESS) {
+            wprintf(L"ControlTrace failed with %lu\n", status);
+            return false;
+        }
+        session = properties->Wnode.HistoricalContext;
+    } else if (status != ERROR_SUCCESS) {
+        wprintf(L"StartTrace failed with %lu\n", status);
+        return false;
+    }
+    m_session.store(session);
+
+    // When only some event ids are wanted, ETW is asked to drop the others
+    // before they are even delivered
+    std::vector<BYTE> eventIdFilter;
+    EVENT_FILTER_DESCRIPTOR filterDescriptor = {};
+    ENABLE_TRACE_PARAMETERS enableParameters = {};
+    if (!eventIds.empty() &&
+        eventIds.size() <= MAX_EVENT_FILTER_EVENT_ID_COUNT) {
+        eventIdFilter.resize(offsetof(EVENT_FILTER_EVENT_ID, Events) +
+                             eventIds.size() * sizeof(USHORT));
+        EVENT_FILTER_EVENT_ID *filter =
+            (EVENT_FILTER_EVENT_ID *)eventIdFilter.data();
+        filter->FilterIn = TRUE;
+        filter->Reserved = 0;
+        filter->Count = (USHORT)eventIds.size();
+        memcpy(filter->Events, eventIds.data(),
+               eventIds.size() * sizeof(USHORT));
+        filterDescriptor.Ptr = (ULONGLONG)(ULONG_PTR)eventIdFilter.data();
+        filterDescriptor.Size = (ULONG)eventIdFilter.size();
+        filterDescriptor.Type = EVENT_FILTER_TYPE_EVENT_ID;
+        enableParameters.Version = ENABLE_TRACE_PARAMETERS_VERSION_2;
+        enableParameters.EnableFilterDesc = &filterDescriptor;
+        enableParameters.FilterDescCount = 1;
+    }
+
+    // Enable the providers for the session
+    for (const Provider &provider : providers.All()) {
+        status = ERROR_NOT_SUPPORTED;
+        if (enableParameters.FilterDescCount > 0) {
+            status = EnableTraceEx2(session, &provider.Id,
+                                    EVENT_CONTROL_CODE_ENABLE_PROVIDER,
+                                    provider.Level, provider.Keywords, 0, 0,
+                                    &enableParameters);
+        }
+        if (status != ERROR_SUCCESS) {
+            // No filter, or the system did not take it. The events are
+            // still filtered when they arrive.
+            status = EnableTraceEx2(session, &provider.Id,
+                                    EVENT_CONTROL_CODE_ENABLE_PROVIDER,
+                                    provider.Level, provider.Keywords, 0, 0,
+                                    NULL);
+        }
+        if (status != ERROR_SUCCESS) {
+            wprintf(L"EnableTraceEx2 failed with %lu for %ls\n", status,
+                    provider.Name.c_str());
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool EtwTraceSource::OpenFile(const WCHAR *path) {
+    m_live = false;
+    m_path = path;
+    m_frequency = FILETIME_FREQUENCY;
+    // OpenTraceW checks the file, in Run()
+    return GetFileAttributesW(path) != INVALID_FILE_ATTRIBUTES;
+}
+
+void WINAPI EtwTraceSource::OnEvent(PEVENT_RECORD event) {
+    EtwTraceSource &source = *(EtwTraceSource *)event->UserContext;
+
+    // How long ETW took to hand the event over, both clocks are QPC
+    if (source.m_live) {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        LONGLONG ticks = now.QuadPart - event->EventHeader.TimeStamp.QuadPart;
+        if (ticks > 0) {
+            stageLatencies.Delivery.Record((ULONGLONG)(
+                (double)ticks * 1e9 / (double)source.m_frequency));
+        }
+    }
+
+    // Get the list of properties of the event, TDH is only asked the
+    // first time an event with this schema is seen
+    ULONG status = ERROR_SUCCESS;
+    const EventSchema *schema = source.m_schemas.Lookup(*event, &status);
+    if (schema == nullptr) {
+        wprintf(L"TdhGetEventInformation failed with %lu\n", status);
+        return;
+    }
+
+    source.m_batch.Add(*event, *schema, true);
+    source.m_events++;
+    if (source.m_batch.Full()) {
+        source.m_batch.Deliver(source.m_onBatch);
+    }
+}
+
+ULONG WINAPI EtwTraceSource::OnBuffer(PEVENT_TRACE_LOGFILEW logFile) {
+    // A real time buffer comes once a second when few events flow, what
+    // it brought is not held longer than that
+    EtwTraceSource &source = *(EtwTraceSource *)logFile->Context;
+    source.m_batch.Deliver(source.m_onBatch);
+    return source.StopRequested() ? FALSE : TRUE;
+}
+
+bool EtwTraceSource::Run(TraceBatchFn onBatch) {
+    m_onBatch = onBatch;
+
+    EVENT_TRACE_LOGFILEW logFile = {0};
+    if (m_live) {
+        // Raw timestamps, so they stay in QPC ticks
+        logFile.LoggerName = (LPWSTR)m_sessionName.c_str();
+        logFile.ProcessTraceMode = PROCESS_TRACE_MODE_REAL_TIME |
+                                   PROCESS_TRACE_MODE_EVENT_RECORD |
+                                   PROCESS_TRACE_MODE_RAW_TIMESTAMP;
+    } else {
+        logFile.LogFileName = (LPWSTR)m_path.c_str();
+        logFile.ProcessTraceMode = PROCESS_TRACE_MODE_EVENT_RECORD;
+    }
+    logFile.EventRecordCallback = OnEvent;
+    logFile.BufferCallback = OnBuffer;
+    logFile.Context = this;
+
+    TRACEHANDLE trace = OpenTraceW(&logFile);
+    if (trace == INVALID_PROCESSTRACE_HANDLE) {
+        wprintf(L"OpenTrace failed with %lu\n", GetLastError());
+        return false;
+    }
+    m_trace.store(trace);
+    if (StopRequested()) {
+        Close(); // stopped while the trace was being opened
+        return true;
+    }
+
+    ULONG status = ProcessTrace(&trace, 1, 0, 0);
+    m_batch.Deliver(onBatch);
+    Close();
+    // Closing the trace while it is processed cancels it
+    return status == ERROR_SUCCESS || status == ERROR_CANCELLED;
+}
+
+void EtwTraceSource::Stop() {
+    TraceSource::Stop();
+    Close();
+}
+
+void EtwTraceSource::Close() {
+    // Stop the trace session if it was started
+    const TRACEHANDLE session = m_session.exchange(0);
+    if (session != 0) {
+        ControlTraceW(session, NULL,
+                      (EVENT_TRACE_PROPERTIES *)m_properties.data(),
+                      EVENT_TRACE_CONTROL_STOP);
+    }
+    // Close the trace handle if it was opened, ProcessTrace then returns
+    const TRACEHANDLE trace = m_trace.exchange(INVALID_PROCESSTRACE_HANDLE);
+    if (trace != INVALID_PROCESSTRACE_HANDLE) {
+        CloseTrace(trace);
+    }
+}
+#endif
@@ -0,0 +1,86 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "event_schema.h"
+#include "platform.h"
+#include "trace_source.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+// ETW events, from a real time session or from an ETL file a session wrote.
+// ETW calls back once per event with data that is only good during the
+// call, so the events are copied into a batch, which is handed over when it
+// is full and whenever ETW is done with a buffer of events.
+class EtwTraceSource : public TraceSource {
+  public:
+    EtwTraceSource() : m_schemas(m_tdh) {}
+    ~EtwTraceSource() override { Close(); }
+    EtwTraceSource(const EtwTraceSource &) = delete;
+    EtwTraceSource &operator=(const EtwTraceSource &) = delete;
+
+    // Starts the real time session, or attaches to it if it already runs,
+    // and enables the providers in it. When eventIds is not empty ETW is
+    // asked to only deliver those ids. Prints what failed and returns false
+    // if the session can not be set up.
+    bool OpenSession(const WCHAR *sessionName,
+                     const std::vector<USHORT> &eventIds);
+
+    // Reads the ETL file at path instead
+    bool OpenFile(const WCHAR *path);
+
+    // Schemas of the events are taken from TDH once and then reused
+    const SchemaCache &Schemas() const { return m_schemas; }
+
+    LONGLONG TimestampFrequency() const override { return m_frequency; }
+    bool Live() const override { return m_live; }
+    MeasurePropertyFn Measure() const override;
+    bool Run(TraceBatchFn onBatch) override;
+
+    // Stops the session and the processing, Run() then returns. Safe to
+    // call from the Ctrl+C handler.
+    void Stop() override;
+
+  private:
+    static void WINAPI OnEvent(PEVENT_RECORD event);
+    static ULONG WINAPI OnBuffer(PEVENT_TRACE_LOGFILEW logFile);
+    void Close();
+
+    WindowsTdhBackend m_tdh;
+    SchemaCache m_schemas;
+    std::wstring m_sessionName;
+    std::wstring m_path;
+    // EVENT_TRACE_PROPERTIES followed by the session name
+    std::vector<ULONGLONG> m_properties;
+    // Both are given up once, by whichever of Stop() and Close() comes first
+    std::atomic<TRACEHANDLE> m_session{0};
+    std::atomic<TRACEHANDLE> m_trace{INVALID_PROCESSTRACE_HANDLE};
+    LONGLONG m_frequency = 0;
+    bool m_live = false;
+    TraceBatch m_batch;
+    TraceBatchFn m_onBatch = nullptr;
+};
+#endif
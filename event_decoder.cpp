@@ -0,0 +1,65 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "event_decoder.h"
+
+ULONG MeasureStringProperty(const EVENT_RECORD &event,
+                            const PropertyLayout &property, ULONG offset,
+                            ULONG &size) {
+    const BYTE *data = (const BYTE *)event.UserData + offset;
+    const ULONG available = event.UserDataLength - offset;
+
+    // Strings in the event data are UTF-16 or ANSI, whatever the size of
+    // wchar_t on this platform is
+    ULONG unit = 0;
+    if (property.InType == TDH_INTYPE_UNICODESTRING) {
+        unit = 2;
+    } else if (property.InType == TDH_INTYPE_ANSISTRING) {
+        unit = 1;
+    } else {
+        return ERROR_INVALID_DATA;
+    }
+
+    // Look for the terminating null, it is part of the property
+    for (ULONG i = 0; i + unit <= available; i += unit) {
+        if (data[i] == 0 && (unit == 1 || data[i + 1] == 0)) {
+            size = i + unit;
+            return ERROR_SUCCESS;
+        }
+    }
+    return ERROR_INVALID_DATA;
+}
+
+bool DecodeEventData(const EVENT_RECORD &event, const EventSchema &schema,
+                     MeasurePropertyFn measure, A2dpEventData &eventData,
+                     A2dpFieldMask fields) {
+    return ForEachProperty(
+        event, schema, measure,
+        [&eventData, fields](const PropertyLayout &property, const BYTE *data,
+                             ULONG size) {
+            if (property.Field != A2dpField::Count &&
+                (fields & FieldBit(property.Field)) != 0) {
+                SetEventField(eventData, property.Field, data, size,
+                              InTypeSize(property.InType));
+            }
+        });
+}
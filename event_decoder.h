@@ -0,0 +1,91 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "a2dp.h"
+#include "event_schema.h"
+#include "platform.h"
+
+// Reads the properties of an event straight from its UserData, using the
+// layout from the schema cache. Properties are contiguous in UserData, so a
+// single walk with a cursor finds all of them without TDH and without
+// copying anything.
+
+// Measures a property whose size depends on the data (for example a
+// string). offset is where the property starts in UserData. Returns
+// ERROR_SUCCESS and stores the size, or returns a Win32 error code.
+typedef ULONG (*MeasurePropertyFn)(const EVENT_RECORD &event,
+                                   const PropertyLayout &property,
+                                   ULONG offset, ULONG &size);
+
+// Portable measurer that understands null terminated strings, the only
+// variable sized values BthA2dp is expected to log
+ULONG MeasureStringProperty(const EVENT_RECORD &event,
+                            const PropertyLayout &property, ULONG offset,
+                            ULONG &size);
+
+// Calls visit(property, data, size) for every top level property of the
+// event, in order. Variable sized properties are measured with measure.
+// Returns false if UserData is shorter than the schema says or a property
+// could not be measured; properties visited before that stay visited.
+template <typename Visitor>
+bool ForEachProperty(const EVENT_RECORD &event, const EventSchema &schema,
+                     MeasurePropertyFn measure, Visitor &&visit) {
+    const BYTE *data = (const BYTE *)event.UserData;
+    const ULONG length = event.UserDataLength;
+
+    // Fast path, every offset is known up front and one check covers all
+    if (schema.FixedDataSize != VARIABLE_LAYOUT) {
+        if (schema.FixedDataSize > length) {
+            return false;
+        }
+        for (const auto &property : schema.Properties) {
+            visit(property, data + property.Offset, property.Size);
+        }
+        return true;
+    }
+
+    ULONG offset = 0;
+    for (const auto &property : schema.Properties) {
+        ULONG size = property.Size;
+        if (size == VARIABLE_LAYOUT) {
+            if (measure == nullptr ||
+                measure(event, property, offset, size) != ERROR_SUCCESS) {
+                return false;
+            }
+        }
+        // offset never exceeds length, so this can not overflow
+        if (size > length - offset) {
+            return false;
+        }
+        visit(property, data + offset, size);
+        offset += size;
+    }
+    return true;
+}
+
+// Fills the given fields of eventData from the properties of the event.
+// Returns false if the event data does not match the schema.
+bool DecodeEventData(const EVENT_RECORD &event, const EventSchema &schema,
+                     MeasurePropertyFn measure, A2dpEventData &eventData,
+                     A2dpFieldMask fields = A2DP_ALL_FIELDS);
@@ -0,0 +1,62 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "a2dp.h"
+#include "event_schema.h"
+#include "platform.h"
+#include "providers.h"
+
+// An event as the receiving thread hands it to the writer thread: decoded
+// for the analysis, with the raw properties kept for traces. See
+// output_writer.h.
+
+// How much of the raw event a message keeps for traces. BthA2dp events are
+// far smaller.
+const ULONG EVENT_MESSAGE_PROPERTIES = 64;
+const ULONG EVENT_MESSAGE_DATA = 1024;
+
+struct EventMessage {
+    GUID ProviderId = {};
+    ProviderKind Kind = ProviderKind::A2dp;
+    LONGLONG Timestamp = 0;
+    UCHAR Processor = 0; // events of one processor arrive in order
+    USHORT EventId = 0;
+    ULONGLONG PublishedAt = 0; // NowNanoseconds(), set by Publish()
+    bool Decoded = false; // false if the data did not match the schema
+    A2dpEventData Data;
+    // The fields Data was decoded for, others are empty even if the event
+    // has them
+    A2dpFieldMask DecodedFields = A2DP_ALL_FIELDS;
+
+    // Raw properties, for traces. Schema is nullptr if the event has none
+    // (events imported from a log). The schema has to stay alive until the
+    // message is written, see OutputWriter::Flush(), and while the flight
+    // recorder may still hold it.
+    const EventSchema *Schema = nullptr;
+    USHORT PropertyCount = 0; // the first properties of the schema that fit
+    USHORT DataLength = 0;
+    USHORT PropertySizes[EVENT_MESSAGE_PROPERTIES];
+    BYTE UserData[EVENT_MESSAGE_DATA];
+};
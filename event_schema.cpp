@@ -0,0 +1,278 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "event_schema.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+// FNV-1a, good enough to tell a handful of metadata blobs apart
+ULONGLONG HashBytes(const BYTE *data, size_t size,
+                    ULONGLONG hash = 0xcbf29ce484222325ULL) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Returns the TraceLogging metadata attached to the event, if any
+const EVENT_HEADER_EXTENDED_DATA_ITEM *FindMetadata(const EVENT_RECORD &event) {
+    for (USHORT i = 0; i < event.ExtendedDataCount; i++) {
+        if (event.ExtendedData[i].ExtType ==
+            EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL) {
+            return &event.ExtendedData[i];
+        }
+    }
+    return nullptr;
+}
+
+// Builds the key of the event with its metadata, found already
+SchemaKey MakeKey(const EVENT_RECORD &event,
+                  const EVENT_HEADER_EXTENDED_DATA_ITEM *metadata) {
+    SchemaKey key = {};
+    key.ProviderId = event.EventHeader.ProviderId;
+    key.Id = event.EventHeader.EventDescriptor.Id;
+    key.Version = event.EventHeader.EventDescriptor.Version;
+    key.Opcode = event.EventHeader.EventDescriptor.Opcode;
+    if (metadata != nullptr) {
+        key.MetadataHash =
+            HashBytes((const BYTE *)(uintptr_t)metadata->DataPtr,
+                      metadata->DataSize);
+    }
+    return key;
+}
+
+// True if the key was made for an event with the same descriptor, whatever
+// its metadata
+bool SameDescriptor(const SchemaKey &key, const EVENT_RECORD &event) {
+    const EVENT_DESCRIPTOR &descriptor = event.EventHeader.EventDescriptor;
+    return key.Id == descriptor.Id && key.Version == descriptor.Version &&
+           key.Opcode == descriptor.Opcode &&
+           memcmp(&key.ProviderId, &event.EventHeader.ProviderId,
+                  sizeof(GUID)) == 0;
+}
+
+// Layout offsets too large for a ULONG, see ComputeLayout
+ULONG ClampLayout(ULONGLONG offset) {
+    return offset < VARIABLE_LAYOUT ? (ULONG)offset : VARIABLE_LAYOUT - 1;
+}
+
+} // namespace
+
+bool SchemaKey::operator==(const SchemaKey &other) const {
+    return memcmp(&ProviderId, &other.ProviderId, sizeof(GUID)) == 0 &&
+           Id == other.Id && Version == other.Version &&
+           Opcode == other.Opcode && MetadataHash == other.MetadataHash;
+}
+
+size_t SchemaKeyHash::operator()(const SchemaKey &key) const {
+    ULONGLONG hash = HashBytes((const BYTE *)&key.ProviderId, sizeof(GUID));
+    hash = HashBytes((const BYTE *)&key.Id, sizeof(key.Id), hash);
+    hash = HashBytes(&key.Version, 1, hash);
+    hash = HashBytes(&key.Opcode, 1, hash);
+    return (size_t)(hash ^ key.MetadataHash);
+}
+
+SchemaKey MakeSchemaKey(const EVENT_RECORD &event) {
+    return MakeKey(event, FindMetadata(event));
+}
+
+ULONG InTypeSize(USHORT inType) {
+    switch (inType) {
+    case TDH_INTYPE_INT8:
+    case TDH_INTYPE_UINT8:
+        return 1;
+    case TDH_INTYPE_INT16:
+    case TDH_INTYPE_UINT16:
+        return 2;
+    case TDH_INTYPE_INT32:
+    case TDH_INTYPE_UINT32:
+    case TDH_INTYPE_HEXINT32:
+    case TDH_INTYPE_FLOAT:
+    case TDH_INTYPE_BOOLEAN:
+        return 4;
+    case TDH_INTYPE_INT64:
+    case TDH_INTYPE_UINT64:
+    case TDH_INTYPE_HEXINT64:
+    case TDH_INTYPE_DOUBLE:
+    case TDH_INTYPE_FILETIME:
+        return 8;
+    case TDH_INTYPE_GUID:
+    case TDH_INTYPE_SYSTEMTIME:
+        return 16;
+    default:
+        // Strings, binary blobs, SIDs and pointers (the size of a pointer
+        // depends on the bitness of the process that logged the event)
+        return 0;
+    }
+}
+
+void ComputeLayout(EventSchema &schema) {
+    // Added up in 64 bits, so sizes can not wrap around to a small total.
+    // A total past what a ULONG holds is clamped to just below
+    // VARIABLE_LAYOUT, larger than any event, so no event passes the
+    // FixedDataSize check.
+    ULONGLONG offset = 0;
+    bool variable = false;
+    for (auto &property : schema.Properties) {
+        property.Field = FindEventField(property.Name.c_str());
+        property.Offset = variable ? VARIABLE_LAYOUT : ClampLayout(offset);
+        if (variable || property.Size == VARIABLE_LAYOUT) {
+            // Everything after a variable sized property has to be found
+            // by parsing the data
+            variable = true;
+        } else {
+            offset += property.Size;
+        }
+    }
+    schema.FixedDataSize = variable ? VARIABLE_LAYOUT : ClampLayout(offset);
+}
+
+#ifdef _WIN32
+ULONG WindowsTdhBackend::GetEventSchema(const EVENT_RECORD &event,
+                                        EventSchema &schema) {
+    ULONG bufferSize = (ULONG)(m_buffer.size() * sizeof(ULONGLONG));
+    PTRACE_EVENT_INFO pInfo =
+        m_buffer.empty() ? NULL : (PTRACE_EVENT_INFO)m_buffer.data();
+
+    // Try the buffer left from the previous call first and grow it if TDH
+    // asks for more
+    ULONG status =
+        TdhGetEventInformation((PEVENT_RECORD)&event, 0, NULL, pInfo,
+                               &bufferSize);
+    if (status == ERROR_INSUFFICIENT_BUFFER) {
+        m_buffer.resize((bufferSize + sizeof(ULONGLONG) - 1) /
+                        sizeof(ULONGLONG));
+        pInfo = (PTRACE_EVENT_INFO)m_buffer.data();
+        status = TdhGetEventInformation((PEVENT_RECORD)&event, 0, NULL, pInfo,
+                                        &bufferSize);
+    }
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+
+    schema.Properties.clear();
+    schema.Properties.reserve(pInfo->TopLevelPropertyCount);
+    for (ULONG i = 0; i < pInfo->TopLevelPropertyCount; i++) {
+        const EVENT_PROPERTY_INFO &info = pInfo->EventPropertyInfoArray[i];
+        PropertyLayout property;
+        property.Name = (PCWSTR)((PBYTE)pInfo + info.NameOffset);
+        property.Flags = info.Flags;
+
+        // The size is only known up front for plain values and for arrays
+        // of them with a count that does not come from the data
+        if ((info.Flags &
+             (PropertyStruct | PropertyParamLength | PropertyParamCount)) ==
+            0) {
+            property.InType = info.nonStructType.InType;
+            ULONG elementSize = info.length != 0
+                                    ? info.length
+                                    : InTypeSize(property.InType);
+            if (elementSize != 0) {
+                property.Size = elementSize * (info.count ? info.count : 1);
+            }
+        }
+        schema.Properties.push_back(property);
+    }
+    return ERROR_SUCCESS;
+}
+#endif
+
+void FakeTdhBackend::AddSchema(const SchemaKey &key,
+                               const EventSchema &schema) {
+    m_schemas[key] = schema;
+}
+
+ULONG FakeTdhBackend::GetEventSchema(const EVENT_RECORD &event,
+                                     EventSchema &schema) {
+    m_calls++;
+    auto it = m_schemas.find(MakeSchemaKey(event));
+    if (it == m_schemas.end()) {
+        return ERROR_NOT_FOUND;
+    }
+    schema = it->second;
+    return ERROR_SUCCESS;
+}
+
+const EventSchema *SchemaCache::Lookup(const EVENT_RECORD &event,
+                                       ULONG *status) {
+    const EVENT_HEADER_EXTENDED_DATA_ITEM *metadata = FindMetadata(event);
+    const BYTE *metadataBytes =
+        metadata ? (const BYTE *)(uintptr_t)metadata->DataPtr : nullptr;
+    const size_t metadataSize = metadata ? metadata->DataSize : 0;
+
+    // Returns true if the entry was built from the same metadata
+    auto sameMetadata = [&](const Entry &entry) {
+        return entry.Metadata.size() == metadataSize &&
+               (metadataSize == 0 ||
+                memcmp(entry.Metadata.data(), metadataBytes, metadataSize) ==
+                    0);
+    };
+
+    if (status != nullptr) {
+        *status = ERROR_SUCCESS;
+    }
+
+    // The same event as last time needs no hashing: the metadata is
+    // compared as it is
+    if (m_lastEntry != nullptr && SameDescriptor(m_lastKey, event) &&
+        sameMetadata(*m_lastEntry)) {
+        m_hits++;
+        return &m_lastEntry->Schema;
+    }
+
+    // Entries whose metadata only has the same hash are kept side by side
+    const SchemaKey key = MakeKey(event, metadata);
+    auto range = m_entries.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (sameMetadata(it->second)) {
+            m_hits++;
+            m_lastKey = key;
+            m_lastEntry = &it->second;
+            return &it->second.Schema;
+        }
+    }
+
+    // Not seen before
+    m_misses++;
+    EventSchema schema;
+    ULONG result = m_backend.GetEventSchema(event, schema);
+    if (status != nullptr) {
+        *status = result;
+    }
+    if (result != ERROR_SUCCESS) {
+        return nullptr;
+    }
+    ComputeLayout(schema);
+
+    // A new entry even on a hash collision, messages may still point at
+    // the schema of the other one
+    Entry &entry = m_entries.emplace(key, Entry())->second;
+    entry.Metadata.assign(metadataBytes, metadataBytes + metadataSize);
+    entry.Schema = std::move(schema);
+    m_lastKey = key;
+    m_lastEntry = &entry;
+    return &entry.Schema;
+}
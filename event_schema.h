@@ -0,0 +1,161 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "a2dp_fields.h"
+#include "platform.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Event schemas (the list of properties of an event) are expensive to get
+// from TDH, but BthA2dp only emits a handful of distinct ones. This module
+// keeps them in a cache so TDH is asked only once per schema.
+
+// Marks a property whose offset or size can only be known by parsing the
+// event data (strings, structs, arrays with a length taken from the data)
+const ULONG VARIABLE_LAYOUT = 0xFFFFFFFF;
+
+// Layout of one top level property of an event
+struct PropertyLayout {
+    std::wstring Name;
+    USHORT InType = TDH_INTYPE_NULL; // TDH_INTYPE_* of a single element
+    ULONG Flags = 0;                 // TDH PropertyFlags
+    ULONG Size = VARIABLE_LAYOUT;    // total size in bytes, if fixed
+    ULONG Offset = VARIABLE_LAYOUT;  // offset in UserData, if fixed
+    // The field of A2dpEventData the property fills, Count if none. Looked
+    // up once here instead of by name for every event.
+    A2dpField Field = A2dpField::Count;
+};
+
+// Parsed list of the top level properties of an event
+struct EventSchema {
+    std::vector<PropertyLayout> Properties;
+    // Size of the UserData if every property has a fixed size,
+    // VARIABLE_LAYOUT otherwise
+    ULONG FixedDataSize = VARIABLE_LAYOUT;
+};
+
+// Identifies a schema. BthA2dp is a TraceLogging provider, and all of its
+// events have Id 0 (see events.txt), so the descriptor alone is not enough:
+// the hash of the TraceLogging metadata carried with the event tells the
+// events apart.
+struct SchemaKey {
+    GUID ProviderId;
+    USHORT Id;
+    UCHAR Version;
+    UCHAR Opcode;
+    ULONGLONG MetadataHash; // 0 for manifest based events
+
+    bool operator==(const SchemaKey &other) const;
+};
+
+struct SchemaKeyHash {
+    size_t operator()(const SchemaKey &key) const;
+};
+
+// Builds the schema key of the event
+SchemaKey MakeSchemaKey(const EVENT_RECORD &event);
+
+// Returns the size of one element of the given TDH input type or 0 if the
+// type has no fixed size
+ULONG InTypeSize(USHORT inType);
+
+// Fills the Offset fields and FixedDataSize from the property sizes, and
+// the Field of every property from its name
+void ComputeLayout(EventSchema &schema);
+
+// Source of event schemas. On Windows it is TDH, elsewhere it is faked.
+class TdhBackend {
+  public:
+    virtual ~TdhBackend() = default;
+
+    // Describes the event. Returns ERROR_SUCCESS or a Win32 error code.
+    virtual ULONG GetEventSchema(const EVENT_RECORD &event,
+                                 EventSchema &schema) = 0;
+};
+
+#ifdef _WIN32
+// Back end that asks TdhGetEventInformation
+class WindowsTdhBackend : public TdhBackend {
+  public:
+    ULONG GetEventSchema(const EVENT_RECORD &event,
+                         EventSchema &schema) override;
+
+  private:
+    // Reused between calls, TRACE_EVENT_INFO must be 8 byte aligned
+    std::vector<ULONGLONG> m_buffer;
+};
+#endif
+
+// Back end that serves schemas registered up front. It lets the cache and
+// everything downstream of it run without TDH.
+class FakeTdhBackend : public TdhBackend {
+  public:
+    void AddSchema(const SchemaKey &key, const EventSchema &schema);
+
+    ULONG GetEventSchema(const EVENT_RECORD &event,
+                         EventSchema &schema) override;
+
+    // Number of times GetEventSchema was called
+    ULONGLONG Calls() const { return m_calls; }
+
+  private:
+    std::unordered_map<SchemaKey, EventSchema, SchemaKeyHash> m_schemas;
+    ULONGLONG m_calls = 0;
+};
+
+// Cache of event schemas. Not thread safe, it is meant to be used from the
+// thread that receives the events.
+class SchemaCache {
+  public:
+    explicit SchemaCache(TdhBackend &backend) : m_backend(backend) {}
+
+    // Returns the schema of the event or nullptr if the back end failed to
+    // describe it. The error code is stored to status when it is not null.
+    // The returned pointer stays valid for the life of the cache.
+    const EventSchema *Lookup(const EVENT_RECORD &event,
+                              ULONG *status = nullptr);
+
+    ULONGLONG Hits() const { return m_hits; }
+    ULONGLONG Misses() const { return m_misses; }
+    size_t Size() const { return m_entries.size(); }
+
+  private:
+    struct Entry {
+        // Copy of the TraceLogging metadata to rule out hash collisions
+        std::vector<BYTE> Metadata;
+        EventSchema Schema;
+    };
+
+    TdhBackend &m_backend;
+    // Entries are never replaced or removed, so the schemas do not move
+    std::unordered_multimap<SchemaKey, Entry, SchemaKeyHash> m_entries;
+    // Events usually come in runs of the same schema, so the last
+    // entry is checked before hashing
+    SchemaKey m_lastKey = {};
+    const Entry *m_lastEntry = nullptr;
+    ULONGLONG m_hits = 0;
+    ULONGLONG m_misses = 0;
+};
@@ -0,0 +1,575 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "filter.h"
+
+#include <cstring>
+
+namespace {
+
+// What the parser builds, moved into the filter once it is all valid
+struct FilterProgram {
+    std::vector<FilterInstruction> Code;
+    std::vector<ULONGLONG> Values;
+    A2dpFieldMask Fields = 0;
+    std::vector<USHORT> EventIds;
+    bool EventIdsRequired = false;
+};
+
+bool IsWordChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_' || c == ':';
+}
+
+int HexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Decimal or 0x prefixed hex
+bool ParseNumber(const char *text, size_t length, ULONGLONG &value) {
+    value = 0;
+    if (length > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        if (length - 2 > 16) {
+            return false;
+        }
+        for (size_t i = 2; i < length; i++) {
+            int digit = HexDigit(text[i]);
+            if (digit < 0) {
+                return false;
+            }
+            value = value << 4 | (ULONGLONG)digit;
+        }
+        return true;
+    }
+    if (length == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        ULONGLONG digit = (ULONGLONG)(text[i] - '0');
+        if (value > (~0ULL - digit) / 10) {
+            return false; // does not fit in 64 bits
+        }
+        value = value * 10 + digit;
+    }
+    return true;
+}
+
+// 12 hex digits, the way Windows shows addresses (7C96D2F479F4), with or
+// without colons between the bytes and an optional 0x
+bool ParseAddress(const char *text, size_t length, ULONGLONG &value) {
+    if (length > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        text += 2;
+        length -= 2;
+    }
+    value = 0;
+    int digits = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == ':') {
+            continue;
+        }
+        int digit = HexDigit(text[i]);
+        if (digit < 0 || ++digits > 12) {
+            return false;
+        }
+        value = value << 4 | (ULONGLONG)digit;
+    }
+    return digits > 0;
+}
+
+// Activity by name, the names AvdtpActivityToString gives
+bool ParseActivity(const char *text, size_t length, ULONGLONG &value) {
+    for (DWORD activity = 0; activity <= 0xFF; activity++) {
+        const WCHAR *name = AvdtpActivityToString((AvdtpActivity)activity);
+        size_t i = 0;
+        while (i < length && name[i] != 0 && name[i] == (WCHAR)text[i]) {
+            i++;
+        }
+        if (i == length && name[i] == 0 && wcscmp(name, L"Unknown") != 0) {
+            value = activity;
+            return true;
+        }
+    }
+    return ParseNumber(text, length, value);
+}
+
+// Recursive descent over the expression, emitting instructions as it goes
+class FilterParser {
+  public:
+    FilterParser(const char *text, FilterProgram &program) :
+        m_text(text), m_position(text), m_program(program) {}
+
+    bool Parse(std::wstring &error) {
+        bool ok = ParseOr(true);
+        if (ok) {
+            SkipSpaces();
+            if (*m_position != 0) {
+                ok = Fail(m_position, L"expected && or ||");
+            }
+        }
+        if (!ok) {
+            error = m_error;
+        }
+        return ok;
+    }
+
+  private:
+    bool ParseOr(bool top) {
+        std::vector<size_t> jumps;
+        if (!ParseAnd(top)) {
+            return false;
+        }
+        while (Accept("||")) {
+            jumps.push_back(Emit(FilterOp::JumpIfTrue));
+            if (!ParseAnd(false)) {
+                return false;
+            }
+        }
+        if (top && !jumps.empty()) {
+            // Either side can let any event id through
+            m_program.EventIdsRequired = false;
+        }
+        Patch(jumps);
+        return true;
+    }
+
+    // Only the terms of the top level && are sure to be required, their
+    // event ids are kept for RequiredEventIds
+    bool ParseAnd(bool top) {
+        std::vector<size_t> jumps;
+        for (;;) {
+            std::vector<ULONGLONG> ids;
+            bool idTerm = false;
+            if (!ParseUnary(top ? &ids : nullptr, idTerm)) {
+                return false;
+            }
+            if (idTerm && !m_program.EventIdsRequired) {
+                // Ids that do not fit an event id never match anyway
+                m_program.EventIds.clear();
+                for (ULONGLONG id : ids) {
+                    if (id <= 0xFFFF) {
+                        m_program.EventIds.push_back((USHORT)id);
+                    }
+                }
+                m_program.EventIdsRequired = !m_program.EventIds.empty();
+            }
+            if (!Accept("&&")) {
+                break;
+            }
+            jumps.push_back(Emit(FilterOp::JumpIfFalse));
+        }
+        Patch(jumps);
+        return true;
+    }
+
+    bool ParseUnary(std::vector<ULONGLONG> *ids, bool &idTerm) {
+        if (Accept("!")) {
+            if (!ParseUnary(nullptr, idTerm)) {
+                return false;
+            }
+            idTerm = false;
+            Emit(FilterOp::Not);
+            return true;
+        }
+        if (Accept("(")) {
+            if (!ParseOr(false)) {
+                return false;
+            }
+            if (!Accept(")")) {
+                return Fail(m_position, L"expected )");
+            }
+            return true;
+        }
+        return ParseComparison(ids, idTerm);
+    }
+
+    bool ParseComparison(std::vector<ULONGLONG> *ids, bool &idTerm) {
+        const char *name = m_position;
+        size_t length = 0;
+        if (!ReadWord(name, length)) {
+            return Fail(name, L"expected a field name");
+        }
+        int field = FILTER_EVENT_ID;
+        if (length != 7 || memcmp(name, "EventId", 7) != 0) {
+            A2dpField known = FindEventField(name, length);
+            if (known == A2dpField::Count) {
+                return Fail(name, L"unknown field");
+            }
+            if (A2DP_FIELDS[(int)known].Format == FieldFormat::Bytes) {
+                return Fail(name, L"the field can not be compared");
+            }
+            field = (int)known;
+            m_program.Fields |= FieldBit(known);
+        }
+
+        FilterInstruction instruction = {};
+        instruction.Field = field;
+        if (Accept("==")) {
+            instruction.Op = FilterOp::Equal;
+        } else if (Accept("!=")) {
+            instruction.Op = FilterOp::NotEqual;
+        } else if (Accept("<=")) {
+            instruction.Op = FilterOp::LessEqual;
+        } else if (Accept(">=")) {
+            instruction.Op = FilterOp::GreaterEqual;
+        } else if (Accept("<")) {
+            instruction.Op = FilterOp::Less;
+        } else if (Accept(">")) {
+            instruction.Op = FilterOp::Greater;
+        } else if (AcceptWord("in")) {
+            instruction.Op = FilterOp::In;
+        } else {
+            return Fail(m_position, L"expected a comparison");
+        }
+
+        if (instruction.Op != FilterOp::In) {
+            if (!ParseValue(field, instruction.Value)) {
+                return false;
+            }
+        } else {
+            if (!Accept("(")) {
+                return Fail(m_position, L"expected (");
+            }
+            instruction.First = (ULONG)m_program.Values.size();
+            do {
+                ULONGLONG value = 0;
+                if (!ParseValue(field, value)) {
+                    return false;
+                }
+                m_program.Values.push_back(value);
+            } while (Accept(","));
+            if (!Accept(")")) {
+                return Fail(m_position, L"expected , or )");
+            }
+            instruction.Count =
+                (ULONG)m_program.Values.size() - instruction.First;
+        }
+        Emit(instruction);
+
+        if (ids != nullptr && field == FILTER_EVENT_ID) {
+            if (instruction.Op == FilterOp::Equal) {
+                ids->push_back(instruction.Value);
+                idTerm = true;
+            } else if (instruction.Op == FilterOp::In) {
+                ids->assign(m_program.Values.begin() + instruction.First,
+                            m_program.Values.end());
+                idTerm = true;
+            }
+        }
+        return true;
+    }
+
+    bool ParseValue(int field, ULONGLONG &value) {
+        const char *text = m_position;
+        size_t length = 0;
+        if (!ReadWord(text, length)) {
+            return Fail(text, L"expected a value");
+        }
+        const FieldFormat format = field == FILTER_EVENT_ID
+                                       ? FieldFormat::Number
+                                       : A2DP_FIELDS[field].Format;
+        switch (format) {
+        case FieldFormat::Address:
+            if (!ParseAddress(text, length, value)) {
+                return Fail(text, L"expected an address of 12 hex digits");
+            }
+            return true;
+        case FieldFormat::Activity:
+            if (!ParseActivity(text, length, value)) {
+                return Fail(text, L"expected an activity name or a number");
+            }
+            return true;
+        default:
+            if (!ParseNumber(text, length, value)) {
+                return Fail(text, L"expected a number");
+            }
+            return true;
+        }
+    }
+
+    void SkipSpaces() {
+        while (*m_position == ' ' || *m_position == '\t') {
+            m_position++;
+        }
+    }
+
+    // Takes the operator if it comes next. A single & or | or ! is not
+    // taken from the start of a longer operator.
+    bool Accept(const char *op) {
+        SkipSpaces();
+        const size_t length = strlen(op);
+        if (strncmp(m_position, op, length) != 0) {
+            return false;
+        }
+        if (length == 1 && m_position[1] == '=' &&
+            (op[0] == '!' || op[0] == '<' || op[0] == '>')) {
+            return false;
+        }
+        m_position += length;
+        return true;
+    }
+
+    bool AcceptWord(const char *word) {
+        SkipSpaces();
+        const size_t length = strlen(word);
+        if (strncmp(m_position, word, length) != 0 ||
+            IsWordChar(m_position[length])) {
+            return false;
+        }
+        m_position += length;
+        return true;
+    }
+
+    // Names and values are both runs of letters, digits, _ and :
+    bool ReadWord(const char *&start, size_t &length) {
+        SkipSpaces();
+        start = m_position;
+        while (IsWordChar(*m_position)) {
+            m_position++;
+        }
+        length = m_position - start;
+        return length > 0;
+    }
+
+    size_t Emit(const FilterInstruction &instruction) {
+        m_program.Code.push_back(instruction);
+        return m_program.Code.size() - 1;
+    }
+
+    // Instructions without operands, jumps are patched later
+    size_t Emit(FilterOp op) {
+        FilterInstruction instruction{};
+        instruction.Op = op;
+        return Emit(instruction);
+    }
+
+    // Points the jumps past the last instruction emitted
+    void Patch(const std::vector<size_t> &jumps) {
+        for (size_t jump : jumps) {
+            m_program.Code[jump].Target = (ULONG)m_program.Code.size();
+        }
+    }
+
+    bool Fail(const char *at, const WCHAR *message) {
+        m_error = message;
+        m_error += L" at column ";
+        m_error += std::to_wstring(at - m_text + 1);
+        return false;
+    }
+
+    const char *m_text;
+    const char *m_position;
+    FilterProgram &m_program;
+    std::wstring m_error;
+};
+
+bool Compare(const FilterInstruction &instruction,
+             const std::vector<ULONGLONG> &values, ULONGLONG value) {
+    switch (instruction.Op) {
+    case FilterOp::Equal:
+        return value == instruction.Value;
+    case FilterOp::NotEqual:
+        return value != instruction.Value;
+    case FilterOp::Less:
+        return value < instruction.Value;
+    case FilterOp::LessEqual:
+        return value <= instruction.Value;
+    case FilterOp::Greater:
+        return value > instruction.Value;
+    case FilterOp::GreaterEqual:
+        return value >= instruction.Value;
+    case FilterOp::In:
+        for (ULONG i = 0; i < instruction.Count; i++) {
+            if (values[instruction.First + i] == value) {
+                return true;
+            }
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+// How reading one field straight from its offset went
+enum class FieldRead {
+    Missing,  // the event does not have it
+    Present,  // read
+    NeedsWalk // behind a variable sized property, the data has to be walked
+};
+
+FieldRead ReadFixedField(const EVENT_RECORD &event, const EventSchema &schema,
+                         A2dpField field, ULONGLONG &value) {
+    // Events have a handful of properties. A later property of the same
+    // name wins, as it does when decoding.
+    for (size_t i = schema.Properties.size(); i-- > 0;) {
+        const PropertyLayout &property = schema.Properties[i];
+        if (property.Field != field) {
+            continue;
+        }
+        if (property.Offset == VARIABLE_LAYOUT ||
+            property.Size == VARIABLE_LAYOUT) {
+            return FieldRead::NeedsWalk;
+        }
+        // The decoder drops a fixed layout event that is too short as a
+        // whole, and reads what fits of a variable one
+        const ULONG end = schema.FixedDataSize != VARIABLE_LAYOUT
+                              ? schema.FixedDataSize
+                              : property.Offset + property.Size;
+        if (end > event.UserDataLength) {
+            return FieldRead::Missing;
+        }
+        return ReadFieldValue(field,
+                              (const BYTE *)event.UserData + property.Offset,
+                              property.Size, InTypeSize(property.InType),
+                              value)
+                   ? FieldRead::Present
+                   : FieldRead::Missing;
+    }
+    return FieldRead::Missing;
+}
+
+} // namespace
+
+bool EventFilter::Compile(const char *text, std::wstring &error) {
+    FilterProgram program;
+    FilterParser parser(text, program);
+    if (!parser.Parse(error)) {
+        return false;
+    }
+    m_code = std::move(program.Code);
+    m_values = std::move(program.Values);
+    m_fields = program.Fields;
+    m_eventIds = std::move(program.EventIds);
+    m_eventIdsRequired = program.EventIdsRequired;
+    return true;
+}
+
+template <typename LoadFn> bool EventFilter::Run(LoadFn &&load) const {
+    bool result = true;
+    size_t next = 0;
+    while (next < m_code.size()) {
+        const FilterInstruction &instruction = m_code[next++];
+        switch (instruction.Op) {
+        case FilterOp::Not:
+            result = !result;
+            break;
+        case FilterOp::JumpIfFalse:
+            if (!result) {
+                next = instruction.Target;
+            }
+            break;
+        case FilterOp::JumpIfTrue:
+            if (result) {
+                next = instruction.Target;
+            }
+            break;
+        default: {
+            ULONGLONG value = 0;
+            result = load(instruction.Field, value) &&
+                     Compare(instruction, m_values, value);
+            break;
+        }
+        }
+    }
+    return result;
+}
+
+bool EventFilter::Matches(const EVENT_RECORD &event, const EventSchema &schema,
+                          MeasurePropertyFn measure) const {
+    // Every field is read once, on first use
+    ULONGLONG values[A2DP_FIELD_COUNT];
+    A2dpFieldMask loaded = 0;
+    A2dpFieldMask present = 0;
+
+    auto load = [&](int field, ULONGLONG &value) {
+        if (field == FILTER_EVENT_ID) {
+            value = event.EventHeader.EventDescriptor.Id;
+            return true;
+        }
+        const A2dpFieldMask bit = FieldBit((A2dpField)field);
+        if ((loaded & bit) == 0) {
+            switch (ReadFixedField(event, schema, (A2dpField)field,
+                                   values[field])) {
+            case FieldRead::Present:
+                present |= bit;
+                loaded |= bit;
+                break;
+            case FieldRead::Missing:
+                loaded |= bit;
+                break;
+            case FieldRead::NeedsWalk:
+                // One walk reads every field the expression uses
+                ForEachProperty(
+                    event, schema, measure,
+                    [&](const PropertyLayout &property, const BYTE *data,
+                        ULONG size) {
+                        if (property.Field == A2dpField::Count ||
+                            (m_fields & FieldBit(property.Field)) == 0) {
+                            return;
+                        }
+                        const A2dpFieldMask fieldBit =
+                            FieldBit(property.Field);
+                        if (ReadFieldValue(property.Field, data, size,
+                                           InTypeSize(property.InType),
+                                           values[(int)property.Field])) {
+                            present |= fieldBit;
+                        }
+                    });
+                loaded |= m_fields;
+                break;
+            }
+        }
+        value = values[field];
+        return (present & bit) != 0;
+    };
+    return Run(load);
+}
+
+bool EventFilter::Matches(ULONG eventId,
+                          const A2dpEventData &eventData) const {
+    return Run([&](int field, ULONGLONG &value) {
+        if (field == FILTER_EVENT_ID) {
+            value = eventId;
+            return true;
+        }
+        return GetEventField(eventData, (A2dpField)field, value);
+    });
+}
+
+bool EventFilter::RequiredEventIds(std::vector<USHORT> &ids) const {
+    if (!m_eventIdsRequired) {
+        return false;
+    }
+    ids = m_eventIds;
+    return true;
+}
@@ -0,0 +1,113 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "a2dp.h"
+#include "event_decoder.h"
+#include "event_schema.h"
+#include "platform.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Filter expressions for --filter, for example
+//
+//   AvdtpActivity in (0x12, 0x14) && BTDeviceAddress == 7C96D2F479F4
+//
+//   expression  := and ("||" and)*
+//   and         := unary ("&&" unary)*
+//   unary       := "!" unary | "(" expression ")" | comparison
+//   comparison  := field ("=="|"!="|"<"|"<="|">"|">=") value
+//                | field "in" "(" value ("," value)* ")"
+//
+// Fields are the property names of A2DP_EVENT_FIELDS and EventId. Values
+// are decimal or 0x hex numbers, addresses are hex with or without colons
+// and activities can also be given by name (SetConfiguration_Cfm). A
+// comparison with a field the event does not have is false, whatever the
+// operator.
+//
+// The expression is compiled once into a list of instructions working on a
+// single boolean register, && and || jump over what they do not need. The
+// fields are read from the raw event data only when an instruction asks
+// for them, so events that fail on the first field are never decoded.
+
+enum class FilterOp : BYTE {
+    Equal,
+    NotEqual,
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    In,          // the value is one of Count values from First
+    Not,         // inverts the register
+    JumpIfFalse, // jumps to Target if the register is false
+    JumpIfTrue,  // jumps to Target if the register is true
+};
+
+struct FilterInstruction {
+    FilterOp Op;
+    int Field;       // A2dpField index, or FILTER_EVENT_ID
+    ULONGLONG Value; // compared to, for Equal to GreaterEqual
+    ULONG First;     // In: first value in the value list
+    ULONG Count;     // In: number of values
+    ULONG Target;    // jumps: index of the next instruction
+};
+
+// Field index of the event id, past the A2dpField ones
+const int FILTER_EVENT_ID = A2DP_FIELD_COUNT;
+
+class EventFilter {
+  public:
+    // Compiles the expression, replacing what was compiled before. Returns
+    // false and describes the problem in error if it is not valid.
+    bool Compile(const char *text, std::wstring &error);
+
+    bool Empty() const { return m_code.empty(); }
+
+    // The fields the expression reads, without the event id
+    A2dpFieldMask Fields() const { return m_fields; }
+
+    // Evaluates the expression on a raw event. An empty filter matches
+    // everything.
+    bool Matches(const EVENT_RECORD &event, const EventSchema &schema,
+                 MeasurePropertyFn measure) const;
+
+    // Same for an event that is already decoded (imported from a log)
+    bool Matches(ULONG eventId, const A2dpEventData &eventData) const;
+
+    // Fills ids with the event ids an event needs to have to pass, when the
+    // expression requires them at its top level (EventId == 5 && ...). ETW
+    // can then drop the others before they are delivered. Returns false if
+    // any event id can pass.
+    bool RequiredEventIds(std::vector<USHORT> &ids) const;
+
+  private:
+    template <typename LoadFn> bool Run(LoadFn &&load) const;
+
+    std::vector<FilterInstruction> m_code;
+    std::vector<ULONGLONG> m_values; // of the In instructions
+    A2dpFieldMask m_fields = 0;
+    std::vector<USHORT> m_eventIds;
+    bool m_eventIdsRequired = false;
+};
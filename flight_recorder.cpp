@@ -0,0 +1,180 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "flight_recorder.h"
+
+#include "device_tracker.h"
+
+#include <algorithm>
+#include <cstring>
+
+std::atomic<bool> flightDumpRequested{false};
+
+const WCHAR *FlightDumpReasonToString(FlightDumpReason reason) {
+    switch (reason) {
+    case FlightDumpReason::UnknownCodec:
+        return L"unknown codec";
+    case FlightDumpReason::ErrorCode:
+        return L"error code";
+    case FlightDumpReason::Requested:
+        return L"requested";
+    }
+    return L"?";
+}
+
+std::optional<FlightDumpReason> FlightDumpTrigger(const A2dpEventData &data,
+                                                  const A2dpFinding &finding) {
+    if (finding.Kind == A2dpFindingKind::UnknownCodec) {
+        return FlightDumpReason::UnknownCodec;
+    }
+    if ((data.ResultCode && *data.ResultCode != 0) ||
+        (data.StatusErrorCode && *data.StatusErrorCode != 0)) {
+        return FlightDumpReason::ErrorCode;
+    }
+    return std::nullopt;
+}
+
+void FlightRecorder::SetCapacity(size_t eventsPerDevice) {
+    m_capacity = eventsPerDevice;
+    m_sequence = 0;
+    for (Ring &ring : m_rings) {
+        ring = Ring();
+    }
+    const size_t total = (FLIGHT_RECORDER_DEVICES + 1) * eventsPerDevice;
+    m_records.clear();
+    m_records.shrink_to_fit();
+    m_records.resize(total);
+    m_selected.clear();
+    m_selected.reserve(total);
+}
+
+FlightRecorder::Ring &FlightRecorder::FindRing(const A2dpEventData &eventData) {
+    const std::optional<ULONGLONG> address = EventDeviceAddress(eventData);
+    if (!address) {
+        return m_rings[0];
+    }
+
+    // A handful of devices, a scan is all it takes
+    Ring *free = nullptr;
+    Ring *oldest = nullptr;
+    for (size_t i = 1; i <= FLIGHT_RECORDER_DEVICES; i++) {
+        Ring &ring = m_rings[i];
+        if (!ring.InUse) {
+            if (free == nullptr) {
+                free = &ring;
+            }
+        } else if (ring.Address == *address) {
+            return ring;
+        } else if (oldest == nullptr || ring.LastUsed < oldest->LastUsed) {
+            oldest = &ring;
+        }
+    }
+    Ring &ring = free != nullptr ? *free : *oldest;
+    ring = Ring();
+    ring.InUse = true;
+    ring.Address = *address;
+    return ring;
+}
+
+void FlightRecorder::Record(const EventMessage &message) {
+    if (m_capacity == 0) {
+        return;
+    }
+    Ring &ring = FindRing(message.Data);
+    const size_t index = (size_t)(&ring - m_rings);
+    Slot &record = m_records[index * m_capacity + ring.Next];
+    record.Sequence = ++m_sequence;
+    ring.LastUsed = m_sequence;
+    ring.Next = ring.Next + 1 == m_capacity ? 0 : ring.Next + 1;
+    if (ring.Count < m_capacity) {
+        ring.Count++;
+    }
+
+    // Only the part of the message in use, most of its buffer is empty
+    EventMessage &copy = record.Message;
+    copy.ProviderId = message.ProviderId;
+    copy.Kind = message.Kind;
+    copy.Timestamp = message.Timestamp;
+    copy.Processor = message.Processor;
+    copy.EventId = message.EventId;
+    copy.PublishedAt = message.PublishedAt;
+    copy.Decoded = message.Decoded;
+    copy.Data = message.Data;
+    copy.DecodedFields = message.DecodedFields;
+    copy.Schema = message.Schema;
+    copy.PropertyCount = message.PropertyCount;
+    copy.DataLength = message.DataLength;
+    memcpy(copy.PropertySizes, message.PropertySizes,
+           message.PropertyCount * sizeof(message.PropertySizes[0]));
+    memcpy(copy.UserData, message.UserData, message.DataLength);
+}
+
+void FlightRecorder::SelectRing(size_t index) {
+    const Ring &ring = m_rings[index];
+    const Slot *records = m_records.data() + index * m_capacity;
+    // The oldest event is at Next once the ring went around
+    size_t slot = ring.Count < m_capacity ? 0 : ring.Next;
+    for (size_t i = 0; i < ring.Count; i++) {
+        m_selected.push_back(&records[slot]);
+        slot = slot + 1 == m_capacity ? 0 : slot + 1;
+    }
+    m_selectedRings[index] = true;
+}
+
+void FlightRecorder::Select(const A2dpEventData *eventData) {
+    m_selected.clear();
+    std::fill(std::begin(m_selectedRings), std::end(m_selectedRings), false);
+    if (m_capacity == 0) {
+        return;
+    }
+    if (eventData == nullptr) {
+        for (size_t i = 0; i <= FLIGHT_RECORDER_DEVICES; i++) {
+            SelectRing(i);
+        }
+    } else {
+        SelectRing(0);
+        const std::optional<ULONGLONG> address =
+            EventDeviceAddress(*eventData);
+        for (size_t i = 1; address && i <= FLIGHT_RECORDER_DEVICES; i++) {
+            if (m_rings[i].InUse && m_rings[i].Address == *address) {
+                SelectRing(i);
+                break;
+            }
+        }
+    }
+    // Each ring is in order already, but they interleave
+    std::sort(m_selected.begin(), m_selected.end(),
+              [](const Slot *a, const Slot *b) {
+                  return a->Sequence < b->Sequence;
+              });
+}
+
+void FlightRecorder::ForgetSelected() {
+    for (size_t i = 0; i <= FLIGHT_RECORDER_DEVICES; i++) {
+        if (m_selectedRings[i]) {
+            m_rings[i].Next = 0;
+            m_rings[i].Count = 0;
+        }
+    }
+    m_selected.clear();
+}
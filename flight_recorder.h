@@ -0,0 +1,134 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "a2dp.h"
+#include "event_message.h"
+#include "platform.h"
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+// Keeps the last events of every device so that when something goes wrong
+// the events that led to it can be shown, without running with --trace all
+// the time. The events are kept raw, as the writer got them, in rings of a
+// fixed number of events each, all allocated up front: recording is a copy
+// into a slot and the memory used never grows.
+//
+// A dump writes the kept events of the device (and those without a device,
+// which may belong to it), oldest first, and forgets them, so a run of
+// errors does not show the same events again.
+
+// Devices with a ring of their own. When more are seen, the ring of the one
+// not heard from for the longest is given to the new one.
+const size_t FLIGHT_RECORDER_DEVICES = 16;
+
+// Events kept per device unless --flight says otherwise
+const size_t FLIGHT_RECORDER_DEFAULT_EVENTS = 32;
+
+// The fields the recorder looks at, on top of the device address
+const A2dpFieldMask FLIGHT_RECORDER_FIELDS =
+    FieldBit(A2dpField::ResultCode) | FieldBit(A2dpField::StatusErrorCode);
+
+// Set by a signal (kill -USR2, Ctrl+Break on Windows) to dump every ring
+extern std::atomic<bool> flightDumpRequested;
+
+enum class FlightDumpReason {
+    UnknownCodec, // the analysis found a codec nobody knows
+    ErrorCode,    // ResultCode or StatusErrorCode was not 0
+    Requested,    // flightDumpRequested
+};
+
+const WCHAR *FlightDumpReasonToString(FlightDumpReason reason);
+
+// Returns why the event should make the recorder dump, if it should
+std::optional<FlightDumpReason> FlightDumpTrigger(const A2dpEventData &data,
+                                                  const A2dpFinding &finding);
+
+// Used by the writer thread only
+class FlightRecorder {
+  public:
+    // Allocates the rings for eventsPerDevice events each, 0 turns the
+    // recorder off. Forgets everything recorded.
+    void SetCapacity(size_t eventsPerDevice);
+
+    bool Enabled() const { return m_capacity > 0; }
+
+    // Bytes allocated for the rings
+    size_t ArenaBytes() const { return m_records.size() * sizeof(Slot); }
+
+    // Keeps a copy of the message, dropping the oldest event of its device
+    // if the ring is full
+    void Record(const EventMessage &message);
+
+    // Calls write(const EventMessage &) for the events kept of the device
+    // the event is about and for those without a device, or for all events
+    // kept if eventData is nullptr, oldest first. Then forgets them.
+    // Returns the number of events written.
+    template <typename Fn>
+    size_t Dump(const A2dpEventData *eventData, Fn &&write) {
+        Select(eventData);
+        for (const Slot *record : m_selected) {
+            write(record->Message);
+        }
+        const size_t count = m_selected.size();
+        ForgetSelected();
+        return count;
+    }
+
+    // The number of events Dump() would write
+    size_t Count(const A2dpEventData *eventData) {
+        Select(eventData);
+        return m_selected.size();
+    }
+
+  private:
+    struct Slot {
+        ULONGLONG Sequence;
+        EventMessage Message;
+    };
+
+    struct Ring {
+        ULONGLONG Address = 0;
+        bool InUse = false;
+        ULONGLONG LastUsed = 0; // Sequence of its last event
+        size_t Next = 0;        // slot the next event goes to
+        size_t Count = 0;
+    };
+
+    Ring &FindRing(const A2dpEventData &eventData);
+    void Select(const A2dpEventData *eventData);
+    void SelectRing(size_t ring);
+    void ForgetSelected();
+
+    size_t m_capacity = 0;
+    ULONGLONG m_sequence = 0;
+    // Ring 0 holds the events without a device, the others one device each
+    Ring m_rings[FLIGHT_RECORDER_DEVICES + 1];
+    std::vector<Slot> m_records; // ring i owns m_capacity records at i
+    std::vector<const Slot *> m_selected; // reserved for all records
+    bool m_selectedRings[FLIGHT_RECORDER_DEVICES + 1] = {};
+};
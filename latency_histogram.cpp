@@ -0,0 +1,191 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "latency_histogram.h"
+
+#include <cwchar>
+#include <stdio.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+StageLatencies stageLatencies;
+std::atomic<bool> latencyReportRequested{false};
+
+namespace {
+
+// Index of the highest set bit, value is not 0
+inline int HighestBit(ULONGLONG value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+// Both histograms split every power of two in 2^subBits linear buckets,
+// the values below 2^subBits have a bucket each
+inline size_t LogLinearBucket(ULONGLONG value, int subBits) {
+    const ULONGLONG subBuckets = 1ULL << subBits;
+    if (value < subBuckets) {
+        return (size_t)value;
+    }
+    const int exponent = HighestBit(value);
+    const int shift = exponent - subBits;
+    const size_t sub = (size_t)(value >> shift) & (subBuckets - 1);
+    return (size_t)(shift + 1) * subBuckets + sub;
+}
+
+inline ULONGLONG LogLinearBucketTop(size_t bucket, int subBits) {
+    const ULONGLONG subBuckets = 1ULL << subBits;
+    if (bucket < subBuckets) {
+        return bucket;
+    }
+    const int shift = (int)(bucket / subBuckets) - 1;
+    const ULONGLONG sub = bucket % subBuckets;
+    const ULONGLONG low = (subBuckets + sub) << shift;
+    return low + ((1ULL << shift) - 1);
+}
+
+void PrintHistogram(const WCHAR *name, const LatencyHistogram &histogram) {
+    if (histogram.Count() == 0) {
+        return;
+    }
+    WCHAR p50[32], p99[32], p999[32], max[32];
+    FormatDuration(histogram.Percentile(0.5), p50, 32);
+    FormatDuration(histogram.Percentile(0.99), p99, 32);
+    FormatDuration(histogram.Percentile(0.999), p999, 32);
+    FormatDuration(histogram.Max(), max, 32);
+    wprintf(L"  %-10ls %10llu %10ls %10ls %10ls %10ls\n", name,
+            (unsigned long long)histogram.Count(), p50, p99, p999, max);
+}
+
+} // namespace
+
+void FormatDuration(ULONGLONG ns, WCHAR *buffer, size_t count) {
+    if (ns < 1000) {
+        swprintf(buffer, count, L"%llu ns", (unsigned long long)ns);
+    } else if (ns < 1000000) {
+        swprintf(buffer, count, L"%.1f us", ns / 1e3);
+    } else if (ns < 1000000000) {
+        swprintf(buffer, count, L"%.1f ms", ns / 1e6);
+    } else {
+        swprintf(buffer, count, L"%.2f s", ns / 1e9);
+    }
+}
+
+size_t LatencyHistogram::BucketOf(ULONGLONG value) {
+    return LogLinearBucket(value, HISTOGRAM_SUB_BUCKET_BITS);
+}
+
+ULONGLONG LatencyHistogram::BucketTop(size_t bucket) {
+    return LogLinearBucketTop(bucket, HISTOGRAM_SUB_BUCKET_BITS);
+}
+
+ULONGLONG LatencyHistogram::Percentile(double fraction) const {
+    const ULONGLONG count = Count();
+    if (count == 0) {
+        return 0;
+    }
+    ULONGLONG wanted = (ULONGLONG)(fraction * count + 0.5);
+    if (wanted == 0) {
+        wanted = 1;
+    }
+    // The buckets and the count are read while others may still record,
+    // so the walk can run out before reaching wanted; max is the answer then
+    ULONGLONG seen = 0;
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        seen += m_buckets[bucket].load(std::memory_order_relaxed);
+        if (seen >= wanted) {
+            ULONGLONG top = BucketTop(bucket);
+            return top < Max() ? top : Max();
+        }
+    }
+    return Max();
+}
+
+void QuantileSketch::Record(ULONGLONG value) {
+    const ULONGLONG largest = (1ULL << SKETCH_VALUE_BITS) - 1;
+    if (value > largest) {
+        value = largest;
+    }
+    m_buckets[LogLinearBucket(value, SKETCH_SUB_BUCKET_BITS)]++;
+    m_count++;
+    m_min = value < m_min ? value : m_min;
+    m_max = value > m_max ? value : m_max;
+}
+
+void QuantileSketch::Merge(const QuantileSketch &other) {
+    for (size_t bucket = 0; bucket < SKETCH_BUCKETS; bucket++) {
+        m_buckets[bucket] += other.m_buckets[bucket];
+    }
+    m_count += other.m_count;
+    m_min = other.m_min < m_min ? other.m_min : m_min;
+    m_max = other.m_max > m_max ? other.m_max : m_max;
+}
+
+ULONGLONG QuantileSketch::Percentile(double fraction) const {
+    if (m_count == 0) {
+        return 0;
+    }
+    ULONGLONG wanted = (ULONGLONG)(fraction * m_count + 0.5);
+    if (wanted == 0) {
+        wanted = 1;
+    }
+    ULONGLONG seen = 0;
+    for (size_t bucket = 0; bucket < SKETCH_BUCKETS; bucket++) {
+        seen += m_buckets[bucket];
+        if (seen >= wanted) {
+            const ULONGLONG top =
+                LogLinearBucketTop(bucket, SKETCH_SUB_BUCKET_BITS);
+            return top < m_max ? top : m_max;
+        }
+    }
+    return m_max;
+}
+
+void PrintStageLatencies() {
+    const LatencyHistogram *stages[] = {
+        &stageLatencies.Delivery, &stageLatencies.Batch,
+        &stageLatencies.Decode,   &stageLatencies.Queue,
+        &stageLatencies.Analysis, &stageLatencies.Output};
+    bool any = false;
+    for (const LatencyHistogram *stage : stages) {
+        any = any || stage->Count() > 0;
+    }
+    if (!any) {
+        return;
+    }
+    wprintf(L"\n");
+    wprintf(L"  %-10ls %10ls %10ls %10ls %10ls %10ls\n", L"latency", L"count",
+            L"p50", L"p99", L"p999", L"max");
+    PrintHistogram(L"delivery", stageLatencies.Delivery);
+    PrintHistogram(L"batch", stageLatencies.Batch);
+    PrintHistogram(L"decode", stageLatencies.Decode);
+    PrintHistogram(L"queue", stageLatencies.Queue);
+    PrintHistogram(L"analysis", stageLatencies.Analysis);
+    PrintHistogram(L"output", stageLatencies.Output);
+}
@@ -0,0 +1,140 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "platform.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+// Log-linear histogram in the spirit of HdrHistogram. Every power of two is
+// split in 32 linear sub-buckets, so a value lands in a bucket at most ~3%
+// wider than itself, from nanoseconds to centuries. Recording is a single
+// atomic increment, any thread can record while another one reads.
+
+const int HISTOGRAM_SUB_BUCKET_BITS = 5;
+const ULONGLONG HISTOGRAM_SUB_BUCKETS = 1ULL << HISTOGRAM_SUB_BUCKET_BITS;
+const size_t HISTOGRAM_BUCKETS =
+    (64 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+
+class LatencyHistogram {
+  public:
+    void Record(ULONGLONG value) {
+        m_buckets[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+        ULONGLONG max = m_max.load(std::memory_order_relaxed);
+        while (value > max && !m_max.compare_exchange_weak(
+                                  max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    ULONGLONG Count() const { return m_count.load(std::memory_order_relaxed); }
+    ULONGLONG Max() const { return m_max.load(std::memory_order_relaxed); }
+    ULONGLONG Sum() const { return m_sum.load(std::memory_order_relaxed); }
+
+    // Values recorded in the bucket, for readers that export the buckets
+    ULONGLONG BucketCount(size_t bucket) const {
+        return m_buckets[bucket].load(std::memory_order_relaxed);
+    }
+
+    // Returns the value that fraction (0.5 for the median) of the recorded
+    // values are at or below, rounded up to the top of its bucket
+    ULONGLONG Percentile(double fraction) const;
+
+    static size_t BucketOf(ULONGLONG value);
+    static ULONGLONG BucketTop(size_t bucket);
+
+  private:
+    std::atomic<ULONGLONG> m_buckets[HISTOGRAM_BUCKETS] = {};
+    std::atomic<ULONGLONG> m_count{0};
+    std::atomic<ULONGLONG> m_sum{0};
+    std::atomic<ULONGLONG> m_max{0};
+};
+
+// A smaller relative of LatencyHistogram for values kept per device and
+// codec: 16 sub-buckets per power of two (a value lands in a bucket at most
+// ~6% wider than itself) up to 2^40, and plain counters. Its size is fixed
+// whatever is recorded, and two sketches merge by adding up their buckets,
+// so partial results (per device, per worker) combine into exact totals of
+// what the buckets hold. Not thread safe.
+
+const int SKETCH_SUB_BUCKET_BITS = 4;
+const ULONGLONG SKETCH_SUB_BUCKETS = 1ULL << SKETCH_SUB_BUCKET_BITS;
+const int SKETCH_VALUE_BITS = 40; // larger values are counted as 2^40 - 1
+const size_t SKETCH_BUCKETS =
+    (SKETCH_VALUE_BITS - SKETCH_SUB_BUCKET_BITS + 1) * SKETCH_SUB_BUCKETS;
+
+class QuantileSketch {
+  public:
+    void Record(ULONGLONG value);
+    void Merge(const QuantileSketch &other);
+
+    ULONGLONG Count() const { return m_count; }
+    ULONGLONG Min() const { return m_count > 0 ? m_min : 0; }
+    ULONGLONG Max() const { return m_max; }
+
+    // Same as LatencyHistogram::Percentile
+    ULONGLONG Percentile(double fraction) const;
+
+  private:
+    // 64 bits like m_count, merged sketches of a fleet or a soak test would
+    // wrap 32 bit buckets
+    ULONGLONG m_buckets[SKETCH_BUCKETS] = {};
+    ULONGLONG m_count = 0;
+    ULONGLONG m_min = ~0ULL;
+    ULONGLONG m_max = 0;
+};
+
+// Where the time goes between ETW logging an event and the tool being done
+// with it, in nanoseconds
+struct StageLatencies {
+    LatencyHistogram Delivery; // event timestamp to the ETW callback
+    LatencyHistogram Batch;    // a whole batch of events, one sample each
+    LatencyHistogram Decode;   // decoding one event
+    LatencyHistogram Queue;    // waiting for the writer thread
+    LatencyHistogram Analysis; // ProcessEventData and the device tracker
+    LatencyHistogram Output;   // printing traces
+};
+
+extern StageLatencies stageLatencies;
+
+// Set from a signal or console handler to have the writer thread print the
+// latencies
+extern std::atomic<bool> latencyReportRequested;
+
+// Prints count, p50, p99, p999 and max of every stage that saw events,
+// nothing if none did
+void PrintStageLatencies();
+
+// Formats nanoseconds with a unit that keeps the number short
+void FormatDuration(ULONGLONG ns, WCHAR *buffer, size_t count);
+
+// Monotonic clock for the stages, in nanoseconds
+inline ULONGLONG NowNanoseconds() {
+    return (ULONGLONG)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
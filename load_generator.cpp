@@ -0,0 +1,265 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "load_generator.h"
+
+#include "a2dp.h"
+#include "device_tracker.h"
+#include "providers.h"
+#include "trace_import.h"
+
+#include <cstring>
+
+namespace {
+
+// One property of a generated event, its data as --trace prints it
+struct LoadProperty {
+    const WCHAR *Name;
+    USHORT InType;
+    const char *Hex;
+};
+
+// The layouts of events.txt, in the order of LoadGenerator::Shape. The
+// values are those of the first event of the log, the generator writes
+// its own over them.
+const std::vector<std::vector<LoadProperty>> LOAD_SHAPES = {
+    // Activity: a step of AVDTP
+    {{L"PartA_PrivTags", TDH_INTYPE_UINT64, "0008000300000000"},
+     {L"AvdtpActivity", TDH_INTYPE_UINT32, "0a000000"},
+     {L"BTDeviceAddress", TDH_INTYPE_UINT64, "f479f4d2967c0000"}},
+    // Capability: a codec the headset supports
+    {{L"PartA_PrivTags", TDH_INTYPE_UINT64, "0008000200000000"},
+     {L"A2dpStandardCodecId", TDH_INTYPE_UINT8, "02"},
+     {L"A2dpVendorId", TDH_INTYPE_UINT32, "00000000"},
+     {L"A2dpVendorCodecId", TDH_INTYPE_UINT16, "0000"},
+     {L"AcceptorStreamEndPointID", TDH_INTYPE_UINT8, "03"},
+     {L"BTDeviceAddress", TDH_INTYPE_UINT64, "f479f4d2967c0000"}},
+    // Configuration: the codec selected
+    {{L"PartA_PrivTags", TDH_INTYPE_UINT64, "0008000300000000"},
+     {L"AvdtpActivity", TDH_INTYPE_UINT32, "12000000"},
+     {L"AcceptorStreamEndPointID", TDH_INTYPE_UINT8, "03"},
+     {L"InitiatorStreamEndPointID", TDH_INTYPE_UINT8, "37"},
+     {L"ResultCode", TDH_INTYPE_UINT8, "00"},
+     {L"A2dpStandardCodecId", TDH_INTYPE_UINT8, "02"},
+     {L"A2dpVendorId", TDH_INTYPE_UINT32, "00000000"},
+     {L"A2dpVendorCodecId", TDH_INTYPE_UINT16, "0000"},
+     {L"Sample Rate", TDH_INTYPE_UINT32, "80bb0000"},
+     {L"ChannelCount", TDH_INTYPE_UINT32, "02000000"},
+     {L"BTDeviceAddress", TDH_INTYPE_UINT64, "f479f4d2967c0000"}},
+    // Connection: the state the driver keeps of the device
+    {{L"PartA_PrivTags", TDH_INTYPE_UINT64, "0008000300000000"},
+     {L"A2dpIsConnected", TDH_INTYPE_UINT32, "01000000"},
+     {L"A2dpIsSepOpen", TDH_INTYPE_UINT32, "01000000"},
+     {L"A2dpIsAvrcpRegistered", TDH_INTYPE_UINT32, "01000000"},
+     {L"A2dpIsSink", TDH_INTYPE_UINT32, "00000000"},
+     {L"A2dpIsStreaming", TDH_INTYPE_UINT32, "00000000"},
+     {L"A2dpSupportsAbsoluteVolume", TDH_INTYPE_UINT32, "01000000"},
+     {L"BTDeviceAddress", TDH_INTYPE_UINT64, "f479f4d2967c0000"}},
+    // Pin: the audio pin created for the stream
+    {{L"PartA_PrivTags", TDH_INTYPE_UINT64, "0000000300000000"},
+     {L"StatusErrorCode", TDH_INTYPE_UINT32, "00000000"},
+     {L"IsKsPinCreated", TDH_INTYPE_UINT32, "01000000"},
+     {L"FormatTag", TDH_INTYPE_UINT16, "feff"},
+     {L"SampleRate", TDH_INTYPE_UINT32, "80bb000080bb000080bb0000"},
+     {L"BitDepth", TDH_INTYPE_UINT16, "10001000000010000000"},
+     {L"ChannelCount", TDH_INTYPE_UINT16, "020002000000"},
+     {L"ChannelMask", TDH_INTYPE_UINT32, "03000000"},
+     {L"BTDeviceAddress", TDH_INTYPE_UINT64, "f479f4d2967c0000"}},
+    // Transition: the driver moved the stream to another state
+    {{L"PartA_PrivTags", TDH_INTYPE_UINT64, "0000000300000000"},
+     {L"TransitionFromState", TDH_INTYPE_UINT8, "01"},
+     {L"TransitionToState", TDH_INTYPE_UINT8, "02"},
+     {L"StatusErrorCode", TDH_INTYPE_UINT32, "00000000"},
+     {L"TransitionDurationMs", TDH_INTYPE_UINT64, "0b00000000000000"},
+     {L"BTDeviceAddress", TDH_INTYPE_UINT64, "f479f4d2967c0000"}},
+};
+
+// A vendor id no company has, so its codecs are never known
+const DWORD UNKNOWN_VENDOR_ID = 0xFFFF;
+
+} // namespace
+
+LoadGenerator::LoadGenerator(const LoadOptions &options) :
+    m_options(options), m_state(options.Seed) {
+    for (int shape = 0; shape < (int)Shape::Count; shape++) {
+        EventSchema &schema = m_schemas[shape];
+        std::vector<BYTE> &data = m_data[shape];
+        for (const LoadProperty &property : LOAD_SHAPES[shape]) {
+            PropertyLayout layout;
+            layout.Name = property.Name;
+            layout.InType = property.InType;
+            layout.Size = (ULONG)strlen(property.Hex) / 2;
+            schema.Properties.push_back(layout);
+
+            const size_t offset = data.size();
+            data.resize(offset + layout.Size);
+            DecodeHex(property.Hex, layout.Size * 2, data.data() + offset);
+        }
+        ComputeLayout(schema);
+
+        for (int &property : m_properties[shape]) {
+            property = -1;
+        }
+        for (size_t i = 0; i < schema.Properties.size(); i++) {
+            const A2dpField field = schema.Properties[i].Field;
+            if (field != A2dpField::Count) {
+                m_properties[shape][(int)field] = (int)i;
+            }
+        }
+    }
+
+    // Every device supports SBC, as A2DP requires, and picks up to
+    // MAX_CODECS - 1 other codecs
+    m_devices.resize(options.Devices > 0 ? options.Devices : 1);
+    for (Device &device : m_devices) {
+        device.Address = (Random() & BT_ADDRESS_MASK) | 1;
+        device.Codecs[device.CodecCount++] = PackCodecKey(CODECS[0]);
+        const ULONG others = 1 + Below(MAX_CODECS - 1);
+        for (ULONG i = 0; i < others; i++) {
+            const ULONGLONG key =
+                PackCodecKey(CODECS[1 + Below(CODECS_COUNT - 1)]);
+            bool taken = false;
+            for (size_t k = 0; k < device.CodecCount; k++) {
+                taken = taken || device.Codecs[k] == key;
+            }
+            if (!taken) {
+                device.Codecs[device.CodecCount++] = key;
+            }
+        }
+    }
+}
+
+ULONGLONG LoadGenerator::Random() {
+    // SplitMix64, small and good enough to look random
+    ULONGLONG z = (m_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void LoadGenerator::Connect(Device &device) {
+    m_stats.Connections++;
+    size_t count = 0;
+    auto add = [&](Shape kind, DWORD value, DWORD value2 = 0,
+                   ULONGLONG codecKey = 0, BYTE sep = 0) {
+        device.Script[count++] = {kind, value, value2, codecKey, sep};
+    };
+
+    add(Shape::Activity, Below(2) == 0 ? AvdtpActivity::Connect_Cfm
+                                       : AvdtpActivity::Connect_Ind);
+    add(Shape::Connection, 1, 0);
+    add(Shape::Activity, AvdtpActivity::Discover_Cfm);
+    add(Shape::Activity, AvdtpActivity::GetCapabilities_Cfm);
+    // A SEP per codec, odd numbers as in events.txt
+    for (size_t i = 0; i < device.CodecCount; i++) {
+        add(Shape::Capability, 0, 0, device.Codecs[i], (BYTE)(2 * i + 1));
+    }
+    if (Below(100) < m_options.UnknownPercent) {
+        m_stats.UnknownCodecs++;
+        add(Shape::Capability, 0, 0,
+            PackCodecKey(A2DP_VENDOR_CODEC_ID, UNKNOWN_VENDOR_ID,
+                         (WORD)Random()),
+            (BYTE)(2 * device.CodecCount + 1));
+    }
+    const size_t selected = Below((ULONG)device.CodecCount);
+    add(Shape::Configuration, AvdtpActivity::SetConfiguration_Cfm, 0,
+        device.Codecs[selected], (BYTE)(2 * selected + 1));
+    add(Shape::Pin, 0);
+    add(Shape::Activity, AvdtpActivity::Open_Cfm);
+    add(Shape::Activity, AvdtpActivity::Start_Cfm);
+    add(Shape::Connection, 1, 1);
+    add(Shape::Transition, 2);
+
+    if (Below(100) < m_options.FlapPercent) {
+        m_stats.Flaps++;
+        add(Shape::Activity, AvdtpActivity::Disconnect_Ind);
+    } else {
+        add(Shape::Activity, AvdtpActivity::Suspend_Cfm);
+        add(Shape::Connection, 1, 0);
+        add(Shape::Activity, AvdtpActivity::Close_Cfm);
+        add(Shape::Transition, 1);
+        add(Shape::Activity, AvdtpActivity::Disconnect_Cfm);
+    }
+    add(Shape::Connection, 0, 0);
+    device.Steps = count;
+    device.Position = 0;
+}
+
+void LoadGenerator::Write(Shape shape, A2dpField field, ULONGLONG value) {
+    const int index = m_properties[(int)shape][(int)field];
+    if (index < 0) {
+        return;
+    }
+    // Little endian, like the data of the events
+    const PropertyLayout &property = m_schemas[(int)shape].Properties[index];
+    memcpy(m_data[(int)shape].data() + property.Offset, &value,
+           property.Size < sizeof(value) ? property.Size : sizeof(value));
+}
+
+bool LoadGenerator::Next(EVENT_RECORD &event, const EventSchema *&schema) {
+    if (m_stats.Events == m_options.Events) {
+        return false;
+    }
+    m_stats.Events++;
+
+    // The devices take turns at random, so their connections interleave
+    Device &device = m_devices[Below((ULONG)m_devices.size())];
+    if (device.Position == device.Steps) {
+        Connect(device);
+    }
+    const Step &step = device.Script[device.Position++];
+    const Shape shape = step.Kind;
+    Write(shape, A2dpField::BTDeviceAddress, device.Address);
+    switch (shape) {
+    case Shape::Activity:
+        Write(shape, A2dpField::AvdtpActivity, step.Value);
+        break;
+    case Shape::Capability:
+    case Shape::Configuration:
+        Write(shape, A2dpField::a2dpStandardCodecId, step.CodecKey >> 48);
+        Write(shape, A2dpField::a2dpVendorId, step.CodecKey >> 16);
+        Write(shape, A2dpField::a2dpVendorCodecId, step.CodecKey);
+        Write(shape, A2dpField::AcceptorStreamEndPointID, step.Sep);
+        break;
+    case Shape::Connection:
+        Write(shape, A2dpField::A2dpIsConnected, step.Value);
+        Write(shape, A2dpField::A2dpIsSepOpen, step.Value2);
+        Write(shape, A2dpField::A2dpIsStreaming, step.Value2);
+        break;
+    case Shape::Transition:
+        Write(shape, A2dpField::TransitionFromState, step.Value == 2 ? 1 : 2);
+        Write(shape, A2dpField::TransitionToState, step.Value);
+        break;
+    default:
+        break;
+    }
+
+    // Events a few tens of microseconds apart
+    m_timestamp += 1 + Below(1000);
+    event = EVENT_RECORD();
+    event.EventHeader.ProviderId = BTHA2DP_PROVIDER;
+    event.EventHeader.TimeStamp.QuadPart = m_timestamp;
+    event.UserData = m_data[(int)shape].data();
+    event.UserDataLength = (USHORT)m_data[(int)shape].size();
+    schema = &m_schemas[(int)shape];
+    return true;
+}
@@ -0,0 +1,132 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "codec_registry.h"
+#include "event_schema.h"
+#include "platform.h"
+
+#include <cstddef>
+#include <vector>
+
+// Synthetic BthA2dp events, to load the decoder and the analysis without a
+// headset. Simulated devices go through connections the way events.txt
+// shows them: connect, discover, a capability event per codec the device
+// supports, SetConfiguration of one of them, open and start, then either a
+// clean suspend, close and disconnect, or a sudden disconnect (a flapping
+// device). Every device supports SBC and a few codecs of CODECS picked at
+// random; some connections also announce a codec nobody knows.
+//
+// The events use the property layouts of events.txt. Their data is kept in
+// one buffer per layout and only the values are written for every event,
+// so generating an event costs far less than decoding it. The same seed
+// always gives the same events.
+
+struct LoadOptions {
+    size_t Devices = 16;
+    ULONGLONG Events = 1000000;
+    ULONGLONG Seed = 1;
+    ULONG FlapPercent = 20;   // connections that end in a sudden disconnect
+    ULONG UnknownPercent = 1; // connections announcing an unknown codec
+};
+
+struct LoadStats {
+    ULONGLONG Events = 0;
+    ULONGLONG Connections = 0;
+    ULONGLONG Flaps = 0;
+    ULONGLONG UnknownCodecs = 0;
+};
+
+// Ticks per second of the timestamps, those of QueryPerformanceCounter
+const LONGLONG LOAD_TIMESTAMP_FREQUENCY = 10000000;
+
+class LoadGenerator {
+  public:
+    explicit LoadGenerator(const LoadOptions &options);
+    LoadGenerator(const LoadGenerator &) = delete;
+    LoadGenerator &operator=(const LoadGenerator &) = delete;
+
+    // Makes the next event. Returns false once options.Events were made.
+    // event.UserData points into the generator and schema is one of its
+    // schemas: the data is good until the next call, the schemas as long
+    // as the generator lives.
+    bool Next(EVENT_RECORD &event, const EventSchema *&schema);
+
+    const LoadStats &Stats() const { return m_stats; }
+
+  private:
+    // The layouts of the events, see LOAD_SHAPES
+    enum class Shape : BYTE {
+        Activity,
+        Capability,
+        Configuration,
+        Connection,
+        Pin,
+        Transition,
+        Count
+    };
+
+    struct Step {
+        Shape Kind;
+        // AvdtpActivity, A2dpIsConnected of Connection or the state a
+        // Transition goes to
+        DWORD Value;
+        DWORD Value2;         // A2dpIsStreaming of Connection
+        ULONGLONG CodecKey;   // Capability and Configuration, PackCodecKey
+        BYTE Sep;             // acceptor SEP of the codec
+    };
+
+    // Longest connection: the fixed steps plus every codec and an unknown
+    static const size_t MAX_STEPS = 16 + 8 + 1;
+    static const size_t MAX_CODECS = 8; // SBC and up to 7 others
+
+    struct Device {
+        ULONGLONG Address = 0;
+        ULONGLONG Codecs[MAX_CODECS] = {}; // PackCodecKey
+        size_t CodecCount = 0;
+        Step Script[MAX_STEPS] = {};
+        size_t Steps = 0;
+        size_t Position = 0;
+    };
+
+    ULONGLONG Random();
+    // A number below bound, scaled instead of divided (a division costs
+    // more than making the random number)
+    ULONG Below(ULONG bound) {
+        return (ULONG)(((Random() >> 32) * bound) >> 32);
+    }
+    void Connect(Device &device);
+    // Stores the low bytes of value in the property of the field
+    void Write(Shape shape, A2dpField field, ULONGLONG value);
+
+    LoadOptions m_options;
+    ULONGLONG m_state;
+    LONGLONG m_timestamp = 0;
+    std::vector<Device> m_devices;
+    EventSchema m_schemas[(int)Shape::Count];
+    std::vector<BYTE> m_data[(int)Shape::Count];
+    // Index of the property of every field in every shape, -1 if the shape
+    // does not have it
+    int m_properties[(int)Shape::Count][A2DP_FIELD_COUNT];
+    LoadStats m_stats;
+};
@@ -0,0 +1,121 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "mapped_file.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+bool MappedFile::Open(const char *path) {
+    Close();
+    m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                         OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size)) {
+        Close();
+        return false;
+    }
+    m_size = (size_t)size.QuadPart;
+    if (m_size == 0) {
+        // Nothing to map, an empty file is still a valid file
+        return true;
+    }
+
+    m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_mapping == NULL) {
+        Close();
+        return false;
+    }
+    m_data = (const BYTE *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (m_data == NULL) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::Close() {
+    if (m_data != nullptr) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping != NULL) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_mapping = NULL;
+    m_file = INVALID_HANDLE_VALUE;
+}
+#else
+bool MappedFile::Open(const char *path) {
+    Close();
+    m_fd = open(path, O_RDONLY);
+    if (m_fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(m_fd, &info) != 0) {
+        Close();
+        return false;
+    }
+    m_size = (size_t)info.st_size;
+    if (m_size == 0) {
+        // mmap refuses empty files, but an empty file is still a valid file
+        return true;
+    }
+
+    void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (data == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    // The file is read front to back
+    madvise(data, m_size, MADV_SEQUENTIAL);
+    m_data = (const BYTE *)data;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (m_data != nullptr) {
+        munmap((void *)m_data, m_size);
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_fd = -1;
+}
+#endif
@@ -0,0 +1,260 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "metrics.h"
+
+#include "a2dp.h"
+#include "codec_registry.h"
+#include "latency_histogram.h"
+#include "output_sink.h"
+#include "providers.h"
+
+#include <cstdio>
+#include <cwchar>
+
+Metrics metrics;
+
+size_t MetricsShard() {
+    static std::atomic<size_t> nextShard{0};
+    thread_local size_t shard =
+        nextShard.fetch_add(1, std::memory_order_relaxed) % METRICS_SHARDS;
+    return shard;
+}
+
+namespace {
+
+// Upper bounds of the histogram buckets, in nanoseconds. The log-linear
+// buckets of LatencyHistogram are counted in the first bound at or above
+// their top, so a value may be reported up to ~3% higher than it was.
+const ULONGLONG STAGE_BOUNDS[] = {1000,     10000,     100000,
+                                  1000000,  10000000,  100000000,
+                                  1000000000};
+const char *STAGE_BOUND_TEXT[] = {"1e-06", "1e-05", "0.0001", "0.001",
+                                  "0.01",  "0.1",   "1.0"};
+static_assert(sizeof(STAGE_BOUNDS) / sizeof(STAGE_BOUNDS[0]) ==
+                  sizeof(STAGE_BOUND_TEXT) / sizeof(STAGE_BOUND_TEXT[0]),
+              "a text for every bound");
+
+void AppendNumber(std::string &out, ULONGLONG value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%llu", (unsigned long long)value);
+    out += text;
+}
+
+void AppendHexNumber(std::string &out, ULONGLONG value, int digits) {
+    char text[32];
+    snprintf(text, sizeof(text), "0x%0*llX", digits, (unsigned long long)value);
+    out += text;
+}
+
+// A label value: UTF-8 with backslash, quote and new line escaped
+void AppendLabelValue(std::string &out, const WCHAR *text) {
+    std::string utf8;
+    AppendUtf8(utf8, text, wcslen(text));
+    out += '"';
+    for (char c : utf8) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+void AppendFamily(std::string &out, const char *name, const char *type,
+                  const char *help) {
+    out += "# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += "\n# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += '\n';
+}
+
+void AppendCounter(std::string &out, const char *name, const char *help,
+                   ULONGLONG value) {
+    AppendFamily(out, name, "counter", help);
+    out += name;
+    out += "_total ";
+    AppendNumber(out, value);
+    out += '\n';
+}
+
+const WCHAR *CodecName(ULONGLONG key) {
+    const CodecData *codec = codecRegistry.Find(key);
+    return codec != nullptr ? codec->Name : L"unknown";
+}
+
+void AppendStage(std::string &out, const char *stage,
+                 const LatencyHistogram &histogram) {
+    // Counted from the buckets, so the +Inf bucket and the count agree
+    ULONGLONG bounds[sizeof(STAGE_BOUNDS) / sizeof(STAGE_BOUNDS[0])] = {};
+    ULONGLONG count = 0;
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        const ULONGLONG values = histogram.BucketCount(bucket);
+        if (values == 0) {
+            continue;
+        }
+        count += values;
+        const ULONGLONG top = LatencyHistogram::BucketTop(bucket);
+        for (size_t i = 0; i < sizeof(STAGE_BOUNDS) / sizeof(STAGE_BOUNDS[0]);
+             i++) {
+            if (top <= STAGE_BOUNDS[i]) {
+                bounds[i] += values;
+            }
+        }
+    }
+    for (size_t i = 0; i < sizeof(STAGE_BOUNDS) / sizeof(STAGE_BOUNDS[0]);
+         i++) {
+        out += "win_bt_codec_stage_seconds_bucket{stage=\"";
+        out += stage;
+        out += "\",le=\"";
+        out += STAGE_BOUND_TEXT[i];
+        out += "\"} ";
+        AppendNumber(out, bounds[i]);
+        out += '\n';
+    }
+    out += "win_bt_codec_stage_seconds_bucket{stage=\"";
+    out += stage;
+    out += "\",le=\"+Inf\"} ";
+    AppendNumber(out, count);
+    out += "\nwin_bt_codec_stage_seconds_count{stage=\"";
+    out += stage;
+    out += "\"} ";
+    AppendNumber(out, count);
+    char sum[32];
+    snprintf(sum, sizeof(sum), "%.9f", (double)histogram.Sum() / 1e9);
+    out += "\nwin_bt_codec_stage_seconds_sum{stage=\"";
+    out += stage;
+    out += "\"} ";
+    out += sum;
+    out += '\n';
+}
+
+} // namespace
+
+void WriteOpenMetrics(std::string &out) {
+    out.clear();
+
+    AppendCounter(out, "win_bt_codec_events",
+                  "Events received, before --filter.", metrics.Events.Value());
+    AppendCounter(out, "win_bt_codec_filtered_events",
+                  "Events dropped by --filter.", metrics.FilteredOut.Value());
+    AppendCounter(out, "win_bt_codec_decode_failures",
+                  "Events whose data did not match their schema.",
+                  metrics.DecodeFailures.Value());
+    AppendCounter(out, "win_bt_codec_dropped_events",
+                  "Events dropped because the writer thread was behind.",
+                  metrics.Dropped.Value());
+
+    AppendFamily(out, "win_bt_codec_events_by_id", "counter",
+                 "Events analyzed, by provider and event id.");
+    const std::vector<Provider> &list = providers.All();
+    metrics.EventsById.ForEach([&](ULONGLONG key, ULONGLONG value) {
+        const ULONGLONG index = key >> 16;
+        out += "win_bt_codec_events_by_id_total{provider=";
+        AppendLabelValue(out, index < list.size() ? list[index].Name.c_str()
+                                                  : L"other");
+        out += ",event_id=\"";
+        AppendNumber(out, key & 0xFFFF);
+        out += "\"} ";
+        AppendNumber(out, value);
+        out += '\n';
+    });
+
+    AppendFamily(out, "win_bt_codec_activity", "counter",
+                 "BthA2dp events, by AVDTP activity.");
+    metrics.EventsByActivity.ForEach([&](ULONGLONG key, ULONGLONG value) {
+        out += "win_bt_codec_activity_total{activity=";
+        AppendLabelValue(out, AvdtpActivityToString((AvdtpActivity)key));
+        out += ",code=\"";
+        AppendHexNumber(out, key, 2);
+        out += "\"} ";
+        AppendNumber(out, value);
+        out += '\n';
+    });
+
+    AppendFamily(out, "win_bt_codec_selected_codec", "counter",
+                 "Codecs selected for a stream.");
+    metrics.SelectedCodecs.ForEach([&](ULONGLONG key, ULONGLONG value) {
+        out += "win_bt_codec_selected_codec_total{codec=";
+        AppendLabelValue(out, CodecName(key));
+        out += "} ";
+        AppendNumber(out, value);
+        out += '\n';
+    });
+
+    AppendFamily(out, "win_bt_codec_device_codec", "info",
+                 "The codec last selected for each device.");
+    metrics.DeviceCodecs.ForEach([&](ULONGLONG address, ULONGLONG codec) {
+        // Addresses are 48 bits, but the key has room for 16 digits
+        char device[17];
+        snprintf(device, sizeof(device), "%012llX",
+                 (unsigned long long)address);
+        out += "win_bt_codec_device_codec_info{device=\"";
+        out += device;
+        out += "\",codec=";
+        AppendLabelValue(out, codec != 0 ? CodecName(codec - 1) : L"unknown");
+        out += "} 1\n";
+    });
+
+    AppendFamily(out, "win_bt_codec_unknown_codec", "counter",
+                 "Codec announcements and selections with unknown ids.");
+    metrics.UnknownCodecs.ForEach([&](ULONGLONG key, ULONGLONG value) {
+        out += "win_bt_codec_unknown_codec_total{standard=\"";
+        AppendHexNumber(out, key >> 48, 2);
+        out += "\",vendor=\"";
+        AppendHexNumber(out, (key >> 16) & 0xFFFFFFFF, 8);
+        out += "\",vendor_codec=\"";
+        AppendHexNumber(out, key & 0xFFFF, 4);
+        out += "\"} ";
+        AppendNumber(out, value);
+        out += '\n';
+    });
+
+    AppendCounter(out, "win_bt_codec_metrics_overflow",
+                  "Updates lost because a labeled metric ran out of slots.",
+                  metrics.EventsById.Overflow() +
+                      metrics.EventsByActivity.Overflow() +
+                      metrics.SelectedCodecs.Overflow() +
+                      metrics.UnknownCodecs.Overflow() +
+                      metrics.DeviceCodecs.Overflow());
+
+    AppendFamily(out, "win_bt_codec_stage_seconds", "histogram",
+                 "Time spent in each stage of the event pipeline.");
+    AppendStage(out, "delivery", stageLatencies.Delivery);
+    AppendStage(out, "batch", stageLatencies.Batch);
+    AppendStage(out, "decode", stageLatencies.Decode);
+    AppendStage(out, "queue", stageLatencies.Queue);
+    AppendStage(out, "analysis", stageLatencies.Analysis);
+    AppendStage(out, "output", stageLatencies.Output);
+
+    out += "# EOF\n";
+}
@@ -0,0 +1,159 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "platform.h"
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+// Counters for a monitoring system to scrape, see metrics_server.h. The
+// threads that see the events only ever do relaxed atomic additions and the
+// exporter only reads, so exporting never slows the ETW callback down, and
+// nothing is locked on either side.
+
+const size_t METRICS_SHARDS = 8;
+
+// Index of the shard the calling thread adds to. Threads get one each, in
+// turn, the first time they ask.
+size_t MetricsShard();
+
+// A counter several threads add to. Each thread adds to its own cache line,
+// so they do not fight over it, and a read adds the shards up.
+class ShardedCounter {
+  public:
+    void Add(ULONGLONG count = 1) {
+        m_shards[MetricsShard()].Value.fetch_add(count,
+                                                 std::memory_order_relaxed);
+    }
+
+    ULONGLONG Value() const {
+        ULONGLONG value = 0;
+        for (const Shard &shard : m_shards) {
+            value += shard.Value.load(std::memory_order_relaxed);
+        }
+        return value;
+    }
+
+  private:
+    struct alignas(64) Shard {
+        std::atomic<ULONGLONG> Value{0};
+    };
+    Shard m_shards[METRICS_SHARDS];
+};
+
+// Values by key (an event id, a codec, a device), for metrics with labels.
+// Open addressing in a fixed array: a key is claimed with a compare and
+// swap and never removed, so lookups and readers need no lock. Keys that
+// do not fit any more are counted in Overflow().
+template <size_t Slots> class MetricsTable {
+    static_assert((Slots & (Slots - 1)) == 0, "Slots has to be a power of two");
+
+  public:
+    // Adds to the counter of key
+    void Add(ULONGLONG key, ULONGLONG count = 1) {
+        std::atomic<ULONGLONG> *value = Find(key);
+        if (value != nullptr) {
+            value->fetch_add(count, std::memory_order_relaxed);
+        } else {
+            m_overflow.fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    // Sets the gauge of key
+    void Set(ULONGLONG key, ULONGLONG value) {
+        std::atomic<ULONGLONG> *slot = Find(key);
+        if (slot != nullptr) {
+            slot->store(value, std::memory_order_relaxed);
+        } else {
+            m_overflow.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Calls fn(key, value) for every key, in no particular order
+    template <typename Fn> void ForEach(Fn &&fn) const {
+        for (size_t i = 0; i < Slots; i++) {
+            const ULONGLONG stored = m_keys[i].load(std::memory_order_acquire);
+            if (stored != 0) {
+                fn(stored - 1, m_values[i].load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    ULONGLONG Overflow() const {
+        return m_overflow.load(std::memory_order_relaxed);
+    }
+
+  private:
+    // Keys are stored plus one, 0 marks a free slot
+    std::atomic<ULONGLONG> *Find(ULONGLONG key) {
+        const ULONGLONG stored = key + 1;
+        ULONGLONG mixed = stored * 0x9E3779B97F4A7C15ULL;
+        size_t slot = (size_t)(mixed >> 32) & (Slots - 1);
+        for (size_t probe = 0; probe < Slots; probe++) {
+            ULONGLONG current = m_keys[slot].load(std::memory_order_acquire);
+            if (current == 0 &&
+                m_keys[slot].compare_exchange_strong(
+                    current, stored, std::memory_order_acq_rel)) {
+                return &m_values[slot];
+            }
+            // current holds the key of the slot, claimed by us or not
+            if (current == stored) {
+                return &m_values[slot];
+            }
+            slot = (slot + 1) & (Slots - 1);
+        }
+        return nullptr;
+    }
+
+    std::atomic<ULONGLONG> m_keys[Slots] = {};
+    std::atomic<ULONGLONG> m_values[Slots] = {};
+    std::atomic<ULONGLONG> m_overflow{0};
+};
+
+// What is exported. Stage times come from stageLatencies.
+struct Metrics {
+    // Counted where the events come in
+    ShardedCounter Events;         // received, before --filter
+    ShardedCounter FilteredOut;    // by --filter
+    ShardedCounter DecodeFailures; // data did not match the schema
+    ShardedCounter Dropped;        // the writer was too far behind
+
+    // Counted by the writer thread
+    MetricsTable<256> EventsById;       // provider index << 16 | event id
+    MetricsTable<64> EventsByActivity;  // AvdtpActivity
+    MetricsTable<64> SelectedCodecs;    // PackCodecKey
+    MetricsTable<256> UnknownCodecs;    // PackCodecKey of the ids
+    MetricsTable<256> DeviceCodecs;     // address, PackCodecKey + 1 of the
+                                        // selected codec, 0 if unknown
+};
+
+extern Metrics metrics;
+
+// Provider index of EventsById for providers not in the list
+const ULONGLONG METRICS_OTHER_PROVIDER = 0xFFFF;
+
+// Replaces out with the metrics in the OpenMetrics text format
+void WriteOpenMetrics(std::string &out);
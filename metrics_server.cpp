@@ -0,0 +1,221 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// winsock2.h has to come before windows.h, which platform.h pulls in
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+
+#include "metrics_server.h"
+
+#include "metrics.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// How long Stop() may wait for the thread to notice
+const int ACCEPT_POLL_MS = 100;
+
+// A request that is not in after this is given up
+const int REQUEST_TIMEOUT_MS = 2000;
+
+// Requests are a line and a few headers, anything longer is not a scraper
+const size_t MAX_REQUEST = 8192;
+
+const char CONTENT_TYPE[] =
+    "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+#ifdef _WIN32
+const MetricsSocket NO_SOCKET = (MetricsSocket)INVALID_SOCKET;
+
+void CloseSocket(MetricsSocket socket) { closesocket((SOCKET)socket); }
+
+// Waits up to timeout for the socket to be readable
+bool WaitReadable(MetricsSocket socket, int timeoutMs) {
+    WSAPOLLFD poll = {};
+    poll.fd = (SOCKET)socket;
+    poll.events = POLLRDNORM;
+    return WSAPoll(&poll, 1, timeoutMs) > 0;
+}
+#else
+const MetricsSocket NO_SOCKET = -1;
+
+void CloseSocket(MetricsSocket socket) { close(socket); }
+
+bool WaitReadable(MetricsSocket socket, int timeoutMs) {
+    pollfd descriptor = {};
+    descriptor.fd = socket;
+    descriptor.events = POLLIN;
+    return poll(&descriptor, 1, timeoutMs) > 0;
+}
+#endif
+
+bool SendAll(MetricsSocket socket, const char *data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        const int chunk = size > 65536 ? 65536 : (int)size;
+        const int sent = send((SOCKET)socket, data, chunk, 0);
+#else
+        // A scraper that hung up must not kill the process with SIGPIPE
+        const ssize_t sent = send(socket, data, size, MSG_NOSIGNAL);
+#endif
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+} // namespace
+
+bool MetricsServer::Start(unsigned short port) {
+    Stop();
+#ifdef _WIN32
+    WSADATA data;
+    if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+        return false;
+    }
+#endif
+    m_listen = (MetricsSocket)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (m_listen == NO_SOCKET) {
+        return false;
+    }
+#ifndef _WIN32
+    // A restarted monitor can take the port again right away
+    int reuse = 1;
+    setsockopt(m_listen, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#endif
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    socklen_t length = sizeof(address);
+    if (bind(m_listen, (sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(m_listen, 4) != 0 ||
+        getsockname(m_listen, (sockaddr *)&address, &length) != 0) {
+        CloseSocket(m_listen);
+        return false;
+    }
+    m_port = ntohs(address.sin_port);
+    m_listening = true;
+    m_stop.store(false);
+    m_thread = std::thread(&MetricsServer::Run, this);
+    return true;
+}
+
+void MetricsServer::Stop() {
+    if (!m_listening) {
+        return;
+    }
+    m_stop.store(true, std::memory_order_release);
+    m_thread.join();
+    CloseSocket(m_listen);
+    m_listening = false;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+void MetricsServer::Run() {
+    while (!m_stop.load(std::memory_order_acquire)) {
+        if (!WaitReadable(m_listen, ACCEPT_POLL_MS)) {
+            continue;
+        }
+        const MetricsSocket client = (MetricsSocket)accept(m_listen, nullptr,
+                                                           nullptr);
+        if (client == NO_SOCKET) {
+            continue;
+        }
+        Serve(client);
+        CloseSocket(client);
+    }
+}
+
+void MetricsServer::Serve(MetricsSocket client) {
+    // Read up to the end of the headers, the body of a GET is ignored
+    m_request.clear();
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(REQUEST_TIMEOUT_MS);
+    char buffer[1024];
+    while (m_request.find("\r\n\r\n") == std::string::npos) {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              deadline - std::chrono::steady_clock::now())
+                              .count();
+        if (left <= 0 || m_request.size() > MAX_REQUEST ||
+            !WaitReadable(client, (int)left)) {
+            return;
+        }
+#ifdef _WIN32
+        const int received = recv((SOCKET)client, buffer, sizeof(buffer), 0);
+#else
+        const ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+#endif
+        if (received <= 0) {
+            return;
+        }
+        m_request.append(buffer, (size_t)received);
+    }
+
+    const char *status = "200 OK";
+    const bool get = m_request.compare(0, 4, "GET ") == 0;
+    const size_t pathEnd = m_request.find(' ', 4);
+    const std::string path =
+        get && pathEnd != std::string::npos ? m_request.substr(4, pathEnd - 4)
+                                            : std::string();
+    if (!get) {
+        status = "405 Method Not Allowed";
+        m_body = "Only GET is supported\n";
+    } else if (path != "/metrics" && path.compare(0, 9, "/metrics?") != 0) {
+        status = "404 Not Found";
+        m_body = "The metrics are at /metrics\n";
+    } else {
+        WriteOpenMetrics(m_body);
+        m_scrapes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    char header[256];
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+             "Connection: close\r\n\r\n",
+             status, status[0] == '2' ? CONTENT_TYPE : "text/plain",
+             m_body.size());
+    m_response = header;
+    m_response += m_body;
+    SendAll(client, m_response.data(), m_response.size());
+}
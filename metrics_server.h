@@ -0,0 +1,79 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "platform.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// A SOCKET on Windows, kept apart from winsock2.h here as that has to come
+// before windows.h
+#ifdef _WIN32
+typedef uintptr_t MetricsSocket;
+#else
+typedef int MetricsSocket;
+#endif
+
+// Serves WriteOpenMetrics() at http://127.0.0.1:PORT/metrics from a thread
+// of its own. It only reads the metrics, so a slow or stuck scraper never
+// holds up the events. One request per connection, one connection at a
+// time: scrapers come every few seconds.
+class MetricsServer {
+  public:
+    MetricsServer() = default;
+    ~MetricsServer() { Stop(); }
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer &operator=(const MetricsServer &) = delete;
+
+    // Listens on the loopback address only, port 0 picks a free port.
+    // Returns false if the port can not be bound.
+    bool Start(unsigned short port);
+
+    void Stop();
+
+    // The port listened on, once started
+    unsigned short Port() const { return m_port; }
+
+    // Requests answered with the metrics
+    ULONGLONG Scrapes() const {
+        return m_scrapes.load(std::memory_order_relaxed);
+    }
+
+  private:
+    void Run();
+    void Serve(MetricsSocket client);
+
+    MetricsSocket m_listen;
+    bool m_listening = false;
+    unsigned short m_port = 0;
+    std::thread m_thread;
+    std::atomic<bool> m_stop{false};
+    std::atomic<ULONGLONG> m_scrapes{0};
+    std::string m_request;
+    std::string m_body;
+    std::string m_response;
+};
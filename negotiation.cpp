@@ -0,0 +1,290 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "negotiation.h"
+
+#include "device_tracker.h"
+
+#include <cwchar>
+#include <stdio.h>
+
+namespace {
+
+// Activities that end the connection or its stream, the next setup is a
+// new connection
+bool EndsConnection(DWORD activity) {
+    switch (activity) {
+    case AvdtpActivity::Disconnect_Cfm:
+    case AvdtpActivity::Disconnect_Ind:
+    case AvdtpActivity::Close_Cfm:
+    case AvdtpActivity::Close_Ind:
+    case AvdtpActivity::Abort_Cfm:
+    case AvdtpActivity::Abort_Ind:
+    case AvdtpActivity::AbortStream:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void PrintSketches(const WCHAR *title, const NegotiationSketches &sketches) {
+    wprintf(L"  %ls: %llu connections\n", title,
+            (unsigned long long)sketches.Connections);
+    for (int i = 0; i < NEGOTIATION_STATS; i++) {
+        const QuantileSketch &sketch = sketches.Stats[i];
+        if (sketch.Count() == 0) {
+            continue;
+        }
+        // The sketches hold microseconds
+        WCHAR p50[32], p99[32], max[32];
+        FormatDuration(sketch.Percentile(0.5) * 1000, p50, 32);
+        FormatDuration(sketch.Percentile(0.99) * 1000, p99, 32);
+        FormatDuration(sketch.Max() * 1000, max, 32);
+        wprintf(L"    %-28ls %8llu %10ls %10ls %10ls\n",
+                NegotiationStatToString((NegotiationStat)i),
+                (unsigned long long)sketch.Count(), p50, p99, max);
+    }
+}
+
+} // namespace
+
+NegotiationPhase PhaseOfActivity(DWORD activity) {
+    switch (activity) {
+    case AvdtpActivity::Discover_Cfm:
+    case AvdtpActivity::Discover_Ind:
+        return NegotiationPhase::Discover;
+    case AvdtpActivity::GetCapabilities_Cfm:
+    case AvdtpActivity::GetCapabilities_ind:
+    case AvdtpActivity::FindNextSepAndGepCaps:
+        return NegotiationPhase::GetCapabilities;
+    case AvdtpActivity::SetConfiguration_Cfm:
+    case AvdtpActivity::SetConfiguration_Ind_1:
+    case AvdtpActivity::SetConfiguration_Ind_2:
+        return NegotiationPhase::SetConfiguration;
+    case AvdtpActivity::Open_Cfm:
+    case AvdtpActivity::Open_Ind:
+        return NegotiationPhase::Open;
+    case AvdtpActivity::Start_Cfm:
+    case AvdtpActivity::Start_Ind:
+        return NegotiationPhase::Start;
+    default:
+        return NegotiationPhase::Count;
+    }
+}
+
+const WCHAR *NegotiationStatToString(NegotiationStat stat) {
+    switch (stat) {
+    case NegotiationStat::DiscoverToCapabilities:
+        return L"discover to capabilities";
+    case NegotiationStat::CapabilitiesToConfiguration:
+        return L"capabilities to configured";
+    case NegotiationStat::ConfigurationToOpen:
+        return L"configured to open";
+    case NegotiationStat::OpenToStart:
+        return L"open to start";
+    case NegotiationStat::TimeToFirstStream:
+        return L"time to first stream";
+    default:
+        return L"Unknown";
+    }
+}
+
+void NegotiationSketches::Merge(const NegotiationSketches &other) {
+    Connections += other.Connections;
+    for (int i = 0; i < NEGOTIATION_STATS; i++) {
+        Stats[i].Merge(other.Stats[i]);
+    }
+}
+
+void NegotiationTracker::Update(LONGLONG timestamp,
+                                const A2dpEventData &eventData,
+                                const A2dpFinding &finding) {
+    if (m_frequency <= 0) {
+        return;
+    }
+    const std::optional<ULONGLONG> address = EventDeviceAddress(eventData);
+    if (!address) {
+        return;
+    }
+
+    NegotiationPhase phase = NegotiationPhase::Count;
+    if (eventData.AvdtpActivity) {
+        if (EndsConnection(*eventData.AvdtpActivity)) {
+            // The entry stays for the next connection of the device, so
+            // reconnecting does not allocate
+            auto found = m_connections.find(*address);
+            if (found != m_connections.end()) {
+                Record(*address, found->second);
+                found->second = Connection();
+            }
+            return;
+        }
+        phase = PhaseOfActivity(*eventData.AvdtpActivity);
+    } else if (finding.Kind == A2dpFindingKind::SupportedCodec ||
+               finding.Kind == A2dpFindingKind::UnknownCodec) {
+        // The headset lists its codecs in answer to GetCapabilities
+        phase = NegotiationPhase::GetCapabilities;
+    }
+    if (phase == NegotiationPhase::Count) {
+        return;
+    }
+
+    Connection &connection = m_connections[*address];
+    if (connection.Active && connection.Recorded &&
+        phase != NegotiationPhase::Start) {
+        // Set up again without an end in between, a new connection
+        Record(*address, connection);
+        connection = Connection();
+    }
+    if (!connection.Active) {
+        if (phase == NegotiationPhase::Start) {
+            return; // a stream resumed, the setup was before the tool ran
+        }
+        connection.Active = true;
+        connection.First = timestamp;
+    }
+
+    // The first event of a phase counts, the phases repeat per SEP and as
+    // Cfm and Ind
+    const unsigned bit = 1u << (int)phase;
+    if ((connection.PhasesSeen & bit) == 0) {
+        connection.PhasesSeen |= bit;
+        connection.PhaseStart[(int)phase] = timestamp;
+    }
+    if (finding.Kind == A2dpFindingKind::SelectedCodec) {
+        connection.Codec = FindCodec(eventData);
+    }
+    if (phase == NegotiationPhase::Start && !connection.Recorded) {
+        Record(*address, connection);
+    }
+}
+
+void NegotiationTracker::Record(ULONGLONG address, Connection &connection) {
+    if (!connection.Active || connection.Recorded) {
+        return;
+    }
+    connection.Recorded = true;
+
+    // Durations in microseconds. Events that came out of order make no
+    // sense as durations and are left out.
+    LONGLONG durations[NEGOTIATION_STATS];
+    bool have[NEGOTIATION_STATS] = {};
+    for (int i = 0; i + 1 < NEGOTIATION_PHASES; i++) {
+        const unsigned both = 3u << i;
+        if ((connection.PhasesSeen & both) == both) {
+            durations[i] =
+                connection.PhaseStart[i + 1] - connection.PhaseStart[i];
+            have[i] = durations[i] >= 0;
+        }
+    }
+    const int start = (int)NegotiationPhase::Start;
+    const int total = (int)NegotiationStat::TimeToFirstStream;
+    if ((connection.PhasesSeen & (1u << start)) != 0) {
+        durations[total] = connection.PhaseStart[start] - connection.First;
+        have[total] = durations[total] >= 0;
+    }
+
+    NegotiationSketches &codec = CodecSketches(connection.Codec);
+    NegotiationSketches *device = DeviceSketches(address);
+    m_all.Connections++;
+    codec.Connections++;
+    if (device != nullptr) {
+        device->Connections++;
+    }
+    for (int i = 0; i < NEGOTIATION_STATS; i++) {
+        if (!have[i]) {
+            continue;
+        }
+        const ULONGLONG us =
+            (ULONGLONG)((double)durations[i] * 1e6 / (double)m_frequency);
+        m_all.Stats[i].Record(us);
+        codec.Stats[i].Record(us);
+        if (device != nullptr) {
+            device->Stats[i].Record(us);
+        }
+    }
+}
+
+void NegotiationTracker::Finish() {
+    for (auto &connection : m_connections) {
+        Record(connection.first, connection.second);
+        connection.second = Connection();
+    }
+}
+
+void NegotiationTracker::Merge(const NegotiationTracker &other) {
+    m_all.Merge(other.m_all);
+    for (const auto &codec : other.m_codecs) {
+        CodecSketches(codec.first).Merge(codec.second);
+    }
+    for (const auto &device : other.m_devices) {
+        NegotiationSketches *sketches = DeviceSketches(device.first);
+        if (sketches != nullptr) {
+            sketches->Merge(device.second);
+        }
+    }
+}
+
+NegotiationSketches &
+NegotiationTracker::CodecSketches(const CodecData *codec) {
+    for (auto &entry : m_codecs) {
+        if (entry.first == codec) {
+            return entry.second;
+        }
+    }
+    m_codecs.emplace_back(codec, NegotiationSketches());
+    return m_codecs.back().second;
+}
+
+NegotiationSketches *NegotiationTracker::DeviceSketches(ULONGLONG address) {
+    for (auto &entry : m_devices) {
+        if (entry.first == address) {
+            return &entry.second;
+        }
+    }
+    if (m_devices.size() == NEGOTIATION_MAX_DEVICES) {
+        return nullptr;
+    }
+    m_devices.emplace_back(address, NegotiationSketches());
+    return &m_devices.back().second;
+}
+
+void PrintNegotiationStats(const NegotiationTracker &tracker) {
+    if (tracker.All().Connections == 0) {
+        return;
+    }
+    wprintf(L"\nStream setup:\n");
+    wprintf(L"    %-28ls %8ls %10ls %10ls %10ls\n", L"", L"count", L"p50",
+            L"p99", L"max");
+    PrintSketches(L"All", tracker.All());
+    tracker.ForEachCodec(
+        [](const CodecData *codec, const NegotiationSketches &sketches) {
+            PrintSketches(codec != nullptr ? codec->Name : L"Codec not known",
+                          sketches);
+        });
+    tracker.ForEachDevice(
+        [](ULONGLONG address, const NegotiationSketches &sketches) {
+            WCHAR title[32];
+            swprintf(title, 32, L"Device %012llX", (unsigned long long)address);
+            PrintSketches(title, sketches);
+        });
+}
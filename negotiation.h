@@ -0,0 +1,139 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "a2dp.h"
+#include "codec_registry.h"
+#include "latency_histogram.h"
+#include "platform.h"
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+// How long AVDTP stream setup takes, per connection, from the event
+// timestamps. A connection goes through the phases below; the time from
+// the first event of one phase to the first event of the next, and from
+// the first event of the connection to the first Start, are recorded in
+// QuantileSketches. They are kept for all connections, per selected codec
+// and per device, so a monitor running for weeks uses the same memory as a
+// short run and separate runs can be merged.
+
+enum class NegotiationPhase {
+    Discover,
+    GetCapabilities, // also the codec announcements of the headset
+    SetConfiguration,
+    Open,
+    Start,
+    Count
+};
+
+const int NEGOTIATION_PHASES = (int)NegotiationPhase::Count;
+
+// Returns the phase the activity belongs to, Count if none
+NegotiationPhase PhaseOfActivity(DWORD activity);
+
+// The durations recorded per connection, in microseconds
+enum class NegotiationStat {
+    DiscoverToCapabilities,
+    CapabilitiesToConfiguration,
+    ConfigurationToOpen,
+    OpenToStart,
+    TimeToFirstStream,
+    Count
+};
+
+const int NEGOTIATION_STATS = (int)NegotiationStat::Count;
+
+const WCHAR *NegotiationStatToString(NegotiationStat stat);
+
+struct NegotiationSketches {
+    ULONGLONG Connections = 0;
+    QuantileSketch Stats[NEGOTIATION_STATS];
+
+    void Merge(const NegotiationSketches &other);
+};
+
+// Devices beyond this many are only counted in the totals and per codec
+const size_t NEGOTIATION_MAX_DEVICES = 64;
+
+class NegotiationTracker {
+  public:
+    // Timestamps are in ticks of ticksPerSecond. With 0 (logs without
+    // timestamps) nothing is tracked.
+    void SetFrequency(LONGLONG ticksPerSecond) { m_frequency = ticksPerSecond; }
+
+    // Moves the connection of the device the event is about. finding is
+    // what AnalyzeEventData made of the event.
+    void Update(LONGLONG timestamp, const A2dpEventData &eventData,
+                const A2dpFinding &finding);
+
+    // Records what the connections still in progress measured so far
+    void Finish();
+
+    // Adds the sketches of other, for example of another run or thread.
+    // Connections in progress are not merged.
+    void Merge(const NegotiationTracker &other);
+
+    const NegotiationSketches &All() const { return m_all; }
+
+    // Calls fn(const CodecData *, const NegotiationSketches &) per selected
+    // codec, the codec is nullptr for connections without a known codec
+    template <typename Fn> void ForEachCodec(Fn &&fn) const {
+        for (const auto &codec : m_codecs) {
+            fn(codec.first, codec.second);
+        }
+    }
+
+    // Calls fn(ULONGLONG address, const NegotiationSketches &) per device
+    template <typename Fn> void ForEachDevice(Fn &&fn) const {
+        for (const auto &device : m_devices) {
+            fn(device.first, device.second);
+        }
+    }
+
+  private:
+    struct Connection {
+        bool Active = false;
+        bool Recorded = false; // reached Start and was recorded
+        LONGLONG First = 0;    // timestamp of the first event
+        LONGLONG PhaseStart[NEGOTIATION_PHASES] = {};
+        unsigned PhasesSeen = 0; // bit per phase
+        const CodecData *Codec = nullptr;
+    };
+
+    void Record(ULONGLONG address, Connection &connection);
+    NegotiationSketches &CodecSketches(const CodecData *codec);
+    NegotiationSketches *DeviceSketches(ULONGLONG address);
+
+    LONGLONG m_frequency = 0;
+    std::unordered_map<ULONGLONG, Connection> m_connections;
+    NegotiationSketches m_all;
+    // A few codecs and a bounded number of devices, searched linearly
+    std::vector<std::pair<const CodecData *, NegotiationSketches>> m_codecs;
+    std::vector<std::pair<ULONGLONG, NegotiationSketches>> m_devices;
+};
+
+// Prints count, p50, p99 and max of every duration, for all connections,
+// per codec and per device. Nothing if no connection was seen.
+void PrintNegotiationStats(const NegotiationTracker &tracker);
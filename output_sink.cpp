@@ -0,0 +1,690 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "output_sink.h"
+#include "output_writer.h"
+#include "providers.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Buffers are written out once they grow past this many characters
+const size_t SINK_BUFFER_SIZE = 64 * 1024;
+
+// The two hex digits of every byte value, so a byte is encoded with a single
+// lookup and no branches
+struct HexTable {
+    char Digits[256][2];
+};
+
+constexpr HexTable BuildHexTable() {
+    HexTable table = {};
+    const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 256; i++) {
+        table.Digits[i][0] = digits[i >> 4];
+        table.Digits[i][1] = digits[i & 0xF];
+    }
+    return table;
+}
+
+constexpr HexTable HEX_TABLE = BuildHexTable();
+
+// Appends size bytes as lower case hex to text, wide or narrow
+template <typename String>
+void AppendHex(String &text, const BYTE *data, size_t size) {
+    const size_t start = text.size();
+    text.resize(start + size * 2);
+    auto *out = &text[start];
+    for (size_t i = 0; i < size; i++) {
+        out[2 * i] = HEX_TABLE.Digits[data[i]][0];
+        out[2 * i + 1] = HEX_TABLE.Digits[data[i]][1];
+    }
+}
+
+template <typename String>
+void AppendDecimal(String &text, ULONGLONG value) {
+    char digits[20];
+    int length = 0;
+    do {
+        digits[length++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (length > 0) {
+        text += digits[--length];
+    }
+}
+
+// Writes everything to the file. Returns false if writing failed.
+bool WriteAll(FILE *file, const void *data, size_t size) {
+    if (file != stdout) {
+        return fwrite(data, 1, size, file) == size;
+    }
+
+    // The rest of the tool prints wide text to stdout, and a wide stream
+    // refuses bytes, so they go to its descriptor after what it buffered
+    fflush(stdout);
+    const char *bytes = (const char *)data;
+    while (size > 0) {
+#ifdef _WIN32
+        int written = _write(_fileno(stdout), bytes,
+                             size > 0x40000000 ? 0x40000000 : (unsigned)size);
+#else
+        ssize_t written = write(STDOUT_FILENO, bytes, size);
+#endif
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+// Appends the code point as UTF-8
+void AppendCodePoint(std::string &text, ULONG c) {
+    if (c < 0x80) {
+        text += (char)c;
+    } else if (c < 0x800) {
+        text += (char)(0xC0 | c >> 6);
+        text += (char)(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        text += (char)(0xE0 | c >> 12);
+        text += (char)(0x80 | (c >> 6 & 0x3F));
+        text += (char)(0x80 | (c & 0x3F));
+    } else {
+        text += (char)(0xF0 | c >> 18);
+        text += (char)(0x80 | (c >> 12 & 0x3F));
+        text += (char)(0x80 | (c >> 6 & 0x3F));
+        text += (char)(0x80 | (c & 0x3F));
+    }
+}
+
+// Reads the code point at text, putting UTF-16 surrogate pairs (WCHAR is
+// UTF-16 on Windows) together, and moves past it
+ULONG NextCodePoint(const WCHAR *&text) {
+    ULONG c = (ULONG)*text++;
+    if (c >= 0xD800 && c < 0xDC00 && (ULONG)*text >= 0xDC00 &&
+        (ULONG)*text < 0xE000) {
+        c = 0x10000 + ((c - 0xD800) << 10) + ((ULONG)*text++ - 0xDC00);
+    }
+    return c;
+}
+
+} // namespace
+
+void AppendUtf8(std::string &out, const WCHAR *text, size_t length) {
+    const WCHAR *end = text + length;
+    while (text < end) {
+        const WCHAR *ascii = text;
+        while (ascii < end && (ULONG)*ascii < 0x80) {
+            ascii++;
+        }
+        const size_t start = out.size();
+        out.resize(start + (ascii - text));
+        for (char *narrow = &out[start]; text < ascii; text++) {
+            *narrow++ = (char)*text;
+        }
+        if (text < end) {
+            AppendCodePoint(out, NextCodePoint(text));
+        }
+    }
+}
+
+namespace {
+
+// What the tool always printed, buffered
+class TextSink : public OutputSink {
+  public:
+    TextSink(FILE *file, bool close) : m_file(file), m_close(close) {}
+    ~TextSink() override {
+        Flush();
+        if (m_close) {
+            fclose(m_file);
+        }
+    }
+
+    void WriteEvent(const EventMessage &message, const A2dpFinding &finding,
+                    bool trace) override {
+        if (trace) {
+            AppendTrace(message);
+        }
+        switch (finding.Kind) {
+        case A2dpFindingKind::SupportedCodec:
+            m_buffer += L"> Received supported codec: ";
+            m_buffer += finding.CodecName;
+            m_buffer += L"\n";
+            break;
+        case A2dpFindingKind::SelectedCodec:
+            m_buffer += L"# Selected codec: ";
+            m_buffer += finding.CodecName;
+            m_buffer += L"\n";
+            break;
+        case A2dpFindingKind::UnknownCodec:
+            m_buffer += L"ERROR: Unknown codec\n";
+            break;
+        default:
+            break;
+        }
+        if (m_buffer.size() >= SINK_BUFFER_SIZE) {
+            Write();
+        }
+    }
+
+    void BeginDump(const WCHAR *reason, size_t events) override {
+        m_buffer += L"=== Flight recorder (";
+        m_buffer += reason;
+        m_buffer += L"): ";
+        AppendDecimal(m_buffer, events);
+        m_buffer += L" events kept ===\n";
+    }
+
+    void EndDump() override {
+        m_buffer += L"=== End of the flight recorder ===\n";
+    }
+
+    void WriteChange(const EventMessage &,
+                     const DeviceChange &change) override {
+        switch (change.Kind) {
+        case DeviceChangeKind::CodecSetUnchanged:
+            m_buffer += L"= Codec set unchanged: ";
+            AppendDecimal(m_buffer, change.Codecs);
+            m_buffer += change.Codecs == 1 ? L" codec\n" : L" codecs\n";
+            break;
+        case DeviceChangeKind::CodecWithdrawn:
+            m_buffer += L"- Codec no longer supported: ";
+            m_buffer += change.CodecName;
+            m_buffer += L"\n";
+            break;
+        case DeviceChangeKind::SelectedCodecChanged:
+            m_buffer += L"# Selected codec changed: ";
+            m_buffer += change.PreviousCodecName;
+            m_buffer += L" -> ";
+            m_buffer += change.CodecName;
+            m_buffer += L"\n";
+            break;
+        }
+    }
+
+    bool Flush() override {
+        Write();
+        if (fflush(m_file) != 0) {
+            m_failed = true;
+        }
+        return !m_failed;
+    }
+
+  private:
+    void AppendTrace(const EventMessage &message) {
+        if (message.Schema == nullptr) {
+            return; // nothing raw to show
+        }
+        m_buffer += L"--------------------------------------\nEvent ID: ";
+        AppendDecimal(m_buffer, message.EventId);
+        m_buffer += L"\n";
+        if (message.Kind != ProviderKind::A2dp) {
+            const Provider *provider = providers.Find(message.ProviderId);
+            m_buffer += L"Provider: ";
+            m_buffer += provider != nullptr ? provider->Name
+                                            : GuidToString(message.ProviderId);
+            m_buffer += L"\n";
+        }
+
+        const BYTE *data = message.UserData;
+        for (USHORT i = 0; i < message.PropertyCount; i++) {
+            const ULONG size = message.PropertySizes[i];
+            AppendPropertyLine(m_buffer, message.Schema->Properties[i], data,
+                               size, message.Data);
+            data += size;
+        }
+
+        if (!message.Decoded) {
+            m_buffer += L"  (event data does not match its schema)\n";
+        } else if (message.PropertyCount <
+                   message.Schema->Properties.size()) {
+            m_buffer += L"  (";
+            AppendDecimal(m_buffer, message.Schema->Properties.size() -
+                                        message.PropertyCount);
+            m_buffer += L" more properties, too big to keep)\n";
+        }
+    }
+
+    // Converting the text ourselves and writing bytes is several times
+    // faster than the conversions of a wide stream
+    void Write() {
+        if (m_buffer.empty()) {
+            return;
+        }
+        m_bytes.clear();
+        AppendUtf8(m_bytes, m_buffer.data(), m_buffer.size());
+        if (!WriteAll(m_file, m_bytes.data(), m_bytes.size())) {
+            m_failed = true;
+        }
+        m_buffer.clear();
+    }
+
+    FILE *m_file;
+    bool m_close;
+    bool m_failed = false;
+    std::wstring m_buffer;
+    std::string m_bytes;
+};
+
+// Appends text as a JSON string, UTF-8 encoded
+void AppendJsonString(std::string &json, const WCHAR *text) {
+    json += '"';
+    while (*text != 0) {
+        ULONG c = NextCodePoint(text);
+        if (c == '"' || c == '\\') {
+            json += '\\';
+            json += (char)c;
+        } else if (c < 0x20) {
+            json += "\\u00";
+            json += HEX_TABLE.Digits[c][0];
+            json += HEX_TABLE.Digits[c][1];
+        } else {
+            AppendCodePoint(json, c);
+        }
+    }
+    json += '"';
+}
+
+const char *FindingName(A2dpFindingKind kind) {
+    switch (kind) {
+    case A2dpFindingKind::SupportedCodec:
+        return "supported_codec";
+    case A2dpFindingKind::SelectedCodec:
+        return "selected_codec";
+    case A2dpFindingKind::UnknownCodec:
+        return "unknown_codec";
+    default:
+        return nullptr;
+    }
+}
+
+// One JSON object per line:
+//
+//   {"timestamp":..,"processor":..,"provider":"BthA2dp","event_id":0,
+//    "decoded":true,"fields":{"BTDeviceAddress":"7C96D2F479F4",..},
+//    "finding":"selected_codec","codec":"MPEG-2,4 (aka AAC)",
+//    "properties":[{"name":"PartA_PrivTags","hex":"0008000300000000"},..]}
+//
+// Fields shown as numbers in traces are JSON numbers, the others strings.
+// finding and codec are there if the analysis found something, properties
+// if the event is traced.
+class JsonLinesSink : public OutputSink {
+  public:
+    explicit JsonLinesSink(FILE *file) : m_file(file) {}
+    ~JsonLinesSink() override {
+        Flush();
+        fclose(m_file);
+    }
+
+    void WriteEvent(const EventMessage &message, const A2dpFinding &finding,
+                    bool trace) override {
+        std::string &json = m_buffer;
+        json += "{\"timestamp\":";
+        AppendDecimal(json, (ULONGLONG)message.Timestamp);
+        json += ",\"processor\":";
+        AppendDecimal(json, message.Processor);
+        json += ",\"provider\":";
+        json += ProviderText(message.ProviderId);
+        json += ",\"event_id\":";
+        AppendDecimal(json, message.EventId);
+        json += message.Decoded ? ",\"decoded\":true" : ",\"decoded\":false";
+        if (m_inDump) {
+            json += ",\"recorded\":true";
+        }
+
+        if (message.Kind == ProviderKind::A2dp) {
+            json += ",\"fields\":{";
+            bool first = true;
+            char value[64];
+            for (int field = 0; field < A2DP_FIELD_COUNT; field++) {
+                if (FormatEventField(message.Data, (A2dpField)field, value,
+                                     sizeof(value)) == 0) {
+                    continue;
+                }
+                json += first ? "\"" : ",\"";
+                json += NARROW_FIELD_NAMES[field].Text;
+                json += "\":";
+                const bool number =
+                    A2DP_FIELDS[field].Format == FieldFormat::Number;
+                if (!number) {
+                    json += '"';
+                }
+                json += value;
+                if (!number) {
+                    json += '"';
+                }
+                first = false;
+            }
+            json += '}';
+        }
+
+        const char *findingName = FindingName(finding.Kind);
+        if (findingName != nullptr) {
+            json += ",\"finding\":\"";
+            json += findingName;
+            json += '"';
+        }
+        if (finding.CodecName != nullptr) {
+            json += ",\"codec\":";
+            AppendJsonString(json, finding.CodecName);
+        }
+
+        if (trace && message.Schema != nullptr) {
+            json += ",\"properties\":[";
+            const BYTE *data = message.UserData;
+            for (USHORT i = 0; i < message.PropertyCount; i++) {
+                json += i == 0 ? "{\"name\":" : ",{\"name\":";
+                AppendJsonString(json,
+                                 message.Schema->Properties[i].Name.c_str());
+                json += ",\"hex\":\"";
+                AppendHex(json, data, message.PropertySizes[i]);
+                json += "\"}";
+                data += message.PropertySizes[i];
+            }
+            json += ']';
+        }
+        json += "}\n";
+
+        if (m_buffer.size() >= SINK_BUFFER_SIZE) {
+            Write();
+        }
+    }
+
+    void BeginDump(const WCHAR *reason, size_t events) override {
+        m_buffer += "{\"flight_recorder\":\"begin\",\"reason\":";
+        AppendJsonString(m_buffer, reason);
+        m_buffer += ",\"events\":";
+        AppendDecimal(m_buffer, events);
+        m_buffer += "}\n";
+        m_inDump = true;
+    }
+
+    void EndDump() override {
+        m_buffer += "{\"flight_recorder\":\"end\"}\n";
+        m_inDump = false;
+    }
+
+    //   {"timestamp":..,"change":"selected_codec_changed",
+    //    "device":"7C96D2F479F4","codec":"SBC","previous":"aptX"}
+    void WriteChange(const EventMessage &message,
+                     const DeviceChange &change) override {
+        std::string &json = m_buffer;
+        json += "{\"timestamp\":";
+        AppendDecimal(json, (ULONGLONG)message.Timestamp);
+        json += ",\"change\":";
+        AppendJsonString(json, DeviceChangeKindToString(change.Kind));
+        char device[32];
+        snprintf(device, sizeof(device), ",\"device\":\"%012llX\"",
+                 (unsigned long long)change.Address);
+        json += device;
+        if (change.Kind == DeviceChangeKind::CodecSetUnchanged) {
+            json += ",\"codecs\":";
+            AppendDecimal(json, change.Codecs);
+        }
+        if (change.CodecName != nullptr) {
+            json += ",\"codec\":";
+            AppendJsonString(json, change.CodecName);
+        }
+        if (change.PreviousCodecName != nullptr) {
+            json += ",\"previous\":";
+            AppendJsonString(json, change.PreviousCodecName);
+        }
+        json += "}\n";
+    }
+
+    bool Flush() override {
+        Write();
+        if (fflush(m_file) != 0) {
+            m_failed = true;
+        }
+        return !m_failed;
+    }
+
+  private:
+    // The provider as a JSON string, its name if it has one. Events of one
+    // provider come in runs, so the last one is kept.
+    const std::string &ProviderText(const GUID &id) {
+        if (m_providerText.empty() || !SameGuid(id, m_provider)) {
+            const Provider *provider = providers.Find(id);
+            m_provider = id;
+            m_providerText.clear();
+            AppendJsonString(m_providerText, provider != nullptr
+                                                 ? provider->Name.c_str()
+                                                 : GuidToString(id).c_str());
+        }
+        return m_providerText;
+    }
+
+    void Write() {
+        if (!m_buffer.empty() &&
+            !WriteAll(m_file, m_buffer.data(), m_buffer.size())) {
+            m_failed = true;
+        }
+        m_buffer.clear();
+    }
+
+    FILE *m_file;
+    bool m_failed = false;
+    bool m_inDump = false;
+    std::string m_buffer;
+    GUID m_provider = {};
+    std::string m_providerText;
+};
+
+// Records as described with OutputRecordHeader
+class BinarySink : public OutputSink {
+  public:
+    explicit BinarySink(FILE *file) : m_file(file) {
+        OutputFileHeader header = {};
+        memcpy(header.Magic, OUTPUT_MAGIC, sizeof(header.Magic));
+        header.Version = OUTPUT_VERSION;
+        header.FieldCount = A2DP_FIELD_COUNT;
+        Append(&header, sizeof(header));
+
+        const uint8_t sizes[] = {
+#define X(member, name, type, format) (uint8_t)sizeof(type),
+            A2DP_EVENT_FIELDS(X)
+#undef X
+        };
+        for (int field = 0; field < A2DP_FIELD_COUNT; field++) {
+            OutputFieldInfo info;
+            info.Size = sizes[field];
+            info.NameLength = (uint8_t)NARROW_FIELD_NAMES[field].Length;
+            Append(&info, sizeof(info));
+            Append(NARROW_FIELD_NAMES[field].Text, info.NameLength);
+        }
+    }
+    ~BinarySink() override {
+        Flush();
+        fclose(m_file);
+    }
+
+    void WriteEvent(const EventMessage &message, const A2dpFinding &finding,
+                    bool) override {
+        const size_t start = m_buffer.size();
+        OutputRecordHeader header = {};
+        header.EventId = message.EventId;
+        header.Timestamp = message.Timestamp;
+        header.ProviderId = message.ProviderId;
+        header.Processor = message.Processor;
+        header.Flags = (message.Kind == ProviderKind::A2dp ? OUTPUT_FLAG_A2DP
+                                                           : 0) |
+                       (message.Decoded ? OUTPUT_FLAG_DECODED : 0) |
+                       (m_inDump ? OUTPUT_FLAG_RECORDED : 0);
+        header.Finding = (uint8_t)finding.Kind;
+        Append(&header, sizeof(header));
+
+        const A2dpEventData &data = message.Data;
+#define X(member, name, type, format)                                          \
+    if (data.member) {                                                         \
+        header.FieldMask |= 1ULL << (int)A2dpField::member;                    \
+        Append(&*data.member, sizeof(type));                                   \
+    }
+        A2DP_EVENT_FIELDS(X)
+#undef X
+
+        // Now that the size and the mask are known
+        header.Size = (uint16_t)(m_buffer.size() - start);
+        memcpy(m_buffer.data() + start, &header, sizeof(header));
+
+        if (m_buffer.size() >= SINK_BUFFER_SIZE) {
+            Write();
+        }
+    }
+
+    // Recorded events are flagged, there is no record for the dump itself
+    void BeginDump(const WCHAR *, size_t) override { m_inDump = true; }
+    void EndDump() override { m_inDump = false; }
+
+    // Records are events. The ones with news are kept, what changed can be
+    // told from their fields.
+    void WriteChange(const EventMessage &, const DeviceChange &) override {}
+
+    bool Flush() override {
+        Write();
+        if (fflush(m_file) != 0) {
+            m_failed = true;
+        }
+        return !m_failed;
+    }
+
+  private:
+    void Append(const void *data, size_t size) {
+        const BYTE *bytes = (const BYTE *)data;
+        m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+    }
+
+    void Write() {
+        if (!m_buffer.empty() &&
+            !WriteAll(m_file, m_buffer.data(), m_buffer.size())) {
+            m_failed = true;
+        }
+        m_buffer.clear();
+    }
+
+    FILE *m_file;
+    bool m_failed = false;
+    bool m_inDump = false;
+    std::vector<BYTE> m_buffer;
+};
+
+} // namespace
+
+bool ParseOutputFormat(const char *text, OutputFormat &format) {
+    if (strcmp(text, "text") == 0) {
+        format = OutputFormat::Text;
+    } else if (strcmp(text, "jsonl") == 0) {
+        format = OutputFormat::JsonLines;
+    } else if (strcmp(text, "binary") == 0) {
+        format = OutputFormat::Binary;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<OutputSink> CreateOutputSink(OutputFormat format,
+                                             const char *path) {
+    if (path == nullptr) {
+        if (format != OutputFormat::Text) {
+            return nullptr;
+        }
+        return std::make_unique<TextSink>(stdout, false);
+    }
+
+    // Text is converted to UTF-8 by the sink, the C runtime only has to
+    // turn the line ends into what the system uses
+    FILE *file = fopen(path, format == OutputFormat::Text ? "w" : "wb");
+    if (file == nullptr) {
+        return nullptr;
+    }
+    switch (format) {
+    case OutputFormat::JsonLines:
+        return std::make_unique<JsonLinesSink>(file);
+    case OutputFormat::Binary:
+        return std::make_unique<BinarySink>(file);
+    default:
+        return std::make_unique<TextSink>(file, true);
+    }
+}
+
+void AppendPropertyLine(std::wstring &line, const PropertyLayout &property,
+                        const BYTE *data, ULONG size,
+                        const A2dpEventData &eventData) {
+    // The line is written through a pointer into room made up front, the
+    // small appends one after another cost more than the formatting
+    const size_t start = line.size();
+    line.resize(start + property.Name.size() + 2 * (size_t)size + 96);
+    WCHAR *out = &line[start];
+
+    *out++ = L' ';
+    *out++ = L' ';
+    wmemcpy(out, property.Name.data(), property.Name.size());
+    out += property.Name.size();
+    *out++ = L' ';
+    *out++ = L'[';
+    WCHAR digits[10];
+    int length = 0;
+    ULONG value = size;
+    do {
+        digits[length++] = (WCHAR)(L'0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (length > 0) {
+        *out++ = digits[--length];
+    }
+    *out++ = L']';
+    *out++ = L':';
+    *out++ = L' ';
+    for (ULONG i = 0; i < size; i++) {
+        *out++ = HEX_TABLE.Digits[data[i]][0];
+        *out++ = HEX_TABLE.Digits[data[i]][1];
+    }
+
+    // Show the decoded value of the fields the tool knows about
+    const A2dpField field = property.Field;
+    if (field != A2dpField::Count) {
+        WCHAR *value = out + 6;
+        int written = FormatEventField(eventData, field, value, 64);
+        if (written > 0) {
+            wmemcpy(out, L"     [", 6);
+            out = value + written;
+            *out++ = L']';
+        }
+    }
+    *out++ = L'\n';
+    line.resize(out - line.data());
+}
@@ -0,0 +1,128 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "a2dp.h"
+#include "coalescer.h"
+#include "event_schema.h"
+#include "platform.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct EventMessage;
+
+// Where the writer thread puts the events. A sink formats every event into
+// a buffer it reuses and writes the buffer out in large blocks, a write
+// call per line used to be most of the cost of tracing.
+
+enum class OutputFormat {
+    Text,      // for people, what the tool always printed
+    JsonLines, // one JSON object per event, for log collectors
+    Binary,    // compact records, see OutputRecordHeader
+};
+
+// Parses "text", "jsonl" or "binary"
+bool ParseOutputFormat(const char *text, OutputFormat &format);
+
+class OutputSink {
+  public:
+    virtual ~OutputSink() = default;
+
+    // Writes the event and what the analysis found in it. With trace the
+    // raw properties are written too, if the format has them.
+    virtual void WriteEvent(const EventMessage &message,
+                            const A2dpFinding &finding, bool trace) = 0;
+
+    // The events the flight recorder kept are written between these two,
+    // reason says what made it dump them
+    virtual void BeginDump(const WCHAR *reason, size_t events) = 0;
+    virtual void EndDump() = 0;
+
+    // Writes what --coalesce found changed on the device, before the event
+    // that showed it (which may itself be left out)
+    virtual void WriteChange(const EventMessage &message,
+                             const DeviceChange &change) = 0;
+
+    // Writes out what is buffered. Returns false if writing failed.
+    virtual bool Flush() = 0;
+};
+
+// Creates a sink that writes to the file at path, replacing it, or to
+// stdout if path is nullptr. Only text goes to stdout, the rest of the tool
+// prints wide text there. Returns nullptr if the file can not be created.
+std::unique_ptr<OutputSink> CreateOutputSink(OutputFormat format,
+                                             const char *path);
+
+// Appends the trace line of one property to line: its name, size and hex
+// data, and the decoded value if the tool knows the field
+void AppendPropertyLine(std::wstring &line, const PropertyLayout &property,
+                        const BYTE *data, ULONG size,
+                        const A2dpEventData &eventData);
+
+// Converts length characters to UTF-8, appending them to out. Traces are
+// nearly all ASCII, that is the fast path.
+void AppendUtf8(std::string &out, const WCHAR *text, size_t length);
+
+// The binary format. All values are little endian, nothing is padded.
+//
+//   file header
+//   field info*   one per A2dpField, the bits of the field masks
+//   record*       header, then the values of the fields in its mask
+
+#pragma pack(push, 1)
+
+struct OutputFileHeader {
+    char Magic[8];       // OUTPUT_MAGIC
+    uint32_t Version;    // OUTPUT_VERSION
+    uint32_t FieldCount; // field infos that follow
+};
+
+// Followed by NameLength characters of the ASCII property name
+struct OutputFieldInfo {
+    uint8_t Size; // of the value in records
+    uint8_t NameLength;
+};
+
+struct OutputRecordHeader {
+    uint16_t Size; // of the record, header included
+    uint16_t EventId;
+    int64_t Timestamp;
+    GUID ProviderId;
+    uint8_t Processor;
+    uint8_t Flags;   // OUTPUT_FLAG_*
+    uint8_t Finding; // A2dpFindingKind
+    uint8_t Reserved;
+    uint64_t FieldMask; // bit n is set if field n has a value in the record
+};
+
+#pragma pack(pop)
+
+const char OUTPUT_MAGIC[8] = {'W', 'B', 'T', 'O', 'U', 'T', 0, 0};
+const uint32_t OUTPUT_VERSION = 1;
+const uint8_t OUTPUT_FLAG_A2DP = 0x1;    // a BthA2dp event
+const uint8_t OUTPUT_FLAG_DECODED = 0x2; // its data matched its schema
+const uint8_t OUTPUT_FLAG_RECORDED = 0x4; // from a flight recorder dump
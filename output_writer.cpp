@@ -0,0 +1,342 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "output_writer.h"
+
+#include <chrono>
+#include <cstring>
+#include <cwchar>
+#include <stdio.h>
+
+namespace {
+
+// How long a live event waits for room in the queue before it is dropped
+const auto DROP_WAIT = std::chrono::milliseconds(1);
+
+// Rounds an idle writer polls the queue before it starts sleeping
+const int IDLE_SPINS = 64;
+const auto IDLE_SLEEP = std::chrono::milliseconds(1);
+
+} // namespace
+
+void FillEventMessage(EventMessage &message, const EVENT_RECORD &event,
+                      const EventSchema &schema, MeasurePropertyFn measure,
+                      A2dpFieldMask fields) {
+    const Provider *provider = providers.Find(event.EventHeader.ProviderId);
+    message.ProviderId = event.EventHeader.ProviderId;
+    message.Kind = provider != nullptr ? provider->Kind : ProviderKind::Generic;
+    message.Timestamp = event.EventHeader.TimeStamp.QuadPart;
+    message.Processor = event.BufferContext.ProcessorNumber;
+    message.EventId = event.EventHeader.EventDescriptor.Id;
+    message.Data = A2dpEventData();
+    if (message.Kind != ProviderKind::A2dp) {
+        fields = A2DP_ALL_FIELDS; // other providers are always traced
+    }
+    message.DecodedFields = fields;
+    message.Schema = &schema;
+    message.PropertyCount = 0;
+    message.DataLength = 0;
+
+    bool full = false;
+    message.Decoded = ForEachProperty(
+        event, schema, measure,
+        [&](const PropertyLayout &property, const BYTE *data, ULONG size) {
+            if (property.Field != A2dpField::Count &&
+                (fields & FieldBit(property.Field)) != 0) {
+                SetEventField(message.Data, property.Field, data, size,
+                              InTypeSize(property.InType));
+            }
+
+            // Keep the raw bytes in order, up to the first property that
+            // does not fit
+            if (full || message.PropertyCount == EVENT_MESSAGE_PROPERTIES ||
+                size > EVENT_MESSAGE_DATA - message.DataLength) {
+                full = true;
+                return;
+            }
+            memcpy(message.UserData + message.DataLength, data, size);
+            message.PropertySizes[message.PropertyCount++] = (USHORT)size;
+            message.DataLength += (USHORT)size;
+        });
+}
+
+void DecodeRemainingFields(EventMessage &message) {
+    if (message.Schema == nullptr) {
+        return;
+    }
+    const A2dpFieldMask skipped = ~message.DecodedFields & A2DP_ALL_FIELDS;
+    const BYTE *data = message.UserData;
+    for (USHORT i = 0; i < message.PropertyCount; i++) {
+        const PropertyLayout &property = message.Schema->Properties[i];
+        const ULONG size = message.PropertySizes[i];
+        if (property.Field != A2dpField::Count &&
+            (skipped & FieldBit(property.Field)) != 0) {
+            SetEventField(message.Data, property.Field, data, size,
+                          InTypeSize(property.InType));
+        }
+        data += size;
+    }
+    message.DecodedFields = A2DP_ALL_FIELDS;
+}
+
+void OutputWriter::Start(bool trace, LONGLONG timestampFrequency,
+                         std::chrono::milliseconds window) {
+    m_trace = trace;
+    m_window = window;
+    m_merger.SetWindow(timestampFrequency * window.count() / 1000);
+    m_negotiations.SetFrequency(timestampFrequency);
+    m_stop.store(false);
+    m_thread = std::thread(&OutputWriter::Run, this);
+}
+
+void OutputWriter::Stop() {
+    if (!m_thread.joinable()) {
+        return;
+    }
+    m_stop.store(true, std::memory_order_release);
+    m_thread.join();
+}
+
+EventMessage *OutputWriter::Claim(OverflowPolicy policy, size_t ahead,
+                                  bool mayWait) {
+    EventMessage *message = m_queue.Claim(ahead);
+    if (message != nullptr) {
+        return message;
+    }
+
+    m_waited++;
+    if (policy == OverflowPolicy::Drop && !mayWait) {
+        m_dropped++;
+        return nullptr;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        std::this_thread::yield();
+        message = m_queue.Claim(ahead);
+        if (message != nullptr) {
+            return message;
+        }
+        if (policy == OverflowPolicy::Drop &&
+            std::chrono::steady_clock::now() - start > DROP_WAIT) {
+            m_dropped++;
+            return nullptr;
+        }
+    }
+}
+
+void OutputWriter::Flush() {
+    if (!m_thread.joinable()) {
+        return;
+    }
+    // Everything is published before the request, so once the writer sees
+    // the request and an empty queue it has all of it
+    ULONGLONG request =
+        m_flushRequests.fetch_add(1, std::memory_order_acq_rel) + 1;
+    while (m_flushesDone.load(std::memory_order_acquire) < request) {
+        std::this_thread::yield();
+    }
+}
+
+void OutputWriter::Run() {
+    auto emit = [this](const EventMessage &message) { Emit(message); };
+    int idle = 0;
+    auto idleSince = std::chrono::steady_clock::now();
+    for (;;) {
+        EventMessage *message = m_queue.Front();
+        if (latencyReportRequested.load(std::memory_order_relaxed) &&
+            latencyReportRequested.exchange(false)) {
+            FlushSink();
+            PrintStageLatencies();
+        }
+        if (flightDumpRequested.load(std::memory_order_relaxed) &&
+            flightDumpRequested.exchange(false)) {
+            DumpFlightRecorder(nullptr, FlightDumpReason::Requested);
+        }
+        if (message != nullptr) {
+            stageLatencies.Queue.Record(NowNanoseconds() -
+                                        message->PublishedAt);
+            m_merger.Push(message->Processor, message->Timestamp, *message);
+            m_queue.Pop();
+            m_merger.Release(emit);
+            idle = 0;
+            continue;
+        }
+
+        // The queue is empty. Anything held is written when asked to, when
+        // stopping, or when no event came for longer than the window, as
+        // then nothing can overtake what is held anymore.
+        ULONGLONG requests = m_flushRequests.load(std::memory_order_acquire);
+        bool stop = m_stop.load(std::memory_order_acquire);
+        if (requests != m_flushesDone.load(std::memory_order_relaxed) ||
+            stop) {
+            if (m_queue.Front() != nullptr) {
+                continue; // published before the request, take it first
+            }
+            m_merger.Drain(emit);
+            FlushSink();
+            m_flushesDone.store(requests, std::memory_order_release);
+            if (stop) {
+                m_negotiations.Finish();
+                break;
+            }
+            continue;
+        }
+
+        if (idle == 0) {
+            idleSince = std::chrono::steady_clock::now();
+        }
+        if (++idle < IDLE_SPINS) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (m_merger.Held() > 0 &&
+            std::chrono::steady_clock::now() - idleSince >= m_window) {
+            m_merger.Drain(emit);
+        }
+        FlushSink();
+        std::this_thread::sleep_for(IDLE_SLEEP);
+    }
+}
+
+void OutputWriter::FlushSink() {
+    if (!m_sink->Flush()) {
+        m_outputFailed.store(true, std::memory_order_relaxed);
+    }
+}
+
+void OutputWriter::CountMetrics(const EventMessage &message,
+                                const A2dpFinding &finding) {
+    const Provider *provider = providers.Find(message.ProviderId);
+    const ULONGLONG index = provider != nullptr
+                                ? (ULONGLONG)(provider - providers.All().data())
+                                : METRICS_OTHER_PROVIDER;
+    metrics.EventsById.Add(index << 16 | message.EventId);
+
+    const A2dpEventData &data = message.Data;
+    if (data.AvdtpActivity) {
+        metrics.EventsByActivity.Add(*data.AvdtpActivity);
+    }
+    if (finding.Kind == A2dpFindingKind::None ||
+        finding.Kind == A2dpFindingKind::SupportedCodec) {
+        return;
+    }
+    const ULONGLONG key = PackCodecKey(data.a2dpStandardCodecId.value_or(0),
+                                       data.a2dpVendorId.value_or(0),
+                                       data.a2dpVendorCodecId.value_or(0));
+    if (finding.Kind == A2dpFindingKind::UnknownCodec) {
+        metrics.UnknownCodecs.Add(key);
+        return;
+    }
+    metrics.SelectedCodecs.Add(key);
+    const std::optional<ULONGLONG> address = EventDeviceAddress(data);
+    if (address) {
+        metrics.DeviceCodecs.Set(*address, key + 1);
+    }
+}
+
+void OutputWriter::DumpFlightRecorder(const A2dpEventData *eventData,
+                                      FlightDumpReason reason) {
+    const size_t count = m_flight.Count(eventData);
+    if (count == 0) {
+        return;
+    }
+    m_flightDumps++;
+    m_sink->BeginDump(FlightDumpReasonToString(reason), count);
+    // The findings were written with the events already
+    m_flight.Dump(eventData, [this](const EventMessage &recorded) {
+        if (recorded.DecodedFields != A2DP_ALL_FIELDS) {
+            m_full = recorded;
+            DecodeRemainingFields(m_full);
+            m_sink->WriteEvent(m_full, A2dpFinding(), true);
+        } else {
+            m_sink->WriteEvent(recorded, A2dpFinding(), true);
+        }
+    });
+    m_sink->EndDump();
+}
+
+void OutputWriter::Emit(const EventMessage &message) {
+    Write(message);
+    m_written.fetch_add(1, std::memory_order_relaxed);
+}
+
+void OutputWriter::Write(const EventMessage &message) {
+    const ULONGLONG start = NowNanoseconds();
+
+    // Other providers are only there to show what happened around the
+    // BthA2dp events, they are always traced
+    A2dpFinding finding;
+    bool trace = true;
+    bool write = true;
+    bool dumped = false;
+    if (message.Kind == ProviderKind::A2dp) {
+        finding = AnalyzeEventData(message.Data);
+        const DeviceState *device = m_devices.Update(message.Data, finding);
+        if (m_status != nullptr) {
+            m_status->Publish(device);
+        }
+        m_negotiations.Update(message.Timestamp, message.Data, finding);
+        CountMetrics(message, finding);
+        trace = m_trace || !message.Decoded ||
+                finding.Kind == A2dpFindingKind::UnknownCodec;
+
+        // What led to a failure is shown before the failing event, which
+        // is then traced too
+        if (m_flight.Enabled()) {
+            const std::optional<FlightDumpReason> reason =
+                FlightDumpTrigger(message.Data, finding);
+            if (reason) {
+                DumpFlightRecorder(&message.Data, *reason);
+                trace = true;
+                dumped = true;
+            }
+        }
+
+        // After everything above, which wants to see the finding as it
+        // was. A failing event is written even if it repeats a finding.
+        if (m_coalesce && message.Decoded) {
+            write = m_coalescer.Update(message.Data, finding) || dumped;
+            for (const DeviceChange &change : m_coalescer.Changes()) {
+                m_sink->WriteChange(message, change);
+            }
+        }
+    }
+    const ULONGLONG analyzed = NowNanoseconds();
+    if (message.Kind == ProviderKind::A2dp) {
+        stageLatencies.Analysis.Record(analyzed - start);
+    }
+
+    // A trace shows every field, the decoder may have skipped some of them
+    // when only the analysis was expected. Rare enough to decode again.
+    if (!write) {
+        // Repeats what was written, only the recorder keeps it
+    } else if (trace && message.DecodedFields != A2DP_ALL_FIELDS) {
+        m_full = message;
+        DecodeRemainingFields(m_full);
+        m_sink->WriteEvent(m_full, finding, trace);
+    } else {
+        m_sink->WriteEvent(message, finding, trace);
+    }
+    m_flight.Record(message);
+    stageLatencies.Output.Record(NowNanoseconds() - analyzed);
+}
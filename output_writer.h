@@ -0,0 +1,229 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "a2dp.h"
+#include "coalescer.h"
+#include "device_tracker.h"
+#include "event_decoder.h"
+#include "event_message.h"
+#include "event_schema.h"
+#include "flight_recorder.h"
+#include "latency_histogram.h"
+#include "metrics.h"
+#include "negotiation.h"
+#include "output_sink.h"
+#include "platform.h"
+#include "providers.h"
+#include "reorder_merger.h"
+#include "spsc_ring.h"
+#include "status_snapshot.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Console output is slow, a trace prints a line per property. Printing on
+// the thread that receives the events would stall it, and a stalled ETW
+// callback makes the real time session lose events. So the receiving thread
+// only decodes each event into an EventMessage and queues it, and a writer
+// thread does all the analysis output and tracing.
+
+// Decodes the given fields of the event into message and keeps as many of
+// its raw properties as fit. The kind is taken from the provider list.
+void FillEventMessage(EventMessage &message, const EVENT_RECORD &event,
+                      const EventSchema &schema, MeasurePropertyFn measure,
+                      A2dpFieldMask fields = A2DP_ALL_FIELDS);
+
+// Decodes the fields a partially decoded message skipped from the raw
+// properties it kept. Traces need them all.
+void DecodeRemainingFields(EventMessage &message);
+
+// What to do when the writer falls behind and the queue is full
+enum class OverflowPolicy {
+    // Wait a moment, then drop the event, see ClaimNext() for batches. For
+    // live sessions, stalling the ETW callback for longer loses events
+    // anyway.
+    Drop,
+    // Wait as long as it takes. For files, where slowing down loses nothing.
+    Wait,
+};
+
+const size_t OUTPUT_QUEUE_CAPACITY = 1024;
+
+// The writer thread and the queue that feeds it. One thread produces
+// messages (Claim, Publish, Flush), the writer thread consumes them and
+// writes them in timestamp order, see ReorderMerger.
+class OutputWriter {
+  public:
+    OutputWriter() : m_sink(CreateOutputSink(OutputFormat::Text, nullptr)) {
+        m_claimed.reserve(OUTPUT_QUEUE_CAPACITY);
+    }
+    ~OutputWriter() { Stop(); }
+    OutputWriter(const OutputWriter &) = delete;
+    OutputWriter &operator=(const OutputWriter &) = delete;
+
+    // Replaces the text on stdout written by default. Only call it while the
+    // writer thread is not running.
+    void SetSink(std::unique_ptr<OutputSink> sink) { m_sink = std::move(sink); }
+
+    // Publishes the devices there after every event, see status_snapshot.h.
+    // The publisher has to outlive the writer thread. Only call it while the
+    // writer thread is not running.
+    void SetStatusPublisher(StatusPublisher *publisher) { m_status = publisher; }
+
+    // Keeps the last eventsPerDevice events of every device and dumps them
+    // when something goes wrong, see flight_recorder.h. 0 turns it off.
+    // Only call it while the writer thread is not running.
+    void SetFlightRecorder(size_t eventsPerDevice) {
+        m_flight.SetCapacity(eventsPerDevice);
+    }
+
+    // Writes repeated codec announcements and selections only as what
+    // changed, see coalescer.h. Only call it while the writer thread is
+    // not running.
+    void SetCoalescing(bool coalesce) { m_coalesce = coalesce; }
+
+    // Starts the writer thread. With trace every event is printed. Events
+    // are held up to window to be put in order, timestampFrequency is the
+    // number of timestamp ticks per second (0 if the events have none).
+    void Start(bool trace, LONGLONG timestampFrequency,
+               std::chrono::milliseconds window);
+
+    // Writes what is still queued and stops the writer thread
+    void Stop();
+
+    // Returns a message to fill and Publish(), or nullptr if the event has
+    // to be dropped
+    EventMessage *Claim(OverflowPolicy policy) {
+        return Claim(policy, 0, true);
+    }
+    void Publish(EventMessage &message) {
+        message.PublishedAt = NowNanoseconds();
+        m_queue.Publish();
+    }
+
+    // The same for a batch of events: ClaimNext() returns the message after
+    // the ones claimed so far, PublishClaimed() hands all of them to the
+    // writer at once. Batches have to stay below OUTPUT_QUEUE_CAPACITY.
+    // With Drop a batch waits for room once: after its first drop the rest
+    // of it is dropped right away when the queue is full, instead of
+    // holding up the ETW callback for DROP_WAIT per event.
+    EventMessage *ClaimNext(OverflowPolicy policy) {
+        EventMessage *message =
+            Claim(policy, m_claimed.size(), !m_droppedInBatch);
+        if (message != nullptr) {
+            m_claimed.push_back(message);
+        } else {
+            m_droppedInBatch = true;
+        }
+        return message;
+    }
+    void PublishClaimed() {
+        const ULONGLONG now = NowNanoseconds();
+        for (EventMessage *message : m_claimed) {
+            message->PublishedAt = now;
+        }
+        m_queue.Publish(m_claimed.size());
+        m_claimed.clear();
+        m_droppedInBatch = false;
+    }
+
+    // Waits until every published message is written, including the ones
+    // held for ordering
+    void Flush();
+
+    // Claims that found the queue full
+    ULONGLONG Waited() const { return m_waited; }
+    // Of those, the ones given up
+    ULONGLONG Dropped() const { return m_dropped; }
+    ULONGLONG Written() const {
+        return m_written.load(std::memory_order_relaxed);
+    }
+
+    // Events that came in after a newer one, and those of them that came
+    // too late to be put in order. Only look at them after Stop().
+    ULONGLONG Reordered() const { return m_merger.Reordered(); }
+    ULONGLONG Late() const { return m_merger.Late(); }
+
+    // True if writing to the sink failed at some point
+    bool OutputFailed() const {
+        return m_outputFailed.load(std::memory_order_relaxed);
+    }
+
+    // State of every device seen. Owned by the writer thread, only look at
+    // it after Stop().
+    const DeviceTracker &Devices() const { return m_devices; }
+
+    // Stream setup times, same as Devices()
+    const NegotiationTracker &Negotiations() const { return m_negotiations; }
+
+    // Times the flight recorder dumped, same as Devices()
+    ULONGLONG FlightDumps() const { return m_flightDumps; }
+
+    // Events --coalesce left out, same as Devices()
+    ULONGLONG Coalesced() const { return m_coalescer.Coalesced(); }
+
+  private:
+    // With Drop, mayWait false drops at once if the queue is full
+    EventMessage *Claim(OverflowPolicy policy, size_t ahead, bool mayWait);
+    void Run();
+    void Emit(const EventMessage &message);
+    void Write(const EventMessage &message);
+    void FlushSink();
+    void CountMetrics(const EventMessage &message, const A2dpFinding &finding);
+    void DumpFlightRecorder(const A2dpEventData *eventData,
+                            FlightDumpReason reason);
+
+    SpscRing<EventMessage, OUTPUT_QUEUE_CAPACITY> m_queue;
+    std::thread m_thread;
+    std::atomic<bool> m_stop{false};
+    std::atomic<ULONGLONG> m_flushRequests{0};
+    std::atomic<ULONGLONG> m_flushesDone{0};
+    bool m_trace = false;
+    std::chrono::milliseconds m_window{0};
+
+    // Producer side
+    ULONGLONG m_waited = 0;
+    ULONGLONG m_dropped = 0;
+    std::vector<EventMessage *> m_claimed; // by ClaimNext, not published
+    bool m_droppedInBatch = false;         // since the last PublishClaimed
+
+    // Writer side
+    std::atomic<ULONGLONG> m_written{0};
+    std::unique_ptr<OutputSink> m_sink;
+    std::atomic<bool> m_outputFailed{false};
+    DeviceTracker m_devices;
+    NegotiationTracker m_negotiations;
+    StatusPublisher *m_status = nullptr;
+    FlightRecorder m_flight;
+    ULONGLONG m_flightDumps = 0;
+    bool m_coalesce = false;
+    Coalescer m_coalescer;
+    ReorderMerger<EventMessage> m_merger;
+    EventMessage m_full; // a partially decoded message, decoded for a trace
+};
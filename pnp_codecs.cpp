@@ -0,0 +1,349 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pnp_codecs.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <string>
+
+#ifdef _WIN32
+#include <cfgmgr32.h>
+#endif
+
+PnpCodecRecord PnpCodecList::Iterator::operator*() const {
+    PnpCodecRecord record;
+    record.StandardCodecId = m_position[0];
+    if (record.StandardCodecId == A2DP_VENDOR_CODEC_ID) {
+        record.VendorId = (DWORD)m_position[1] | (DWORD)m_position[2] << 8 |
+                          (DWORD)m_position[3] << 16 |
+                          (DWORD)m_position[4] << 24;
+        record.VendorCodecId =
+            (WORD)(m_position[5] | (WORD)m_position[6] << 8);
+    }
+    return record;
+}
+
+PnpCodecList::PnpCodecList(const BYTE *data, size_t size) : m_data(data) {
+    // Only the first byte of a record tells its size, so one pass over
+    // those bytes finds the records and checks the last one is complete
+    size_t offset = 0;
+    while (offset < size) {
+        const size_t recordSize = PnpCodecRecordSize(data[offset]);
+        if (recordSize > size - offset) {
+            m_valid = false;
+            break;
+        }
+        offset += recordSize;
+        m_count++;
+    }
+    m_size = offset;
+}
+
+int PnpCodecList::IndexOf(ULONGLONG key) const {
+    int index = 0;
+    for (const PnpCodecRecord &record : *this) {
+        if (record.Key() == key) {
+            return index;
+        }
+        index++;
+    }
+    return -1;
+}
+
+int SelectedCodecIndex(const PnpCodecList &remote,
+                       const PnpCodecList &configured) {
+    if (configured.Empty()) {
+        return -1;
+    }
+    return remote.IndexOf((*configured.begin()).Key());
+}
+
+namespace {
+
+// Name of the codec, or its ids if the registry does not know it
+std::wstring CodecRecordName(const PnpCodecRecord &record) {
+    const CodecData *codec = record.Find();
+    if (codec != nullptr) {
+        return codec->Name;
+    }
+    WCHAR text[64];
+    if (record.StandardCodecId == A2DP_VENDOR_CODEC_ID) {
+        swprintf(text, 64, L"unknown (FF %04X %04X)", (unsigned)record.VendorId,
+                 (unsigned)record.VendorCodecId);
+    } else {
+        swprintf(text, 64, L"unknown (%02X)", (unsigned)record.StandardCodecId);
+    }
+    return text;
+}
+
+int HexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Appends the bytes of a line like "FF D7 00 00" to out. Returns false,
+// appending nothing, if the line is anything else.
+bool AppendHexBytes(const std::string &line, std::vector<BYTE> &out) {
+    const size_t start = out.size();
+    size_t i = 0;
+    while (i < line.size()) {
+        if (line[i] == ' ' || line[i] == '\t') {
+            i++;
+            continue;
+        }
+        int high = HexValue(line[i]);
+        int low = i + 1 < line.size() ? HexValue(line[i + 1]) : -1;
+        bool separated = i + 2 == line.size() || line[i + 2] == ' ' ||
+                         line[i + 2] == '\t';
+        if (high < 0 || low < 0 || !separated) {
+            out.resize(start);
+            return false;
+        }
+        out.push_back((BYTE)(high << 4 | low));
+        i += 2;
+    }
+    return out.size() > start;
+}
+
+bool StartsWith(const std::string &text, size_t offset, const char *prefix) {
+    return text.compare(offset, strlen(prefix), prefix) == 0;
+}
+
+// The property set as pnputil prints it, lower case
+const char PNP_PROPERTIES_TEXT[] = "{29ce83d4-7a82-4744-bd1d-abec85321dd6}[";
+
+} // namespace
+
+bool ReadPnpDump(const char *path, std::vector<PnpDeviceCodecs> &devices) {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    std::string text;
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, read);
+    }
+    fclose(file);
+
+    // PowerShell saves redirected output as UTF-16, pnputil only prints
+    // ASCII so the low bytes are all there is to it
+    if (text.size() >= 2 && (BYTE)text[0] == 0xFF && (BYTE)text[1] == 0xFE) {
+        std::string narrow;
+        for (size_t i = 2; i + 1 < text.size(); i += 2) {
+            narrow += text[i + 1] == 0 ? text[i] : '?';
+        }
+        text.swap(narrow);
+    }
+
+    enum class Pending { None, Address, Connected, Configured, Remote };
+    Pending pending = Pending::None;
+    PnpDeviceCodecs device;
+    bool inInterface = false;
+    auto finishInterface = [&]() {
+        if (inInterface &&
+            (!device.Configured.empty() || !device.Remote.empty())) {
+            devices.push_back(device);
+        }
+        device = PnpDeviceCodecs();
+    };
+
+    size_t lineStart = 0;
+    while (lineStart < text.size()) {
+        size_t lineEnd = text.find('\n', lineStart);
+        if (lineEnd == std::string::npos) {
+            lineEnd = text.size();
+        }
+        std::string line = text.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        const size_t indent = line.find_first_not_of(" \t");
+        if (indent == std::string::npos) {
+            continue;
+        }
+
+        // The value of a property is on the lines after its name
+        if (pending == Pending::Address) {
+            device.Address = strtoull(line.c_str() + indent, nullptr, 16);
+            pending = Pending::None;
+            continue;
+        }
+        if (pending == Pending::Connected) {
+            device.Connected = StartsWith(line, indent, "TRUE");
+            pending = Pending::None;
+            continue;
+        }
+        if (pending == Pending::Configured || pending == Pending::Remote) {
+            if (AppendHexBytes(line, pending == Pending::Configured
+                                         ? device.Configured
+                                         : device.Remote)) {
+                continue; // more lines of the same value may follow
+            }
+            pending = Pending::None;
+        }
+
+        if (StartsWith(line, indent, "Interface Path:")) {
+            finishInterface();
+            inInterface = true;
+        } else if (StartsWith(line, indent,
+                              "DEVPKEY_Bluetooth_DeviceAddress ")) {
+            pending = Pending::Address;
+        } else if (StartsWith(line, indent, PNP_PROPERTIES_TEXT)) {
+            const ULONG pid = strtoul(
+                line.c_str() + indent + sizeof(PNP_PROPERTIES_TEXT) - 1,
+                nullptr, 10);
+            if (pid == PNP_AVDTP_CONNECTED_PID) {
+                pending = Pending::Connected;
+            } else if (pid == PNP_CONFIGURED_CODEC_PID) {
+                pending = Pending::Configured;
+                device.Configured.clear();
+            } else if (pid == PNP_REMOTE_CODECS_PID) {
+                pending = Pending::Remote;
+                device.Remote.clear();
+            }
+        }
+    }
+    finishInterface();
+    return true;
+}
+
+#ifdef _WIN32
+namespace {
+
+// KSCATEGORY_AUDIO, the class of the interfaces that have the properties
+const GUID AUDIO_INTERFACE_CLASS = {
+    0x6994ad04, 0x93ef, 0x11d0, {0xa3, 0xcc, 0x00, 0xa0, 0xc9, 0x22, 0x31, 0x96}};
+
+// DEVPKEY_Bluetooth_DeviceAddress, a string of 12 hex digits
+const DEVPROPKEY BLUETOOTH_ADDRESS_KEY = {
+    {0x2bd67d8b, 0x8beb, 0x48d5, {0x87, 0xe0, 0x6c, 0xda, 0x34, 0x28, 0x04, 0x0a}},
+    1};
+
+// Reads a property of the interface to value. Returns false if the
+// interface does not have it.
+bool GetInterfaceProperty(const WCHAR *path, const DEVPROPKEY &key,
+                          std::vector<BYTE> &value) {
+    DEVPROPTYPE type;
+    ULONG size = 0;
+    CONFIGRET result =
+        CM_Get_Device_Interface_PropertyW(path, &key, &type, NULL, &size, 0);
+    if (result != CR_BUFFER_SMALL) {
+        return false;
+    }
+    value.resize(size);
+    result = CM_Get_Device_Interface_PropertyW(path, &key, &type, value.data(),
+                                               &size, 0);
+    return result == CR_SUCCESS;
+}
+
+bool GetInterfaceProperty(const WCHAR *path, ULONG pid,
+                          std::vector<BYTE> &value) {
+    DEVPROPKEY key = {BTHA2DP_PNP_PROPERTIES, pid};
+    return GetInterfaceProperty(path, key, value);
+}
+
+} // namespace
+
+bool ReadPnpCodecs(std::vector<PnpDeviceCodecs> &devices) {
+    // The list can grow between asking its size and getting it
+    std::vector<WCHAR> list;
+    CONFIGRET result;
+    do {
+        ULONG length = 0;
+        result = CM_Get_Device_Interface_List_SizeW(
+            &length, (LPGUID)&AUDIO_INTERFACE_CLASS, NULL,
+            CM_GET_DEVICE_INTERFACE_LIST_PRESENT);
+        if (result != CR_SUCCESS) {
+            return false;
+        }
+        list.resize(length);
+        result = CM_Get_Device_Interface_ListW(
+            (LPGUID)&AUDIO_INTERFACE_CLASS, NULL, list.data(), length,
+            CM_GET_DEVICE_INTERFACE_LIST_PRESENT);
+    } while (result == CR_BUFFER_SMALL);
+    if (result != CR_SUCCESS) {
+        return false;
+    }
+
+    std::vector<BYTE> value;
+    for (const WCHAR *path = list.data(); *path != 0;
+         path += wcslen(path) + 1) {
+        PnpDeviceCodecs device;
+        GetInterfaceProperty(path, PNP_CONFIGURED_CODEC_PID, device.Configured);
+        GetInterfaceProperty(path, PNP_REMOTE_CODECS_PID, device.Remote);
+        if (device.Configured.empty() && device.Remote.empty()) {
+            continue; // not an interface of BthA2dp
+        }
+        if (GetInterfaceProperty(path, PNP_AVDTP_CONNECTED_PID, value) &&
+            value.size() == sizeof(DEVPROP_BOOLEAN)) {
+            device.Connected = value[0] != DEVPROP_FALSE;
+        }
+        if (GetInterfaceProperty(path, BLUETOOTH_ADDRESS_KEY, value)) {
+            value.resize(value.size() + sizeof(WCHAR)); // make sure of the null
+            device.Address = wcstoull((const WCHAR *)value.data(), NULL, 16);
+        }
+        devices.push_back(device);
+    }
+    return true;
+}
+#endif
+
+void PrintPnpDeviceCodecs(const PnpDeviceCodecs &device) {
+    const PnpCodecList remote = device.RemoteCodecs();
+    const PnpCodecList configured = device.ConfiguredCodecs();
+
+    wprintf(L"Device %012llX:", (unsigned long long)device.Address);
+    if (device.Connected) {
+        wprintf(*device.Connected ? L" connected," : L" not connected,");
+    }
+    if (configured.Empty()) {
+        wprintf(L" no codec configured");
+    } else {
+        wprintf(L" codec %ls", CodecRecordName(*configured.begin()).c_str());
+    }
+    wprintf(L", %zu codecs supported\n", remote.Count());
+
+    const int selected = SelectedCodecIndex(remote, configured);
+    int index = 0;
+    for (const PnpCodecRecord &record : remote) {
+        wprintf(L"  %lc %ls\n", index == selected ? L'>' : L' ',
+                CodecRecordName(record).c_str());
+        index++;
+    }
+    if (!remote.Valid() || !configured.Valid()) {
+        wprintf(L"  (codec list cut short)\n");
+    }
+}
@@ -0,0 +1,151 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "codec_registry.h"
+#include "platform.h"
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+// btha2dp.sys keeps the codecs of every connected device as properties of
+// its audio device interface (see pnp_info.md), so the current codec can be
+// read at any time instead of waiting for the headset to negotiate again
+// while the trace runs.
+
+// Property set of the BthA2dp device interface properties
+const GUID BTHA2DP_PNP_PROPERTIES = {
+    0x29ce83d4, 0x7a82, 0x4744, {0xbd, 0x1d, 0xab, 0xec, 0x85, 0x32, 0x1d, 0xd6}};
+
+// Property ids of the set, as seen in pnputil output. The driver also
+// stores the codecs of the local controller, its id is not known yet.
+const ULONG PNP_AVDTP_CONNECTED_PID = 2;  // Boolean
+const ULONG PNP_CONFIGURED_CODEC_PID = 3; // Binary, one codec record
+const ULONG PNP_REMOTE_CODECS_PID = 4;    // Binary, codec records
+
+// A codec in a blob is its standard codec id, followed by the vendor id (4
+// bytes, little endian) and the vendor codec id (2 bytes) only for vendor
+// specific codecs:
+//
+//   FF D7 00 00 00 24 00    aptX HD
+//   02                      MPEG-2,4 (aka AAC)
+struct PnpCodecRecord {
+    BYTE StandardCodecId = 0;
+    DWORD VendorId = 0;
+    WORD VendorCodecId = 0;
+
+    ULONGLONG Key() const {
+        return PackCodecKey(StandardCodecId, VendorId, VendorCodecId);
+    }
+
+    // The codec from the registry, nullptr if it is not known
+    const CodecData *Find() const { return codecRegistry.Find(Key()); }
+};
+
+// Size of a record starting with standardCodecId
+inline size_t PnpCodecRecordSize(BYTE standardCodecId) {
+    return standardCodecId == A2DP_VENDOR_CODEC_ID ? 7 : 1;
+}
+
+// View of a blob of codec records. Nothing is copied, the blob has to stay
+// alive while the view and its iterators are used. Records are decoded as
+// they are iterated.
+class PnpCodecList {
+  public:
+    class Iterator {
+      public:
+        explicit Iterator(const BYTE *position) : m_position(position) {}
+
+        PnpCodecRecord operator*() const;
+        Iterator &operator++() {
+            m_position += PnpCodecRecordSize(*m_position);
+            return *this;
+        }
+        bool operator!=(const Iterator &other) const {
+            return m_position != other.m_position;
+        }
+
+      private:
+        const BYTE *m_position;
+    };
+
+    PnpCodecList() = default;
+
+    // Checks the blob. If the last record is cut short, the list holds the
+    // records before it and Valid() is false.
+    PnpCodecList(const BYTE *data, size_t size);
+
+    bool Valid() const { return m_valid; }
+    size_t Count() const { return m_count; }
+    bool Empty() const { return m_count == 0; }
+
+    Iterator begin() const { return Iterator(m_data); }
+    Iterator end() const { return Iterator(m_data + m_size); }
+
+    // Returns the position of the codec in the list or -1
+    int IndexOf(ULONGLONG key) const;
+
+  private:
+    const BYTE *m_data = nullptr;
+    size_t m_size = 0; // of the complete records
+    size_t m_count = 0;
+    bool m_valid = true;
+};
+
+// The codec properties of one device, as read from the system or from a
+// pnputil dump. Properties the device does not have are empty.
+struct PnpDeviceCodecs {
+    ULONGLONG Address = 0; // Bluetooth address, 0 if not known
+    std::optional<bool> Connected;
+    std::vector<BYTE> Configured;
+    std::vector<BYTE> Remote;
+
+    PnpCodecList ConfiguredCodecs() const {
+        return PnpCodecList(Configured.data(), Configured.size());
+    }
+    PnpCodecList RemoteCodecs() const {
+        return PnpCodecList(Remote.data(), Remote.size());
+    }
+};
+
+// Returns the position of the configured codec among the codecs the device
+// supports, or -1 if there is none or it is not in the list
+int SelectedCodecIndex(const PnpCodecList &remote,
+                       const PnpCodecList &configured);
+
+#ifdef _WIN32
+// Reads the codec properties of every Bluetooth audio device that is
+// present. Returns false if the device interfaces can not be listed.
+bool ReadPnpCodecs(std::vector<PnpDeviceCodecs> &devices);
+#endif
+
+// Reads the codec properties from the output of
+//   pnputil /enum-devices /connected /interfaces /properties /class MEDIA
+// saved to a file (ANSI or UTF-16), see pnp_info.md. Returns false if the
+// file can not be read.
+bool ReadPnpDump(const char *path, std::vector<PnpDeviceCodecs> &devices);
+
+// Prints the address, the selected codec and the supported codecs
+void PrintPnpDeviceCodecs(const PnpDeviceCodecs &device);
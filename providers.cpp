@@ -0,0 +1,161 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "providers.h"
+
+#include <cstdlib>
+#include <cwchar>
+
+ProviderList providers;
+
+namespace {
+
+int HexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Reads digits hex digits into value
+bool ReadHex(const char *&text, int digits, ULONGLONG &value) {
+    value = 0;
+    for (int i = 0; i < digits; i++) {
+        int digit = HexValue(text[i]);
+        if (digit < 0) {
+            return false;
+        }
+        value = value << 4 | (ULONGLONG)digit;
+    }
+    text += digits;
+    return true;
+}
+
+} // namespace
+
+ProviderList::ProviderList() {
+    m_providers.push_back({BTHA2DP_PROVIDER, PROVIDER_DEFAULT_LEVEL, 0,
+                           ProviderKind::A2dp, L"BthA2dp"});
+}
+
+bool ProviderList::Add(const char *description) {
+    const char *comma = strchr(description, ',');
+    size_t guidLength = comma ? (size_t)(comma - description)
+                              : strlen(description);
+    Provider provider = {};
+    if (!ParseGuid(description, guidLength, provider.Id)) {
+        return false;
+    }
+    provider.Level = PROVIDER_DEFAULT_LEVEL;
+    provider.Kind = ProviderKind::Generic;
+    provider.Name = GuidToString(provider.Id);
+
+    if (comma != nullptr) {
+        char *end = nullptr;
+        unsigned long level = strtoul(comma + 1, &end, 10);
+        if (end == comma + 1 || level > 255 || (*end != 0 && *end != ',')) {
+            return false;
+        }
+        provider.Level = (UCHAR)level;
+        if (*end == ',') {
+            const char *keywords = end + 1;
+            provider.Keywords = strtoull(keywords, &end, 16);
+            if (end == keywords || *end != 0) {
+                return false;
+            }
+        }
+    }
+
+    for (Provider &existing : m_providers) {
+        if (SameGuid(existing.Id, provider.Id)) {
+            existing.Level = provider.Level;
+            existing.Keywords = provider.Keywords;
+            return true;
+        }
+    }
+    m_providers.push_back(provider);
+    return true;
+}
+
+const Provider *ProviderList::Find(const GUID &id) const {
+    // A handful of providers, a scan is as good as anything
+    for (const Provider &provider : m_providers) {
+        if (SameGuid(provider.Id, id)) {
+            return &provider;
+        }
+    }
+    return nullptr;
+}
+
+bool ParseGuid(const char *text, size_t length, GUID &guid) {
+    if (length == 38 && text[0] == '{' && text[37] == '}') {
+        text++;
+        length -= 2;
+    }
+    if (length != 36) {
+        return false;
+    }
+
+    ULONGLONG value;
+    if (!ReadHex(text, 8, value) || *text++ != '-') {
+        return false;
+    }
+    guid.Data1 = (DWORD)value;
+    if (!ReadHex(text, 4, value) || *text++ != '-') {
+        return false;
+    }
+    guid.Data2 = (WORD)value;
+    if (!ReadHex(text, 4, value) || *text++ != '-') {
+        return false;
+    }
+    guid.Data3 = (WORD)value;
+    for (int i = 0; i < 8; i++) {
+        if (i == 2 && *text++ != '-') {
+            return false;
+        }
+        if (!ReadHex(text, 2, value)) {
+            return false;
+        }
+        guid.Data4[i] = (BYTE)value;
+    }
+    return true;
+}
+
+std::wstring GuidToString(const GUID &guid) {
+    WCHAR text[40];
+    swprintf(text, 40,
+             L"{%08lx-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x}",
+             (unsigned long)guid.Data1, (unsigned)guid.Data2,
+             (unsigned)guid.Data3, (unsigned)guid.Data4[0],
+             (unsigned)guid.Data4[1], (unsigned)guid.Data4[2],
+             (unsigned)guid.Data4[3], (unsigned)guid.Data4[4],
+             (unsigned)guid.Data4[5], (unsigned)guid.Data4[6],
+             (unsigned)guid.Data4[7]);
+    return text;
+}
@@ -0,0 +1,91 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "platform.h"
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// The ETW providers the session listens to. BthA2dp is always there and its
+// events go through the A2DP analysis. Other providers (BthPort, the HCI
+// providers, the audio endpoint builder...) can be added to see what
+// happened around a negotiation, their events are traced as they are.
+
+// How the events of a provider are decoded
+enum class ProviderKind {
+    A2dp,    // BthA2dp, decoded and analyzed
+    Generic, // anything else, printed property by property
+};
+
+// Microsoft.Windows.Bluetooth.BthA2dp
+const GUID BTHA2DP_PROVIDER = {
+    0x8776ad1e, 0x5022, 0x4451, {0xa5, 0x66, 0xf4, 0x7e, 0x70, 0x8b, 0x90, 0x75}};
+
+// TRACE_LEVEL_VERBOSE, every event
+const UCHAR PROVIDER_DEFAULT_LEVEL = 5;
+
+struct Provider {
+    GUID Id;
+    UCHAR Level;
+    ULONGLONG Keywords; // MatchAnyKeyword, 0 for all
+    ProviderKind Kind;
+    std::wstring Name;
+};
+
+class ProviderList {
+  public:
+    ProviderList();
+
+    // Adds a provider described as "GUID[,level[,keywords]]", the GUID with
+    // or without braces, level decimal and keywords hex. Adding BthA2dp
+    // again changes its level and keywords. Returns false if the
+    // description is malformed.
+    bool Add(const char *description);
+
+    // Returns the provider or nullptr if it is not in the list
+    const Provider *Find(const GUID &id) const;
+
+    const std::vector<Provider> &All() const { return m_providers; }
+
+  private:
+    std::vector<Provider> m_providers;
+};
+
+// Providers of the session. Filled while parsing the command line and only
+// read after that, from any thread.
+extern ProviderList providers;
+
+// Parses xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx, with or without braces
+bool ParseGuid(const char *text, size_t length, GUID &guid);
+
+// The usual {xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx} form
+std::wstring GuidToString(const GUID &guid);
+
+inline bool SameGuid(const GUID &a, const GUID &b) {
+    return a.Data1 == b.Data1 && a.Data2 == b.Data2 && a.Data3 == b.Data3 &&
+           memcmp(a.Data4, b.Data4, sizeof(a.Data4)) == 0;
+}
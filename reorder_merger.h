@@ -0,0 +1,210 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "platform.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <vector>
+
+// Puts events from several streams back in timestamp order. ETW delivers a
+// real time session buffer by buffer and every CPU has its own buffers, so
+// events of one CPU arrive in order but the CPUs overtake each other.
+//
+// Every stream (a CPU) has its own queue. An event is held until the newest
+// timestamp seen is more than the window past it, then the queues are
+// merged through a heap of their heads (a k-way merge). An event that comes
+// in after newer ones were already released is released right away and
+// counted as late.
+//
+// The held events live in one pool of entries, and the queues link their
+// entries by index. Released entries go back to the pool, so once it has
+// grown to the most events held at a time nothing is allocated anymore:
+// the writer thread pushes every event through here.
+//
+// Nothing here knows about ETW, T is whatever the caller orders.
+template <typename T> class ReorderMerger {
+  public:
+    // window is in timestamp units. At most maxHeld events are held, when
+    // more come in the oldest go out early.
+    ReorderMerger(LONGLONG window = 0, size_t maxHeld = 4096) :
+        m_window(window), m_maxHeld(maxHeld) {}
+
+    void SetWindow(LONGLONG window) { m_window = window; }
+
+    void Push(size_t stream, LONGLONG timestamp, const T &item) {
+        if (stream >= m_streams.size()) {
+            m_streams.resize(stream + 1);
+        }
+        if (timestamp < m_newest) {
+            m_reordered++;
+        } else {
+            m_newest = timestamp;
+        }
+        if (timestamp < m_released) {
+            m_late++;
+        }
+
+        const size_t index = Allocate();
+        Entry &entry = m_entries[index];
+        entry.Timestamp = timestamp;
+        entry.Next = NO_ENTRY;
+        entry.Item = item;
+
+        Queue &queue = m_streams[stream];
+        if (queue.First == NO_ENTRY) {
+            queue.First = queue.Last = index;
+            m_heads.push_back({timestamp, stream});
+            std::push_heap(m_heads.begin(), m_heads.end(), Later);
+        } else if (timestamp >= m_entries[queue.Last].Timestamp) {
+            m_entries[queue.Last].Next = index;
+            queue.Last = index;
+        } else if (timestamp < m_entries[queue.First].Timestamp) {
+            // Out of order within its own stream, should not happen with
+            // ETW. It became the head, so fix the heap.
+            entry.Next = queue.First;
+            queue.First = index;
+            for (Head &head : m_heads) {
+                if (head.Stream == stream) {
+                    head.Timestamp = timestamp;
+                }
+            }
+            std::make_heap(m_heads.begin(), m_heads.end(), Later);
+        } else {
+            // Out of order too, sort it in after the entries not later.
+            // The last entry is later, so the walk stops before it.
+            size_t previous = queue.First;
+            while (m_entries[m_entries[previous].Next].Timestamp <=
+                   timestamp) {
+                previous = m_entries[previous].Next;
+            }
+            entry.Next = m_entries[previous].Next;
+            m_entries[previous].Next = index;
+        }
+        m_held++;
+    }
+
+    // Calls emit(T &) in timestamp order for the events that can not be
+    // overtaken any more
+    template <typename Emit> void Release(Emit &&emit) {
+        const LONGLONG limit =
+            m_newest < LLONG_MIN + m_window ? LLONG_MIN : m_newest - m_window;
+        while (!m_heads.empty() &&
+               (m_heads.front().Timestamp <= limit || m_held > m_maxHeld)) {
+            EmitFirst(emit);
+        }
+    }
+
+    // Calls emit(T &) for every held event, in timestamp order. For the
+    // end of the input, or when it went quiet for longer than the window.
+    template <typename Emit> void Drain(Emit &&emit) {
+        while (!m_heads.empty()) {
+            EmitFirst(emit);
+        }
+    }
+
+    size_t Held() const { return m_held; }
+    // Events that came in after a newer one
+    ULONGLONG Reordered() const { return m_reordered; }
+    // Of those, the ones that came too late to be put in order
+    ULONGLONG Late() const { return m_late; }
+
+  private:
+    static const size_t NO_ENTRY = ~(size_t)0;
+
+    struct Entry {
+        LONGLONG Timestamp;
+        size_t Next; // in its queue, or in the free list
+        T Item;
+    };
+
+    // Entries of one stream, oldest first
+    struct Queue {
+        size_t First = NO_ENTRY;
+        size_t Last = NO_ENTRY;
+    };
+
+    struct Head {
+        LONGLONG Timestamp;
+        size_t Stream;
+    };
+
+    // Heap order, the earliest head (then the lowest stream) on top
+    static bool Later(const Head &a, const Head &b) {
+        if (a.Timestamp != b.Timestamp) {
+            return a.Timestamp > b.Timestamp;
+        }
+        return a.Stream > b.Stream;
+    }
+
+    template <typename Emit> void EmitFirst(Emit &emit) {
+        std::pop_heap(m_heads.begin(), m_heads.end(), Later);
+        const size_t stream = m_heads.back().Stream;
+        m_heads.pop_back();
+
+        Queue &queue = m_streams[stream];
+        const size_t index = queue.First;
+        Entry &entry = m_entries[index];
+        if (entry.Timestamp > m_released) {
+            m_released = entry.Timestamp;
+        }
+        emit(entry.Item);
+        queue.First = entry.Next;
+        entry.Next = m_free;
+        m_free = index;
+        m_held--;
+
+        if (queue.First != NO_ENTRY) {
+            m_heads.push_back({m_entries[queue.First].Timestamp, stream});
+            std::push_heap(m_heads.begin(), m_heads.end(), Later);
+        } else {
+            queue.Last = NO_ENTRY;
+        }
+    }
+
+    // Takes an entry from the free list, or grows the pool if there is none
+    size_t Allocate() {
+        if (m_free == NO_ENTRY) {
+            m_entries.emplace_back();
+            return m_entries.size() - 1;
+        }
+        const size_t index = m_free;
+        m_free = m_entries[index].Next;
+        return index;
+    }
+
+    std::vector<Entry> m_entries;
+    size_t m_free = NO_ENTRY; // first free entry
+    std::vector<Queue> m_streams;
+    std::vector<Head> m_heads; // one per stream with events, a min heap
+    LONGLONG m_window;
+    size_t m_maxHeld;
+    size_t m_held = 0;
+    LONGLONG m_newest = LLONG_MIN;
+    LONGLONG m_released = LLONG_MIN;
+    ULONGLONG m_reordered = 0;
+    ULONGLONG m_late = 0;
+};
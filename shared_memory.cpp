@@ -0,0 +1,167 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "shared_memory.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+namespace {
+
+// Local\ keeps the name in the session of the user, Global\ would need
+// SeCreateGlobalPrivilege
+std::wstring MappingName(const char *name) {
+    std::wstring mappingName = L"Local\\";
+    for (const char *c = name; *c != 0; c++) {
+        mappingName += (WCHAR)(unsigned char)*c;
+    }
+    return mappingName;
+}
+
+} // namespace
+
+bool SharedMemoryRegion::Create(const char *name, size_t size) {
+    Close();
+    const ULONGLONG size64 = size;
+    m_mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                   (DWORD)(size64 >> 32), (DWORD)size64,
+                                   MappingName(name).c_str());
+    if (m_mapping == NULL) {
+        return false;
+    }
+    m_data = (BYTE *)MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, size);
+    if (m_data == NULL) {
+        Close();
+        return false;
+    }
+    m_size = size;
+    m_created = true;
+    memset(m_data, 0, size);
+    return true;
+}
+
+bool SharedMemoryRegion::Open(const char *name, size_t size) {
+    Close();
+    m_mapping =
+        OpenFileMappingW(FILE_MAP_READ, FALSE, MappingName(name).c_str());
+    if (m_mapping == NULL) {
+        return false;
+    }
+    m_data = (BYTE *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (m_data == NULL) {
+        Close();
+        return false;
+    }
+    MEMORY_BASIC_INFORMATION info;
+    if (VirtualQuery(m_data, &info, sizeof(info)) == 0 ||
+        info.RegionSize < size) {
+        Close();
+        return false;
+    }
+    m_size = info.RegionSize;
+    return true;
+}
+
+void SharedMemoryRegion::Close() {
+    // The mapping goes away with the last handle to it
+    if (m_data != nullptr) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping != NULL) {
+        CloseHandle(m_mapping);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_mapping = NULL;
+    m_created = false;
+}
+#else
+bool SharedMemoryRegion::Create(const char *name, size_t size) {
+    Close();
+    const std::string shmName = std::string("/") + name;
+    int fd = shm_open(shmName.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    // Readers check the size, so a region of an older layout is resized
+    // before anything is mapped
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        shm_unlink(shmName.c_str());
+        return false;
+    }
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the memory
+    if (data == MAP_FAILED) {
+        shm_unlink(shmName.c_str());
+        return false;
+    }
+    m_data = (BYTE *)data;
+    m_size = size;
+    m_name = shmName;
+    m_created = true;
+    return true;
+}
+
+bool SharedMemoryRegion::Open(const char *name, size_t size) {
+    Close();
+    const std::string shmName = std::string("/") + name;
+    int fd = shm_open(shmName.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < size) {
+        close(fd);
+        return false;
+    }
+    void *data =
+        mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    m_data = (BYTE *)data;
+    m_size = (size_t)info.st_size;
+    return true;
+}
+
+void SharedMemoryRegion::Close() {
+    if (m_data != nullptr) {
+        munmap(m_data, m_size);
+    }
+    if (m_created) {
+        shm_unlink(m_name.c_str());
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_name.clear();
+    m_created = false;
+}
+#endif
@@ -0,0 +1,66 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "platform.h"
+
+#include <cstddef>
+#include <string>
+
+// A named region of memory shared with other processes: a file mapping
+// backed by the paging file on Windows, POSIX shared memory elsewhere. The
+// name is given without decoration, "win_bt_codec" becomes
+// Local\win_bt_codec on Windows and /win_bt_codec on POSIX.
+class SharedMemoryRegion {
+  public:
+    SharedMemoryRegion() = default;
+    ~SharedMemoryRegion() { Close(); }
+    SharedMemoryRegion(const SharedMemoryRegion &) = delete;
+    SharedMemoryRegion &operator=(const SharedMemoryRegion &) = delete;
+
+    // Creates the region, or takes over one left behind by a process that
+    // did not exit cleanly, and maps it read write. The region is zeroed.
+    // Returns false if it can not be created.
+    bool Create(const char *name, size_t size);
+
+    // Maps an existing region read only. size is what the caller expects
+    // at least. Returns false if there is no such region or it is smaller.
+    bool Open(const char *name, size_t size);
+
+    // Unmaps the region. The creator also removes the name, processes that
+    // still have it mapped keep their mapping.
+    void Close();
+
+    BYTE *Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+  private:
+    BYTE *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_created = false;
+#ifdef _WIN32
+    HANDLE m_mapping = NULL;
+#else
+    std::string m_name;
+#endif
+};
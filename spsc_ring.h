@@ -0,0 +1,109 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Fixed capacity lock free queue between exactly one producer thread and
+// exactly one consumer thread. Slots are used in place: the producer claims
+// a slot, fills it and publishes it, the consumer reads the front slot and
+// pops it when done. Nothing is copied and nothing is allocated after
+// construction.
+//
+// Each side keeps a private copy of the other side's index and only reads
+// the shared one when the copy says the queue is full (or empty), so in the
+// steady state the two threads do not touch each other's cache lines.
+template <typename T, size_t Capacity> class SpscRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity has to be a power of two");
+
+  public:
+    SpscRing() : m_slots(Capacity) {}
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    static constexpr size_t CAPACITY = Capacity;
+
+    // Producer: returns the next free slot or nullptr if the queue is full.
+    // The slot still holds whatever it held before. With ahead, returns the
+    // slot that many after the next one, so a batch of slots can be filled
+    // before they are published together; ahead has to be less than
+    // Capacity.
+    T *Claim(size_t ahead = 0) {
+        size_t head = m_head.load(std::memory_order_relaxed) + ahead;
+        if (head - m_cachedTail >= Capacity) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head - m_cachedTail >= Capacity) {
+                return nullptr;
+            }
+        }
+        return &m_slots[head & (Capacity - 1)];
+    }
+
+    // Producer: hands the count slots claimed first to the consumer, with
+    // a single store however many there are
+    void Publish(size_t count = 1) {
+        m_head.store(m_head.load(std::memory_order_relaxed) + count,
+                     std::memory_order_release);
+    }
+
+    // Consumer: returns the oldest published slot or nullptr if the queue is
+    // empty
+    T *Front() {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_cachedHead) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail == m_cachedHead) {
+                return nullptr;
+            }
+        }
+        return &m_slots[tail & (Capacity - 1)];
+    }
+
+    // Consumer: gives the slot returned by Front() back to the producer
+    void Pop() {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+    }
+
+    // Either side: number of published slots not popped yet. Only a hint
+    // while the other side is running.
+    size_t Size() const {
+        return m_head.load(std::memory_order_acquire) -
+               m_tail.load(std::memory_order_acquire);
+    }
+
+  private:
+    // Producer side
+    alignas(64) std::atomic<size_t> m_head{0};
+    size_t m_cachedTail = 0;
+
+    // Consumer side
+    alignas(64) std::atomic<size_t> m_tail{0};
+    size_t m_cachedHead = 0;
+
+    alignas(64) std::vector<T> m_slots;
+};
@@ -0,0 +1,245 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "status_snapshot.h"
+
+#include "latency_histogram.h"
+#include "output_sink.h"
+
+#include <cstring>
+#include <cwchar>
+#include <stdio.h>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace {
+
+uint32_t CurrentProcessId() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return (uint32_t)getpid();
+#endif
+}
+
+int8_t Tristate(const std::optional<bool> &value) {
+    return value ? (int8_t)(*value ? 1 : 0) : (int8_t)-1;
+}
+
+} // namespace
+
+bool StatusPublisher::Open(const char *name) {
+    Close();
+    if (!m_region.Create(name, STATUS_REGION_SIZE)) {
+        return false;
+    }
+    m_header = (StatusHeader *)m_region.Data();
+    m_devices = (StatusDevice *)(m_region.Data() + sizeof(StatusHeader));
+    m_slotCodecs.assign(STATUS_MAX_DEVICES, nullptr);
+
+    // A region taken over from a crashed publisher may be mid write, the
+    // sequence goes on from where it was so readers see the change
+    const uint64_t sequence = m_header->Sequence.load(std::memory_order_relaxed);
+    m_header->Sequence.store(sequence | 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->Version = STATUS_VERSION;
+    m_header->HeaderSize = sizeof(StatusHeader);
+    m_header->DeviceSize = sizeof(StatusDevice);
+    m_header->MaxDevices = STATUS_MAX_DEVICES;
+    m_header->State = (uint32_t)StatusState::Running;
+    m_header->ProcessId = CurrentProcessId();
+    m_header->DeviceCount = 0;
+    m_header->Events = 0;
+    m_header->UpdatedAt = NowNanoseconds();
+    memcpy(m_header->Magic, STATUS_MAGIC, sizeof(STATUS_MAGIC));
+    m_header->Sequence.store((sequence | 1) + 1, std::memory_order_release);
+    return true;
+}
+
+void StatusPublisher::Close() {
+    if (m_header != nullptr) {
+        const uint64_t sequence =
+            m_header->Sequence.load(std::memory_order_relaxed);
+        m_header->Sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_header->State = (uint32_t)StatusState::Stopped;
+        m_header->UpdatedAt = NowNanoseconds();
+        m_header->Sequence.store(sequence + 2, std::memory_order_release);
+    }
+    m_region.Close();
+    m_header = nullptr;
+    m_devices = nullptr;
+    m_slots.clear();
+    m_slotCodecs.clear();
+}
+
+void StatusPublisher::Publish(const DeviceState *device) {
+    if (m_header == nullptr) {
+        return;
+    }
+
+    // Find the slot before the write starts, to keep the odd window short
+    StatusDevice *slot = nullptr;
+    size_t index = 0;
+    if (device != nullptr) {
+        auto found = m_slots.find(device->Address);
+        if (found != m_slots.end()) {
+            index = found->second;
+            slot = &m_devices[index];
+        } else if (m_slots.size() < STATUS_MAX_DEVICES) {
+            index = m_slots.size();
+            m_slots.emplace(device->Address, (uint32_t)index);
+            slot = &m_devices[index];
+        }
+    }
+
+    const uint64_t sequence = m_header->Sequence.load(std::memory_order_relaxed);
+    m_header->Sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->Events++;
+    m_header->UpdatedAt = NowNanoseconds();
+    if (slot != nullptr) {
+        WriteDevice(*slot, *device, index);
+        m_header->DeviceCount = (uint32_t)m_slots.size();
+    }
+    m_header->Sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void StatusPublisher::WriteDevice(StatusDevice &slot, const DeviceState &device,
+                                  size_t index) {
+    slot.Address = device.Address;
+    slot.Events = device.Events;
+    slot.StreamState = (uint8_t)device.State;
+    slot.Connected = Tristate(device.Connected);
+    slot.Streaming = Tristate(device.Streaming);
+    slot.CodecsAdvertised = (uint16_t)device.AdvertisedCodecs();
+    slot.SampleRate = device.SampleRate.value_or(0);
+    slot.ChannelCount = device.ChannelCount.value_or(0);
+    slot.LastActivity = device.LastActivity.value_or(0xFFFFFFFF);
+
+    const CodecData *codec = device.SelectedCodec;
+    slot.HasCodec = codec != nullptr ? 1 : 0;
+    slot.CodecId = codec != nullptr ? codec->A2dpStandardCodecId : 0;
+    slot.VendorId = codec != nullptr ? codec->A2dpVendorId : 0;
+    slot.VendorCodecId = codec != nullptr ? codec->A2dpVendorCodecId : 0;
+    if (codec != m_slotCodecs[index]) {
+        // The codec changes a few times per connection, not per event
+        std::string name;
+        if (codec != nullptr) {
+            AppendUtf8(name, codec->Name, wcslen(codec->Name));
+        }
+        const size_t length = name.size() < STATUS_CODEC_NAME - 1
+                                  ? name.size()
+                                  : STATUS_CODEC_NAME - 1;
+        memcpy(slot.CodecName, name.data(), length);
+        memset(slot.CodecName + length, 0, STATUS_CODEC_NAME - length);
+        m_slotCodecs[index] = codec;
+    }
+}
+
+bool ReadStatusSnapshot(const BYTE *region, size_t size,
+                        StatusSnapshot &snapshot, int attempts) {
+    if (region == nullptr || size < STATUS_REGION_SIZE) {
+        return false;
+    }
+    const StatusHeader *header = (const StatusHeader *)region;
+    const StatusDevice *devices =
+        (const StatusDevice *)(region + sizeof(StatusHeader));
+
+    for (int attempt = 0; attempt < attempts; attempt++) {
+        const uint64_t before =
+            header->Sequence.load(std::memory_order_acquire);
+        if ((before & 1) != 0) {
+            // The publisher is writing, it is done within a microsecond
+            std::this_thread::yield();
+            continue;
+        }
+        if (memcmp(header->Magic, STATUS_MAGIC, sizeof(STATUS_MAGIC)) != 0 ||
+            header->Version != STATUS_VERSION ||
+            header->HeaderSize != sizeof(StatusHeader) ||
+            header->DeviceSize != sizeof(StatusDevice) ||
+            header->MaxDevices != STATUS_MAX_DEVICES) {
+            return false;
+        }
+        snapshot.State = (StatusState)header->State;
+        snapshot.ProcessId = header->ProcessId;
+        snapshot.DeviceCount = header->DeviceCount;
+        snapshot.Events = header->Events;
+        snapshot.UpdatedAt = header->UpdatedAt;
+        // A torn count is caught by the sequence check below, but it must
+        // not make the copy run past the region first
+        const uint32_t count = snapshot.DeviceCount < STATUS_MAX_DEVICES
+                                   ? snapshot.DeviceCount
+                                   : STATUS_MAX_DEVICES;
+        memcpy(snapshot.Devices, devices, count * sizeof(StatusDevice));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->Sequence.load(std::memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PrintStatusSnapshot(const StatusSnapshot &snapshot) {
+    wprintf(L"Process %lu, %ls, %llu events, %lu devices\n",
+            (unsigned long)snapshot.ProcessId,
+            snapshot.State == StatusState::Running ? L"running" : L"stopped",
+            (unsigned long long)snapshot.Events,
+            (unsigned long)snapshot.DeviceCount);
+    for (uint32_t i = 0; i < snapshot.DeviceCount && i < STATUS_MAX_DEVICES;
+         i++) {
+        const StatusDevice &device = snapshot.Devices[i];
+        wprintf(L"Device %012llX: %ls", (unsigned long long)device.Address,
+                StreamStateToString((StreamState)device.StreamState));
+        if (device.Connected == 0) {
+            wprintf(L", disconnected");
+        }
+        if (device.HasCodec) {
+            // Codec names are ASCII but for the odd vendor name, which
+            // gets a ? per byte on the console
+            WCHAR name[STATUS_CODEC_NAME];
+            size_t length = 0;
+            for (; length + 1 < STATUS_CODEC_NAME &&
+                   device.CodecName[length] != 0;
+                 length++) {
+                const unsigned char c = (unsigned char)device.CodecName[length];
+                name[length] = c < 0x80 ? (WCHAR)c : L'?';
+            }
+            name[length] = 0;
+            wprintf(L", codec %ls", name);
+        }
+        if (device.SampleRate != 0) {
+            wprintf(L", %lu Hz", (unsigned long)device.SampleRate);
+        }
+        if (device.ChannelCount != 0) {
+            wprintf(L", %lu channels", (unsigned long)device.ChannelCount);
+        }
+        wprintf(L", %u codecs advertised, %llu events\n",
+                (unsigned)device.CodecsAdvertised,
+                (unsigned long long)device.Events);
+    }
+}
@@ -0,0 +1,150 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "device_tracker.h"
+#include "platform.h"
+#include "shared_memory.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// The state of every device, published in shared memory for other
+// processes (QoS and telemetry agents) to read without talking to the
+// tool. The layout is fixed and all values are little endian:
+//
+//   StatusHeader
+//   StatusDevice[MaxDevices]   the first DeviceCount are in use
+//
+// The region is guarded by a seqlock: the publisher makes Sequence odd,
+// writes, and makes it even again. A reader copies what it needs between
+// two reads of Sequence and tries again if they differ or are odd, so it
+// never waits for a lock or makes a system call, and the publisher never
+// waits for readers. See ReadStatusSnapshot.
+
+const char STATUS_MAGIC[8] = {'W', 'B', 'T', 'S', 'T', 'A', 'T', 0};
+const uint32_t STATUS_VERSION = 1;
+const uint32_t STATUS_MAX_DEVICES = 64;
+const size_t STATUS_CODEC_NAME = 64; // UTF-8, null terminated
+
+enum class StatusState : uint32_t {
+    Stopped = 0, // the publisher exited, the values are the last ones
+    Running = 1,
+};
+
+struct StatusHeader {
+    char Magic[8];       // STATUS_MAGIC, written last when the region is set up
+    uint32_t Version;    // STATUS_VERSION
+    uint32_t HeaderSize; // sizeof(StatusHeader)
+    uint32_t DeviceSize; // sizeof(StatusDevice)
+    uint32_t MaxDevices; // STATUS_MAX_DEVICES
+    std::atomic<uint64_t> Sequence; // odd while the publisher writes
+    uint32_t State;                 // StatusState
+    uint32_t ProcessId;             // of the publisher
+    uint32_t DeviceCount;
+    uint32_t Reserved;
+    uint64_t Events;    // BthA2dp events analyzed
+    uint64_t UpdatedAt; // steady clock of the publisher, in nanoseconds
+};
+
+struct StatusDevice {
+    uint64_t Address;
+    uint64_t Events;
+    uint8_t StreamState; // StreamState
+    int8_t Connected;    // 1 or 0, -1 if not known
+    int8_t Streaming;    // A2dpIsStreaming: 1 or 0, -1 if not known
+    uint8_t HasCodec;    // 1 if a codec was selected
+    uint8_t CodecId;     // A2dpStandardCodecId of the selected codec
+    uint8_t Reserved[3];
+    uint32_t VendorId;      // of the selected vendor codec
+    uint16_t VendorCodecId; // of the selected vendor codec
+    uint16_t CodecsAdvertised;
+    uint32_t SampleRate;   // 0 if not known
+    uint32_t ChannelCount; // 0 if not known
+    uint32_t LastActivity; // AvdtpActivity, 0xFFFFFFFF if none
+    uint32_t Reserved2;
+    char CodecName[STATUS_CODEC_NAME]; // of the selected codec, or empty
+};
+
+static_assert(sizeof(StatusHeader) == 64, "StatusHeader layout changed");
+static_assert(sizeof(StatusDevice) == 112, "StatusDevice layout changed");
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the sequence has to work across processes");
+
+const size_t STATUS_REGION_SIZE =
+    sizeof(StatusHeader) + STATUS_MAX_DEVICES * sizeof(StatusDevice);
+
+// Writes the region. Only one thread may publish, the writer thread of
+// OutputWriter does after every BthA2dp event.
+class StatusPublisher {
+  public:
+    StatusPublisher() = default;
+    ~StatusPublisher() { Close(); }
+    StatusPublisher(const StatusPublisher &) = delete;
+    StatusPublisher &operator=(const StatusPublisher &) = delete;
+
+    // Creates the region. Returns false if it can not be created.
+    bool Open(const char *name);
+
+    // Marks the region stopped and removes it
+    void Close();
+
+    bool IsOpen() const { return m_header != nullptr; }
+
+    // Counts the event and writes the device it changed, if any. Devices
+    // beyond STATUS_MAX_DEVICES are left out.
+    void Publish(const DeviceState *device);
+
+  private:
+    void WriteDevice(StatusDevice &slot, const DeviceState &device,
+                     size_t index);
+
+    SharedMemoryRegion m_region;
+    StatusHeader *m_header = nullptr;
+    StatusDevice *m_devices = nullptr;
+    std::unordered_map<ULONGLONG, uint32_t> m_slots; // by address
+    // The codec whose name is in each slot, names are converted once
+    std::vector<const CodecData *> m_slotCodecs;
+};
+
+// A consistent copy of the region
+struct StatusSnapshot {
+    StatusState State = StatusState::Stopped;
+    uint32_t ProcessId = 0;
+    uint32_t DeviceCount = 0;
+    uint64_t Events = 0;
+    uint64_t UpdatedAt = 0;
+    StatusDevice Devices[STATUS_MAX_DEVICES];
+};
+
+// Copies the region into snapshot, trying up to attempts times while the
+// publisher writes. Returns false if the region is not a status region of
+// this version, or no consistent copy was made.
+bool ReadStatusSnapshot(const BYTE *region, size_t size,
+                        StatusSnapshot &snapshot, int attempts = 1000);
+
+// Prints the snapshot, a line per device like PrintDeviceState
+void PrintStatusSnapshot(const StatusSnapshot &snapshot);
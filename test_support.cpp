@@ -0,0 +1,268 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "test_support.h"
+
+#include "capture_file.h"
+#include "providers.h"
+#include "reorder_merger.h"
+#include "trace_import.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+std::atomic<ULONGLONG> allocations{0};
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *memory = malloc(size != 0 ? size : 1);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void *memory) noexcept { free(memory); }
+void operator delete(void *memory, size_t) noexcept { free(memory); }
+
+namespace {
+
+// One property of a synthetic event, its data in the hex --trace prints
+struct SyntheticProperty {
+    const WCHAR *Name;
+    USHORT InType; // of one element, arrays are longer than one element
+    const char *Hex;
+};
+
+// The event shapes BthA2dp logs, taken from events.txt
+const std::vector<std::vector<SyntheticProperty>> EVENT_SHAPES = {
+    // a codec the headset supports
+    {{L"PartA_PrivTags", TDH_INTYPE_UINT64, "0008000200000000"},
+     {L"A2dpStandardCodecId", TDH_INTYPE_UINT8, "ff"},
+     {L"A2dpVendorId", TDH_INTYPE_UINT32, "d7000000"},
+     {L"A2dpVendorCodecId", TDH_INTYPE_UINT16, "2400"},
+     {L"AcceptorStreamEndPointID", TDH_INTYPE_UINT8, "07"},
+     {L"BTDeviceAddress", TDH_INTYPE_UINT64, "f479f4d2967c0000"}},
+    {{L"PartA_PrivTags", TDH_INTYPE_UINT64, "0008000200000000"},
+     {L"A2dpStandardCodecId", TDH_INTYPE_UINT8, "02"},
+     {L"A2dpVendorId", TDH_INTYPE_UINT32, "00000000"},
+     {L"A2dpVendorCodecId", TDH_INTYPE_UINT16, "0000"},
+     {L"AcceptorStreamEndPointID", TDH_INTYPE_UINT8, "03"},
+     {L"BTDeviceAddress", TDH_INTYPE_UINT64, "f479f4d2967c0000"}},
+    // the codec that was selected
+    {{L"PartA_PrivTags", TDH_INTYPE_UINT64, "0008000300000000"},
+     {L"AvdtpActivity", TDH_INTYPE_UINT32, "12000000"},
+     {L"AcceptorStreamEndPointID", TDH_INTYPE_UINT8, "03"},
+     {L"InitiatorStreamEndPointID", TDH_INTYPE_UINT8, "37"},
+     {L"ResultCode", TDH_INTYPE_UINT8, "00"},
+     {L"A2dpStandardCodecId", TDH_INTYPE_UINT8, "02"},
+     {L"A2dpVendorId", TDH_INTYPE_UINT32, "00000000"},
+     {L"A2dpVendorCodecId", TDH_INTYPE_UINT16, "0000"},
+     {L"BTDeviceAddress", TDH_INTYPE_UINT64, "f479f4d2967c0000"}},
+    {{L"PartA_PrivTags", TDH_INTYPE_UINT64, "0008000300000000"},
+     {L"A2dpIsConnected", TDH_INTYPE_UINT32, "01000000"},
+     {L"A2dpIsSepOpen", TDH_INTYPE_UINT32, "01000000"},
+     {L"A2dpIsAvrcpRegistered", TDH_INTYPE_UINT32, "01000000"},
+     {L"A2dpIsSink", TDH_INTYPE_UINT32, "00000000"},
+     {L"A2dpIsStreaming", TDH_INTYPE_UINT32, "00000000"},
+     {L"A2dpSupportsAbsoluteVolume", TDH_INTYPE_UINT32, "01000000"},
+     {L"BTDeviceAddress", TDH_INTYPE_UINT64, "f479f4d2967c0000"}},
+    {{L"PartA_PrivTags", TDH_INTYPE_UINT64, "0000000300000000"},
+     {L"StatusErrorCode", TDH_INTYPE_UINT32, "00000000"},
+     {L"IsKsPinCreated", TDH_INTYPE_UINT32, "00000000"},
+     {L"FormatTag", TDH_INTYPE_UINT16, "feff"},
+     {L"SampleRate", TDH_INTYPE_UINT32, "80bb000080bb000080bb0000"},
+     {L"BitDepth", TDH_INTYPE_UINT16, "10001000000010000000"},
+     {L"ChannelCount", TDH_INTYPE_UINT16, "020002000000"},
+     {L"ChannelMask", TDH_INTYPE_UINT32, "03000000"},
+     {L"BTDeviceAddress", TDH_INTYPE_UINT64, "f479f4d2967c0000"}},
+    {{L"PartA_PrivTags", TDH_INTYPE_UINT64, "0008000300000000"},
+     {L"AudioSessionId", TDH_INTYPE_GUID, "a16c3dc9202a04008b29d5c9202adc01"},
+     {L"L2capChannelHandleSessionId", TDH_INTYPE_UINT64, "e00a6a6f8ca4ffff"},
+     {L"BTDeviceAddress", TDH_INTYPE_UINT64, "f479f4d2967c0000"}},
+    {{L"PartA_PrivTags", TDH_INTYPE_UINT64, "0000000300000000"},
+     {L"TransitionFromState", TDH_INTYPE_UINT8, "01"},
+     {L"TransitionToState", TDH_INTYPE_UINT8, "02"},
+     {L"StatusErrorCode", TDH_INTYPE_UINT32, "00000000"},
+     {L"TransitionDurationMs", TDH_INTYPE_UINT64, "0b00000000000000"},
+     {L"BTDeviceAddress", TDH_INTYPE_UINT64, "f479f4d2967c0000"}},
+    {{L"PartA_PrivTags", TDH_INTYPE_UINT64, "0008000300000000"},
+     {L"L2capChannelHandleSessionId", TDH_INTYPE_UINT64, "e00a6a6f8ca4ffff"},
+     {L"DurationInMilliseconds", TDH_INTYPE_UINT64, "cd5b000000000000"},
+     {L"A2dpStandardCodecId", TDH_INTYPE_UINT8, "02"},
+     {L"A2dpVendorId", TDH_INTYPE_UINT32, "00000000"},
+     {L"A2dpVendorCodecId", TDH_INTYPE_UINT16, "0000"},
+     {L"A2dpIsSink", TDH_INTYPE_UINT32, "00000000"},
+     {L"BTDeviceAddress", TDH_INTYPE_UINT64, "f479f4d2967c0000"}},
+};
+
+} // namespace
+
+void BuildEventCorpus(EventCorpus &corpus) {
+    for (const auto &shape : EVENT_SHAPES) {
+        EventSchema schema;
+        std::vector<BYTE> data;
+        for (const SyntheticProperty &property : shape) {
+            PropertyLayout layout;
+            layout.Name = property.Name;
+            layout.InType = property.InType;
+            layout.Size = (ULONG)strlen(property.Hex) / 2;
+            schema.Properties.push_back(layout);
+
+            const size_t offset = data.size();
+            data.resize(offset + layout.Size);
+            DecodeHex(property.Hex, layout.Size * 2, data.data() + offset);
+        }
+        ComputeLayout(schema);
+        corpus.Schemas.push_back(schema);
+        corpus.Data.push_back(data);
+    }
+    for (size_t i = 0; i < corpus.Schemas.size(); i++) {
+        EVENT_RECORD event = {};
+        event.EventHeader.ProviderId = BTHA2DP_PROVIDER;
+        event.EventHeader.TimeStamp.QuadPart = (LONGLONG)i;
+        event.UserData = corpus.Data[i].data();
+        event.UserDataLength = (USHORT)corpus.Data[i].size();
+        corpus.Events.push_back(event);
+    }
+}
+
+void BuildTraceLoggingCorpus(const EventCorpus &corpus,
+                             TraceLoggingCorpus &traceLogging) {
+    const size_t shapes = corpus.Events.size();
+    // The events point into both, they must not move
+    traceLogging.Metadata.resize(shapes);
+    traceLogging.Items.resize(shapes);
+    for (size_t i = 0; i < shapes; i++) {
+        // Like TraceLogging metadata: the event name, then the fields. Two
+        // shapes have the same fields, their names tell them apart.
+        std::vector<BYTE> &metadata = traceLogging.Metadata[i];
+        char name[16];
+        snprintf(name, sizeof(name), "Event%u", (unsigned)i);
+        metadata.assign(name, name + strlen(name) + 1);
+        for (const PropertyLayout &property : corpus.Schemas[i].Properties) {
+            for (WCHAR c : property.Name) {
+                metadata.push_back((BYTE)c);
+            }
+            metadata.push_back(0);
+            metadata.push_back((BYTE)property.InType);
+        }
+        EVENT_HEADER_EXTENDED_DATA_ITEM &item = traceLogging.Items[i];
+        item = {};
+        item.ExtType = EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL;
+        item.DataSize = (USHORT)metadata.size();
+        item.DataPtr = (ULONGLONG)(uintptr_t)metadata.data();
+
+        EVENT_RECORD event = corpus.Events[i];
+        event.ExtendedDataCount = 1;
+        event.ExtendedData = &item;
+        traceLogging.Events.push_back(event);
+        traceLogging.Backend.AddSchema(MakeSchemaKey(event),
+                                       corpus.Schemas[i]);
+    }
+}
+
+// Writes count events of the corpus, round robin, to a capture file
+bool WriteCorpusCapture(const char *path, const EventCorpus &corpus,
+                        size_t count) {
+    CaptureWriter writer;
+    if (!writer.Open(path, 1000000)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const size_t k = i % corpus.Events.size();
+        EVENT_RECORD event = corpus.Events[k];
+        event.EventHeader.TimeStamp.QuadPart = (LONGLONG)i;
+        if (!writer.Write(event, corpus.Schemas[k])) {
+            return false;
+        }
+    }
+    return writer.Close();
+}
+
+A2dpEventData CodecEvent(ULONGLONG address, const CodecData &codec,
+                         bool selected) {
+    A2dpEventData data;
+    data.BTDeviceAddress = address;
+    data.a2dpStandardCodecId = codec.A2dpStandardCodecId;
+    data.a2dpVendorId = codec.A2dpVendorId;
+    data.a2dpVendorCodecId = codec.A2dpVendorCodecId;
+    data.AcceptorStreamEndPointID = 1;
+    if (selected) {
+        data.InitiatorStreamEndPointID = 2;
+        data.AvdtpActivity = AvdtpActivity::SetConfiguration_Cfm;
+    }
+    return data;
+}
+
+const BYTE PNP_REMOTE_CODECS[] = {
+    0xFF, 0xD7, 0x00, 0x00, 0x00, 0x24, 0x00, 0xFF, 0x4F, 0x00, 0x00, 0x00,
+    0x01, 0x00, 0x02, 0xFF, 0x0A, 0x00, 0x00, 0x00, 0x06, 0x01, 0xFF, 0x0A,
+    0x00, 0x00, 0x00, 0x04, 0x01, 0xFF, 0x0A, 0x00, 0x00, 0x00, 0x03, 0x01,
+    0x00};
+const BYTE PNP_CONFIGURED_CODEC[] = {0x02};
+
+std::vector<StreamEvent> InterleavedStreams(size_t streams, size_t batch,
+                                            size_t count) {
+    std::vector<StreamEvent> events;
+    for (size_t base = 0; base < count; base += streams * batch) {
+        for (size_t stream = 0; stream < streams; stream++) {
+            for (size_t k = 0; k < batch; k++) {
+                size_t i = base + k * streams + stream;
+                if (i < count) {
+                    events.push_back({stream, (LONGLONG)i});
+                }
+            }
+        }
+    }
+    return events;
+}
+
+bool MergeStreams(const std::vector<StreamEvent> &events, LONGLONG window) {
+    ReorderMerger<LONGLONG> merger(window, events.size());
+    LONGLONG last = -1;
+    bool ordered = true;
+    auto check = [&](LONGLONG timestamp) {
+        ordered = ordered && timestamp == last + 1;
+        last = timestamp;
+    };
+    for (const StreamEvent &event : events) {
+        merger.Push(event.Stream, event.Timestamp, event.Timestamp);
+        merger.Release(check);
+    }
+    merger.Drain(check);
+    return ordered && merger.Late() == 0 &&
+           last == (LONGLONG)events.size() - 1;
+}
+
+std::string StatusRegionName() {
+    char name[64];
+    snprintf(name, sizeof(name), "win_bt_codec_bench_%llx",
+             (unsigned long long)std::chrono::steady_clock::now()
+                 .time_since_epoch()
+                 .count());
+    return name;
+}
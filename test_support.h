@@ -0,0 +1,147 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Synthetic events and helpers that the tests and the benchmarks share
+
+#pragma once
+
+#include "a2dp.h"
+#include "codec_registry.h"
+#include "event_schema.h"
+#include "platform.h"
+#include "spsc_ring.h"
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Every allocation of the process is counted, so the benchmarks can report
+// allocations per item and the tests can check that a path does not
+// allocate. test_support.cpp replaces operator new to count them.
+extern std::atomic<ULONGLONG> allocations;
+
+// Raw BthA2dp events with their schemas, one per event shape of
+// events.txt. The events point into Data and the schemas, so the corpus
+// can not be copied.
+struct EventCorpus {
+    EventCorpus() = default;
+    EventCorpus(const EventCorpus &) = delete;
+    EventCorpus &operator=(const EventCorpus &) = delete;
+
+    std::vector<EventSchema> Schemas;
+    std::vector<std::vector<BYTE>> Data;
+    std::vector<EVENT_RECORD> Events;
+};
+
+void BuildEventCorpus(EventCorpus &corpus);
+
+// The corpus as TraceLogging events: all of them have the descriptor of
+// BthA2dp events (Id 0) and only their metadata tells them apart. The
+// schemas are served by the fake back end, keyed by that metadata.
+struct TraceLoggingCorpus {
+    TraceLoggingCorpus() = default;
+    TraceLoggingCorpus(const TraceLoggingCorpus &) = delete;
+    TraceLoggingCorpus &operator=(const TraceLoggingCorpus &) = delete;
+
+    std::vector<std::vector<BYTE>> Metadata;
+    std::vector<EVENT_HEADER_EXTENDED_DATA_ITEM> Items;
+    std::vector<EVENT_RECORD> Events;
+    FakeTdhBackend Backend;
+};
+
+void BuildTraceLoggingCorpus(const EventCorpus &corpus,
+                             TraceLoggingCorpus &traceLogging);
+
+// Writes count events of the corpus, round robin, to a capture file
+bool WriteCorpusCapture(const char *path, const EventCorpus &corpus,
+                        size_t count);
+
+// An announcement (acceptor SEP only) or a selection (both SEPs and a
+// SetConfiguration) of the codec by the device
+A2dpEventData CodecEvent(ULONGLONG address, const CodecData &codec,
+                         bool selected);
+
+// The codecs of the headset in pnp_info.md, and the one it was set up with
+extern const BYTE PNP_REMOTE_CODECS[37];
+extern const BYTE PNP_CONFIGURED_CODEC[1];
+
+// Timestamps of streams streams, delivered the way ETW delivers per CPU
+// buffers: batch events of one stream, then batch of the next, so streams
+// overtake each other by up to streams * batch events
+struct StreamEvent {
+    size_t Stream;
+    LONGLONG Timestamp;
+};
+
+std::vector<StreamEvent> InterleavedStreams(size_t streams, size_t batch,
+                                            size_t count);
+
+// Merges the events with the window. Returns true if they came out in
+// timestamp order, none late.
+bool MergeStreams(const std::vector<StreamEvent> &events, LONGLONG window);
+
+// Name of a status region only this process uses
+std::string StatusRegionName();
+
+// Moves count sequence numbers through a ring between two threads, batch
+// at a time. A small ring makes both sides hit the full and the empty ring
+// all the time. Returns true if every number arrived, in order.
+template <size_t Capacity>
+bool TransferThroughRing(ULONGLONG count, size_t batch) {
+    static SpscRing<ULONGLONG, Capacity> ring;
+    bool ordered = true;
+    std::thread consumer([count, &ordered] {
+        for (ULONGLONG expected = 0; expected < count;) {
+            const ULONGLONG *value = ring.Front();
+            if (value == nullptr) {
+                std::this_thread::yield();
+                continue;
+            }
+            ordered = ordered && *value == expected;
+            ring.Pop();
+            expected++;
+        }
+    });
+    for (ULONGLONG i = 0; i < count;) {
+        // The last batch is cut short by count
+        size_t claimed = 0;
+        while (claimed < batch && i + claimed < count) {
+            ULONGLONG *slot = ring.Claim(claimed);
+            if (slot == nullptr) {
+                if (claimed > 0) {
+                    break; // publish what fits
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            *slot = i + claimed;
+            claimed++;
+        }
+        ring.Publish(claimed);
+        i += claimed;
+    }
+    consumer.join();
+    return ordered;
+}
@@ -0,0 +1,1628 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Tests of the decoding and analysis code. Builds on any platform.
+//
+// Every check exits the process with an error message if it fails, ctest
+// runs them all. With names on the command line, only those checks run.
+
+#include "a2dp.h"
+#include "batch.h"
+#include "capture_file.h"
+#include "coalescer.h"
+#include "codec_registry.h"
+#include "device_tracker.h"
+#include "event_decoder.h"
+#include "event_schema.h"
+#include "filter.h"
+#include "flight_recorder.h"
+#include "latency_histogram.h"
+#include "load_generator.h"
+#include "metrics.h"
+#include "metrics_server.h"
+#include "negotiation.h"
+#include "output_sink.h"
+#include "output_writer.h"
+#include "pnp_codecs.h"
+#include "reorder_merger.h"
+#include "status_snapshot.h"
+#include "test_support.h"
+#include "trace_import.h"
+#include "trace_source.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+const char NULL_DEVICE[] = "NUL";
+#else
+const char NULL_DEVICE[] = "/dev/null";
+#endif
+
+// Exits the process if the schema cache asks the back end more than once
+// per schema, miscounts, or mixes up events that only differ by metadata
+void CheckSchemaCache() {
+    EventCorpus corpus;
+    BuildEventCorpus(corpus);
+    TraceLoggingCorpus traceLogging;
+    BuildTraceLoggingCorpus(corpus, traceLogging);
+    SchemaCache cache(traceLogging.Backend);
+    const size_t shapes = traceLogging.Events.size();
+    std::vector<const EventSchema *> found(shapes, nullptr);
+    bool ok = true;
+    // Runs of three, so both the last entry and the map are looked at
+    const ULONGLONG lookups = 3000;
+    for (ULONGLONG i = 0; i < lookups; i++) {
+        const size_t k = (size_t)(i / 3) % shapes;
+        const EventSchema *schema = cache.Lookup(traceLogging.Events[k]);
+        ok = ok && schema != nullptr &&
+             (found[k] == nullptr || found[k] == schema) &&
+             schema->Properties.size() ==
+                 corpus.Schemas[k].Properties.size() &&
+             schema->FixedDataSize == corpus.Schemas[k].FixedDataSize;
+        found[k] = schema;
+    }
+    for (size_t i = 0; i < shapes; i++) {
+        for (size_t k = i + 1; k < shapes; k++) {
+            ok = ok && found[i] != found[k];
+        }
+    }
+    if (!ok || cache.Misses() != shapes || cache.Hits() != lookups - shapes ||
+        cache.Size() != shapes || traceLogging.Backend.Calls() != shapes) {
+        fprintf(stderr, "SchemaCache: wrong schemas or counts\n");
+        exit(1);
+    }
+
+    // A failed lookup is not cached, the next one asks again
+    EVENT_RECORD unknown = traceLogging.Events[0];
+    unknown.ExtendedDataCount = 0;
+    for (int i = 0; i < 2; i++) {
+        ULONG status = ERROR_SUCCESS;
+        if (cache.Lookup(unknown, &status) != nullptr ||
+            status != ERROR_NOT_FOUND) {
+            fprintf(stderr, "SchemaCache: found an unknown schema\n");
+            exit(1);
+        }
+    }
+    if (cache.Misses() != shapes + 2 ||
+        traceLogging.Backend.Calls() != shapes + 2) {
+        fprintf(stderr, "SchemaCache: failed lookups miscounted\n");
+        exit(1);
+    }
+}
+
+bool SameBatchStats(const BatchStats &a, const BatchStats &b) {
+    if (a.Files != b.Files || a.Blocks != b.Blocks || a.Events != b.Events ||
+        a.A2dpEvents != b.A2dpEvents ||
+        a.UndecodedEvents != b.UndecodedEvents ||
+        a.Codecs.size() != b.Codecs.size() ||
+        a.UnknownCodecs != b.UnknownCodecs) {
+        return false;
+    }
+    for (const auto &entry : a.Codecs) {
+        auto other = b.Codecs.find(entry.first);
+        if (other == b.Codecs.end() ||
+            other->second.Announced != entry.second.Announced ||
+            other->second.Selected != entry.second.Selected) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Exits the process if the batch counts depend on the number of workers, or
+// miss events of the files
+void CheckBatch() {
+    EventCorpus corpus;
+    BuildEventCorpus(corpus);
+    // Files of several blocks each, so the pool splits them too
+    const size_t files = 4;
+    const size_t events = 100000;
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < files; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "win_bt_codec_test_%zu.cap", i);
+        if (!WriteCorpusCapture(path, corpus, events)) {
+            fprintf(stderr, "Unable to write %s\n", path);
+            exit(1);
+        }
+        paths.push_back(path);
+    }
+    const EventFilter filter;
+    const BatchStats one = RunBatch(paths, 1, filter);
+    const BatchStats four = RunBatch(paths, 4, filter);
+    for (const std::string &path : paths) {
+        remove(path.c_str());
+    }
+    if (one.Events != files * events || one.UnreadableFiles != 0 ||
+        one.Codecs.empty() || !SameBatchStats(one, four)) {
+        fprintf(stderr, "RunBatch: counts differ between runs\n");
+        exit(1);
+    }
+}
+
+// Writes a capture of a few events whose schema says their two UINT32
+// properties take 2 GB each, which added up in 32 bits is 0 bytes
+bool WriteOversizedCapture(const char *path) {
+    EventSchema schema;
+    for (const WCHAR *name : {L"A", L"B"}) {
+        PropertyLayout property;
+        property.Name = name;
+        property.InType = TDH_INTYPE_UINT32;
+        property.Size = 4;
+        schema.Properties.push_back(property);
+    }
+    ComputeLayout(schema);
+    BYTE data[8] = {};
+    EVENT_RECORD event = {};
+    event.UserData = data;
+    event.UserDataLength = sizeof(data);
+    CaptureWriter writer;
+    bool written = writer.Open(path, 1000000);
+    for (int i = 0; written && i < 4; i++) {
+        written = writer.Write(event, schema);
+    }
+    if (!writer.Close() || !written) {
+        return false;
+    }
+
+    // The schema is the first record of the first block, patch the sizes
+    std::vector<BYTE> file;
+    FILE *in = fopen(path, "rb");
+    if (in == nullptr) {
+        return false;
+    }
+    BYTE chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        file.insert(file.end(), chunk, chunk + read);
+    }
+    fclose(in);
+    size_t offset = sizeof(CaptureFileHeader) + sizeof(CaptureBlockHeader) +
+                    sizeof(CaptureSchemaRecord);
+    for (int i = 0; i < 2; i++) {
+        const uint32_t size = 0x80000000;
+        memcpy(file.data() + offset + offsetof(CaptureSchemaProperty, Size),
+               &size, sizeof(size));
+        offset += sizeof(CaptureSchemaProperty) + sizeof(uint16_t);
+    }
+    FILE *out = fopen(path, "wb");
+    if (out == nullptr) {
+        return false;
+    }
+    written = fwrite(file.data(), file.size(), 1, out) == 1;
+    return fclose(out) == 0 && written;
+}
+
+// Exits the process (or crashes) if sizes from a damaged capture file can
+// wrap the layout around instead of making its block corrupt
+void CheckOversizedCapture() {
+    EventSchema schema;
+    for (int i = 0; i < 2; i++) {
+        PropertyLayout property;
+        property.InType = TDH_INTYPE_UINT32;
+        property.Size = 0x80000000;
+        schema.Properties.push_back(property);
+    }
+    ComputeLayout(schema);
+    BYTE data[4] = {};
+    EVENT_RECORD event = {};
+    event.UserData = data;
+    event.UserDataLength = sizeof(data);
+    A2dpEventData eventData;
+    if (schema.FixedDataSize < 0x80000000 ||
+        DecodeEventData(event, schema, MeasureStringProperty, eventData)) {
+        fprintf(stderr, "ComputeLayout: sizes wrapped around\n");
+        exit(1);
+    }
+
+    const char *path = "win_bt_codec_test_oversized.cap";
+    if (!WriteOversizedCapture(path)) {
+        fprintf(stderr, "Unable to write %s\n", path);
+        exit(1);
+    }
+    CaptureReader reader;
+    bool corrupt = !reader.Open(path) || reader.BlockCount() != 1;
+    ULONGLONG events = 0;
+    if (!corrupt) {
+        CaptureBlockReader block = reader.Block(0);
+        EVENT_RECORD record;
+        const EventSchema *recordSchema = nullptr;
+        while (block.Next(record, recordSchema)) {
+            events++;
+        }
+        corrupt = block.Corrupt();
+    }
+    const BatchStats stats = RunBatch({path}, 1, EventFilter());
+    remove(path);
+    if (!corrupt || events != 0 || stats.CorruptBlocks != 1 ||
+        stats.Events != 0) {
+        fprintf(stderr, "CaptureBlockReader: oversized schema accepted\n");
+        exit(1);
+    }
+}
+
+// Records 1..count. p50, p99, p99.9 and p100 must not be below the exact
+// value, nor more than one sub-bucket width above it.
+void CheckPercentiles() {
+    static LatencyHistogram histogram;
+    const ULONGLONG count = 1000000;
+    for (ULONGLONG value = 1; value <= count; value++) {
+        histogram.Record(value);
+    }
+    for (double fraction : {0.5, 0.99, 0.999, 1.0}) {
+        const double exact = fraction * count;
+        const double got = (double)histogram.Percentile(fraction);
+        if (got < exact || got > exact * (1.0 + 1.0 / HISTOGRAM_SUB_BUCKETS)) {
+            fprintf(stderr, "LatencyHistogram: p%g is %.0f, expected %.0f\n",
+                    fraction * 100, got, exact);
+            exit(1);
+        }
+    }
+}
+
+// Records 1..count split over two sketches and exits the process if the
+// merged sketch differs from one that saw everything, or a percentile is off
+// by more than the bucket width
+void CheckSketchMerge() {
+    const ULONGLONG count = 1000000;
+    static QuantileSketch whole, odd, even;
+    for (ULONGLONG value = 1; value <= count; value++) {
+        whole.Record(value);
+        (value % 2 ? odd : even).Record(value);
+    }
+    odd.Merge(even);
+    bool ok = odd.Count() == whole.Count() && odd.Min() == 1 &&
+              odd.Max() == count;
+    for (double fraction : {0.5, 0.99, 0.999, 1.0}) {
+        const double exact = fraction * count;
+        const double got = (double)odd.Percentile(fraction);
+        ok = ok && odd.Percentile(fraction) == whole.Percentile(fraction) &&
+             got >= exact && got <= exact * (1.0 + 1.0 / SKETCH_SUB_BUCKETS);
+    }
+    if (!ok) {
+        fprintf(stderr, "QuantileSketch: merged sketch is off\n");
+        exit(1);
+    }
+}
+
+// Exits the process if the flight recorder does not give back the last
+// events of a device, oldest first, with the events without a device
+// between them, or keeps a device it should have given up
+void CheckFlightRecorder() {
+    static FlightRecorder recorder;
+    const size_t capacity = 4;
+    recorder.SetCapacity(capacity);
+    static EventMessage message;
+    // Four devices first, then as many as there are rings, which take the
+    // rings of the first four. Every tenth event has no device.
+    for (LONGLONG i = 0; i < 100; i++) {
+        message.Timestamp = i;
+        message.Data = A2dpEventData();
+        if (i < 4) {
+            message.Data.BTDeviceAddress = 0x200 + (ULONGLONG)i;
+        } else if (i % 10 != 9) {
+            message.Data.BTDeviceAddress =
+                0x100 + (ULONGLONG)i % FLIGHT_RECORDER_DEVICES;
+        }
+        recorder.Record(message);
+    }
+
+    // Device 0x105 saw 5, 21, 37, 53 and 85, the last events without a
+    // device are 69, 79, 89 and 99
+    A2dpEventData device;
+    device.BTDeviceAddress = 0x105;
+    std::vector<LONGLONG> timestamps;
+    recorder.Dump(&device, [&](const EventMessage &recorded) {
+        timestamps.push_back(recorded.Timestamp);
+    });
+    const std::vector<LONGLONG> expected = {21, 37, 53, 69, 79, 85, 89, 99};
+    A2dpEventData evicted;
+    evicted.BTDeviceAddress = 0x200;
+    bool ok = timestamps == expected && recorder.Count(&device) == 0;
+    // Only the events without a device were forgotten with the dump
+    ok = ok && recorder.Count(&evicted) == 0 && recorder.Count(nullptr) > 0;
+    if (!ok) {
+        fprintf(stderr, "FlightRecorder: wrong events dumped\n");
+        exit(1);
+    }
+}
+
+// Adds the data and the timestamp of the event to the hash (FNV-1a)
+ULONGLONG HashEvent(ULONGLONG hash, const EVENT_RECORD &event) {
+    const BYTE *data = (const BYTE *)event.UserData;
+    for (USHORT i = 0; i < event.UserDataLength; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return (hash ^ (ULONGLONG)event.EventHeader.TimeStamp.QuadPart) *
+           0x100000001b3ULL;
+}
+
+const ULONGLONG FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+
+// Hashes the data of count generated events
+ULONGLONG HashGeneratedEvents(const LoadOptions &options, ULONGLONG count) {
+    LoadOptions limited = options;
+    limited.Events = count;
+    LoadGenerator generator(limited);
+    EVENT_RECORD event;
+    const EventSchema *schema = nullptr;
+    ULONGLONG hash = FNV_OFFSET_BASIS;
+    while (generator.Next(event, schema)) {
+        hash = HashEvent(hash, event);
+    }
+    return hash;
+}
+
+// Exits the process if the generator depends on anything but its seed, or
+// if its events do not decode into the findings it meant
+void CheckLoadGenerator() {
+    LoadOptions options;
+    options.UnknownPercent = 10;
+    const ULONGLONG first = HashGeneratedEvents(options, 100000);
+    const ULONGLONG again = HashGeneratedEvents(options, 100000);
+    options.Seed++;
+    const ULONGLONG other = HashGeneratedEvents(options, 100000);
+    if (first != again || first == other) {
+        fprintf(stderr, "LoadGenerator: not deterministic by seed\n");
+        exit(1);
+    }
+
+    options.Events = 100000;
+    LoadGenerator generator(options);
+    EVENT_RECORD event;
+    const EventSchema *schema = nullptr;
+    ULONGLONG counts[4] = {};
+    bool decoded = true;
+    while (generator.Next(event, schema)) {
+        A2dpEventData eventData;
+        decoded = decoded && DecodeEventData(event, *schema,
+                                             MeasureStringProperty, eventData);
+        counts[(int)AnalyzeEventData(eventData).Kind]++;
+    }
+    // A connection selects once, announces its codecs before and may not
+    // have got that far when the events ran out
+    const LoadStats &stats = generator.Stats();
+    const ULONGLONG selected = counts[(int)A2dpFindingKind::SelectedCodec];
+    const ULONGLONG unknown = counts[(int)A2dpFindingKind::UnknownCodec];
+    if (!decoded || selected + 16 < stats.Connections ||
+        selected > stats.Connections || unknown == 0 ||
+        unknown > stats.UnknownCodecs ||
+        counts[(int)A2dpFindingKind::SupportedCodec] < 2 * selected) {
+        fprintf(stderr, "LoadGenerator: unexpected findings\n");
+        exit(1);
+    }
+}
+
+// What the batches handed over by a trace source add up to
+ULONGLONG batchedHash = 0;
+ULONGLONG batchedEvents = 0;
+size_t batchCount = 0;
+size_t largestBatch = 0;
+std::vector<const EventSchema *> batchedSchemas;
+
+void HashBatch(const TraceEvent *events, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        batchedHash = HashEvent(batchedHash, events[i].Record);
+        const EventSchema *schema = events[i].Schema;
+        if (std::find(batchedSchemas.begin(), batchedSchemas.end(), schema) ==
+            batchedSchemas.end()) {
+            batchedSchemas.push_back(schema);
+        }
+    }
+    batchedEvents += count;
+    batchCount++;
+    largestBatch = count > largestBatch ? count : largestBatch;
+}
+
+void RunHashed(TraceSource &source) {
+    batchedHash = FNV_OFFSET_BASIS;
+    batchedEvents = 0;
+    batchCount = 0;
+    largestBatch = 0;
+    batchedSchemas.clear();
+    source.Run(HashBatch);
+}
+
+const BYTE COPIED_DATA[] = {1, 2, 3, 4};
+const BYTE COPIED_SCHEMA[] = {'E', 'v', 0, 'V', 'a', 'l', 'u', 'e', 0, 8};
+bool copiedIntact = false;
+
+void CheckCopiedBatch(const TraceEvent *events, size_t count) {
+    const EVENT_RECORD &record = events[0].Record;
+    copiedIntact =
+        count == 1 && record.UserDataLength == sizeof(COPIED_DATA) &&
+        memcmp(record.UserData, COPIED_DATA, sizeof(COPIED_DATA)) == 0 &&
+        record.ExtendedDataCount == 1 &&
+        record.ExtendedData[0].ExtType ==
+            EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL &&
+        record.ExtendedData[0].DataSize == sizeof(COPIED_SCHEMA) &&
+        memcmp((const void *)(uintptr_t)record.ExtendedData[0].DataPtr,
+               COPIED_SCHEMA, sizeof(COPIED_SCHEMA)) == 0;
+}
+
+// Exits the process if an event copied into a batch loses its data or its
+// TraceLogging schema once the buffers it came from are reused
+void CheckBatchCopy() {
+    BYTE data[sizeof(COPIED_DATA)];
+    BYTE schemaData[sizeof(COPIED_SCHEMA)];
+    memcpy(data, COPIED_DATA, sizeof(data));
+    memcpy(schemaData, COPIED_SCHEMA, sizeof(schemaData));
+    EVENT_HEADER_EXTENDED_DATA_ITEM items[2] = {};
+    items[0].ExtType = EVENT_HEADER_EXT_TYPE_RELATED_ACTIVITYID;
+    items[1].ExtType = EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL;
+    items[1].DataSize = sizeof(schemaData);
+    items[1].DataPtr = (ULONGLONG)(uintptr_t)schemaData;
+    EVENT_RECORD event = {};
+    event.UserData = data;
+    event.UserDataLength = sizeof(data);
+    event.ExtendedDataCount = 2;
+    event.ExtendedData = items;
+
+    EventSchema schema;
+    TraceBatch batch;
+    batch.Add(event, schema, true);
+    memset(data, 0, sizeof(data));
+    memset(schemaData, 0, sizeof(schemaData));
+    memset(items, 0, sizeof(items));
+    batch.Deliver(CheckCopiedBatch);
+    if (!copiedIntact) {
+        fprintf(stderr, "TraceBatch: copied event differs\n");
+        exit(1);
+    }
+}
+
+// Exits the process if the generator and capture sources do not hand over
+// the very events the generator makes, in full batches
+void CheckTraceSources() {
+    CheckBatchCopy();
+
+    LoadOptions options;
+    options.Events = 100000;
+    const ULONGLONG expected = HashGeneratedEvents(options, options.Events);
+    const size_t batches =
+        (size_t)((options.Events + TRACE_BATCH_EVENTS - 1) /
+                 TRACE_BATCH_EVENTS);
+
+    GeneratorTraceSource generated(options);
+    RunHashed(generated);
+    const size_t schemas = batchedSchemas.size();
+    if (batchedHash != expected || batchedEvents != options.Events ||
+        generated.Events() != options.Events || batchCount != batches ||
+        largestBatch != TRACE_BATCH_EVENTS) {
+        fprintf(stderr, "GeneratorTraceSource: events differ\n");
+        exit(1);
+    }
+
+    const char *path = "win_bt_codec_test_source.cap";
+    LoadGenerator generator(options);
+    CaptureWriter writer;
+    bool written = writer.Open(path, LOAD_TIMESTAMP_FREQUENCY);
+    EVENT_RECORD event;
+    const EventSchema *schema = nullptr;
+    while (written && generator.Next(event, schema)) {
+        written = writer.Write(event, *schema);
+    }
+    written = writer.Close() && written;
+    CaptureTraceSource captured;
+    if (!written || !captured.Open(path)) {
+        fprintf(stderr, "Unable to write %s\n", path);
+        exit(1);
+    }
+    RunHashed(captured);
+    remove(path);
+    // Every block writes its schemas again, the events of all blocks must
+    // still share one copy of each
+    if (batchedHash != expected || batchedEvents != options.Events ||
+        batchedSchemas.size() != schemas || captured.Corrupt() ||
+        batchCount != batches ||
+        largestBatch != TRACE_BATCH_EVENTS ||
+        captured.TimestampFrequency() != LOAD_TIMESTAMP_FREQUENCY) {
+        fprintf(stderr, "CaptureTraceSource: events differ\n");
+        exit(1);
+    }
+}
+
+// Connects a device again and again, dropping a codec and changing the
+// selection on the way, and counts what gets through
+void CheckCoalescer() {
+    Coalescer coalescer;
+    int written = 0;
+    int unchanged = 0;
+    int withdrawn = 0;
+    int changed = 0;
+    for (int connection = 0; connection < 20; connection++) {
+        const int announced = connection == 10 ? 3 : 4;
+        std::vector<A2dpEventData> events;
+        for (int codec = 0; codec < announced; codec++) {
+            events.push_back(CodecEvent(0x42, CODECS[codec], false));
+        }
+        const CodecData &selected = CODECS[connection < 15 ? 2 : 0];
+        events.push_back(CodecEvent(0x42, selected, true));
+        events.push_back(CodecEvent(0x42, selected, true));
+
+        for (const A2dpEventData &data : events) {
+            A2dpFinding finding = AnalyzeEventData(data);
+            written += coalescer.Update(data, finding) ? 1 : 0;
+            for (const DeviceChange &change : coalescer.Changes()) {
+                unchanged += change.Kind == DeviceChangeKind::CodecSetUnchanged;
+                withdrawn += change.Kind == DeviceChangeKind::CodecWithdrawn;
+                changed += change.Kind == DeviceChangeKind::SelectedCodecChanged;
+            }
+        }
+    }
+    // The first four codecs and selection, the codec coming back after it
+    // was dropped and the new selection. The set is unchanged once before
+    // the drop and once after.
+    if (written != 7 || unchanged != 2 || withdrawn != 1 || changed != 1 ||
+        coalescer.Coalesced() != 20 * 6 - 1 - 7) {
+        fprintf(stderr, "Coalescer: %d written, %d unchanged, %d withdrawn, "
+                        "%d changed\n",
+                written, unchanged, withdrawn, changed);
+        exit(1);
+    }
+}
+
+// The last event CheckDeviceTracker imported
+A2dpEventData importedEvent;
+
+void KeepImportedEvent(ULONG, const A2dpEventData &eventData) {
+    importedEvent = eventData;
+}
+
+// Exits the process if reconnects make a device count its codecs again, or
+// if channel counts lose bits
+void CheckDeviceTracker() {
+    DeviceTracker tracker;
+    const ULONGLONG address = 0x7C96D2F479F4ULL;
+    const CodecData unknown = {A2DP_VENDOR_CODEC_ID, 0xFFFF, 0xFFFF,
+                               L"Unknown", L"", 0};
+    const DeviceState *device = nullptr;
+    for (int round = 0; round < 5; round++) {
+        for (const CodecData *codec : {&CODECS[0], &CODECS[1], &unknown}) {
+            const A2dpEventData data = CodecEvent(address, *codec, false);
+            device = tracker.Update(data, AnalyzeEventData(data));
+        }
+        const A2dpEventData data = CodecEvent(address, CODECS[1], true);
+        device = tracker.Update(data, AnalyzeEventData(data));
+    }
+    A2dpEventData pin;
+    pin.BTDeviceAddress = address;
+    pin.ChannelCount = 0x10002;
+    device = tracker.Update(pin, AnalyzeEventData(pin));
+    if (device == nullptr || device->AdvertisedCodecs() != 3 ||
+        device->SelectedCodec != &CODECS[1] || device->ChannelCount != 0x10002) {
+        fprintf(stderr, "DeviceTracker: codecs or channels miscounted\n");
+        exit(1);
+    }
+
+    // The pin events of events.txt log three 16 bit channel counts
+    const char log[] = "Provider GUID:\n"
+                       "  ChannelCount [6]: 020002000000\n"
+                       "  SampleRate: 80bb000080bb000080bb0000\n";
+    TraceImporter importer(KeepImportedEvent);
+    importer.Feed(log, sizeof(log) - 1);
+    importer.Finish();
+    if (importedEvent.ChannelCount != 2 || importedEvent.PinSampleRate != 48000) {
+        fprintf(stderr, "TraceImporter: array read past its first value\n");
+        exit(1);
+    }
+}
+
+// A log with good and bad property lines, some values followed by what
+// --trace decodes them to
+const char IMPORT_LOG[] =
+    "Event ID: 7\n"
+    "  AvdtpActivity [4]: 12000000     [SetConfiguration_Cfm]\n"
+    "  AudioSessionId [16]: a16c3dc9202a04008b29d5c9202adc01\n"
+    "  BTDeviceAddress: F479F4D2967C0000\n"
+    "  ResultCode [1]: 0\n"
+    "  ResultCode [1]: 0g\n"
+    "  ResultCode [2]: 00\n"
+    "  A2dpVendorId [4]: 0000000x00000000\n"
+    "  ResultCode [1]: 05     [5]\n";
+
+// Exits the process if the importer takes a bad hex value (odd, not hex,
+// not the declared size) or misses a good one, fed whole or a byte at a
+// time
+void CheckTraceImporter() {
+    for (size_t chunk : {sizeof(IMPORT_LOG), (size_t)1}) {
+        importedEvent = A2dpEventData();
+        TraceImporter importer(KeepImportedEvent);
+        for (size_t i = 0; i < sizeof(IMPORT_LOG) - 1; i += chunk) {
+            const size_t left = sizeof(IMPORT_LOG) - 1 - i;
+            importer.Feed(IMPORT_LOG + i, left < chunk ? left : chunk);
+        }
+        importer.Finish();
+        const TraceImportStats &stats = importer.Stats();
+        if (stats.Events != 1 || stats.Properties != 4 ||
+            stats.BadLines != 4 || importedEvent.AvdtpActivity != 0x12u ||
+            importedEvent.BTDeviceAddress != 0x7C96D2F479F4ULL ||
+            importedEvent.ResultCode != 5 || !importedEvent.AudioSessionId ||
+            importedEvent.a2dpVendorId) {
+            fprintf(stderr,
+                    "TraceImporter: %llu properties, %llu bad lines in "
+                    "chunks of %zu\n",
+                    (unsigned long long)stats.Properties,
+                    (unsigned long long)stats.BadLines, chunk);
+            exit(1);
+        }
+    }
+}
+
+// Feeds the tracker one AVDTP event of the device, timestamps in us
+void Negotiate(NegotiationTracker &tracker, ULONGLONG address,
+               LONGLONG timestamp, DWORD activity) {
+    A2dpEventData data;
+    data.BTDeviceAddress = address;
+    data.AvdtpActivity = activity;
+    tracker.Update(timestamp, data, AnalyzeEventData(data));
+}
+
+// Whether the duration was recorded count times, between min and max us
+bool HasDurations(const NegotiationSketches &sketches, NegotiationStat stat,
+                  ULONGLONG count, ULONGLONG min, ULONGLONG max) {
+    const QuantileSketch &sketch = sketches.Stats[(int)stat];
+    return sketch.Count() == count && sketch.Min() == min &&
+           sketch.Max() == max;
+}
+
+// Scripted setups with timestamps in microseconds:
+// - Discover, GetCapabilities, SetConfiguration, Open and Start give the
+//   four phase durations and the time to the first stream
+// - a Start without a setup before it is ignored
+// - a disconnect records what the connection got to and ends it, so the
+//   next setup starts a new connection
+// - Merge adds up the connections and the sketch counts
+void CheckNegotiation() {
+    const ULONGLONG first = 0x7C96D2F479F4ULL;
+    const ULONGLONG second = 0x001A7DDA7113ULL;
+    NegotiationTracker tracker;
+    tracker.SetFrequency(1000000);
+
+    Negotiate(tracker, first, 1000, AvdtpActivity::Discover_Cfm);
+    Negotiate(tracker, first, 1100, AvdtpActivity::GetCapabilities_Cfm);
+    Negotiate(tracker, first, 1150, AvdtpActivity::GetCapabilities_Cfm);
+    Negotiate(tracker, first, 1300, AvdtpActivity::SetConfiguration_Cfm);
+    Negotiate(tracker, first, 1600, AvdtpActivity::Open_Cfm);
+    Negotiate(tracker, first, 2000, AvdtpActivity::Start_Cfm);
+    Negotiate(tracker, first, 2100, AvdtpActivity::Start_Ind);
+    const NegotiationSketches &all = tracker.All();
+    if (all.Connections != 1 ||
+        !HasDurations(all, NegotiationStat::DiscoverToCapabilities, 1, 100,
+                      100) ||
+        !HasDurations(all, NegotiationStat::CapabilitiesToConfiguration, 1,
+                      200, 200) ||
+        !HasDurations(all, NegotiationStat::ConfigurationToOpen, 1, 300,
+                      300) ||
+        !HasDurations(all, NegotiationStat::OpenToStart, 1, 400, 400) ||
+        !HasDurations(all, NegotiationStat::TimeToFirstStream, 1, 1000,
+                      1000)) {
+        fprintf(stderr, "Negotiation: setup durations wrong\n");
+        exit(1);
+    }
+
+    // The stream stops and resumes, and the other device streams without
+    // a setup the tracker saw
+    Negotiate(tracker, first, 3000, AvdtpActivity::Disconnect_Ind);
+    Negotiate(tracker, first, 3500, AvdtpActivity::Start_Ind);
+    Negotiate(tracker, second, 3600, AvdtpActivity::Start_Cfm);
+    if (all.Connections != 1 ||
+        all.Stats[(int)NegotiationStat::TimeToFirstStream].Count() != 1) {
+        fprintf(stderr, "Negotiation: Start without a setup recorded\n");
+        exit(1);
+    }
+
+    // Disconnected during the setup, then set up again
+    Negotiate(tracker, second, 10000, AvdtpActivity::Discover_Ind);
+    Negotiate(tracker, second, 10050, AvdtpActivity::GetCapabilities_ind);
+    Negotiate(tracker, second, 11000, AvdtpActivity::Disconnect_Cfm);
+    if (all.Connections != 2 ||
+        !HasDurations(all, NegotiationStat::DiscoverToCapabilities, 2, 50,
+                      100) ||
+        all.Stats[(int)NegotiationStat::TimeToFirstStream].Count() != 1) {
+        fprintf(stderr, "Negotiation: disconnect did not end the setup\n");
+        exit(1);
+    }
+    Negotiate(tracker, second, 12000, AvdtpActivity::Discover_Ind);
+    Negotiate(tracker, second, 12700, AvdtpActivity::Start_Ind);
+    tracker.Finish();
+    if (all.Connections != 3 ||
+        !HasDurations(all, NegotiationStat::TimeToFirstStream, 2, 700,
+                      1000)) {
+        fprintf(stderr, "Negotiation: reconnect measured from the old "
+                        "connection\n");
+        exit(1);
+    }
+
+    NegotiationTracker other;
+    other.SetFrequency(1000000);
+    Negotiate(other, first, 0, AvdtpActivity::Discover_Cfm);
+    Negotiate(other, first, 30, AvdtpActivity::GetCapabilities_Cfm);
+    Negotiate(other, first, 5000, AvdtpActivity::Start_Cfm);
+    tracker.Merge(other);
+    ULONGLONG deviceConnections = 0;
+    tracker.ForEachDevice(
+        [&](ULONGLONG, const NegotiationSketches &device) {
+            deviceConnections += device.Connections;
+        });
+    if (all.Connections != 4 || deviceConnections != 4 ||
+        !HasDurations(all, NegotiationStat::DiscoverToCapabilities, 3, 30,
+                      100) ||
+        !HasDurations(all, NegotiationStat::OpenToStart, 1, 400, 400) ||
+        !HasDurations(all, NegotiationStat::TimeToFirstStream, 3, 700,
+                      5000)) {
+        fprintf(stderr, "Negotiation: merge miscounted\n");
+        exit(1);
+    }
+}
+
+#ifndef _WIN32
+// Scrapes the server like a monitoring system would, returns the response
+std::string Scrape(unsigned short port, const char *path) {
+    std::string response;
+    const int client = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (connect(client, (sockaddr *)&address, sizeof(address)) == 0) {
+        std::string request = "GET ";
+        request += path;
+        request += " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        send(client, request.data(), request.size(), 0);
+        char buffer[4096];
+        ssize_t received;
+        while ((received = recv(client, buffer, sizeof(buffer), 0)) > 0) {
+            response.append(buffer, (size_t)received);
+        }
+    }
+    close(client);
+    return response;
+}
+
+// Exits the process if the server does not answer with the metrics, ended
+// as OpenMetrics wants them
+void CheckMetricsServer() {
+    MetricsServer server;
+    if (!server.Start(0)) {
+        fprintf(stderr, "MetricsServer: unable to listen\n");
+        exit(1);
+    }
+    metrics.UnknownCodecs.Add(PackCodecKey(0xFF, 0x1234, 0x5678));
+    const std::string response = Scrape(server.Port(), "/metrics");
+    const std::string missing = Scrape(server.Port(), "/other");
+    const char end[] = "\n# EOF\n";
+    const bool ok =
+        response.compare(0, 15, "HTTP/1.1 200 OK") == 0 &&
+        response.size() > sizeof(end) &&
+        response.compare(response.size() - (sizeof(end) - 1),
+                         sizeof(end) - 1, end) == 0 &&
+        response.find("win_bt_codec_unknown_codec_total{standard=\"0xFF\","
+                      "vendor=\"0x00001234\",vendor_codec=\"0x5678\"} 1") !=
+            std::string::npos &&
+        missing.compare(0, 12, "HTTP/1.1 404") == 0 && server.Scrapes() == 1;
+    if (!ok) {
+        fprintf(stderr, "MetricsServer: bad response\n%s\n", response.c_str());
+        exit(1);
+    }
+}
+#endif
+
+// Publishes from one thread while another reads, and exits the process if
+// a snapshot mixes two updates. Every update writes the same counter into
+// several fields of the header and the devices, so a torn copy shows.
+void CheckStatusSeqlock() {
+    const ULONGLONG updates = 1000000;
+    StatusPublisher publisher;
+    const std::string name = StatusRegionName();
+    if (!publisher.Open(name.c_str())) {
+        fprintf(stderr, "StatusPublisher: unable to create the region\n");
+        exit(1);
+    }
+    SharedMemoryRegion region;
+    if (!region.Open(name.c_str(), STATUS_REGION_SIZE)) {
+        fprintf(stderr, "StatusPublisher: unable to open the region\n");
+        exit(1);
+    }
+
+    std::atomic<bool> done(false);
+    std::thread writer([&] {
+        DeviceState devices[2];
+        devices[0].Address = 0x111111111111ULL;
+        devices[1].Address = 0x222222222222ULL;
+        for (ULONGLONG i = 1; i <= updates; i++) {
+            for (DeviceState &device : devices) {
+                device.Events = i;
+                device.SampleRate = (DWORD)i;
+                device.ChannelCount = (DWORD)~i;
+            }
+            publisher.Publish(&devices[i % 2]);
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    static StatusSnapshot snapshot;
+    ULONGLONG reads = 0;
+    bool ok = true;
+    while (ok && !done.load(std::memory_order_acquire)) {
+        if (!ReadStatusSnapshot(region.Data(), region.Size(), snapshot)) {
+            continue;
+        }
+        reads++;
+        for (uint32_t i = 0; i < snapshot.DeviceCount; i++) {
+            const StatusDevice &device = snapshot.Devices[i];
+            ok = ok && device.SampleRate == (uint32_t)device.Events &&
+                 device.ChannelCount == (uint32_t)~device.Events &&
+                 device.Events <= snapshot.Events;
+        }
+    }
+    writer.join();
+
+    if (!ReadStatusSnapshot(region.Data(), region.Size(), snapshot) ||
+        snapshot.Events != updates || snapshot.DeviceCount != 2 ||
+        snapshot.State != StatusState::Running) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "StatusPublisher: torn snapshot after %llu reads\n",
+                (unsigned long long)reads);
+        exit(1);
+    }
+}
+
+// The remote codec blob of pnp_info.md must give its seven codecs by name,
+// in order, with AAC as the configured one. Cut inside the last vendor
+// record it must be invalid, and still give the five records before.
+void CheckPnpCodecs() {
+    const WCHAR *expected[] = {
+        L"aptX HD",
+        L"aptX",
+        L"MPEG-2,4 (aka AAC)",
+        L"The CSR True Wireless Stereo v3 Codec ID for aptX",
+        L"The CSR True Wireless Stereo v3 Codec ID for AAC",
+        L"Qualcomm specific aptX version",
+        L"SBC"};
+    const PnpCodecList remote(PNP_REMOTE_CODECS, sizeof(PNP_REMOTE_CODECS));
+    const PnpCodecList configured(PNP_CONFIGURED_CODEC,
+                                  sizeof(PNP_CONFIGURED_CODEC));
+    bool ok = remote.Valid() && remote.Count() == 7 &&
+              SelectedCodecIndex(remote, configured) == 2;
+    size_t index = 0;
+    for (const PnpCodecRecord &record : remote) {
+        const CodecData *codec = record.Find();
+        ok = ok && index < 7 && codec != nullptr &&
+             wcscmp(codec->Name, expected[index]) == 0;
+        index++;
+    }
+
+    // Cut in the middle of the last vendor record
+    const PnpCodecList cut(PNP_REMOTE_CODECS, sizeof(PNP_REMOTE_CODECS) - 3);
+    ok = ok && !cut.Valid() && cut.Count() == 5;
+    if (!ok) {
+        fprintf(stderr, "PnpCodecList: pnp_info.md blob read wrong\n");
+        exit(1);
+    }
+}
+
+// Filters and how many of the EVENT_SHAPES each one matches
+const struct {
+    const char *Text;
+    size_t Matches;
+} FILTER_CASES[] = {
+    {"AvdtpActivity in (0x12, 0x14) && BTDeviceAddress == 7C96D2F479F4", 1},
+    {"BTDeviceAddress == 7C:96:D2:F4:79:F4", 8},
+    {"A2dpStandardCodecId == 0xFF || A2dpIsConnected == 1", 2},
+    {"!(A2dpStandardCodecId == 2)", 5},
+    {"A2dpVendorId != 0", 1},
+    {"AvdtpActivity == SetConfiguration_Cfm", 1},
+    {"TransitionToState >= 2 && TransitionFromState < 2", 1},
+    {"EventId == 0 && (SampleRate == 48000 || ChannelCount in (1, 2))", 1},
+    {"L2capChannelHandleSessionId == 0xFFFFA48C6F6A0AE0", 2},
+};
+
+// Malformed filters must not compile. Every FILTER_CASES filter must match
+// its count of shapes on the raw events, on the same events behind a
+// string (so the fields are found by walking), and on the decoded data.
+// Only event ids that every match requires may be handed to ETW.
+void CheckFilters() {
+    EventCorpus events;
+    BuildEventCorpus(events);
+    std::vector<A2dpEventData> decoded(events.Events.size());
+    for (size_t k = 0; k < events.Events.size(); k++) {
+        DecodeEventData(events.Events[k], events.Schemas[k],
+                        MeasureStringProperty, decoded[k]);
+    }
+    bool ok = true;
+    std::wstring error;
+    EventFilter filter;
+    for (const char *bad :
+         {"", "AvdtpActivity", "AvdtpActivity == ", "Foo == 1",
+          "AudioSessionId == 1", "AvdtpActivity in (1,", "A2dpVendorId = 1",
+          "A2dpVendorId == 1 & A2dpIsSink == 0", "(A2dpIsSink == 0",
+          "BTDeviceAddress == 7C96D2F479F4AB", "A2dpVendorId == 0x",
+          "A2dpVendorId == 18446744073709551616"}) {
+        if (filter.Compile(bad, error)) {
+            fprintf(stderr, "EventFilter: \"%s\" compiled\n", bad);
+            ok = false;
+        }
+    }
+
+    // The same events behind a string, so the fields have to be found by
+    // walking the data
+    EventCorpus variable;
+    BuildEventCorpus(variable);
+    for (size_t k = 0; k < variable.Events.size(); k++) {
+        PropertyLayout name;
+        name.Name = L"Name";
+        name.InType = TDH_INTYPE_UNICODESTRING;
+        EventSchema &schema = variable.Schemas[k];
+        schema.Properties.insert(schema.Properties.begin(), name);
+        ComputeLayout(schema);
+        std::vector<BYTE> &data = variable.Data[k];
+        const BYTE text[] = {'a', 0, 'b', 0, 0, 0};
+        data.insert(data.begin(), text, text + sizeof(text));
+        variable.Events[k].UserData = data.data();
+        variable.Events[k].UserDataLength = (USHORT)data.size();
+    }
+
+    for (const auto &test : FILTER_CASES) {
+        if (!filter.Compile(test.Text, error)) {
+            fprintf(stderr, "EventFilter: \"%s\": %ls\n", test.Text,
+                    error.c_str());
+            ok = false;
+            continue;
+        }
+        size_t raw = 0, walked = 0, imported = 0;
+        for (size_t k = 0; k < events.Events.size(); k++) {
+            raw += filter.Matches(events.Events[k], events.Schemas[k],
+                                  MeasureStringProperty);
+            walked += filter.Matches(variable.Events[k], variable.Schemas[k],
+                                     MeasureStringProperty);
+            imported += filter.Matches(0, decoded[k]);
+        }
+        if (raw != test.Matches || walked != test.Matches ||
+            imported != test.Matches) {
+            fprintf(stderr,
+                    "EventFilter: \"%s\" matched %zu/%zu/%zu, expected "
+                    "%zu\n",
+                    test.Text, raw, walked, imported, test.Matches);
+            ok = false;
+        }
+    }
+
+    // Only event ids required at the top level can go to ETW
+    std::vector<USHORT> ids;
+    ok = ok && filter.Compile("EventId in (3, 4) && A2dpIsSink == 0", error) &&
+         filter.RequiredEventIds(ids) && ids.size() == 2 && ids[0] == 3 &&
+         ids[1] == 4;
+    ok = ok && filter.Compile("EventId == 3 || A2dpIsSink == 0", error) &&
+         !filter.RequiredEventIds(ids);
+    ok = ok && filter.Compile("!(EventId == 3)", error) &&
+         !filter.RequiredEventIds(ids);
+    if (!ok) {
+        fprintf(stderr, "EventFilter: checks failed\n");
+        exit(1);
+    }
+}
+
+// Exits the process if numbers get lost or reordered on their way through a
+// ring, one at a time and in batches
+void CheckSpscRing() {
+    if (!TransferThroughRing<64>(1000000, 1) ||
+        !TransferThroughRing<64>(1000000, 16)) {
+        fprintf(stderr, "SpscRing: numbers out of order\n");
+        exit(1);
+    }
+}
+
+// Exits the process if the merger lets streams that overtake each other by
+// no more than the window come out of order, or does not sort in events
+// that are out of order within their own stream
+void CheckReorderMerger() {
+    for (size_t streams : {4, 64}) {
+        const size_t batch = 16;
+        if (!MergeStreams(InterleavedStreams(streams, batch, 100000),
+                          (LONGLONG)(streams * batch))) {
+            fprintf(stderr, "ReorderMerger: %zu streams out of order\n",
+                    streams);
+            exit(1);
+        }
+    }
+
+    // A new head, one in the middle, one after an equal timestamp, and the
+    // pool reused for a second round
+    ReorderMerger<int> merger(100);
+    std::vector<int> order;
+    auto keep = [&order](int item) { order.push_back(item); };
+    for (int round = 0; round < 2; round++) {
+        const LONGLONG pushed[][2] = {{5, 0}, {9, 1}, {2, 2}, {7, 3}, {5, 4}};
+        for (const auto &event : pushed) {
+            merger.Push(0, event[0], (int)event[1]);
+        }
+        merger.Push(1, 6, 5);
+        merger.Drain(keep);
+    }
+    const std::vector<int> expected = {2, 0, 4, 5, 3, 1, 2, 0, 4, 5, 3, 1};
+    if (order != expected || merger.Held() != 0) {
+        fprintf(stderr, "ReorderMerger: stream not sorted in\n");
+        exit(1);
+    }
+}
+
+// Once the writer has seen every shape and processor, events that go
+// through the queue, the merger and the sink must not allocate
+void CheckWriterAllocations() {
+    EventCorpus corpus;
+    BuildEventCorpus(corpus);
+    const size_t shapes = corpus.Events.size();
+    OutputWriter writer;
+    writer.SetSink(CreateOutputSink(OutputFormat::Text, NULL_DEVICE));
+    // Ticks of a microsecond and a window of 10 ms, so about 4096 events
+    // are held and the merger hits its limit
+    writer.Start(false, 1000000, std::chrono::milliseconds(10));
+    LONGLONG timestamp = 0;
+    auto feed = [&](size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            const size_t k = i % shapes;
+            EVENT_RECORD event = corpus.Events[k];
+            event.EventHeader.TimeStamp.QuadPart = ++timestamp;
+            event.BufferContext.ProcessorNumber = (UCHAR)(i % 4);
+            EventMessage *message = writer.Claim(OverflowPolicy::Wait);
+            FillEventMessage(*message, event, corpus.Schemas[k],
+                             MeasureStringProperty);
+            writer.Publish(*message);
+        }
+        writer.Flush();
+    };
+    feed(100000);
+    const ULONGLONG before = allocations.load();
+    feed(100000);
+    const ULONGLONG allocated = allocations.load() - before;
+    writer.Stop();
+    if (allocated != 0 || writer.Written() != 200000) {
+        fprintf(stderr, "OutputWriter: %llu allocations for 100000 events\n",
+                (unsigned long long)allocated);
+        exit(1);
+    }
+}
+
+// Reads the whole file, an empty string if it can not be read
+std::string ReadFile(const char *path) {
+    std::string content;
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) {
+        return content;
+    }
+    char chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        content.append(chunk, read);
+    }
+    fclose(file);
+    return content;
+}
+
+// A JSON reader just strict enough to tell whether a line is valid JSON.
+// The strings it meets are kept decoded, as UTF-8.
+class JsonChecker {
+  public:
+    explicit JsonChecker(const std::string &text) : m_text(text) {}
+
+    bool Parse() {
+        SkipSpace();
+        const bool ok = Value();
+        SkipSpace();
+        return ok && m_at == m_text.size();
+    }
+
+    std::vector<std::string> Strings;
+
+  private:
+    bool Value() {
+        if (m_at >= m_text.size()) {
+            return false;
+        }
+        switch (m_text[m_at]) {
+        case '{':
+            return Container('}', true);
+        case '[':
+            return Container(']', false);
+        case '"':
+            return String();
+        default:
+            return Literal("true") || Literal("false") || Literal("null") ||
+                   Number();
+        }
+    }
+
+    // An object (members are "name": value) or an array
+    bool Container(char end, bool object) {
+        m_at++;
+        SkipSpace();
+        if (m_at < m_text.size() && m_text[m_at] == end) {
+            m_at++;
+            return true;
+        }
+        for (;;) {
+            SkipSpace();
+            if (object) {
+                if (!String()) {
+                    return false;
+                }
+                SkipSpace();
+                if (!Accept(':')) {
+                    return false;
+                }
+                SkipSpace();
+            }
+            if (!Value()) {
+                return false;
+            }
+            SkipSpace();
+            if (!Accept(',')) {
+                return Accept(end);
+            }
+        }
+    }
+
+    bool String() {
+        if (!Accept('"')) {
+            return false;
+        }
+        std::string decoded;
+        while (m_at < m_text.size()) {
+            const unsigned char c = (unsigned char)m_text[m_at++];
+            if (c == '"') {
+                Strings.push_back(decoded);
+                return true;
+            }
+            if (c < 0x20) {
+                return false; // control characters have to be escaped
+            }
+            if (c != '\\') {
+                decoded += (char)c;
+                continue;
+            }
+            if (m_at >= m_text.size()) {
+                return false;
+            }
+            const char escape = m_text[m_at++];
+            switch (escape) {
+            case '"':
+            case '\\':
+            case '/':
+                decoded += escape;
+                continue;
+            case 'b':
+                decoded += '\b';
+                continue;
+            case 'f':
+                decoded += '\f';
+                continue;
+            case 'n':
+                decoded += '\n';
+                continue;
+            case 'r':
+                decoded += '\r';
+                continue;
+            case 't':
+                decoded += '\t';
+                continue;
+            case 'u':
+                break;
+            default:
+                return false;
+            }
+            ULONG unit = 0;
+            for (int i = 0; i < 4; i++) {
+                const char digit = m_at < m_text.size() ? m_text[m_at++] : 0;
+                const char *at = strchr("0123456789abcdef", tolower(digit));
+                if (digit == 0 || at == nullptr) {
+                    return false;
+                }
+                unit = unit * 16 + (ULONG)(at - "0123456789abcdef");
+            }
+            // The sink only escapes control characters this way
+            if (unit >= 0x80) {
+                return false;
+            }
+            decoded += (char)unit;
+        }
+        return false;
+    }
+
+    bool Number() {
+        const size_t start = m_at;
+        Accept('-');
+        if (Digits() == 0) {
+            return false;
+        }
+        if (Accept('.') && Digits() == 0) {
+            return false;
+        }
+        if (Accept('e') || Accept('E')) {
+            if (!Accept('+')) {
+                Accept('-');
+            }
+            if (Digits() == 0) {
+                return false;
+            }
+        }
+        return m_at > start;
+    }
+
+    size_t Digits() {
+        const size_t start = m_at;
+        while (m_at < m_text.size() && m_text[m_at] >= '0' &&
+               m_text[m_at] <= '9') {
+            m_at++;
+        }
+        return m_at - start;
+    }
+
+    bool Literal(const char *word) {
+        const size_t length = strlen(word);
+        if (m_text.compare(m_at, length, word) != 0) {
+            return false;
+        }
+        m_at += length;
+        return true;
+    }
+
+    bool Accept(char c) {
+        if (m_at < m_text.size() && m_text[m_at] == c) {
+            m_at++;
+            return true;
+        }
+        return false;
+    }
+
+    void SkipSpace() {
+        while (m_at < m_text.size() &&
+               (m_text[m_at] == ' ' || m_text[m_at] == '\t')) {
+            m_at++;
+        }
+    }
+
+    const std::string &m_text;
+    size_t m_at = 0;
+};
+
+// The value of the field as the binary sink writes it. Returns false if
+// the event does not have the field.
+bool FieldValue(const A2dpEventData &data, int field, const BYTE *&value) {
+    switch ((A2dpField)field) {
+#define X(member, name, type, format)                                          \
+    case A2dpField::member:                                                    \
+        value = data.member ? (const BYTE *)&*data.member : nullptr;          \
+        break;
+        A2DP_EVENT_FIELDS(X)
+#undef X
+    default:
+        value = nullptr;
+    }
+    return value != nullptr;
+}
+
+std::string ToUtf8(const WCHAR *text) {
+    std::string utf8;
+    AppendUtf8(utf8, text, wcslen(text));
+    return utf8;
+}
+
+// A property name and a dump reason with every character JSON has to escape
+const WCHAR ESCAPED_NAME[] = L"Quote\" Backslash\\ Tab\t Bell\x07 Unit\x1F";
+const WCHAR ESCAPED_REASON[] = L"Line\nbreak \"quoted\" C:\\path";
+
+// Writes the corpus, plus an event with a property whose name needs
+// escaping, to every sink, traced and inside a flight recorder dump, and
+// reads the files back:
+// - every JSON line parses, and the escaped name and reason decode to what
+//   was written
+// - every binary record has the size and field mask of the values that
+//   follow it, and they are the values of the event
+// - the text has a "> Received supported codec" or "# Selected codec" line
+//   for every finding, in order
+void CheckOutputSinks() {
+    EventCorpus corpus;
+    BuildEventCorpus(corpus);
+    EventSchema escapedSchema;
+    PropertyLayout escaped;
+    escaped.Name = ESCAPED_NAME;
+    escaped.InType = TDH_INTYPE_UINT8;
+    escaped.Size = 1;
+    escapedSchema.Properties.push_back(escaped);
+    ComputeLayout(escapedSchema);
+    BYTE escapedData[1] = {0x42};
+    EVENT_RECORD escapedEvent = corpus.Events[0];
+    escapedEvent.UserData = escapedData;
+    escapedEvent.UserDataLength = sizeof(escapedData);
+
+    std::vector<EventMessage> messages(corpus.Events.size() + 1);
+    std::vector<A2dpFinding> findings(messages.size());
+    for (size_t k = 0; k < messages.size(); k++) {
+        const bool last = k == corpus.Events.size();
+        FillEventMessage(messages[k], last ? escapedEvent : corpus.Events[k],
+                         last ? escapedSchema : corpus.Schemas[k],
+                         MeasureStringProperty);
+        findings[k] = AnalyzeEventData(messages[k].Data);
+    }
+
+    const struct {
+        OutputFormat Format;
+        const char *Path;
+    } sinks[] = {{OutputFormat::Text, "win_bt_codec_test_sink.txt"},
+                 {OutputFormat::JsonLines, "win_bt_codec_test_sink.jsonl"},
+                 {OutputFormat::Binary, "win_bt_codec_test_sink.bin"}};
+    std::string written[3];
+    for (int i = 0; i < 3; i++) {
+        {
+            std::unique_ptr<OutputSink> sink =
+                CreateOutputSink(sinks[i].Format, sinks[i].Path);
+            if (sink == nullptr) {
+                fprintf(stderr, "Unable to write %s\n", sinks[i].Path);
+                exit(1);
+            }
+            sink->BeginDump(ESCAPED_REASON, messages.size());
+            for (size_t k = 0; k < messages.size(); k++) {
+                sink->WriteEvent(messages[k], findings[k], true);
+            }
+            sink->EndDump();
+            if (!sink->Flush()) {
+                fprintf(stderr, "OutputSink: writing %s failed\n",
+                        sinks[i].Path);
+                exit(1);
+            }
+        }
+        written[i] = ReadFile(sinks[i].Path);
+        remove(sinks[i].Path);
+    }
+
+    // Text, with the line ends the C runtime wrote taken out
+    std::string &text = written[0];
+    text.erase(std::remove(text.begin(), text.end(), '\r'), text.end());
+    size_t at = 0;
+    size_t findingLines = 0;
+    bool textOk = true;
+    for (size_t k = 0; k < messages.size(); k++) {
+        std::string line;
+        if (findings[k].Kind == A2dpFindingKind::SupportedCodec) {
+            line = "\n> Received supported codec: ";
+        } else if (findings[k].Kind == A2dpFindingKind::SelectedCodec) {
+            line = "\n# Selected codec: ";
+        } else {
+            continue;
+        }
+        line += ToUtf8(findings[k].CodecName) + "\n";
+        at = text.find(line, at);
+        textOk = textOk && at != std::string::npos;
+        at = at == std::string::npos ? text.size() : at + line.size() - 1;
+        findingLines++;
+    }
+    if (!textOk || findingLines < 3) {
+        fprintf(stderr, "OutputSink text: finding lines missing\n%s\n",
+                text.c_str());
+        exit(1);
+    }
+
+    // JSON lines: a begin, the events, an end
+    const std::string &json = written[1];
+    size_t lines = 0;
+    bool jsonOk = true;
+    std::vector<std::string> strings;
+    for (size_t start = 0; start < json.size();) {
+        size_t end = json.find('\n', start);
+        if (end == std::string::npos) {
+            jsonOk = false; // every line ends with a line break
+            break;
+        }
+        const std::string line = json.substr(start, end - start);
+        JsonChecker checker(line);
+        if (!checker.Parse()) {
+            fprintf(stderr, "OutputSink jsonl: invalid line %s\n",
+                    line.c_str());
+            jsonOk = false;
+        }
+        strings.insert(strings.end(), checker.Strings.begin(),
+                       checker.Strings.end());
+        lines++;
+        start = end + 1;
+    }
+    const bool decoded =
+        std::find(strings.begin(), strings.end(), ToUtf8(ESCAPED_NAME)) !=
+            strings.end() &&
+        std::find(strings.begin(), strings.end(), ToUtf8(ESCAPED_REASON)) !=
+            strings.end();
+    if (!jsonOk || !decoded || lines != messages.size() + 2) {
+        fprintf(stderr, "OutputSink jsonl: bad output\n");
+        exit(1);
+    }
+
+    // Binary: the header, the field infos, then one record per event
+    const std::string &binary = written[2];
+    const BYTE *data = (const BYTE *)binary.data();
+    const BYTE *end = data + binary.size();
+    OutputFileHeader fileHeader;
+    bool binaryOk = binary.size() >= sizeof(fileHeader);
+    if (binaryOk) {
+        memcpy(&fileHeader, data, sizeof(fileHeader));
+        data += sizeof(fileHeader);
+        binaryOk = memcmp(fileHeader.Magic, OUTPUT_MAGIC,
+                          sizeof(OUTPUT_MAGIC)) == 0 &&
+                   fileHeader.Version == OUTPUT_VERSION &&
+                   fileHeader.FieldCount == (uint32_t)A2DP_FIELD_COUNT;
+    }
+    uint8_t sizes[A2DP_FIELD_COUNT] = {};
+    for (int field = 0; binaryOk && field < A2DP_FIELD_COUNT; field++) {
+        OutputFieldInfo info;
+        binaryOk = end - data >= (ptrdiff_t)sizeof(info);
+        if (binaryOk) {
+            memcpy(&info, data, sizeof(info));
+            data += sizeof(info) + info.NameLength;
+            sizes[field] = info.Size;
+            binaryOk = info.Size == A2DP_FIELDS[field].Size && data <= end;
+        }
+    }
+    size_t records = 0;
+    while (binaryOk && data < end) {
+        OutputRecordHeader header;
+        binaryOk = end - data >= (ptrdiff_t)sizeof(header) &&
+                   records < messages.size();
+        if (!binaryOk) {
+            break;
+        }
+        memcpy(&header, data, sizeof(header));
+        const EventMessage &message = messages[records];
+        binaryOk = header.Size <= end - data &&
+                   header.Timestamp == message.Timestamp &&
+                   header.Finding == (uint8_t)findings[records].Kind &&
+                   (header.Flags & OUTPUT_FLAG_RECORDED) != 0;
+        const BYTE *value = data + sizeof(header);
+        for (int field = 0; binaryOk && field < A2DP_FIELD_COUNT; field++) {
+            const BYTE *expected;
+            const bool has = FieldValue(message.Data, field, expected);
+            binaryOk = has == ((header.FieldMask >> field & 1) != 0);
+            if (has && binaryOk) {
+                binaryOk = value + sizes[field] <= data + header.Size &&
+                           memcmp(value, expected, sizes[field]) == 0;
+                value += sizes[field];
+            }
+        }
+        binaryOk = binaryOk && value == data + header.Size;
+        data += header.Size;
+        records++;
+    }
+    if (!binaryOk || records != messages.size()) {
+        fprintf(stderr, "OutputSink binary: record %zu does not match\n",
+                records);
+        exit(1);
+    }
+}
+
+// With the writer thread not running the queue stays full. A live batch
+// that finds it so must wait for room once, not once per event, and count
+// every event it could not queue as dropped.
+void CheckDropPolicy() {
+    static OutputWriter writer;
+    for (size_t i = 0; i < OUTPUT_QUEUE_CAPACITY; i++) {
+        writer.Publish(*writer.Claim(OverflowPolicy::Wait));
+    }
+    for (int batch = 0; batch < 2; batch++) {
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < TRACE_BATCH_EVENTS; i++) {
+            if (writer.ClaimNext(OverflowPolicy::Drop) != nullptr) {
+                fprintf(stderr, "OutputWriter: claimed from a full queue\n");
+                exit(1);
+            }
+        }
+        writer.PublishClaimed();
+        const auto waited = std::chrono::steady_clock::now() - start;
+        // One wait is a millisecond, one per event would be 256
+        if (waited > std::chrono::milliseconds(50)) {
+            fprintf(stderr, "OutputWriter: a dropped batch waited %lld ms\n",
+                    (long long)std::chrono::duration_cast<
+                        std::chrono::milliseconds>(waited)
+                        .count());
+            exit(1);
+        }
+    }
+    if (writer.Dropped() != 2 * TRACE_BATCH_EVENTS ||
+        writer.Waited() != 2 * TRACE_BATCH_EVENTS) {
+        fprintf(stderr, "OutputWriter: drops miscounted\n");
+        exit(1);
+    }
+}
+
+const struct {
+    const char *Name;
+    void (*Run)();
+} CHECKS[] = {
+    {"SchemaCache", CheckSchemaCache},
+    {"Filters", CheckFilters},
+    {"Batch", CheckBatch},
+    {"OversizedCapture", CheckOversizedCapture},
+    {"PnpCodecs", CheckPnpCodecs},
+    {"LoadGenerator", CheckLoadGenerator},
+    {"TraceSources", CheckTraceSources},
+    {"ReorderMerger", CheckReorderMerger},
+    {"Percentiles", CheckPercentiles},
+    {"SketchMerge", CheckSketchMerge},
+#ifndef _WIN32
+    {"MetricsServer", CheckMetricsServer},
+#endif
+    {"FlightRecorder", CheckFlightRecorder},
+    {"Coalescer", CheckCoalescer},
+    {"DeviceTracker", CheckDeviceTracker},
+    {"TraceImporter", CheckTraceImporter},
+    {"Negotiation", CheckNegotiation},
+    {"StatusSeqlock", CheckStatusSeqlock},
+    {"SpscRing", CheckSpscRing},
+    {"WriterAllocations", CheckWriterAllocations},
+    {"DropPolicy", CheckDropPolicy},
+    {"OutputSinks", CheckOutputSinks},
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    // The analysis code prints what it finds, only the failures matter here
+    freopen(NULL_DEVICE, "w", stdout);
+    int run = 0;
+    for (const auto &check : CHECKS) {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc && !selected; i++) {
+            selected = strcmp(argv[i], check.Name) == 0;
+        }
+        if (selected) {
+            fprintf(stderr, "%s\n", check.Name);
+            check.Run();
+            run++;
+        }
+    }
+    if (run == 0) {
+        fprintf(stderr, "Usage: win_bt_codec_test [CHECK...]\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,454 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "trace_import.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMPORT_SSE2 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+// Logs are read in chunks of this size
+const size_t IMPORT_CHUNK_SIZE = 1 << 20;
+
+struct HexTable {
+    signed char Values[256]; // value of the hex digit or -1
+};
+
+constexpr HexTable BuildHexTable() {
+    HexTable table = {};
+    for (int c = 0; c < 256; c++) {
+        table.Values[c] = -1;
+    }
+    for (int c = '0'; c <= '9'; c++) {
+        table.Values[c] = (signed char)(c - '0');
+    }
+    for (int c = 'a'; c <= 'f'; c++) {
+        table.Values[c] = (signed char)(c - 'a' + 10);
+        table.Values[c - 'a' + 'A'] = (signed char)(c - 'a' + 10);
+    }
+    return table;
+}
+
+inline constexpr HexTable HEX_TABLE = BuildHexTable();
+
+#ifdef IMPORT_SSE2
+// Converts 16 hex digits to 8 bytes at once. Returns false if one of them
+// is not a hex digit.
+inline bool DecodeHex16(const char *text, BYTE *out) {
+    const __m128i chars = _mm_loadu_si128((const __m128i *)text);
+
+    // Setting the 0x20 bit makes letters lower case and leaves digits alone
+    const __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+    const __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    const __m128i letter = _mm_sub_epi8(lower, _mm_set1_epi8('a'));
+
+    // For unsigned bytes x <= n is the same as min(x, n) == x
+    const __m128i isDigit =
+        _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    const __m128i isLetter =
+        _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+    if (_mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) != 0xFFFF) {
+        return false;
+    }
+
+    const __m128i nibbles = _mm_or_si128(
+        _mm_and_si128(isDigit, digit),
+        _mm_and_si128(isLetter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+
+    // Every 16 bit lane has the high nibble in its low byte and the low
+    // nibble in its high byte. Put them together and pack the lanes.
+    const __m128i high =
+        _mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00FF)), 4);
+    const __m128i low = _mm_srli_epi16(nibbles, 8);
+    const __m128i bytes = _mm_or_si128(high, low);
+    _mm_storel_epi64((__m128i *)out, _mm_packus_epi16(bytes, bytes));
+    return true;
+}
+#endif
+
+#ifdef IMPORT_SSE2
+// Bit i is set if text[i] is a newline, for 64 characters
+inline uint64_t NewlineMask64(const char *text) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i chars = _mm_loadu_si128((const __m128i *)(text + 16 * i));
+        mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(
+                    _mm_cmpeq_epi8(chars, newline))
+                << (16 * i);
+    }
+    return mask;
+}
+
+// Index of the lowest set bit, mask is not 0
+inline int LowestBit(uint64_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+#endif
+
+// Same as memchr, faster for the few characters of a log line where the
+// call costs more than the search
+inline const char *FindChar(const char *text, const char *end, char c) {
+#ifdef IMPORT_SSE2
+    const __m128i wanted = _mm_set1_epi8(c);
+    for (; end - text >= 16; text += 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i *)text);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chars, wanted));
+        if (mask != 0) {
+            return text + LowestBit((uint64_t)mask);
+        }
+    }
+#endif
+    for (; text < end; text++) {
+        if (*text == c) {
+            return text;
+        }
+    }
+    return nullptr;
+}
+
+// Decodes the hex digits at text up to the first character that is not
+// one, and returns how many there were. Looking for the end of the value
+// first would read it twice. out needs room for (end - text) / 2 bytes.
+inline size_t ScanHex(const char *text, const char *end, BYTE *out) {
+    const char *start = text;
+#ifdef IMPORT_SSE2
+    for (; end - text >= 16 && DecodeHex16(text, out); text += 16) {
+        out += 8;
+    }
+#endif
+    for (; end - text >= 2; text += 2) {
+        int high = HEX_TABLE.Values[(unsigned char)text[0]];
+        int low = HEX_TABLE.Values[(unsigned char)text[1]];
+        if ((high | low) < 0) {
+            break;
+        }
+        *out++ = (BYTE)((high << 4) | low);
+    }
+    // A digit without a pair, the value is then cut
+    if (text < end && HEX_TABLE.Values[(unsigned char)*text] >= 0) {
+        text++;
+    }
+    return text - start;
+}
+
+// Narrow character of a UTF-16 code unit. The logs are ASCII, anything
+// else can not be part of a name or a hex value anyway.
+inline char NarrowChar(unsigned char low, unsigned char high) {
+    return high == 0 && low < 0x80 ? (char)low : '?';
+}
+
+} // namespace
+
+bool DecodeHex(const char *text, size_t length, BYTE *out) {
+    size_t i = 0;
+#ifdef IMPORT_SSE2
+    for (; i + 16 <= length; i += 16) {
+        if (!DecodeHex16(text + i, out + i / 2)) {
+            return false;
+        }
+    }
+#endif
+    for (; i + 1 < length; i += 2) {
+        int high = HEX_TABLE.Values[(unsigned char)text[i]];
+        int low = HEX_TABLE.Values[(unsigned char)text[i + 1]];
+        if ((high | low) < 0) {
+            return false;
+        }
+        out[i / 2] = (BYTE)((high << 4) | low);
+    }
+    return true;
+}
+
+void TraceImporter::Feed(const char *data, size_t size) {
+    m_stats.Bytes += size;
+
+    // The byte order mark tells the encoding, so wait for enough bytes.
+    // Only a log that starts with chunks of less than three bytes needs
+    // them copied, the first chunk is usually looked at in place.
+    std::string head;
+    if (m_encoding == Encoding::Unknown) {
+        if (!m_head.empty() || size < 3) {
+            m_head.append(data, size);
+            if (m_head.size() < 3) {
+                return;
+            }
+            head.swap(m_head);
+            data = head.data();
+            size = head.size();
+        }
+        if ((unsigned char)data[0] == 0xFF && (unsigned char)data[1] == 0xFE) {
+            m_encoding = Encoding::Utf16;
+            data += 2;
+            size -= 2;
+        } else {
+            m_encoding = Encoding::Narrow;
+            if (memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+                data += 3;
+                size -= 3;
+            }
+        }
+    }
+
+    if (m_encoding == Encoding::Narrow) {
+        FeedNarrow(data, size);
+        return;
+    }
+
+    // UTF-16, convert to narrow text first. A code unit can be cut in two
+    // by the end of the chunk.
+    m_narrow.clear();
+    size_t i = 0;
+    if (m_oddByte >= 0 && size > 0) {
+        m_narrow.push_back(NarrowChar((unsigned char)m_oddByte,
+                                      (unsigned char)data[0]));
+        m_oddByte = -1;
+        i = 1;
+    }
+    for (; i + 1 < size; i += 2) {
+        m_narrow.push_back(
+            NarrowChar((unsigned char)data[i], (unsigned char)data[i + 1]));
+    }
+    if (i < size) {
+        m_oddByte = (unsigned char)data[i];
+    }
+    FeedNarrow(m_narrow.data(), m_narrow.size());
+}
+
+void TraceImporter::FeedNarrow(const char *data, size_t size) {
+    const char *end = data + size;
+
+    // Finish the line the previous chunk ended in
+    if (!m_partial.empty()) {
+        const char *newline = (const char *)memchr(data, '\n', size);
+        if (newline == nullptr) {
+            m_partial.append(data, size);
+            return;
+        }
+        m_partial.append(data, newline - data);
+        ParseLine(m_partial.data(), m_partial.size());
+        m_partial.clear();
+        data = newline + 1;
+    }
+
+    // Lines are parsed in place, only the last partial one is copied. Lines
+    // are short, so instead of searching for every newline, the newlines
+    // of 64 characters are found at once and then walked bit by bit.
+#ifdef IMPORT_SSE2
+    for (const char *block = data; end - block >= 64; block += 64) {
+        for (uint64_t mask = NewlineMask64(block); mask != 0;
+             mask &= mask - 1) {
+            const char *newline = block + LowestBit(mask);
+            ParseLine(data, newline - data);
+            data = newline + 1;
+        }
+    }
+#endif
+    while (data < end) {
+        const char *newline = (const char *)memchr(data, '\n', end - data);
+        if (newline == nullptr) {
+            m_partial.assign(data, end - data);
+            return;
+        }
+        ParseLine(data, newline - data);
+        data = newline + 1;
+    }
+}
+
+void TraceImporter::Finish() {
+    if (m_encoding == Encoding::Unknown && !m_head.empty()) {
+        // Less than three bytes in the whole log, no room for a byte order
+        // mark
+        m_encoding = Encoding::Narrow;
+        std::string head;
+        head.swap(m_head);
+        FeedNarrow(head.data(), head.size());
+    }
+    if (!m_partial.empty()) {
+        ParseLine(m_partial.data(), m_partial.size());
+        m_partial.clear();
+    }
+    FlushEvent();
+}
+
+void TraceImporter::ParseLine(const char *line, size_t length) {
+    m_stats.Lines++;
+    if (length > 0 && line[length - 1] == '\r') {
+        length--;
+    }
+
+    // Properties are indented by exactly two spaces. Deeper indented lines
+    // are the comments (like "Codec Name") some logs have.
+    if (length >= 3 && line[0] == ' ' && line[1] == ' ' && line[2] != ' ') {
+        ParseProperty(line, length);
+        return;
+    }
+
+    const char EVENT_ID[] = "Event ID:";
+    const size_t EVENT_ID_LENGTH = sizeof(EVENT_ID) - 1;
+    if (length >= EVENT_ID_LENGTH &&
+        memcmp(line, EVENT_ID, EVENT_ID_LENGTH) == 0) {
+        FlushEvent();
+        m_inEvent = true;
+        size_t i = EVENT_ID_LENGTH;
+        while (i < length && line[i] == ' ') {
+            i++;
+        }
+        for (; i < length && line[i] >= '0' && line[i] <= '9'; i++) {
+            m_eventId = m_eventId * 10 + (line[i] - '0');
+        }
+    }
+}
+
+void TraceImporter::ParseProperty(const char *line, size_t length) {
+    const char *end = line + length;
+    const char *name = line + 2;
+    const char *colon = FindChar(name, end, ':');
+    if (colon == nullptr) {
+        return; // not a property
+    }
+    size_t nameLength = colon - name;
+
+    // "Name [size]" in the current format, just "Name" in the older one
+    long declaredSize = -1;
+    if (nameLength > 0 && name[nameLength - 1] == ']') {
+        const char *open = colon - 1;
+        while (open > name && *open != '[') {
+            open--;
+        }
+        if (*open == '[' && open > name && open[-1] == ' ') {
+            long value = 0;
+            const char *digit = open + 1;
+            for (; digit < colon - 1 && *digit >= '0' && *digit <= '9' &&
+                   value <= 0xFFFF;
+                 digit++) {
+                value = value * 10 + (*digit - '0');
+            }
+            if (digit == colon - 1 && digit > open + 1) {
+                declaredSize = value;
+                nameLength = open - 1 - name;
+            }
+        }
+    }
+
+    // The hex value runs up to the end of the line or up to the decoded
+    // value --trace prints after it
+    const char *value = colon + 1;
+    if (value < end && *value == ' ') {
+        value++;
+    }
+    const size_t room = (end - value) / 2;
+    if (m_bytes.size() < room) {
+        m_bytes.resize(room);
+    }
+    const size_t digits = ScanHex(value, end, m_bytes.data());
+    const ULONG size = (ULONG)(digits / 2);
+    if ((value + digits < end && value[digits] != ' ') || digits % 2 != 0 ||
+        (declaredSize >= 0 && declaredSize != size)) {
+        m_stats.BadLines++;
+        return;
+    }
+
+    m_inEvent = true;
+    m_stats.Properties++;
+    A2dpField field = FindEventField(name, nameLength);
+    if (field != A2dpField::Count) {
+        // Arrays are not marked in the log, their first element is read.
+        // A size that is not a multiple of the field is an array of
+        // smaller values ("ChannelCount [6]: 020002000000" in events.txt
+        // is three 16 bit counts), taken as the largest power of two that
+        // divides the size.
+        const ULONG fieldSize = A2DP_FIELDS[(int)field].Size;
+        ULONG elementSize = 0;
+        if (size > fieldSize && size % fieldSize != 0) {
+            elementSize = size & (0 - size);
+        }
+        SetEventField(m_event, field, m_bytes.data(), size, elementSize);
+    }
+}
+
+void TraceImporter::FlushEvent() {
+    if (!m_inEvent) {
+        return;
+    }
+    m_stats.Events++;
+    m_onEvent(m_eventId, m_event);
+    m_event = A2dpEventData();
+    m_eventId = 0;
+    m_inEvent = false;
+}
+
+bool ImportTraceLog(const char *path, ImportedEventFn onEvent,
+                    TraceImportStats &stats) {
+    FILE *file = nullptr;
+    if (strcmp(path, "-") == 0) {
+        file = stdin;
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    } else {
+        file = fopen(path, "rb");
+    }
+    if (file == nullptr) {
+        return false;
+    }
+    // The chunks are big enough, stdio buffering would only add a copy
+    setvbuf(file, nullptr, _IONBF, 0);
+
+    TraceImporter importer(onEvent);
+    std::vector<char> chunk(IMPORT_CHUNK_SIZE);
+    size_t read;
+    while ((read = fread(chunk.data(), 1, chunk.size(), file)) > 0) {
+        importer.Feed(chunk.data(), read);
+    }
+    bool ok = ferror(file) == 0;
+    if (file != stdin) {
+        fclose(file);
+    }
+
+    importer.Finish();
+    stats = importer.Stats();
+    return ok;
+}
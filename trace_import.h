@@ -0,0 +1,92 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "a2dp.h"
+#include "platform.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Reads the text that --trace prints (see events.txt) back into events, so
+// old logs can be analyzed again when the codec or activity tables change.
+// Both the current "  Name [size]: hex" lines and the older "  Name: hex"
+// lines are understood, everything else in the log is skipped.
+
+// Converts length hex digits (upper or lower case) to length / 2 bytes.
+// length has to be even. Returns false if a character is not a hex digit,
+// out is then partially written.
+bool DecodeHex(const char *text, size_t length, BYTE *out);
+
+// Called for every event found in the log
+typedef void (*ImportedEventFn)(ULONG eventId, const A2dpEventData &eventData);
+
+struct TraceImportStats {
+    ULONGLONG Bytes = 0;
+    ULONGLONG Lines = 0;
+    ULONGLONG Events = 0;
+    ULONGLONG Properties = 0;
+    // Property lines whose value is not hex or does not match their size
+    ULONGLONG BadLines = 0;
+};
+
+// Streaming parser of a log. The log can be fed in chunks of any size, lines
+// cut by a chunk boundary are put together again. UTF-8 logs and the UTF-16
+// logs PowerShell writes with > are both accepted.
+class TraceImporter {
+  public:
+    explicit TraceImporter(ImportedEventFn onEvent) : m_onEvent(onEvent) {}
+
+    void Feed(const char *data, size_t size);
+
+    // Parses what is left after the last chunk and reports the last event
+    void Finish();
+
+    const TraceImportStats &Stats() const { return m_stats; }
+
+  private:
+    enum class Encoding { Unknown, Narrow, Utf16 };
+
+    void FeedNarrow(const char *data, size_t size);
+    void ParseLine(const char *line, size_t length);
+    void ParseProperty(const char *line, size_t length);
+    void FlushEvent();
+
+    ImportedEventFn m_onEvent;
+    TraceImportStats m_stats;
+    Encoding m_encoding = Encoding::Unknown;
+    std::string m_head;    // first bytes, until the encoding is known
+    std::string m_partial; // start of a line cut by the end of a chunk
+    std::string m_narrow;  // a UTF-16 chunk converted to narrow text
+    int m_oddByte = -1;    // a UTF-16 code unit cut by the end of a chunk
+    std::vector<BYTE> m_bytes;
+    A2dpEventData m_event;
+    ULONG m_eventId = 0;
+    bool m_inEvent = false;
+};
+
+// Imports the log at path ("-" reads standard input), reading it in chunks
+// so logs of any size stream through. Returns false if it can not be read.
+bool ImportTraceLog(const char *path, ImportedEventFn onEvent,
+                    TraceImportStats &stats);
@@ -0,0 +1,108 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "trace_source.h"
+
+#include <cstdint>
+#include <cstring>
+
+void TraceBatch::Add(const EVENT_RECORD &event, const EventSchema &schema,
+                     bool copyData) {
+    TraceEvent &added = m_events[m_count];
+    added.Record = event;
+    added.Schema = &schema;
+    m_offsets[m_count] = NOT_COPIED;
+    m_schemaOffsets[m_count] = NOT_COPIED;
+    if (copyData) {
+        m_offsets[m_count] = m_data.size();
+        const BYTE *data = (const BYTE *)event.UserData;
+        m_data.insert(m_data.end(), data, data + event.UserDataLength);
+        // Only the TraceLogging schema is looked at later, the rest of the
+        // extended data would not outlive the call either
+        added.Record.ExtendedDataCount = 0;
+        added.Record.ExtendedData = nullptr;
+        for (USHORT i = 0; i < event.ExtendedDataCount; i++) {
+            const EVENT_HEADER_EXTENDED_DATA_ITEM &item = event.ExtendedData[i];
+            if (item.ExtType != EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL) {
+                continue;
+            }
+            m_schemaItems[m_count] = item;
+            m_schemaOffsets[m_count] = m_data.size();
+            const BYTE *schemaData = (const BYTE *)(uintptr_t)item.DataPtr;
+            m_data.insert(m_data.end(), schemaData, schemaData + item.DataSize);
+            added.Record.ExtendedDataCount = 1;
+            added.Record.ExtendedData = &m_schemaItems[m_count];
+            break;
+        }
+    }
+    m_count++;
+}
+
+void TraceBatch::Deliver(TraceBatchFn onBatch) {
+    if (m_count == 0) {
+        return;
+    }
+    for (size_t i = 0; i < m_count; i++) {
+        if (m_offsets[i] != NOT_COPIED) {
+            m_events[i].Record.UserData = m_data.data() + m_offsets[i];
+        }
+        if (m_schemaOffsets[i] != NOT_COPIED) {
+            m_schemaItems[i].DataPtr =
+                (ULONGLONG)(uintptr_t)(m_data.data() + m_schemaOffsets[i]);
+        }
+    }
+    onBatch(m_events, m_count);
+    m_count = 0;
+    m_data.clear();
+}
+
+bool CaptureTraceSource::Run(TraceBatchFn onBatch) {
+    for (size_t i = 0; i < m_reader.BlockCount() && !StopRequested(); i++) {
+        CaptureBlockReader block = m_reader.Block(i, &m_schemas);
+        EVENT_RECORD event;
+        const EventSchema *schema = nullptr;
+        while (block.Next(event, schema)) {
+            m_batch.Add(event, *schema, false);
+            m_events++;
+            if (m_batch.Full()) {
+                m_batch.Deliver(onBatch);
+            }
+        }
+        m_corrupt = m_corrupt || block.Corrupt();
+    }
+    m_batch.Deliver(onBatch);
+    return !m_corrupt;
+}
+
+bool GeneratorTraceSource::Run(TraceBatchFn onBatch) {
+    EVENT_RECORD event;
+    const EventSchema *schema = nullptr;
+    while (!StopRequested() && m_generator.Next(event, schema)) {
+        m_batch.Add(event, *schema, true);
+        m_events++;
+        if (m_batch.Full()) {
+            m_batch.Deliver(onBatch);
+        }
+    }
+    m_batch.Deliver(onBatch);
+    return true;
+}
@@ -0,0 +1,175 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "capture_file.h"
+#include "event_decoder.h"
+#include "event_schema.h"
+#include "load_generator.h"
+#include "platform.h"
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Where the events come from. Every source hands its events over in
+// batches instead of one call per event, so the cost of the call, of
+// reading the clocks and of publishing to the writer is paid once per
+// batch, and the decoder works through a batch while its code and tables
+// are in the cache.
+//
+//   CaptureTraceSource    a capture file, on any platform
+//   GeneratorTraceSource  synthetic events made in memory, on any platform
+//   EtwTraceSource        a real time ETW session or an ETL file, on
+//                         Windows (etw_trace_source.h)
+
+// Events per batch, at most. Well below OUTPUT_QUEUE_CAPACITY, so a batch
+// always fits in the queue.
+const size_t TRACE_BATCH_EVENTS = 256;
+
+// An event and its schema. The schema is the source's, it stays valid as
+// long as the source lives.
+struct TraceEvent {
+    EVENT_RECORD Record;
+    const EventSchema *Schema;
+};
+
+// Called with every batch. The data of the events is only good during the
+// call.
+typedef void (*TraceBatchFn)(const TraceEvent *events, size_t count);
+
+// Collects the events of a batch. Sources whose data does not outlive the
+// call that gives it to them copy it into the batch, with the TraceLogging
+// schema of the event: TDH needs it to measure variable sized properties
+// later (see EtwTraceSource::Measure). The other extended data is dropped.
+class TraceBatch {
+  public:
+    TraceBatch() { m_data.reserve(TRACE_BATCH_EVENTS * 256); }
+
+    void Add(const EVENT_RECORD &event, const EventSchema &schema,
+             bool copyData);
+
+    bool Full() const { return m_count == TRACE_BATCH_EVENTS; }
+
+    // Calls onBatch with the events collected, if any, and empties the
+    // batch
+    void Deliver(TraceBatchFn onBatch);
+
+  private:
+    // Marks events whose data was not copied
+    static const size_t NOT_COPIED = ~(size_t)0;
+
+    TraceEvent m_events[TRACE_BATCH_EVENTS];
+    // Where the copies are in m_data, the pointers are only set once the
+    // batch is complete as m_data may move while it grows
+    size_t m_offsets[TRACE_BATCH_EVENTS];
+    // The TraceLogging schema items of the copied events, and where their
+    // data is in m_data
+    EVENT_HEADER_EXTENDED_DATA_ITEM m_schemaItems[TRACE_BATCH_EVENTS];
+    size_t m_schemaOffsets[TRACE_BATCH_EVENTS];
+    std::vector<BYTE> m_data;
+    size_t m_count = 0;
+};
+
+class TraceSource {
+  public:
+    virtual ~TraceSource() = default;
+
+    // Ticks per second of the event timestamps, 0 if they have none
+    virtual LONGLONG TimestampFrequency() const = 0;
+
+    // True if the events come in as they happen and can not wait: when
+    // the writer falls behind they are dropped instead
+    virtual bool Live() const { return false; }
+
+    // Measures the variable sized properties of the events
+    virtual MeasurePropertyFn Measure() const { return MeasureStringProperty; }
+
+    // Hands the events over in batches of at most TRACE_BATCH_EVENTS until
+    // there are no more or Stop() is called. Returns false if the source
+    // failed on the way, after the events it could read.
+    virtual bool Run(TraceBatchFn onBatch) = 0;
+
+    // Makes Run() return soon. Can be called from any thread.
+    virtual void Stop() { m_stop.store(true, std::memory_order_relaxed); }
+
+    // Events handed over
+    ULONGLONG Events() const { return m_events; }
+
+  protected:
+    bool StopRequested() const {
+        return m_stop.load(std::memory_order_relaxed);
+    }
+
+    ULONGLONG m_events = 0;
+
+  private:
+    std::atomic<bool> m_stop{false};
+};
+
+// The events of a capture file. They are handed over straight from the
+// mapping, nothing is copied.
+class CaptureTraceSource : public TraceSource {
+  public:
+    // Returns false if the file can not be read or is not a capture file
+    bool Open(const char *path) { return m_reader.Open(path); }
+
+    // True if the file ends in a partially written block
+    bool Truncated() const { return m_reader.Truncated(); }
+
+    // True if Run() met corrupt blocks. It still hands over the events
+    // before the corruption, and the other blocks.
+    bool Corrupt() const { return m_corrupt; }
+
+    LONGLONG TimestampFrequency() const override {
+        return m_reader.TimestampFrequency();
+    }
+    bool Run(TraceBatchFn onBatch) override;
+
+  private:
+    CaptureReader m_reader;
+    // The writer may still hold events of earlier blocks for ordering, so
+    // their schemas are kept here rather than by the block readers
+    CaptureSchemaStore m_schemas;
+    TraceBatch m_batch;
+    bool m_corrupt = false;
+};
+
+// Synthetic events of a LoadGenerator. The generator reuses its buffers
+// for every event, so the events are copied into the batch.
+class GeneratorTraceSource : public TraceSource {
+  public:
+    explicit GeneratorTraceSource(const LoadOptions &options) :
+        m_generator(options) {}
+
+    const LoadStats &Stats() const { return m_generator.Stats(); }
+
+    LONGLONG TimestampFrequency() const override {
+        return LOAD_TIMESTAMP_FREQUENCY;
+    }
+    bool Run(TraceBatchFn onBatch) override;
+
+  private:
+    LoadGenerator m_generator;
+    TraceBatch m_batch;
+};
@@ -20,552 +20,756 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include "a2dp.h"
+#include "batch.h"
+#include "capture_file.h"
+#ifdef _WIN32
+#include "etw_trace_source.h"
+#endif
+#include "event_decoder.h"
+#include "event_schema.h"
+#include "filter.h"
+#include "flight_recorder.h"
+#include "latency_histogram.h"
+#include "load_generator.h"
+#include "metrics.h"
+#include "metrics_server.h"
+#include "output_sink.h"
+#include "output_writer.h"
+#include "platform.h"
+#include "pnp_codecs.h"
+#include "providers.h"
+#include "shared_memory.h"
+#include "status_snapshot.h"
+#include "trace_import.h"
+#include "trace_source.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
 #include <cwchar>
-#include <windows.h>
-
-#include <evntcons.h>
-#include <evntrace.h>
+#include <memory>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <signal.h>
+#endif
 #include <stdio.h>
-#include <tdh.h>
 #include <wchar.h>
 
-#include <optional>
-
 // The process and data is taken from this article
 // https://helgeklein.com/blog/how-to-check-which-bluetooth-a2dp-audio-codec-is-used-on-windows/
 
 // Set to true to print events data
 bool TRACE_EVENTS = false;
 
-struct CodecData {
-    const BYTE A2dpStandardCodecId;
-    const DWORD A2dpVendorId;
-    const WORD A2dpVendorCodecId;
-    const WCHAR *Name;
-};
-
-const CodecData CODECS[] = {
-    {0x0, 0x0, 0x0, L"SBC"},
-    {0x01, 0x0, 0x0, L"MPEG-1,2 (aka MP3)"},
-    {0x02, 0x0, 0x0, L"MPEG-2,4 (aka AAC)"},
-    {0x03, 0x0, 0x0, L"ATRAC"},
-    {0xFF, 0x004F, 0x01, L"aptX"},
-    {0xFF, 0x00D7, 0x24, L"aptX HD"},
-    {0xFF, 0x000A, 0x02, L"aptX Low Latency"},
-    {0xFF, 0x00D7, 0x02, L"aptX Low Latency"},
-    {0xFF, 0x000A, 0x01, L"FastStream"},
-    {0xFF, 0x012D, 0xAA, L"LDAC"},
-    {0xFF, 0x0075, 0x0102, L"Samsung HD"},
-    {0xFF, 0x0075, 0x0103, L"Samsung Scalable Codec"},
-    {0xFF, 0x053A, 0x484C, L"Savitech LHDC"},
-    {0xFF, 0x000A, 0x0103, L"Qualcomm specific aptX version"},
-    {0xFF, 0x000A, 0x0104, L"The CSR True Wireless Stereo v3 Codec ID for AAC"},
-    {0xFF, 0x000A, 0x0105, L"The CSR True Wireless Stereo v3 Codec ID for MP3"},
-    {0xFF, 0x000A, 0x0106,
-     L"The CSR True Wireless Stereo v3 Codec ID for aptX"}};
-
-struct A2dpEventData {
-    std::optional<BYTE> a2dpStandardCodecId;
-    std::optional<DWORD> a2dpVendorId;
-    std::optional<WORD> a2dpVendorCodecId;
-    std::optional<DWORD> AvdtpActivity;
-    std::optional<WORD> ResultCode;
-    std::optional<DWORD> SampleRate;
-    std::optional<DWORD> ChannelCount;
-    std::optional<BYTE> AcceptorStreamEndPointID;
-    std::optional<BYTE> InitiatorStreamEndPointID;
-};
-
-// These vaklues were reversed from btha2dp.sys on Windows 11 build 26100
-// and I am not sure if this going to stay the same in new builds.
-// I explained the process in the events.md file
-enum AvdtpActivity {
-    Abort_Cfm = 0x2e,
-    Abort_Ind = 0x2f,
-    Close_Cfm = 0x26,
-    Close_Ind = 0x27,
-    Connect_Cfm = 0x2,
-    Connect_Ind = 0x3,
-    Disconnect_Cfm = 0x6,
-    Disconnect_Ind = 0x7,
-    Discover_Cfm = 10,
-    Discover_Ind = 0xb,
-    GetCapabilities_Cfm = 0xe,
-    GetCapabilities_ind = 0xf,
-    GetConfiguration_Cfm = 0x16,
-    GetConfiguration_Ind = 0x17,
-    SetConfiguration_Cfm = 0x12,
-    SetConfiguration_Ind_1 = 0x13, // in the same func it goes 0x13 and then
-                                   // 0x14
-    SetConfiguration_Ind_2 = 0x14,
-
-    Open_Cfm = 0x1e,
-    Open_Ind = 0x1f,
-    Reconfigure_Cfm = 0x1a,
-    Reconfigure_Ind_1 = 0x1c, // Same as above, it goes 0x1c and then 0x1b
-    Reconfigure_Ind_2 = 0x1b,
-    Start_Cfm = 0x22,
-    Start_Ind = 0x24,
-    Suspend_Cfm = 0x2a,
-    Suspend_Ind = 0x2c,
-
-    AbortStream = 0x2d,
-    EnterNewStreamingState = 0x29,
-    FindNextSepAndGepCaps = 0xd,
-    RequestOpenMediaChannel = 0x1d,
-    RequestStreamClose = 0x25,
-    RequestStreamOpen = 9,
-
-    SendReconfigurationRequest = 0x19,
-};
-
-const WCHAR *AvdtpActivityToString(AvdtpActivity activity) {
-    switch (activity) {
-    case Abort_Cfm:
-        return L"Abort_Cfm";
-    case Abort_Ind:
-        return L"Abort_Ind";
-    case Close_Cfm:
-        return L"Close_Cfm";
-    case Close_Ind:
-        return L"Close_Ind";
-    case Connect_Cfm:
-        return L"Connect_Cfm";
-    case Connect_Ind:
-        return L"Connect_Ind";
-    case Disconnect_Cfm:
-        return L"Disconnect_Cfm";
-    case Disconnect_Ind:
-        return L"Disconnect_Ind";
-    case Discover_Cfm:
-        return L"Discover_Cfm";
-    case Discover_Ind:
-        return L"Discover_Ind";
-    case GetCapabilities_Cfm:
-        return L"GetCapabilities_Cfm";
-    case GetCapabilities_ind:
-        return L"GetCapabilities_ind";
-    case GetConfiguration_Cfm:
-        return L"GetConfiguration_Cfm";
-    case GetConfiguration_Ind:
-        return L"GetConfiguration_Ind";
-    case SetConfiguration_Cfm:
-        return L"SetConfiguration_Cfm";
-    case SetConfiguration_Ind_1:
-        return L"SetConfiguration_Ind_1";
-    case SetConfiguration_Ind_2:
-        return L"SetConfiguration_Ind_2";
-    case Reconfigure_Ind_1:
-        return L"Reconfigure_Ind_1";
-    case Reconfigure_Ind_2:
-        return L"Reconfigure_Ind_2";
-    case Open_Cfm:
-        return L"Open_Cfm";
-    case Open_Ind:
-        return L"Open_Ind";
-    case Reconfigure_Cfm:
-        return L"Reconfigure_Cfm";
-    case Start_Cfm:
-        return L"Start_Cfm";
-    case Start_Ind:
-        return L"Start_Ind";
-    case Suspend_Cfm:
-        return L"Suspend_Cfm";
-    case Suspend_Ind:
-        return L"Suspend_Ind";
-    case AbortStream:
-        return L"AbortStream";
-    case EnterNewStreamingState:
-        return L"EnterNewStreamingState";
-    case FindNextSepAndGepCaps:
-        return L"FindNextSepAndGepCaps";
-    case RequestOpenMediaChannel:
-        return L"RequestOpenMediaChannel";
-    case RequestStreamClose:
-        return L"RequestStreamClose";
-    case RequestStreamOpen:
-        return L"RequestStreamOpen";
-    case SendReconfigurationRequest:
-        return L"SendReconfigurationRequest";
-    default:
-        return L"Unknown";
-    }
-}
+// Measures the variable sized properties of the events being decoded. Live
+// events go to TDH, replayed ones can only use the portable measurer.
+MeasurePropertyFn measureProperty = MeasureStringProperty;
 
-// The GUID for the provider we want to trace
-// This one is Microsoft.Windows.Bluetooth.BthA2dp
-static GUID ProviderGuid = {0x8776ad1e,
-                            0x5022,
-                            0x4451,
-                            {0xa5, 0x66, 0xf4, 0x7e, 0x70, 0x8b, 0x90, 0x75}};
-// The name of the ETW session
-const WCHAR *sessionName = L"BT_CODEC";
-
-// Global variables to hold handles and properties for the ETW session
-// These are global so they can be accessed by the Ctrl+C handler
-TRACEHANDLE hSession = 0;
-TRACEHANDLE hTrace = 0;
-EVENT_TRACE_PROPERTIES *pSessionProperties = NULL;
-
-// Cleans up resources used by the ETW session
-void Cleanup() {
-    // Stop the trace session if it was started
-    if (hSession != 0) {
-        ControlTraceW(hSession, NULL, pSessionProperties,
-                      EVENT_TRACE_CONTROL_STOP);
-    }
-    // Close the trace handle if it was opened
-    if (hTrace != 0) {
-        CloseTrace(hTrace);
-    }
-    // Free the memory allocated for the session properties
-    if (pSessionProperties != NULL) {
-        free(pSessionProperties);
-    }
-}
+// All analysis output and traces are printed by its thread
+OutputWriter outputWriter;
+
+// With --shm the devices are published in shared memory for other processes
+StatusPublisher statusPublisher;
+
+// With --metrics the counters are served over HTTP
+MetricsServer metricsServer;
+
+// --filter, events that do not match are dropped before they are decoded
+EventFilter eventFilter;
+ULONGLONG filteredOut = 0;
 
+// The fields the outputs show. Without traces only the analysis and the
+// device tracker look at the data, and they need a few fields.
+A2dpFieldMask decodeFields = A2DP_ALL_FIELDS;
+
+// How long events are held to be put in timestamp order. Real time buffers
+// are flushed every second (see FlushTimer), that is how far apart the
+// processors can be.
+std::chrono::milliseconds mergeWindow(1000);
+
+// Raw events go here with --record
+CaptureWriter captureWriter;
+
+// What happens when the writer falls behind: live events can not wait and
+// are dropped, the others wait for it
+OverflowPolicy overflowPolicy = OverflowPolicy::Wait;
+
+// The source being analyzed, Ctrl+C stops it
+TraceSource *activeSource = nullptr;
+
+#ifdef _WIN32
 // Handles the Ctrl+C signal to gracefully stop the trace
 BOOL WINAPI CtrlCHandler(DWORD fdwCtrlType) {
     switch (fdwCtrlType) {
     case CTRL_C_EVENT:
+        if (activeSource == nullptr) {
+            return FALSE;
+        }
         wprintf(L"Ctrl+C received, stopping trace...\n");
-        Cleanup();
+        activeSource->Stop();
+        return TRUE;
+    case CTRL_BREAK_EVENT:
+        // Ctrl+Break prints the latencies and the flight recorder and keeps
+        // tracing
+        latencyReportRequested = true;
+        flightDumpRequested = true;
         return TRUE;
     default:
         return FALSE;
     }
 }
-
-void TraceEventInfo(const PEVENT_RECORD pEvent, const PTRACE_EVENT_INFO pInfo) {
-    DWORD status = ERROR_SUCCESS;
-
-    // Print general event information
-    wprintf(L"--------------------------------------\n");
-    wprintf(L"Event ID: %u\n", pEvent->EventHeader.EventDescriptor.Id);
-    //wprintf(L"Provider GUID: ");
-    //for (int i = 0; i < 8; i++) {
-        // wprintf(L"%02x", pEvent->EventHeader.ProviderId.Data4[i]);
-    //}
-    //wprintf(L"\n");
-
-    // Iterate through the properties of the event
-    for (ULONG i = 0; i < pInfo->TopLevelPropertyCount; i++) {
-        PROPERTY_DATA_DESCRIPTOR descriptor;
-        descriptor.PropertyName =
-            (ULONGLONG)((PBYTE)pInfo +
-                        pInfo->EventPropertyInfoArray[i].NameOffset);
-        descriptor.ArrayIndex = 0;
-
-        // Get the size of the property data
-        ULONG propertySize = 0;
-        status =
-            TdhGetPropertySize(pEvent, 0, NULL, 1, &descriptor, &propertySize);
-        if (status != ERROR_SUCCESS) {
+#endif
+
+// Decodes a batch of events and queues them for the writer thread, which
+// prints the analysis and the traces. The events are published to the
+// writer once per batch, not once per event.
+void HandleEvents(const TraceEvent *events, size_t count) {
+    const ULONGLONG received = NowNanoseconds();
+    metrics.Events.Add(count);
+    for (size_t i = 0; i < count; i++) {
+        const EVENT_RECORD &event = events[i].Record;
+        const EventSchema &schema = *events[i].Schema;
+        if (captureWriter.IsOpen() && !captureWriter.Write(event, schema)) {
+            wprintf(L"Failed to write to the capture file, recording "
+                    L"stopped\n");
+            captureWriter.Close();
+        }
+        if (!eventFilter.Empty() &&
+            !eventFilter.Matches(event, schema, measureProperty)) {
+            filteredOut++;
+            metrics.FilteredOut.Add();
             continue;
         }
-
-        // Allocate memory for the property data
-        PBYTE pPropertyData = (PBYTE)malloc(propertySize);
-        if (pPropertyData == NULL) {
+        EventMessage *message = outputWriter.ClaimNext(overflowPolicy);
+        if (message == nullptr) {
+            // the writer is too far behind, counted as dropped
+            metrics.Dropped.Add();
             continue;
         }
+        const ULONGLONG start = NowNanoseconds();
+        FillEventMessage(*message, event, schema, measureProperty,
+                         decodeFields);
+        if (!message->Decoded) {
+            metrics.DecodeFailures.Add();
+        }
+        stageLatencies.Decode.Record(NowNanoseconds() - start);
+    }
+    outputWriter.PublishClaimed();
+    stageLatencies.Batch.Record(NowNanoseconds() - received);
+}
 
-        // Get the property data
-        status = TdhGetProperty(pEvent, 0, NULL, 1, &descriptor, propertySize,
-                                pPropertyData);
-        if (status == ERROR_SUCCESS) {
-            // wprintf(L"Property size: %d\n", propertySize);
-            wprintf(L"  %s [%d]: ", (PWSTR)descriptor.PropertyName,
-                    propertySize);
-            // Otherwise, print the raw hex bytes
-            for (ULONG k = 0; k < propertySize; k++) {
-                wprintf(L"%02x", pPropertyData[k]);
-            }
+// Runs the events of the source through the decoder and the analysis until
+// it has no more or is stopped. Returns false if the source failed.
+bool Analyze(TraceSource &source) {
+    measureProperty = source.Measure();
+    overflowPolicy =
+        source.Live() ? OverflowPolicy::Drop : OverflowPolicy::Wait;
+    outputWriter.Start(TRACE_EVENTS, source.TimestampFrequency(),
+                       mergeWindow);
+    const bool succeeded = source.Run(HandleEvents);
+    outputWriter.Flush();
+    return succeeded;
+}
 
-            if (wcscmp((PWSTR)descriptor.PropertyName, L"AvdtpActivity") == 0) {
-                AvdtpActivity activityValue =
-                    static_cast<AvdtpActivity>(*(DWORD *)pPropertyData);
-                auto activity = AvdtpActivityToString(activityValue);
-                wprintf(L"     [%s]", activity);
-            }
+// With --record, raw events are also written to a capture file
+bool OpenCapture(const char *recordPath, LONGLONG timestampFrequency) {
+    if (recordPath != nullptr &&
+        !captureWriter.Open(recordPath, timestampFrequency)) {
+        wprintf(L"Unable to create the capture file\n");
+        return false;
+    }
+    return true;
+}
 
-            wprintf(L"\n");
-            free(pPropertyData);
+void CloseCapture() {
+    if (captureWriter.IsOpen()) {
+        ULONGLONG recorded = captureWriter.EventCount();
+        if (captureWriter.Close()) {
+            wprintf(L"Recorded %llu events\n", (unsigned long long)recorded);
+        } else {
+            wprintf(L"Failed to write to the capture file\n");
         }
     }
 }
 
-// Returns pointer to codec name or nullptr if codec was not found
-const WCHAR *GetCodecName(const A2dpEventData &eventData) {
-    // Find coded if codec data was specified
-    if (eventData.a2dpStandardCodecId) {
-        // wprintf(L"Look for codec with %d, %d, %d\n", a2dpStandardCodecId,
-        // a2dpVendorId, a2dpStandardCodecId);
-        for (const auto &codec : CODECS) {
-            // if a set of a2dpStandardCodecId is in 0,1,2 or 4 then
-            // we should not check other fields
-            if (eventData.a2dpStandardCodecId == 0x00 ||
-                eventData.a2dpStandardCodecId == 0x01 ||
-                eventData.a2dpStandardCodecId == 0x02 ||
-                eventData.a2dpStandardCodecId == 0x04) {
-                if (codec.A2dpStandardCodecId ==
-                    eventData.a2dpStandardCodecId) {
-                    return codec.Name;
-                }
-            } else if (codec.A2dpStandardCodecId ==
-                           eventData.a2dpStandardCodecId &&
-                       codec.A2dpVendorId == eventData.a2dpVendorId &&
-                       codec.A2dpVendorCodecId == eventData.a2dpVendorCodecId) {
-                return codec.Name;
-            }
-        }
+// Reports how many events --filter dropped
+void PrintFilterStats() {
+    if (!eventFilter.Empty()) {
+        wprintf(L"Filtered out: %llu events\n",
+                (unsigned long long)filteredOut);
     }
+}
 
-    return nullptr;
+// Reports how far out of order the events came, once the writer stopped
+void PrintMergeStats() {
+    if (outputWriter.Reordered() > 0) {
+        wprintf(L"Merge: %llu events arrived out of order, %llu too late to "
+                L"be put in order\n",
+                (unsigned long long)outputWriter.Reordered(),
+                (unsigned long long)outputWriter.Late());
+    }
 }
 
-// Returns true if all OK or false if error happened during processing
-bool ProcessEventData(const A2dpEventData &eventData) {
-    // Here is absolute guess based on the events I saw
-    // 1. If AcceptorStreamEndPointID is defined but
-    // InitiatorStreamEndPointID and codec data is defined, seems like that
-    // is receiver transmits its list of supported codecs
-    if (eventData.AcceptorStreamEndPointID &&
-        !eventData.InitiatorStreamEndPointID && eventData.a2dpStandardCodecId) {
-        const WCHAR *codecName = GetCodecName(eventData);
-        if (codecName != nullptr) {
-            wprintf(L"> Received supported codec: %s\n", codecName);
-        } else {
-            wprintf(L"ERROR: Unknown codec\n");
-            return false;
+#ifdef _WIN32
+// Prints what the ETW source did, once the writer stopped
+void PrintEtwStats(const EtwTraceSource &source) {
+    const SchemaCache &schemas = source.Schemas();
+    wprintf(L"Event schema cache: %llu hits, %llu misses, %zu schemas\n",
+            (unsigned long long)schemas.Hits(),
+            (unsigned long long)schemas.Misses(), schemas.Size());
+    wprintf(L"Output: %llu events written, %llu waited for the writer, "
+            L"%llu dropped\n",
+            (unsigned long long)outputWriter.Written(),
+            (unsigned long long)outputWriter.Waited(),
+            (unsigned long long)outputWriter.Dropped());
+    PrintFilterStats();
+    PrintMergeStats();
+}
+
+// Runs the real time ETW session until Ctrl+C. If recordPath is set, raw
+// events are also written there.
+int RunLiveSession(const char *recordPath) {
+    // What is already connected, events only tell about what changes
+    std::vector<PnpDeviceCodecs> pnpDevices;
+    if (ReadPnpCodecs(pnpDevices) && !pnpDevices.empty()) {
+        wprintf(L"Connected devices:\n");
+        for (const PnpDeviceCodecs &device : pnpDevices) {
+            PrintPnpDeviceCodecs(device);
         }
     }
 
-    // 2. If AcceptorStreamEndPointID and InitiatorStreamEndPointID are
-    // defined and if AvdtpActivity is defined and equal to 0x12, seems like
-    // that means that codec was selected
-    if (eventData.AcceptorStreamEndPointID &&
-        eventData.InitiatorStreamEndPointID && eventData.AvdtpActivity &&
-        (eventData.AvdtpActivity == AvdtpActivity::SetConfiguration_Cfm ||
-         eventData.AvdtpActivity == AvdtpActivity::SetConfiguration_Ind_2)) {
-        const WCHAR *codecName = GetCodecName(eventData);
-        if (codecName != nullptr) {
-            wprintf(L"# Selected codec: %s\n", codecName);
-        } else {
-            wprintf(L"ERROR: Unknown codec\n");
-            return false;
-        }
+    // When the filter only lets some event ids through, ETW is asked to
+    // drop the others before they are even delivered
+    std::vector<USHORT> eventIds;
+    if (!eventFilter.RequiredEventIds(eventIds)) {
+        eventIds.clear();
+    }
+    EtwTraceSource source;
+    if (!source.OpenSession(L"BT_CODEC", eventIds) ||
+        !OpenCapture(recordPath, source.TimestampFrequency())) {
+        return 1;
     }
 
-    return true;
+    // Set the Ctrl+C handler
+    activeSource = &source;
+    if (!SetConsoleCtrlHandler(CtrlCHandler, TRUE)) {
+        wprintf(L"SetConsoleCtrlHandler failed with %lu\n", GetLastError());
+        activeSource = nullptr;
+        return 1;
+    }
+
+    wprintf(L"Listening for events... Press Ctrl+C to stop.\n");
+    wprintf(L"Now please connect the Bluetooth device to the computer.\n");
+    wprintf(L"Note: this app uses internal Windows messages and analysis is\n"
+            L"      based on guess. So results may be not accurate.\n\n");
+
+    int result = Analyze(source) ? 0 : 1;
+    activeSource = nullptr;
+    outputWriter.Stop();
+    if (outputWriter.OutputFailed()) {
+        wprintf(L"Writing the output failed\n");
+        result = 1;
+    }
+    CloseCapture();
+    PrintEtwStats(source);
+    return result;
 }
 
-// Callback function that processes each event received from the ETW session
-void WINAPI ProcessEvent(PEVENT_RECORD pEvent) {
-    DWORD status = ERROR_SUCCESS;
-    PTRACE_EVENT_INFO pInfo = NULL;
-    DWORD bufferSize = 0;
-
-    // Get the size of the buffer required for the event information
-    status = TdhGetEventInformation(pEvent, 0, NULL, pInfo, &bufferSize);
-    if (ERROR_INSUFFICIENT_BUFFER == status) {
-        // Allocate memory for the event information
-        pInfo = (PTRACE_EVENT_INFO)malloc(bufferSize);
-        if (pInfo == NULL) {
-            wprintf(L"Failed to allocate memory for event info\n");
-            return;
-        }
+// Analyzes the events of an ETL file written by an ETW session. If
+// recordPath is set, they are also converted to a capture file there.
+int ReadEtl(const char *path, const char *recordPath) {
+    const int length = MultiByteToWideChar(CP_ACP, 0, path, -1, NULL, 0);
+    std::wstring widePath(length > 0 ? (size_t)length : 1, L'\0');
+    MultiByteToWideChar(CP_ACP, 0, path, -1, &widePath[0], length);
+
+    EtwTraceSource source;
+    if (length <= 0 || !source.OpenFile(widePath.c_str())) {
+        wprintf(L"Unable to read the ETL file\n");
+        return 1;
+    }
+    if (!OpenCapture(recordPath, source.TimestampFrequency())) {
+        return 1;
+    }
+
+    activeSource = &source;
+    SetConsoleCtrlHandler(CtrlCHandler, TRUE);
+    auto start = std::chrono::steady_clock::now();
+    int result = Analyze(source) ? 0 : 1;
+    auto end = std::chrono::steady_clock::now();
+    activeSource = nullptr;
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    wprintf(L"Read %llu events in %.3f s (%.0f events/s)\n",
+            (unsigned long long)source.Events(), seconds,
+            seconds > 0 ? source.Events() / seconds : 0.0);
+    outputWriter.Stop();
+    CloseCapture();
+    PrintEtwStats(source);
+    return result;
+}
+#endif
+
+// Feeds the events of a capture file through the decoder and the analysis
+// as fast as they can go
+int Replay(const char *path) {
+    CaptureTraceSource source;
+    if (!source.Open(path)) {
+        wprintf(L"Unable to read the capture file\n");
+        return 1;
+    }
+    if (source.Truncated()) {
+        wprintf(L"The capture file is truncated, replaying what is there\n");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Analyze(source);
+    auto end = std::chrono::steady_clock::now();
 
-        // Get the event information
-        status = TdhGetEventInformation(pEvent, 0, NULL, pInfo, &bufferSize);
+    if (source.Corrupt()) {
+        wprintf(L"Some blocks of the capture file are corrupt\n");
     }
+    const ULONGLONG events = source.Events();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    wprintf(L"Replayed %llu events in %.3f s (%.0f events/s)\n",
+            (unsigned long long)events, seconds,
+            seconds > 0 ? events / seconds : 0.0);
+    outputWriter.Stop();
+    PrintFilterStats();
+    PrintMergeStats();
+    return source.Corrupt() ? 1 : 0;
+}
 
-    if (ERROR_SUCCESS != status) {
-        wprintf(L"TdhGetEventInformation failed with %lu\n", status);
-        if (pInfo) {
-            free(pInfo);
+// Generates synthetic events, see load_generator.h. With recordPath they
+// are written to a capture file, otherwise they go through the decoder and
+// the analysis like a replay.
+int Generate(const LoadOptions &options, const char *recordPath) {
+    LoadStats stats;
+    auto start = std::chrono::steady_clock::now();
+    if (recordPath != nullptr) {
+        LoadGenerator generator(options);
+        EVENT_RECORD event;
+        const EventSchema *schema = nullptr;
+        CaptureWriter writer;
+        if (!writer.Open(recordPath, LOAD_TIMESTAMP_FREQUENCY)) {
+            wprintf(L"Unable to create the capture file\n");
+            return 1;
         }
+        bool failed = false;
+        while (!failed && generator.Next(event, schema)) {
+            failed = !writer.Write(event, *schema);
+        }
+        if (!writer.Close() || failed) {
+            wprintf(L"Failed to write to the capture file\n");
+            return 1;
+        }
+        stats = generator.Stats();
+    } else {
+        GeneratorTraceSource source(options);
+        Analyze(source);
+        stats = source.Stats();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    wprintf(L"Generated %llu events of %zu devices in %.3f s (%.0f "
+            L"events/s): %llu connections, %llu dropped suddenly, %llu "
+            L"unknown codecs\n",
+            (unsigned long long)stats.Events, options.Devices, seconds,
+            seconds > 0 ? stats.Events / seconds : 0.0,
+            (unsigned long long)stats.Connections,
+            (unsigned long long)stats.Flaps,
+            (unsigned long long)stats.UnknownCodecs);
+    if (recordPath == nullptr) {
+        outputWriter.Stop();
+        PrintFilterStats();
+        PrintMergeStats();
+    }
+    return 0;
+}
+
+// Analyzes the capture files listed in listPath on jobs threads (0 for one
+// per core) and prints what all of them add up to
+int Batch(const char *listPath, size_t jobs) {
+    std::vector<std::string> paths;
+    if (!ReadBatchList(listPath, paths)) {
+        wprintf(L"Unable to read the list of capture files\n");
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    const BatchStats stats = RunBatch(paths, jobs, eventFilter);
+    auto end = std::chrono::steady_clock::now();
+
+    PrintBatchStats(stats);
+    double seconds = std::chrono::duration<double>(end - start).count();
+    wprintf(L"\nAnalyzed %llu events in %.3f s (%.0f events/s)\n",
+            (unsigned long long)stats.Events, seconds,
+            seconds > 0 ? stats.Events / seconds : 0.0);
+    return stats.UnreadableFiles > 0 || stats.CorruptBlocks > 0 ? 1 : 0;
+}
+
+// Events read back from a --trace log only have their known properties left,
+// so they go straight to the analysis
+void HandleImportedEvent(ULONG eventId, const A2dpEventData &eventData) {
+    metrics.Events.Add();
+    if (!eventFilter.Empty() && !eventFilter.Matches(eventId, eventData)) {
+        filteredOut++;
+        metrics.FilteredOut.Add();
         return;
     }
+    EventMessage *message = outputWriter.Claim(OverflowPolicy::Wait);
+    message->ProviderId = BTHA2DP_PROVIDER;
+    message->Kind = ProviderKind::A2dp;
+    message->Timestamp = 0; // logs have no timestamps, they stay in order
+    message->Processor = 0;
+    message->EventId = (USHORT)eventId;
+    message->Decoded = true;
+    message->Data = eventData;
+    message->DecodedFields = A2DP_ALL_FIELDS;
+    message->Schema = nullptr;
+    outputWriter.Publish(*message);
+}
 
-    if (TRACE_EVENTS) {
-        TraceEventInfo(pEvent, pInfo);
-    }
-
-    // Sizes of the data
-    // Property size: 1
-    // A2dpStandardCodecId: 02
-    // Property size: 4
-    // A2dpVendorId: 00000000
-    // Property size: 2
-    // A2dpVendorCodecId: 0000
-    // Sample Rate: 80bb0000
-    // ChannelCount: 02000000
-    A2dpEventData eventData;
-
-    // Iterate through the properties of the event
-    for (ULONG i = 0; i < pInfo->TopLevelPropertyCount; i++) {
-        PROPERTY_DATA_DESCRIPTOR descriptor;
-        descriptor.PropertyName =
-            (ULONGLONG)((PBYTE)pInfo +
-                        pInfo->EventPropertyInfoArray[i].NameOffset);
-        descriptor.ArrayIndex = 0;
-
-        // Get the size of the property data
-        ULONG propertySize = 0;
-        status =
-            TdhGetPropertySize(pEvent, 0, NULL, 1, &descriptor, &propertySize);
-        if (status != ERROR_SUCCESS) {
-            continue;
-        }
+int Import(const char *path) {
+    outputWriter.Start(TRACE_EVENTS, 0, mergeWindow);
+    auto start = std::chrono::steady_clock::now();
+    TraceImportStats stats;
+    if (!ImportTraceLog(path, HandleImportedEvent, stats)) {
+        wprintf(L"Unable to read the log\n");
+        return 1;
+    }
+    outputWriter.Flush();
+    auto end = std::chrono::steady_clock::now();
 
-        // Allocate memory for the property data
-        PBYTE pPropertyData = (PBYTE)malloc(propertySize);
-        if (pPropertyData == NULL) {
-            continue;
-        }
+    if (stats.BadLines > 0) {
+        wprintf(L"Skipped %llu property lines that could not be parsed\n",
+                (unsigned long long)stats.BadLines);
+    }
+    double seconds = std::chrono::duration<double>(end - start).count();
+    wprintf(L"Imported %llu events from %llu lines in %.3f s (%.1f MB/s)\n",
+            (unsigned long long)stats.Events,
+            (unsigned long long)stats.Lines, seconds,
+            seconds > 0 ? stats.Bytes / seconds / 1e6 : 0.0);
+    PrintFilterStats();
+    return 0;
+}
 
-        // Get the property data
-        status = TdhGetProperty(pEvent, 0, NULL, 1, &descriptor, propertySize,
-                                pPropertyData);
-        if (status == ERROR_SUCCESS) {
-            if (wcscmp((PWSTR)descriptor.PropertyName,
-                       L"A2dpStandardCodecId") == 0) {
-                eventData.a2dpStandardCodecId = *(BYTE *)pPropertyData;
-            } else if (wcscmp((PWSTR)descriptor.PropertyName,
-                              L"A2dpVendorId") == 0) {
-                eventData.a2dpVendorId = *(DWORD *)pPropertyData;
-            } else if (wcscmp((PWSTR)descriptor.PropertyName,
-                              L"A2dpVendorCodecId") == 0) {
-                eventData.a2dpVendorCodecId = *(WORD *)pPropertyData;
-            } else if (wcscmp((PWSTR)descriptor.PropertyName,
-                              L"AvdtpActivity") == 0) {
-                eventData.AvdtpActivity = *(DWORD *)pPropertyData;
-            } else if (wcscmp((PWSTR)descriptor.PropertyName, L"ResultCode") ==
-                       0) {
-                eventData.ResultCode = *(WORD *)pPropertyData;
-            } else if (wcscmp((PWSTR)descriptor.PropertyName, L"Sample Rate") ==
-                       0) {
-                eventData.SampleRate = *(DWORD *)pPropertyData;
-            } else if (wcscmp((PWSTR)descriptor.PropertyName,
-                              L"ChannelCount") == 0) {
-                eventData.ChannelCount = *(DWORD *)pPropertyData;
-            } else if (wcscmp((PWSTR)descriptor.PropertyName,
-                              L"AcceptorStreamEndPointID") == 0) {
-                eventData.AcceptorStreamEndPointID = *(BYTE *)pPropertyData;
-            } else if (wcscmp((PWSTR)descriptor.PropertyName,
-                              L"InitiatorStreamEndPointID") == 0) {
-                eventData.InitiatorStreamEndPointID = *(BYTE *)pPropertyData;
-            }
+// Prints the codecs of every device, read from the system or from saved
+// pnputil output
+int Snapshot(const char *dumpPath) {
+    std::vector<PnpDeviceCodecs> devices;
+    if (dumpPath != nullptr) {
+        if (!ReadPnpDump(dumpPath, devices)) {
+            wprintf(L"Unable to read the pnputil output\n");
+            return 1;
         }
-        free(pPropertyData);
+    } else {
+#ifdef _WIN32
+        if (!ReadPnpCodecs(devices)) {
+            wprintf(L"Unable to list the audio devices\n");
+            return 1;
+        }
+#else
+        wprintf(L"Reading the devices needs Windows, use --snapshot-from\n");
+        return 1;
+#endif
     }
 
-    if (!ProcessEventData(eventData)) {
-        TraceEventInfo(pEvent, pInfo);
+    if (devices.empty()) {
+        wprintf(L"No Bluetooth audio devices found\n");
     }
+    for (const PnpDeviceCodecs &device : devices) {
+        PrintPnpDeviceCodecs(device);
+    }
+    return 0;
+}
 
-    if (pInfo) {
-        free(pInfo);
+// Prints what another instance publishes with --shm
+int PrintStatus(const char *name) {
+    SharedMemoryRegion region;
+    if (!region.Open(name, STATUS_REGION_SIZE)) {
+        wprintf(L"No status published under that name\n");
+        return 1;
     }
+    static StatusSnapshot snapshot;
+    if (!ReadStatusSnapshot(region.Data(), region.Size(), snapshot)) {
+        wprintf(L"The status could not be read\n");
+        return 1;
+    }
+    PrintStatusSnapshot(snapshot);
+    return 0;
 }
 
+void PrintHelp() {
+    wprintf(L"Help:\n");
+    wprintf(L"   -h|--help to print help\n");
+    wprintf(L"   -t|--trace to print all ETW events\n");
+    wprintf(L"   --codecs FILE to load extra codec definitions\n");
+    wprintf(L"   --record FILE to also save raw events to a capture file\n");
+    wprintf(L"   --replay FILE to analyze a capture file instead of live "
+            L"events\n");
+    wprintf(L"   --etl FILE to analyze an ETL file written by an ETW session, "
+            L"with --record\n       it is also converted to a capture "
+            L"file\n");
+    wprintf(L"   --provider GUID[,level[,keywords]] to also trace another "
+            L"provider\n");
+    wprintf(L"   --window MS to hold events that long to put them in order "
+            L"(default 1000)\n");
+    wprintf(L"   --generate N to analyze N synthetic events instead of live "
+            L"events, or to\n       write them to the --record file\n");
+    wprintf(L"   --devices N, --seed N, --flap PERCENT, --unknown PERCENT to "
+            L"shape them:\n       devices simulated (default 16), seed of "
+            L"the events, connections that\n       drop suddenly (default "
+            L"20) and that announce an unknown codec (default 1)\n");
+    wprintf(L"   --import FILE to analyze a log printed by --trace, - reads "
+            L"stdin\n");
+    wprintf(L"   --format text|jsonl|binary to choose how events are written "
+            L"(default text)\n");
+    wprintf(L"   --output FILE to write events there instead of the "
+            L"console, needed for jsonl and binary\n");
+    wprintf(L"   --snapshot to print the codecs of the connected devices and "
+            L"exit\n");
+    wprintf(L"   --snapshot-from FILE to do the same from saved pnputil "
+            L"output\n");
+    wprintf(L"   --filter EXPR to only show the events that match, for "
+            L"example\n");
+    wprintf(L"       \"AvdtpActivity in (0x12,0x14) && BTDeviceAddress == "
+            L"7C96D2F479F4\"\n");
+    wprintf(L"   --coalesce to write repeated codec announcements and "
+            L"selections only as\n       what changed since the last "
+            L"connection of the device\n");
+    wprintf(L"   --flight N to keep the last N events of every device and "
+            L"show them on an\n       unknown codec or an error code "
+            L"(default 32, 0 turns it off)\n");
+    wprintf(L"   --batch LIST to analyze the capture files listed in LIST, one "
+            L"path per line,\n       on all cores and print the codec "
+            L"counts of all of them\n");
+    wprintf(L"   --jobs N to use N threads with --batch\n");
+    wprintf(L"   --metrics PORT to serve OpenMetrics counters at "
+            L"http://127.0.0.1:PORT/metrics\n");
+    wprintf(L"   --shm NAME to publish the devices in shared memory for other "
+            L"processes\n");
+    wprintf(L"   --status NAME to print what another instance publishes with "
+            L"--shm and exit\n");
+}
+
+#ifndef _WIN32
+// kill -USR1 prints the latencies, like Ctrl+Break on Windows
+void LatencySignalHandler(int) { latencyReportRequested = true; }
+
+// kill -USR2 prints what the flight recorder holds
+void FlightSignalHandler(int) { flightDumpRequested = true; }
+#endif
+
 int main(int argc, char *argv[]) {
 
+    const char *recordPath = nullptr;
+    const char *replayPath = nullptr;
+    const char *etlPath = nullptr;
+    const char *importPath = nullptr;
+    const char *snapshotPath = nullptr;
+    const char *outputPath = nullptr;
+    const char *batchPath = nullptr;
+    size_t jobs = 0;
+    size_t flightEvents = FLIGHT_RECORDER_DEFAULT_EVENTS;
+    const char *shmName = nullptr;
+    int metricsPort = -1;
+    const char *statusName = nullptr;
+    OutputFormat outputFormat = OutputFormat::Text;
+    bool snapshot = false;
+    bool coalesce = false;
+    bool generate = false;
+    LoadOptions loadOptions;
+
     // Very simple cmd args parsing
-    if (argc == 2) {
-        const char *param = argv[1];
+    for (int i = 1; i < argc; i++) {
+        const char *param = argv[i];
         if (strcmp(param, "--help") == 0 || strcmp(param, "-h") == 0) {
-            wprintf(L"Help:\n");
-            wprintf(L"   -h|--help to print help\n");
-            wprintf(L"   -t|--trace to print all ETW events\n");
+            PrintHelp();
             return 1;
         } else if (strcmp(param, "--trace") == 0 || strcmp(param, "-t") == 0) {
             wprintf(L"Trace: Print all events for tracing purposes\n");
             TRACE_EVENTS = true;
+        } else if (strcmp(param, "--codecs") == 0 && i + 1 < argc) {
+            // Extra codec definitions, see codecs.txt
+            int badLine = 0;
+            int loaded = codecRegistry.LoadFile(argv[++i], badLine);
+            if (loaded < 0) {
+                if (badLine == 0) {
+                    wprintf(L"Unable to read the codec file\n");
+                } else {
+                    wprintf(L"Codec file: bad definition at line %d\n",
+                            badLine);
+                }
+                return 1;
+            }
+            wprintf(L"Loaded %d codec definitions\n", loaded);
+        } else if (strcmp(param, "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(param, "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (strcmp(param, "--etl") == 0 && i + 1 < argc) {
+            etlPath = argv[++i];
+        } else if (strcmp(param, "--provider") == 0 && i + 1 < argc) {
+            if (!providers.Add(argv[++i])) {
+                wprintf(L"Bad provider, expected GUID[,level[,keywords]]\n");
+                return 1;
+            }
+        } else if (strcmp(param, "--window") == 0 && i + 1 < argc) {
+            mergeWindow = std::chrono::milliseconds(atoi(argv[++i]));
+        } else if (strcmp(param, "--generate") == 0 && i + 1 < argc) {
+            generate = true;
+            loadOptions.Events = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(param, "--devices") == 0 && i + 1 < argc) {
+            const int count = atoi(argv[++i]);
+            loadOptions.Devices = count > 0 ? (size_t)count : 1;
+        } else if (strcmp(param, "--seed") == 0 && i + 1 < argc) {
+            loadOptions.Seed = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(param, "--flap") == 0 && i + 1 < argc) {
+            loadOptions.FlapPercent = (ULONG)atoi(argv[++i]);
+        } else if (strcmp(param, "--unknown") == 0 && i + 1 < argc) {
+            loadOptions.UnknownPercent = (ULONG)atoi(argv[++i]);
+        } else if (strcmp(param, "--import") == 0 && i + 1 < argc) {
+            importPath = argv[++i];
+        } else if (strcmp(param, "--format") == 0 && i + 1 < argc) {
+            if (!ParseOutputFormat(argv[++i], outputFormat)) {
+                wprintf(L"Bad format, expected text, jsonl or binary\n");
+                return 1;
+            }
+        } else if (strcmp(param, "--output") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (strcmp(param, "--filter") == 0 && i + 1 < argc) {
+            std::wstring error;
+            if (!eventFilter.Compile(argv[++i], error)) {
+                wprintf(L"Bad filter: %ls\n", error.c_str());
+                return 1;
+            }
+        } else if (strcmp(param, "--coalesce") == 0) {
+            outputWriter.SetCoalescing(true);
+            coalesce = true;
+        } else if (strcmp(param, "--flight") == 0 && i + 1 < argc) {
+            const int count = atoi(argv[++i]);
+            flightEvents = count > 0 ? (size_t)count : 0;
+        } else if (strcmp(param, "--batch") == 0 && i + 1 < argc) {
+            batchPath = argv[++i];
+        } else if (strcmp(param, "--jobs") == 0 && i + 1 < argc) {
+            const int count = atoi(argv[++i]);
+            jobs = count > 0 ? (size_t)count : 0;
+        } else if (strcmp(param, "--metrics") == 0 && i + 1 < argc) {
+            metricsPort = atoi(argv[++i]);
+            if (metricsPort < 0 || metricsPort > 65535) {
+                wprintf(L"Bad metrics port\n");
+                return 1;
+            }
+        } else if (strcmp(param, "--shm") == 0 && i + 1 < argc) {
+            shmName = argv[++i];
+        } else if (strcmp(param, "--status") == 0 && i + 1 < argc) {
+            statusName = argv[++i];
+        } else if (strcmp(param, "--snapshot") == 0) {
+            snapshot = true;
+        } else if (strcmp(param, "--snapshot-from") == 0 && i + 1 < argc) {
+            snapshot = true;
+            snapshotPath = argv[++i];
+        } else {
+            PrintHelp();
+            return 1;
         }
     }
 
-    // Allocate memory for the session properties
-    const size_t bufferSize = sizeof(EVENT_TRACE_PROPERTIES) +
-                              (wcslen(sessionName) + 1) * sizeof(WCHAR);
-    pSessionProperties = (EVENT_TRACE_PROPERTIES *)malloc(bufferSize);
-    if (pSessionProperties == NULL) {
-        wprintf(L"Unable to allocate memory for properties\n");
-        return 1;
+#ifndef _WIN32
+    signal(SIGUSR1, LatencySignalHandler);
+    signal(SIGUSR2, FlightSignalHandler);
+#endif
+
+    // Traces and the structured formats show every field
+    if (!TRACE_EVENTS && outputFormat == OutputFormat::Text) {
+        decodeFields = DEVICE_TRACKER_FIELDS;
+    }
+    outputWriter.SetFlightRecorder(flightEvents);
+    if (flightEvents > 0) {
+        decodeFields |= FLIGHT_RECORDER_FIELDS;
     }
 
-    // Zero out the memory and set the session properties
-    ZeroMemory(pSessionProperties, bufferSize);
-    pSessionProperties->Wnode.BufferSize = (ULONG)bufferSize;
-    pSessionProperties->Wnode.Flags = WNODE_FLAG_TRACED_GUID;
-    pSessionProperties->Wnode.ClientContext = 1; // Use QPC for timestamp
-    pSessionProperties->Wnode.Guid = ProviderGuid;
-    pSessionProperties->LogFileMode = EVENT_TRACE_REAL_TIME_MODE;
-    pSessionProperties->LoggerNameOffset = sizeof(EVENT_TRACE_PROPERTIES);
-
-    // Start the trace session
-    ULONG status = StartTraceW(&hSession, sessionName, pSessionProperties);
-    // If the session already exists, attach to it
-    if (status == ERROR_ALREADY_EXISTS) {
-        wprintf(L"Attaching to existing session...\n");
-        // Query the existing session to get its handle
-        status = ControlTraceW(0, sessionName, pSessionProperties,
-                               EVENT_TRACE_CONTROL_QUERY);
-        if (status != ERROR_SUCCESS) {
-            wprintf(L"ControlTrace failed with %lu\n", status);
-            Cleanup();
+    if (outputPath != nullptr || outputFormat != OutputFormat::Text) {
+        if (outputPath == nullptr) {
+            wprintf(L"jsonl and binary output need --output FILE\n");
             return 1;
         }
-        hSession = pSessionProperties->Wnode.HistoricalContext;
-    } else if (status != ERROR_SUCCESS) {
-        wprintf(L"StartTrace failed with %lu\n", status);
-        Cleanup();
-        return 1;
+        std::unique_ptr<OutputSink> sink =
+            CreateOutputSink(outputFormat, outputPath);
+        if (sink == nullptr) {
+            wprintf(L"Unable to create the output file\n");
+            return 1;
+        }
+        outputWriter.SetSink(std::move(sink));
     }
 
-    // Enable the provider for the session
-    status = EnableTraceEx2(hSession, &ProviderGuid,
-                            EVENT_CONTROL_CODE_ENABLE_PROVIDER,
-                            TRACE_LEVEL_VERBOSE, 0, 0, 0, NULL);
-    if (status != ERROR_SUCCESS) {
-        wprintf(L"EnableTraceEx2 failed with %lu\n", status);
-        Cleanup();
-        return 1;
+    if (statusName != nullptr) {
+        return PrintStatus(statusName);
     }
-
-    // Set the Ctrl+C handler
-    if (!SetConsoleCtrlHandler(CtrlCHandler, TRUE)) {
-        wprintf(L"SetConsoleCtrlHandler failed with %lu\n", GetLastError());
-        Cleanup();
-        return 1;
+    if (shmName != nullptr) {
+        if (!statusPublisher.Open(shmName)) {
+            wprintf(L"Unable to create the shared memory status\n");
+            return 1;
+        }
+        outputWriter.SetStatusPublisher(&statusPublisher);
     }
 
-    // Set up the log file structure to process events in real time
-    EVENT_TRACE_LOGFILEW logFile = {0};
-    logFile.LoggerName = (LPWSTR)sessionName;
-    logFile.ProcessTraceMode =
-        PROCESS_TRACE_MODE_REAL_TIME | PROCESS_TRACE_MODE_EVENT_RECORD;
-    logFile.EventRecordCallback = ProcessEvent;
+    if (metricsPort >= 0) {
+        if (!metricsServer.Start((unsigned short)metricsPort)) {
+            wprintf(L"Unable to listen on the metrics port\n");
+            return 1;
+        }
+        wprintf(L"Metrics at http://127.0.0.1:%u/metrics\n",
+                (unsigned)metricsServer.Port());
+    }
 
-    // Open the trace to start processing events
-    hTrace = OpenTraceW(&logFile);
-    if (INVALID_PROCESSTRACE_HANDLE == hTrace) {
-        wprintf(L"OpenTrace failed with %lu\n", GetLastError());
-        Cleanup();
-        return 1;
+    int result = 1;
+    if (snapshot) {
+        return Snapshot(snapshotPath);
+    } else if (batchPath != nullptr) {
+        return Batch(batchPath, jobs);
+    } else if (generate) {
+        result = Generate(loadOptions, recordPath);
+    } else if (replayPath != nullptr) {
+        result = Replay(replayPath);
+    } else if (etlPath != nullptr) {
+#ifdef _WIN32
+        result = ReadEtl(etlPath, recordPath);
+#else
+        wprintf(L"Reading ETL files needs Windows, use --replay\n");
+#endif
+    } else if (importPath != nullptr) {
+        result = Import(importPath);
+    } else {
+#ifdef _WIN32
+        result = RunLiveSession(recordPath);
+#else
+        (void)recordPath;
+        wprintf(L"Live capture needs Windows, use --replay or --import\n");
+#endif
     }
 
-    wprintf(L"Listening for events... Press Ctrl+C to stop.\n");
-    wprintf(L"Now please connect the Bluetooth device to the computer.\n");
-    wprintf(L"Note: this app uses internal Windows messages and analysis is\n"
-            L"      based on guess. So results may be not accurate.\n\n");
+    outputWriter.Stop();
+    statusPublisher.Close();
+    metricsServer.Stop();
 
-    // Start processing traces
-    ProcessTrace(&hTrace, 1, 0, 0);
+    const DeviceTracker &devices = outputWriter.Devices();
+    if (devices.Size() > 0) {
+        wprintf(L"\nDevices seen: %zu\n", devices.Size());
+        devices.ForEach(PrintDeviceState);
+    }
+    if (coalesce) {
+        wprintf(L"Coalesced: %llu repeated announcements and selections "
+                L"left out\n",
+                (unsigned long long)outputWriter.Coalesced());
+    }
+    PrintNegotiationStats(outputWriter.Negotiations());
+    PrintStageLatencies();
+    return result;
+}
 
-    // Clean up resources before exiting
-    Cleanup();
 
-    return 0;
-}
@@ -0,0 +1,139 @@
+// MIT License
+//
+// Copyright (c) 2025 The win_bt_codec project authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs tasks on a fixed number of threads, each with its own deque. A
+// worker takes the newest task of its own deque (the data it just touched
+// is still in its cache) and, once it runs dry, steals the oldest task of
+// another worker (usually the biggest piece of work left there). Tasks can
+// queue more tasks, which is how a large piece of work is split only when
+// it turns out to be large.
+//
+// The deques are guarded by a mutex each. Tasks here take milliseconds, so
+// the lock is never what limits the pool, and only the owner and a thief
+// ever meet on it.
+template <typename Task> class WorkStealingPool {
+  public:
+    explicit WorkStealingPool(size_t workers) {
+        for (size_t i = 0; i < (workers != 0 ? workers : 1); i++) {
+            m_deques.push_back(std::make_unique<Deque>());
+        }
+    }
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    size_t Workers() const { return m_deques.size(); }
+
+    // Queues a task on the deque of worker. Call it before Run() or from a
+    // task running on that worker.
+    void Push(size_t worker, const Task &task) {
+        m_pending.fetch_add(1, std::memory_order_relaxed);
+        Deque &deque = *m_deques[worker];
+        std::lock_guard<std::mutex> lock(deque.Lock);
+        deque.Tasks.push_back(task);
+    }
+
+    // Calls run(worker, task) for every task, including the ones queued
+    // while running, and returns once all of them are done. The calling
+    // thread is worker 0.
+    template <typename Fn> void Run(Fn &&run) {
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < m_deques.size(); i++) {
+            threads.emplace_back([this, i, &run] { Work(i, run); });
+        }
+        Work(0, run);
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+
+    // Tasks taken from the deque of another worker
+    unsigned long long Steals() const {
+        unsigned long long steals = 0;
+        for (const auto &deque : m_deques) {
+            steals += deque->Steals;
+        }
+        return steals;
+    }
+
+  private:
+    struct alignas(64) Deque {
+        std::mutex Lock;
+        std::deque<Task> Tasks;
+        unsigned long long Steals = 0; // by the owner of this deque
+    };
+
+    bool PopOwn(size_t worker, Task &task) {
+        Deque &deque = *m_deques[worker];
+        std::lock_guard<std::mutex> lock(deque.Lock);
+        if (deque.Tasks.empty()) {
+            return false;
+        }
+        task = deque.Tasks.back();
+        deque.Tasks.pop_back();
+        return true;
+    }
+
+    bool Steal(size_t worker, Task &task) {
+        // Starting at the next worker spreads the thieves over the victims
+        for (size_t i = 1; i < m_deques.size(); i++) {
+            Deque &victim = *m_deques[(worker + i) % m_deques.size()];
+            std::lock_guard<std::mutex> lock(victim.Lock);
+            if (!victim.Tasks.empty()) {
+                task = victim.Tasks.front();
+                victim.Tasks.pop_front();
+                m_deques[worker]->Steals++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename Fn> void Work(size_t worker, Fn &run) {
+        Task task;
+        for (;;) {
+            if (PopOwn(worker, task) || Steal(worker, task)) {
+                run(worker, task);
+                // After run, the tasks it queued are already counted
+                m_pending.fetch_sub(1, std::memory_order_acq_rel);
+            } else if (m_pending.load(std::memory_order_acquire) == 0) {
+                return;
+            } else {
+                // Another worker is still on a task that may queue more
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Deque>> m_deques;
+    std::atomic<size_t> m_pending{0};
+};